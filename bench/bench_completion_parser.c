@@ -0,0 +1,135 @@
+/**
+ * @file bench_completion_parser.c
+ * @brief Compare the single-pass completion extractor with cJSON
+ *
+ * Builds chat completion responses of increasing size and measures the time
+ * to get from the raw body to an owned copy of the message content, once
+ * through a full cJSON tree and once through completion_extract().
+ */
+
+#include "../src/runtime/completion_parser.h"
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Build a response whose content is roughly content_size bytes of prose
+// with the quotes, newlines and non-ASCII text real completions contain
+static char *build_response(size_t content_size, size_t *length) {
+  const char *sentence = "The \\\"forecast\\\" for Z\\u00fcrich: sunny, "
+                         "25\\u00b0C.\\nWind light from the west. ";
+  size_t sentence_length = strlen(sentence);
+  size_t repeats = content_size / sentence_length + 1;
+
+  size_t capacity = repeats * sentence_length + 1024;
+  char *json = malloc(capacity);
+  if (!json)
+    return NULL;
+
+  size_t n = (size_t)snprintf(
+      json, capacity,
+      "{\"id\":\"chatcmpl-bench\",\"object\":\"chat.completion\","
+      "\"created\":1700000000,\"model\":\"gpt-3.5-turbo\",\"choices\":[{"
+      "\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":\"");
+  for (size_t i = 0; i < repeats; i++) {
+    memcpy(json + n, sentence, sentence_length);
+    n += sentence_length;
+  }
+  n += (size_t)snprintf(json + n, capacity - n,
+                        "\"},\"logprobs\":null,\"finish_reason\":\"stop\"}],"
+                        "\"usage\":{\"prompt_tokens\":42,"
+                        "\"completion_tokens\":%zu,\"total_tokens\":%zu}}",
+                        repeats * 12, repeats * 12 + 42);
+  *length = n;
+  return json;
+}
+
+static char *extract_with_cjson(char *json, size_t length) {
+  cJSON *root = cJSON_ParseWithLength(json, length);
+  cJSON *choices = cJSON_GetObjectItem(root, "choices");
+  cJSON *choice = cJSON_GetArrayItem(choices, 0);
+  cJSON *message = cJSON_GetObjectItem(choice, "message");
+  cJSON *content = cJSON_GetObjectItem(message, "content");
+  char *result = cJSON_IsString(content) ? strdup(content->valuestring) : NULL;
+  cJSON_Delete(root);
+  return result;
+}
+
+static char *extract_in_place(char *json, size_t length) {
+  CompletionFields fields;
+  if (!completion_extract(json, length, &fields) || !fields.content)
+    return NULL;
+  char *result = malloc(fields.content_length + 1);
+  if (result)
+    memcpy(result, fields.content, fields.content_length + 1);
+  return result;
+}
+
+// Time one extraction path. Every iteration restores the pristine body,
+// standing in for the bytes curl writes into the response buffer.
+static double run(char *(*extract)(char *, size_t), const char *json,
+                  size_t length, char *work, int iterations) {
+  double start = now_seconds();
+  for (int i = 0; i < iterations; i++) {
+    memcpy(work, json, length + 1);
+    char *content = extract(work, length);
+    if (!content) {
+      fprintf(stderr, "extraction failed\n");
+      exit(1);
+    }
+    free(content);
+  }
+  return (now_seconds() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+  double budget = argc > 1 ? atof(argv[1]) : 0.5; // Seconds per measurement
+  size_t sizes[] = {256, 4 * 1024, 64 * 1024, 1024 * 1024};
+
+  printf("%10s %14s %14s %9s\n", "content", "cJSON (us)", "extract (us)",
+         "speedup");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t length;
+    char *json = build_response(sizes[i], &length);
+    char *work = malloc(length + 1);
+    if (!json || !work) {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+
+    // Check both paths agree before timing them
+    memcpy(work, json, length + 1);
+    char *expected = extract_with_cjson(work, length);
+    memcpy(work, json, length + 1);
+    char *actual = extract_in_place(work, length);
+    if (!expected || !actual || strcmp(expected, actual) != 0) {
+      fprintf(stderr, "extractors disagree at %zu bytes\n", sizes[i]);
+      return 1;
+    }
+    free(expected);
+    free(actual);
+
+    // Calibrate the iteration count on the slower path
+    int iterations = 1;
+    while (run(extract_with_cjson, json, length, work, iterations) *
+               iterations < budget / 10)
+      iterations *= 2;
+    iterations *= 10;
+
+    double cjson = run(extract_with_cjson, json, length, work, iterations);
+    double scanner = run(extract_in_place, json, length, work, iterations);
+    printf("%10zu %14.2f %14.2f %8.1fx\n", sizes[i], cjson * 1e6,
+           scanner * 1e6, cjson / scanner);
+
+    free(json);
+    free(work);
+  }
+  return 0;
+}
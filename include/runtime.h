@@ -7,6 +7,7 @@
 #define RUNTIME_H
 
 #include "vibelang.h"
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,7 +16,8 @@ extern "C" {
 /**
  * Initialize the Vibe language runtime. This is called automatically the first
  * time a generated function executes, but may be invoked explicitly to check
- * for errors or override configuration.
+ * for errors or override configuration. Initialization is guarded so that
+ * concurrent first calls from several threads initialize the runtime once.
  *
  * @return VIBE_SUCCESS on success, error code on failure
  */
@@ -23,12 +25,242 @@ VibeError vibe_runtime_init(void);
 
 /**
  * Shutdown the Vibe language runtime. It will also be called automatically at
- * program exit.
+ * program exit. No other thread may be executing prompts while it runs.
  */
 void vibe_runtime_shutdown(void);
 
 /**
- * Execute a prompt with a specific meaning context
+ * Generation parameters compiled into a module, either from the function's
+ * entry in the "overrides" section of vibeconfig.json or from the type of the
+ * result. Fields left unset fall back to the configuration the runtime loads.
+ */
+typedef struct VibeGenerationParams {
+  const char *model;           // Model to request, NULL if unset
+  double temperature;          // Sampling temperature, negative if unset
+  int max_tokens;              // Completion length limit, 0 if unset
+  const char *const *stop;     // Stop sequences ending in NULL, NULL if unset
+  const char *instruction;     // System message for the prompt, NULL if unset
+  const char *response_format; // JSON object to send as is, NULL if unset
+} VibeGenerationParams;
+
+/**
+ * How a response is turned into a value, chosen by the compiler from the
+ * return type of the function containing the prompt
+ */
+typedef enum VibeDecoder {
+  VIBE_DECODE_STRING = 0, // The text as is
+  VIBE_DECODE_INT,        // The first integer in the text, as a number
+  VIBE_DECODE_FLOAT,      // The first decimal number in the text
+  VIBE_DECODE_BOOL,       // The first yes/no style answer, as a boolean
+  VIBE_DECODE_CUSTOM,     // The text, for generated code to decode
+  VIBE_DECODE_JSON        // The first JSON object or array, as an object
+} VibeDecoder;
+
+/**
+ * How a field of a class is stored in the C struct the compiler generates
+ */
+typedef enum VibeFieldKind {
+  VIBE_FIELD_INT,    // int
+  VIBE_FIELD_FLOAT,  // double
+  VIBE_FIELD_BOOL,   // int, 0 or 1
+  VIBE_FIELD_STRING, // char *, pointing into the response text
+  VIBE_FIELD_OBJECT  // Another class, stored inline
+} VibeFieldKind;
+
+struct VibeObjectShape;
+
+/**
+ * A field of a class: its JSON name and where the struct keeps it
+ */
+typedef struct VibeField {
+  const char *name;                    // Property name in the response
+  VibeFieldKind kind;                  // Storage of the value
+  size_t offset;                       // offsetof the member
+  const struct VibeObjectShape *shape; // Layout of an object, else NULL
+} VibeField;
+
+/**
+ * Layout of the C struct generated for a class. Every such struct ends with
+ * a char *vibe_response member that owns the text its strings point into.
+ */
+typedef struct VibeObjectShape {
+  const VibeField *fields; // Fields in declaration order
+  int field_count;         // Number of fields
+  size_t size;             // sizeof the struct
+  size_t response_offset;  // offsetof its vibe_response member
+} VibeObjectShape;
+
+/**
+ * Type of a node of an object value
+ */
+typedef enum VibeNodeType {
+  VIBE_NODE_MISSING = 0, // No such node
+  VIBE_NODE_NULL,
+  VIBE_NODE_BOOL,
+  VIBE_NODE_NUMBER,
+  VIBE_NODE_STRING,
+  VIBE_NODE_ARRAY,
+  VIBE_NODE_OBJECT
+} VibeNodeType;
+
+/**
+ * The parsed form of a VIBE_OBJECT value: a flat array of tagged entries in
+ * document order, followed by the response text they point into. It is a
+ * single allocation, released with free().
+ */
+typedef struct VibeTape VibeTape;
+
+/**
+ * A node of an object value. Nodes are plain values that stay valid as long
+ * as the value they came from; a missing node has a NULL tape.
+ */
+typedef struct VibeNode {
+  const VibeTape *tape; // The value's tape, NULL for a missing node
+  size_t index;         // Entry of the node
+  size_t key;           // Entry of its key inside an object, else 0
+} VibeNode;
+
+/**
+ * Describes where a prompt comes from. Generated code emits one static
+ * descriptor per prompt block so the runtime can apply the function's
+ * configuration overrides and decode the response by type.
+ *
+ * Limits are derived by the compiler from the result type: a number or a
+ * boolean needs a handful of tokens, not a paragraph. They yield to params
+ * and to a max_tokens the function's runtime override sets. The route names
+ * an entry of the "routes" section whose model the site uses unless the
+ * function sets its own; without a configured route the global model applies.
+ */
+typedef struct VibePromptSite {
+  const char *function_name; // Function containing the prompt, may be NULL
+  const char *meaning;       // Semantic meaning of the result, may be NULL
+  const VibeGenerationParams *params; // Compiled-in parameters, may be NULL
+  VibeDecoder decoder;                // Type of the result
+  const VibeGenerationParams *limits; // Limits for the type, may be NULL
+  const char *route;                  // Model route, may be NULL
+} VibePromptSite;
+
+/**
+ * A literal run of a precompiled prompt template and the variable that
+ * follows it
+ */
+typedef struct VibePromptSegment {
+  const char *text; // Literal text
+  size_t length;    // Its length in bytes
+  int slot;         // Variable rendered after the text, -1 for none
+} VibePromptSegment;
+
+/**
+ * The value of a prompt variable, borrowed from the caller and not
+ * necessarily NUL-terminated
+ */
+typedef struct VibePromptArg {
+  const char *text; // May be NULL when length is 0
+  size_t length;    // Bytes of text to render
+} VibePromptArg;
+
+/**
+ * A prompt template that the compiler has split into literal segments and
+ * variable slots. A variable used more than once has one slot.
+ */
+typedef struct VibePromptTemplate {
+  const VibePromptSegment *segments;
+  int segment_count;
+  int slot_count;        // Distinct variables
+  size_t literal_length; // Bytes of literal text in all segments
+} VibePromptTemplate;
+
+/**
+ * Counters of the in-process response cache
+ */
+typedef struct VibeCacheStats {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions; // Entries dropped for space or expiry
+  unsigned long long coalesced; // Requests that shared an identical
+                                // in-flight request's response
+  size_t entries;
+  size_t bytes;
+} VibeCacheStats;
+
+/**
+ * Cancels the prompt calls it is attached to. Create one per unit of work
+ * (a request handler, say), attach it with vibe_call_context_enter and
+ * cancel it from any thread. It must outlive the calls it is attached to.
+ */
+typedef struct VibeCancelToken VibeCancelToken;
+
+/**
+ * The deadline and cancellation token that prompt calls made by a thread
+ * observe, including those made inside generated functions
+ */
+typedef struct VibeCallContext {
+  long long deadline_ms;   // Monotonic deadline, 0 for none
+  VibeCancelToken *cancel; // Token aborting the calls, may be NULL
+} VibeCallContext;
+
+/**
+ * Create a cancellation token
+ *
+ * @return The token, or NULL if out of memory
+ */
+VibeCancelToken *vibe_cancel_token_create(void);
+
+/**
+ * Cancel every prompt call attached to the token. Transfers in flight are
+ * aborted and retries stop at once; later calls fail immediately. Safe to
+ * call from any thread, more than once.
+ *
+ * @param token The token to cancel
+ */
+void vibe_cancel_token_cancel(VibeCancelToken *token);
+
+/**
+ * Check whether a token has been cancelled
+ *
+ * @param token The token
+ * @return 1 if cancelled, 0 otherwise
+ */
+int vibe_cancel_token_is_cancelled(VibeCancelToken *token);
+
+/**
+ * Free a token no call is attached to any more
+ *
+ * @param token The token, may be NULL
+ */
+void vibe_cancel_token_free(VibeCancelToken *token);
+
+/**
+ * Bound the prompt calls the calling thread makes from now on. The deadline
+ * only ever narrows: an enclosing context's earlier deadline is kept. When
+ * the deadline passes, outstanding transfers time out and no retry starts.
+ *
+ * @param timeout_ms Time allowed from now, 0 to keep the current deadline
+ * @param cancel Token to attach, NULL to keep the current one
+ * @return The previous context, to pass to vibe_call_context_restore
+ */
+VibeCallContext vibe_call_context_enter(long timeout_ms,
+                                        VibeCancelToken *cancel);
+
+/**
+ * Restore the context that vibe_call_context_enter replaced
+ *
+ * @param previous The context it returned
+ */
+void vibe_call_context_restore(VibeCallContext previous);
+
+/**
+ * Get the calling thread's context, e.g. to hand it to a worker thread
+ *
+ * @return The current context
+ */
+VibeCallContext vibe_call_context_current(void);
+
+/**
+ * Execute a prompt with a specific meaning context. Safe to call from any
+ * number of threads; each thread uses its own LLM session. The result is a
+ * number for the meaning "temperature in Celsius" and text otherwise; use
+ * vibe_execute_site with a decoder for other types.
  *
  * @param prompt The prompt template to execute
  * @param meaning The semantic meaning context
@@ -36,6 +268,186 @@ void vibe_runtime_shutdown(void);
  */
 VibeValue vibe_execute_prompt(const char *prompt, const char *meaning);
 
+/**
+ * Render a precompiled prompt template and execute it on behalf of a prompt
+ * site. Prompts of up to 4 KiB are rendered on the stack. If the prompt
+ * would exceed the token budget of the site's function, the arguments are
+ * shortened, longest first, until it fits.
+ *
+ * @param site The prompt site, may be NULL
+ * @param template The precompiled template
+ * @param args One argument per slot; their lengths may be reduced
+ * @return A VibeValue containing the result
+ */
+VibeValue vibe_execute_template(const VibePromptSite *site,
+                                const VibePromptTemplate *template,
+                                VibePromptArg *args);
+
+/**
+ * Get why the calling thread's last prompt call failed. Calls that fail
+ * return VIBE_NULL whatever the cause, and generated functions return their
+ * value alone, so this tells a prompt over its token budget
+ * (VIBE_ERROR_CONTEXT_LENGTH) from an ended context or a failed request.
+ *
+ * @return The error of the thread's last vibe_execute_* or vibe_fetch_site
+ * call, VIBE_SUCCESS if it got a response
+ */
+VibeError vibe_last_error(void);
+
+/**
+ * Count the tokens of a text with the configured tokenizer vocabulary, or
+ * estimate them at four bytes per token if none is configured
+ *
+ * @param text The text
+ * @return The number of tokens
+ */
+size_t vibe_count_tokens(const char *text);
+
+/**
+ * Execute a prompt on behalf of a prompt site. Identical requests are served
+ * from the response cache unless the site's function opts out, and callers
+ * issuing a request that is already in flight wait for its response instead
+ * of sending their own.
+ *
+ * @param site The prompt site, may be NULL
+ * @param prompt The formatted prompt
+ * @return A VibeValue containing the result
+ */
+VibeValue vibe_execute_site(const VibePromptSite *site, const char *prompt);
+
+/**
+ * Callback receiving each piece of a streamed response as it arrives. The
+ * delta is NUL terminated and only valid for the duration of the call.
+ * Callbacks run on the runtime's I/O thread and must return quickly.
+ */
+typedef void (*VibeTokenCallback)(const char *delta, size_t length,
+                                  void *user_data);
+
+/**
+ * Execute a prompt and stream the response. on_token is invoked for every
+ * content delta; the complete response is returned once the stream ends,
+ * typed as by vibe_execute_prompt.
+ *
+ * @param prompt The prompt template to execute
+ * @param meaning The semantic meaning context
+ * @param on_token Callback receiving content deltas, may be NULL
+ * @param user_data Passed to on_token
+ * @return A VibeValue containing the complete result
+ */
+VibeValue vibe_execute_prompt_stream(const char *prompt, const char *meaning,
+                                     VibeTokenCallback on_token,
+                                     void *user_data);
+
+/**
+ * Stream a prompt on behalf of a prompt site. A cached response is delivered
+ * to on_token as a single delta.
+ *
+ * @param site The prompt site, may be NULL
+ * @param prompt The formatted prompt
+ * @param on_token Callback receiving content deltas, may be NULL
+ * @param user_data Passed to on_token
+ * @return A VibeValue containing the complete result
+ */
+VibeValue vibe_execute_site_stream(const VibePromptSite *site,
+                                   const char *prompt,
+                                   VibeTokenCallback on_token,
+                                   void *user_data);
+
+/**
+ * Streaming counterpart of vibe_execute_template
+ *
+ * @param site The prompt site, may be NULL
+ * @param template The precompiled template
+ * @param args One argument per slot; their lengths may be reduced
+ * @param on_token Callback receiving content deltas, may be NULL
+ * @param user_data Passed through to on_token
+ * @return A VibeValue containing the complete response
+ */
+VibeValue vibe_execute_template_stream(const VibePromptSite *site,
+                                       const VibePromptTemplate *template,
+                                       VibePromptArg *args,
+                                       VibeTokenCallback on_token,
+                                       void *user_data);
+
+/**
+ * Fetch the response to a prompt for a site without decoding it. The
+ * request goes through the response cache, the cassette and the provider
+ * like any call; the compiler uses it to materialize constant prompts.
+ *
+ * @param site The prompt site, may be NULL
+ * @param prompt The formatted prompt
+ * @param used Receives the generation parameters the request was sent with,
+ * may be NULL. Its strings belong to the site or the runtime configuration.
+ * @return The response, which the caller frees, or NULL on failure
+ */
+char *vibe_fetch_site(const VibePromptSite *site, const char *prompt,
+                      VibeGenerationParams *used);
+
+/**
+ * Turn a response materialized at build time into the value a call to the
+ * site would have returned, with no request
+ *
+ * @param site The prompt site, may be NULL
+ * @param response The response, copied
+ * @return The value, decoded as the site's decoder says
+ */
+VibeValue vibe_decode_site(const VibePromptSite *site, const char *response);
+
+/**
+ * Streaming counterpart of vibe_decode_site; the response is delivered to
+ * on_token as a single delta
+ *
+ * @param site The prompt site, may be NULL
+ * @param response The response, copied
+ * @param on_token Callback receiving the response, may be NULL
+ * @param user_data Passed to on_token
+ * @return The value, decoded as the site's decoder says
+ */
+VibeValue vibe_decode_site_stream(const VibePromptSite *site,
+                                  const char *response,
+                                  VibeTokenCallback on_token,
+                                  void *user_data);
+
+/**
+ * One prompt of a batch
+ */
+typedef struct VibePromptRequest {
+  const char *prompt;        // The formatted prompt
+  const char *meaning;       // Semantic meaning of the result, may be NULL
+  const char *function_name; // Function whose overrides apply, may be NULL
+  VibeDecoder decoder;       // Type of the result
+} VibePromptRequest;
+
+/**
+ * Execute a batch of prompts. Up to max_concurrency requests are in flight
+ * at once; a failed item does not stop the others. Every item observes the
+ * calling thread's call context.
+ *
+ * @param requests The prompts to execute
+ * @param count Number of prompts
+ * @param max_concurrency Requests to keep in flight, or 0 for the transport's
+ * per-host connection limit, which also caps it
+ * @param results Receives one value per request; failed items are VIBE_NULL
+ * @param errors Receives one error code per request, may be NULL
+ * @return VIBE_SUCCESS if every item succeeded, VIBE_ERROR_RUNTIME if any
+ * item failed, VIBE_ERROR_GENERAL for invalid arguments
+ */
+VibeError vibe_execute_prompts_batch(const VibePromptRequest *requests,
+                                     size_t count, int max_concurrency,
+                                     VibeValue *results, VibeError *errors);
+
+/**
+ * Read the response cache counters
+ *
+ * @param stats Filled with the current counters
+ */
+void vibe_cache_stats(VibeCacheStats *stats);
+
+/**
+ * Drop every cached response and reset the counters
+ */
+void vibe_cache_clear(void);
+
 /**
  * Load a compiled module
  *
@@ -102,6 +514,118 @@ int vibe_value_get_int(VibeValue *value);
  */
 int vibe_get_bool(VibeValue *value);
 
+/**
+ * Decode a JSON object response into the struct generated for a class. The
+ * response text is unescaped in place and string fields point into it, so
+ * nothing is allocated. The struct takes over the text as its vibe_response
+ * member; free that to release the strings. Properties that are missing or
+ * null stay zero and unknown ones are skipped.
+ *
+ * @param value The value to decode; a string value is consumed
+ * @param shape The layout of the struct
+ * @param out The struct to fill in, zeroed first
+ * @return 1 on success, 0 if the value holds no JSON object
+ */
+int vibe_value_get_object(VibeValue *value, const VibeObjectShape *shape,
+                          void *out);
+
+/**
+ * Parse the first JSON object or array in a string value into an object
+ * value. Text around it, such as a Markdown fence, is ignored. The parse
+ * makes one allocation, which the value's object_val points to.
+ *
+ * @param value The value; a string value is consumed either way
+ * @return 1 if the value is now a VIBE_OBJECT, 0 if it holds no well-formed
+ * JSON object or array and is now VIBE_NULL
+ */
+int vibe_value_to_object(VibeValue *value);
+
+/**
+ * Get the root of an object value
+ *
+ * @param value The value
+ * @return Its root object or array, missing if it is not a VIBE_OBJECT
+ */
+VibeNode vibe_value_root(const VibeValue *value);
+
+/**
+ * Get the type of a node
+ *
+ * @param node The node
+ * @return Its type, VIBE_NODE_MISSING for a missing node
+ */
+VibeNodeType vibe_node_type(VibeNode node);
+
+/**
+ * Count the members of an object or the elements of an array
+ *
+ * @param node The node
+ * @return The count, 0 for any other node
+ */
+size_t vibe_node_count(VibeNode node);
+
+/**
+ * Look up a member of an object by name. The members are scanned in order,
+ * so for repeated lookups in a large object iterate instead.
+ *
+ * @param object The object
+ * @param name The member's name
+ * @return The first member with that name, missing if there is none
+ */
+VibeNode vibe_node_get(VibeNode object, const char *name);
+
+/**
+ * Get the first member of an object or element of an array
+ *
+ * @param node The object or array
+ * @return The first child, missing if it is empty or not a container
+ */
+VibeNode vibe_node_first(VibeNode node);
+
+/**
+ * Get the member or element after a node
+ *
+ * @param node A child returned by vibe_node_first or vibe_node_next
+ * @return The next child, missing after the last one
+ */
+VibeNode vibe_node_next(VibeNode node);
+
+/**
+ * Get the name of an object member
+ *
+ * @param node A member of an object
+ * @return Its name, NULL for nodes that are not object members
+ */
+const char *vibe_node_key(VibeNode node);
+
+/**
+ * Get the text of a string node. Escapes are already decoded and the text
+ * is NUL-terminated; length counts any embedded NUL bytes.
+ *
+ * @param node The node
+ * @param length Receives the length in bytes, may be NULL
+ * @return The text, NULL if the node is not a string
+ */
+const char *vibe_node_string(VibeNode node, size_t *length);
+
+/**
+ * Get the value of a number node. A string holding a number, such as "25",
+ * is read as well.
+ *
+ * @param node The node
+ * @return The number, 0 if the node holds none
+ */
+double vibe_node_number(VibeNode node);
+
+/**
+ * Get the value of a boolean node. A string holding an answer, such as
+ * "yes", is read as well.
+ *
+ * @param node The node
+ * @return 1 or 0, 0 if the node holds no answer
+ */
+int vibe_node_bool(VibeNode node);
+
 #ifdef __cplusplus
 }
 #endif
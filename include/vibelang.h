@@ -23,7 +23,10 @@ typedef enum VibeError {
   VIBE_ERROR_CODEGEN = -4,
   VIBE_ERROR_RUNTIME = -5,
   VIBE_ERROR_IO = -6,
-  VIBE_ERROR_LLM_CONNECTION_FAILED = -7 // Added this error code
+  VIBE_ERROR_LLM_CONNECTION_FAILED = -7, // Added this error code
+  VIBE_ERROR_TIMEOUT = -8,        // The call's deadline passed
+  VIBE_ERROR_CANCELLED = -9,      // The call's cancellation token was cancelled
+  VIBE_ERROR_CONTEXT_LENGTH = -10 // The prompt exceeds its token budget
 } VibeError;
 
 /**
@@ -46,7 +49,7 @@ typedef struct VibeValue {
     char *string_val;
     double number_val;
     int bool_val;
-    void *object_val;
+    void *object_val; // A VibeTape, released with free()
   } data;
 } VibeValue;
 
@@ -71,6 +74,28 @@ void vibelang_shutdown(void);
  */
 int vibelang_compile(const char *source, const char *output_file);
 
+/**
+ * Choose the configuration file whose per-function "overrides" (model,
+ * temperature, max_tokens) are compiled into generated modules. By default
+ * vibeconfig.json in the working directory is used when present.
+ *
+ * @param config_file The configuration file, or NULL to compile none in
+ */
+void vibelang_set_config_file(const char *config_file);
+
+/**
+ * Answer constant prompts while compiling and embed the answers in the
+ * generated module. A prompt is constant when its template has no variables,
+ * or for a call that passes string literals for all of them. Requests go
+ * through the runtime, so a replay cassette answers them offline. The
+ * answers, the parameters they were requested with and the date are recorded
+ * in <name>.materialized.json next to the output file <name>.c.
+ *
+ * @param enabled 1 to materialize constant prompts, 0 to leave them to run
+ * time
+ */
+void vibelang_set_materialize(int enabled);
+
 /**
  * Parse VibeLanguage source code into an AST
  *
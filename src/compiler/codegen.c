@@ -3,13 +3,17 @@
  * @brief Code generation implementation for the Vibe language compiler
  */
 
+#include "../../include/runtime.h"
 #include "../utils/ast.h"
 #include "../utils/file_utils.h"
 #include "../utils/log_utils.h"
+#include "../utils/response_decoder.h"
+#include "../vendor/cjson/cJSON.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // Forward declarations
 static int generate_function(ast_node_t *func, FILE *file);
@@ -21,6 +25,22 @@ static int generate_type_declaration(ast_node_t *type_decl, FILE *file);
 static int generate_prompt_block(ast_node_t *prompt, FILE *file, int indent);
 static int generate_headers(FILE *file);
 static ast_node_t *find_type_decl(ast_node_t *node, const char *name);
+static int generate_class(ast_node_t *root, ast_node_t *class_decl, FILE *file,
+                          ast_node_t **emitted, int *emitted_count, int depth);
+
+// Set while emitting the streaming variant of a function so prompt blocks
+// forward the caller's token callback
+static int generating_stream_variant = 0;
+
+// Configuration read for overrides unless codegen_set_config_file says
+// otherwise; the runtime reads the same file from the working directory
+#define CODEGEN_DEFAULT_CONFIG_FILE "vibeconfig.json"
+
+// Configuration whose "overrides" are compiled into prompt sites, and its
+// parsed contents while a module is being generated
+static char *config_file_path = NULL;
+static int config_file_set = 0;
+static cJSON *config_json = NULL;
 
 // Helper function to add indentation to the output
 static void add_indent(FILE *file, int indent) {
@@ -29,80 +49,39 @@ static void add_indent(FILE *file, int indent) {
   }
 }
 
-// Helper function to parse a template string and extract variable references
-static char **extract_variables(const char *template, int *count) {
-  char **variables = NULL;
-  *count = 0;
-
-  if (!template)
-    return NULL;
-
-  // First count the number of variables
-  const char *ptr = template;
-  while ((ptr = strchr(ptr, '{')) != NULL) {
-    const char *end = strchr(ptr, '}');
-    if (end != NULL) {
-      (*count)++;
-      ptr = end + 1;
-    } else {
-      break;
-    }
-  }
-
-  if (*count == 0) {
+// Recursively search the AST for a type declaration with the given name
+static ast_node_t *find_type_decl(ast_node_t *node, const char *name) {
+  if (!node || !name)
     return NULL;
-  }
 
-  // Allocate memory for the variable names
-  variables = (char **)malloc(sizeof(char *) * (*count));
-  if (!variables) {
-    ERROR("Failed to allocate memory for variables");
-    return NULL;
+  if (node->type == AST_TYPE_DECL) {
+    const char *decl_name = ast_get_string(node, "name");
+    if (decl_name && strcmp(decl_name, name) == 0)
+      return node;
   }
 
-  // Extract the variable names
-  int index = 0;
-  ptr = template;
-  while ((ptr = strchr(ptr, '{')) != NULL) {
-    const char *end = strchr(ptr, '}');
-    if (end != NULL) {
-      size_t len = end - ptr - 1;
-      variables[index] = (char *)malloc(len + 1);
-      if (!variables[index]) {
-        ERROR("Failed to allocate memory for variable name");
-        // Free already allocated variables
-        for (int i = 0; i < index; i++) {
-          free(variables[i]);
-        }
-        free(variables);
-        *count = 0;
-        return NULL;
-      }
-      strncpy(variables[index], ptr + 1, len);
-      variables[index][len] = '\0';
-      index++;
-      ptr = end + 1;
-    } else {
-      break;
-    }
+  for (int i = 0; i < node->child_count; i++) {
+    ast_node_t *found = find_type_decl(node->children[i], name);
+    if (found)
+      return found;
   }
 
-  return variables;
+  return NULL;
 }
 
-// Recursively search the AST for a type declaration with the given name
-static ast_node_t *find_type_decl(ast_node_t *node, const char *name) {
+// Recursively search the AST for a class declaration with the given name
+static ast_node_t *find_class_decl(ast_node_t *node, const char *name) {
   if (!node || !name)
     return NULL;
 
-  if (node->type == AST_TYPE_DECL) {
+  if (node->type == AST_CLASS_DECL) {
     const char *decl_name = ast_get_string(node, "name");
     if (decl_name && strcmp(decl_name, name) == 0)
       return node;
   }
 
   for (int i = 0; i < node->child_count; i++) {
-    ast_node_t *found = find_type_decl(node->children[i], name);
+    ast_node_t *found = find_class_decl(node->children[i], name);
     if (found)
       return found;
   }
@@ -110,38 +89,153 @@ static ast_node_t *find_type_decl(ast_node_t *node, const char *name) {
   return NULL;
 }
 
-/**
- * Generate code from the AST and write it to an output file
- *
- * @param ast The root AST node
- * @param output_file The path to the output file
- * @return 1 on success, 0 on error
- */
-int generate_code(ast_node_t *ast, const char *output_file) {
-  FILE *file = NULL;
+// Decoder of a basic type, NULL if the name is not one
+static const char *basic_type_decoder(const char *type_name) {
+  if (strcmp(type_name, "Int") == 0)
+    return "VIBE_DECODE_INT";
+  if (strcmp(type_name, "Float") == 0)
+    return "VIBE_DECODE_FLOAT";
+  if (strcmp(type_name, "Bool") == 0)
+    return "VIBE_DECODE_BOOL";
+  if (strcmp(type_name, "String") == 0)
+    return "VIBE_DECODE_STRING";
+  return NULL;
+}
 
-  // Check parameters
-  if (!ast || !output_file) {
-    ERROR("Invalid parameters for code generation");
-    return 0;
+// Decoder of a meaning type: that of its base type, text by default
+static const char *meaning_type_decoder(ast_node_t *meaning_type) {
+  const char *decoder = NULL;
+  if (meaning_type->child_count > 0 &&
+      meaning_type->children[0]->type == AST_BASIC_TYPE)
+    decoder = basic_type_decoder(
+        ast_get_string(meaning_type->children[0], "type"));
+  return decoder ? decoder : "VIBE_DECODE_STRING";
+}
+
+// Resolve the response decoder and meaning of a prompt-backed function,
+// looking through type aliases to the underlying base type. Types that are
+// neither basic nor aliases of one decode as custom.
+static void resolve_prompt_return(ast_node_t *parent, const char **decoder,
+                                  const char **meaning_value) {
+  // Look for the return type in the function declaration
+  for (int i = 0; i < parent->child_count; i++) {
+    ast_node_t *child = parent->children[i];
+    if (child->type == AST_BASIC_TYPE) {
+      const char *type_name = ast_get_string(child, "type");
+      const char *basic = basic_type_decoder(type_name);
+      if (basic) {
+        *decoder = basic;
+        break;
+      }
+
+      // Check for alias types, with or without a meaning
+      ast_node_t *root = parent;
+      while (root->parent)
+        root = root->parent;
+      ast_node_t *decl = find_type_decl(root, type_name);
+      ast_node_t *aliased = decl && decl->child_count > 0 ? decl->children[0]
+                                                         : NULL;
+      if (aliased && aliased->type == AST_MEANING_TYPE) {
+        *meaning_value = ast_get_string(aliased, "meaning");
+        *decoder = meaning_type_decoder(aliased);
+      } else if (aliased && aliased->type == AST_BASIC_TYPE &&
+                 basic_type_decoder(ast_get_string(aliased, "type"))) {
+        *decoder = basic_type_decoder(ast_get_string(aliased, "type"));
+      } else {
+        *decoder = "VIBE_DECODE_CUSTOM";
+      }
+      break;
+    } else if (child->type == AST_MEANING_TYPE) {
+      // For Meaning types, use the base type
+      *meaning_value = ast_get_string(child, "meaning");
+      *decoder = meaning_type_decoder(child);
+      break;
+    }
   }
+}
 
-  INFO("Generating code to %s", output_file);
+// The class a prompt-backed function returns, NULL if it returns another
+// type
+static ast_node_t *prompt_return_class(ast_node_t *func) {
+  for (int i = 0; i < func->child_count; i++) {
+    ast_node_t *child = func->children[i];
+    if (child->type != AST_BASIC_TYPE)
+      continue;
+    ast_node_t *root = func;
+    while (root->parent)
+      root = root->parent;
+    return find_class_decl(root, ast_get_string(child, "type"));
+  }
+  return NULL;
+}
 
-  // Open the output file
-  file = fopen(output_file, "w");
-  if (!file) {
-    ERROR("Failed to open output file: %s", output_file);
+// Check whether a node contains a prompt block
+static int contains_prompt_block(ast_node_t *node) {
+  if (!node)
     return 0;
+  if (node->type == AST_PROMPT_BLOCK)
+    return 1;
+  for (int i = 0; i < node->child_count; i++) {
+    if (contains_prompt_block(node->children[i]))
+      return 1;
   }
+  return 0;
+}
 
+// Read the configuration file for its function overrides. A missing or
+// malformed file just means no parameters are compiled in.
+static cJSON *load_codegen_config(void) {
+  const char *path =
+      config_file_set ? config_file_path : CODEGEN_DEFAULT_CONFIG_FILE;
+  if (!path)
+    return NULL;
+  if (!file_exists(path)) {
+    if (config_file_set)
+      WARN("Configuration file not found: %s", path);
+    return NULL;
+  }
+
+  char *content = read_file(path);
+  if (!content) {
+    WARN("Failed to read configuration file: %s", path);
+    return NULL;
+  }
+  cJSON *json = cJSON_Parse(content);
+  free(content);
+  if (!json)
+    WARN("Ignoring malformed configuration file: %s", path);
+  else
+    DEBUG("Compiling function overrides from %s", path);
+  return json;
+}
+
+// Emit the declarations of a module after its headers
+static int generate_module(ast_node_t *ast, FILE *file) {
   // Generate standard headers and includes
   if (!generate_headers(file)) {
     ERROR("Failed to generate headers");
-    fclose(file);
     return 0;
   }
 
+  // Classes come first, each after the classes it holds, so that functions
+  // can return them and other classes can hold them by value
+  ast_node_t **emitted = malloc(sizeof(ast_node_t *) * (ast->child_count + 1));
+  if (!emitted) {
+    ERROR("Memory allocation failed for class list");
+    return 0;
+  }
+  int emitted_count = 0;
+  for (int i = 0; i < ast->child_count; i++) {
+    if (ast->children[i]->type == AST_CLASS_DECL &&
+        !generate_class(ast, ast->children[i], file, emitted, &emitted_count,
+                        0)) {
+      ERROR("Failed to generate class");
+      free(emitted);
+      return 0;
+    }
+  }
+  free(emitted);
+
   // Process each declaration in the AST
   for (int i = 0; i < ast->child_count; i++) {
     ast_node_t *decl = ast->children[i];
@@ -150,7 +244,6 @@ int generate_code(ast_node_t *ast, const char *output_file) {
     case AST_FUNCTION_DECL:
       if (!generate_function(decl, file)) {
         ERROR("Failed to generate function");
-        fclose(file);
         return 0;
       }
       break;
@@ -158,11 +251,13 @@ int generate_code(ast_node_t *ast, const char *output_file) {
     case AST_TYPE_DECL:
       if (!generate_type_declaration(decl, file)) {
         ERROR("Failed to generate type declaration");
-        fclose(file);
         return 0;
       }
       break;
 
+    case AST_CLASS_DECL:
+      break; // Already generated
+
       // Add other declaration types as needed
 
     default:
@@ -171,13 +266,1082 @@ int generate_code(ast_node_t *ast, const char *output_file) {
     }
   }
 
+  return 1;
+}
+
+// Write bytes as a C string literal
+static void write_c_bytes(FILE *file, const char *str, size_t length) {
+  fputc('"', file);
+  const unsigned char *p = (const unsigned char *)str;
+  for (size_t i = 0; i < length; i++) {
+    if (p[i] == '"' || p[i] == '\\')
+      fprintf(file, "\\%c", p[i]);
+    else if (p[i] < 0x20 || p[i] == 0x7f)
+      fprintf(file, "\\%03o", p[i]);
+    else
+      fputc(p[i], file);
+  }
+  fputc('"', file);
+}
+
+// Write a string as a C string literal
+static void write_c_string(FILE *file, const char *str) {
+  write_c_bytes(file, str, strlen(str));
+}
+
+// Storage of a class member in the generated struct and the response schema
+typedef struct {
+  const char *kind;        // VibeFieldKind constant
+  const char *c_type;      // Member type in the struct
+  const char *schema_type; // JSON schema type
+  const char *meaning;     // Description for the schema, may be NULL
+  ast_node_t *class_decl;  // Class held by value, NULL for scalars
+} MemberType;
+
+// Fill in the storage of a basic type. Returns 0 if the name is not one.
+static int basic_member_type(const char *type_name, MemberType *member) {
+  if (!type_name)
+    return 0;
+  if (strcmp(type_name, "Int") == 0) {
+    member->kind = "VIBE_FIELD_INT";
+    member->c_type = "int";
+    member->schema_type = "integer";
+  } else if (strcmp(type_name, "Float") == 0) {
+    member->kind = "VIBE_FIELD_FLOAT";
+    member->c_type = "double";
+    member->schema_type = "number";
+  } else if (strcmp(type_name, "Bool") == 0) {
+    member->kind = "VIBE_FIELD_BOOL";
+    member->c_type = "int";
+    member->schema_type = "boolean";
+  } else if (strcmp(type_name, "String") == 0) {
+    member->kind = "VIBE_FIELD_STRING";
+    member->c_type = "char*";
+    member->schema_type = "string";
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+// Resolve the type of a class member through meanings and aliases to a
+// basic type or another class. Returns 0 for a type that cannot be stored.
+static int resolve_member_type(ast_node_t *root, ast_node_t *type,
+                               MemberType *member) {
+  memset(member, 0, sizeof(*member));
+  if (type->type == AST_MEANING_TYPE) {
+    member->meaning = ast_get_string(type, "meaning");
+    type = type->child_count > 0 ? type->children[0] : NULL;
+  }
+  if (!type || type->type != AST_BASIC_TYPE)
+    return 0;
+
+  const char *type_name = ast_get_string(type, "type");
+  if (basic_member_type(type_name, member))
+    return 1;
+
+  ast_node_t *decl = find_type_decl(root, type_name);
+  if (decl) {
+    ast_node_t *aliased = decl->child_count > 0 ? decl->children[0] : NULL;
+    if (aliased && aliased->type == AST_MEANING_TYPE) {
+      if (!member->meaning)
+        member->meaning = ast_get_string(aliased, "meaning");
+      aliased = aliased->child_count > 0 ? aliased->children[0] : NULL;
+    }
+    return aliased && aliased->type == AST_BASIC_TYPE &&
+           basic_member_type(ast_get_string(aliased, "type"), member);
+  }
+
+  member->class_decl = find_class_decl(root, type_name);
+  if (!member->class_decl)
+    return 0;
+  member->kind = "VIBE_FIELD_OBJECT";
+  member->c_type = type_name;
+  member->schema_type = "object";
+  return 1;
+}
+
+// The member variables of a class, in declaration order
+static ast_node_t *class_body(ast_node_t *class_decl) {
+  for (int i = 0; i < class_decl->child_count; i++) {
+    if (class_decl->children[i]->type == AST_CLASS_BODY)
+      return class_decl->children[i];
+  }
+  return NULL;
+}
+
+// Build the strict JSON schema of a class: every property required and no
+// others allowed, as structured output modes expect
+static cJSON *class_schema(ast_node_t *root, ast_node_t *class_decl) {
+  cJSON *schema = cJSON_CreateObject();
+  if (!schema)
+    return NULL;
+  cJSON_AddStringToObject(schema, "type", "object");
+  cJSON *properties = cJSON_AddObjectToObject(schema, "properties");
+  cJSON *required = cJSON_AddArrayToObject(schema, "required");
+  cJSON_AddFalseToObject(schema, "additionalProperties");
+  if (!properties || !required) {
+    cJSON_Delete(schema);
+    return NULL;
+  }
+
+  ast_node_t *body = class_body(class_decl);
+  for (int i = 0; body && i < body->child_count; i++) {
+    ast_node_t *var = body->children[i];
+    MemberType member;
+    if (var->type != AST_MEMBER_VAR || var->child_count == 0 ||
+        !resolve_member_type(root, var->children[0], &member))
+      continue;
+
+    const char *name = ast_get_string(var, "name");
+    cJSON *property = member.class_decl
+                          ? class_schema(root, member.class_decl)
+                          : cJSON_CreateObject();
+    if (!property) {
+      cJSON_Delete(schema);
+      return NULL;
+    }
+    if (!member.class_decl)
+      cJSON_AddStringToObject(property, "type", member.schema_type);
+    if (member.meaning)
+      cJSON_AddStringToObject(property, "description", member.meaning);
+    cJSON_AddItemToObject(properties, name, property);
+    cJSON_AddItemToArray(required, cJSON_CreateString(name));
+  }
+  return schema;
+}
+
+// Emit a class as a struct and the field table the runtime decodes it with,
+// after the classes it holds. emitted lists the classes already written and
+// depth catches classes that contain themselves.
+static int generate_class(ast_node_t *root, ast_node_t *class_decl, FILE *file,
+                          ast_node_t **emitted, int *emitted_count,
+                          int depth) {
+  for (int i = 0; i < *emitted_count; i++) {
+    if (emitted[i] == class_decl)
+      return 1;
+  }
+
+  const char *class_name = ast_get_string(class_decl, "name");
+  if (depth > root->child_count) {
+    ERROR("Class %s contains itself", class_name);
+    return 0;
+  }
+
+  ast_node_t *body = class_body(class_decl);
+  int field_count = 0;
+  for (int i = 0; body && i < body->child_count; i++) {
+    ast_node_t *var = body->children[i];
+    if (var->type != AST_MEMBER_VAR) {
+      WARN("Ignoring method in class %s", class_name);
+      continue;
+    }
+    MemberType member;
+    if (var->child_count == 0 ||
+        !resolve_member_type(root, var->children[0], &member)) {
+      ERROR("Unsupported type for member %s of class %s",
+            ast_get_string(var, "name"), class_name);
+      return 0;
+    }
+    if (member.class_decl &&
+        !generate_class(root, member.class_decl, file, emitted, emitted_count,
+                        depth + 1))
+      return 0;
+    field_count++;
+  }
+
+  fprintf(file, "/* Class %s */\n", class_name);
+  fprintf(file, "typedef struct %s {\n", class_name);
+  for (int i = 0; body && i < body->child_count; i++) {
+    ast_node_t *var = body->children[i];
+    MemberType member;
+    if (var->type != AST_MEMBER_VAR)
+      continue;
+    resolve_member_type(root, var->children[0], &member);
+    add_indent(file, 1);
+    fprintf(file, "%s %s;\n", member.c_type, ast_get_string(var, "name"));
+  }
+  add_indent(file, 1);
+  fprintf(file, "char *vibe_response; // Owns the text the strings point into\n");
+  fprintf(file, "} %s;\n\n", class_name);
+
+  if (field_count > 0) {
+    fprintf(file, "static const VibeField %s_fields[] = {\n", class_name);
+    for (int i = 0; body && i < body->child_count; i++) {
+      ast_node_t *var = body->children[i];
+      MemberType member;
+      if (var->type != AST_MEMBER_VAR)
+        continue;
+      resolve_member_type(root, var->children[0], &member);
+      const char *name = ast_get_string(var, "name");
+      add_indent(file, 1);
+      fprintf(file, "{\"%s\", %s, offsetof(%s, %s), ", name, member.kind,
+              class_name, name);
+      if (member.class_decl)
+        fprintf(file, "&%s_shape},\n", member.c_type);
+      else
+        fprintf(file, "NULL},\n");
+    }
+    fprintf(file, "};\n");
+  }
+  fprintf(file, "static const VibeObjectShape %s_shape = {", class_name);
+  if (field_count > 0)
+    fprintf(file, "%s_fields, ", class_name);
+  else
+    fprintf(file, "NULL, ");
+  fprintf(file, "%d, sizeof(%s), offsetof(%s, vibe_response)};\n\n",
+          field_count, class_name, class_name);
+
+  emitted[(*emitted_count)++] = class_decl;
+  return 1;
+}
+
+// Generation parameters of a prompt site. They are built once so that the
+// emitted descriptor and a request made at build time agree.
+typedef struct {
+  VibeGenerationParams params;
+  const char **stop; // The list params.stop points to, owned
+  char *text;        // Owned instruction or response format, may be NULL
+} SiteParams;
+
+static void site_params_free(SiteParams *site_params) {
+  free(site_params->stop);
+  free(site_params->text);
+  memset(site_params, 0, sizeof(*site_params));
+}
+
+// Build the NULL-terminated list of stop sequences in a string or an array
+// of strings. Returns 0 if the value holds none, -1 if out of memory.
+static int build_stop_list(cJSON *stop, SiteParams *site_params) {
+  int count = 0;
+  if (cJSON_IsString(stop) && stop->valuestring && *stop->valuestring) {
+    count = 1;
+  } else if (cJSON_IsArray(stop)) {
+    cJSON *item;
+    cJSON_ArrayForEach(item, stop) {
+      if (cJSON_IsString(item) && item->valuestring && *item->valuestring)
+        count++;
+    }
+  }
+  if (count == 0)
+    return 0;
+
+  const char **list = malloc((count + 1) * sizeof(char *));
+  if (!list) {
+    ERROR("Failed to allocate memory for stop sequences");
+    return -1;
+  }
+  count = 0;
+  if (cJSON_IsString(stop)) {
+    list[count++] = stop->valuestring;
+  } else {
+    cJSON *item;
+    cJSON_ArrayForEach(item, stop) {
+      if (cJSON_IsString(item) && item->valuestring && *item->valuestring)
+        list[count++] = item->valuestring;
+    }
+  }
+  list[count] = NULL;
+  site_params->stop = list;
+  site_params->params.stop = list;
+  return 1;
+}
+
+// Build the generation parameters a function's override sets. Strings point
+// into the configuration. Returns 0 if it sets none, -1 if out of memory.
+static int build_prompt_params(const char *function_name,
+                               SiteParams *site_params) {
+  memset(site_params, 0, sizeof(*site_params));
+  site_params->params.temperature = -1;
+  cJSON *overrides = cJSON_GetObjectItem(config_json, "overrides");
+  cJSON *override = function_name && cJSON_IsObject(overrides)
+                        ? cJSON_GetObjectItem(overrides, function_name)
+                        : NULL;
+  if (!cJSON_IsObject(override))
+    return 0;
+
+  cJSON *model = cJSON_GetObjectItem(override, "model");
+  cJSON *temperature = cJSON_GetObjectItem(override, "temperature");
+  cJSON *max_tokens = cJSON_GetObjectItem(override, "max_tokens");
+  cJSON *instruction = cJSON_GetObjectItem(override, "instruction");
+  int has_model = cJSON_IsString(model) && model->valuestring;
+  int has_temperature =
+      cJSON_IsNumber(temperature) && temperature->valuedouble >= 0;
+  int has_max_tokens = cJSON_IsNumber(max_tokens) && max_tokens->valueint > 0;
+  int has_instruction = cJSON_IsString(instruction) &&
+                        instruction->valuestring && *instruction->valuestring;
+  int has_stop =
+      build_stop_list(cJSON_GetObjectItem(override, "stop"), site_params);
+  if (has_stop < 0)
+    return -1;
+  if (!has_model && !has_temperature && !has_max_tokens && !has_stop &&
+      !has_instruction)
+    return 0;
+
+  VibeGenerationParams *params = &site_params->params;
+  if (has_model)
+    params->model = model->valuestring;
+  if (has_temperature)
+    params->temperature = temperature->valuedouble;
+  if (has_max_tokens)
+    params->max_tokens = max_tokens->valueint;
+  if (has_instruction)
+    params->instruction = instruction->valuestring;
+  return 1;
+}
+
+// Completion limits for a scalar result: a signed 19-digit number with
+// grouping is about a dozen tokens, a boolean is one or two
+#define NUMBER_MAX_TOKENS 16
+#define BOOL_MAX_TOKENS 4
+
+// Build the response format of a class result: its strict JSON schema, so
+// that the model can only answer with an object the decoder understands.
+// Returns 1, or -1 if the schema cannot be built.
+static int build_prompt_format(ast_node_t *result_class,
+                               SiteParams *site_params) {
+  memset(site_params, 0, sizeof(*site_params));
+  site_params->params.temperature = -1;
+  ast_node_t *root = result_class;
+  while (root->parent)
+    root = root->parent;
+
+  cJSON *format = cJSON_CreateObject();
+  cJSON_AddStringToObject(format, "type", "json_schema");
+  cJSON *json_schema = cJSON_AddObjectToObject(format, "json_schema");
+  cJSON *schema = class_schema(root, result_class);
+  if (!format || !json_schema || !schema) {
+    ERROR("Failed to build the response schema");
+    cJSON_Delete(format);
+    cJSON_Delete(schema);
+    return -1;
+  }
+  cJSON_AddStringToObject(json_schema, "name",
+                          ast_get_string(result_class, "name"));
+  cJSON_AddTrueToObject(json_schema, "strict");
+  cJSON_AddItemToObject(json_schema, "schema", schema);
+
+  site_params->text = cJSON_PrintUnformatted(format);
+  cJSON_Delete(format);
+  if (!site_params->text) {
+    ERROR("Failed to print the response schema");
+    return -1;
+  }
+  site_params->params.response_format = site_params->text;
+  return 1;
+}
+
+// Build the limits that follow from a prompt's result type. Text and custom
+// types are left unbounded. Returns 0 if there are none, -1 if out of
+// memory.
+static int build_prompt_limits(const char *decoder, const char *meaning,
+                               SiteParams *site_params) {
+  memset(site_params, 0, sizeof(*site_params));
+  site_params->params.temperature = -1;
+  const char *form;
+  int max_tokens;
+  if (strcmp(decoder, "VIBE_DECODE_INT") == 0) {
+    form = "an integer";
+    max_tokens = NUMBER_MAX_TOKENS;
+  } else if (strcmp(decoder, "VIBE_DECODE_FLOAT") == 0) {
+    form = "a number";
+    max_tokens = NUMBER_MAX_TOKENS;
+  } else if (strcmp(decoder, "VIBE_DECODE_BOOL") == 0) {
+    form = "true or false";
+    max_tokens = BOOL_MAX_TOKENS;
+  } else {
+    return 0;
+  }
+
+  // The instruction is sized for the whole meaning, however long
+  int named = meaning && *meaning;
+  int length =
+      named ? snprintf(NULL, 0, "Reply with only the %s, as %s.", meaning, form)
+            : snprintf(NULL, 0, "Reply with only %s.", form);
+  if (length < 0) {
+    ERROR("Failed to format prompt limits");
+    return -1;
+  }
+
+  // The answer is on the first line, so a newline ends the generation
+  site_params->text = malloc((size_t)length + 1);
+  site_params->stop = malloc(2 * sizeof(char *));
+  if (!site_params->text || !site_params->stop) {
+    ERROR("Failed to allocate memory for prompt limits");
+    site_params_free(site_params);
+    return -1;
+  }
+  if (named)
+    snprintf(site_params->text, (size_t)length + 1,
+             "Reply with only the %s, as %s.", meaning, form);
+  else
+    snprintf(site_params->text, (size_t)length + 1, "Reply with only %s.",
+             form);
+  site_params->stop[0] = "\n";
+  site_params->stop[1] = NULL;
+  site_params->params.max_tokens = max_tokens;
+  site_params->params.stop = site_params->stop;
+  site_params->params.instruction = site_params->text;
+  return 1;
+}
+
+// Emit generation parameters as a static descriptor, after the list of stop
+// sequences it points to, which is named <name>_stop
+static void generate_generation_params(const char *name,
+                                       const SiteParams *site_params,
+                                       FILE *file, int indent) {
+  const VibeGenerationParams *params = &site_params->params;
+  if (params->stop) {
+    add_indent(file, indent);
+    fprintf(file, "static const char *const %s_stop[] = {", name);
+    for (const char *const *stop = params->stop; *stop; stop++) {
+      write_c_string(file, *stop);
+      fprintf(file, ", ");
+    }
+    fprintf(file, "NULL};\n");
+  }
+
+  // Designated, so fields left unset read as zero or NULL
+  add_indent(file, indent);
+  fprintf(file, "static const VibeGenerationParams %s = {", name);
+  if (params->model) {
+    fprintf(file, ".model = ");
+    write_c_string(file, params->model);
+    fprintf(file, ", ");
+  }
+  fprintf(file, ".temperature = %.15g, .max_tokens = %d", params->temperature,
+          params->max_tokens);
+  if (params->stop)
+    fprintf(file, ", .stop = %s_stop", name);
+  if (params->instruction) {
+    fprintf(file, ", .instruction = ");
+    write_c_string(file, params->instruction);
+  }
+  if (params->response_format) {
+    fprintf(file, ", .response_format = ");
+    write_c_string(file, params->response_format);
+  }
+  fprintf(file, "};\n");
+}
+
+// Check whether a route's list of strings holds a value. "number" in the
+// types list stands for both int and float.
+static int route_lists(cJSON *route, const char *list, const char *value) {
+  cJSON *item;
+  cJSON_ArrayForEach(item, cJSON_GetObjectItem(route, list)) {
+    if (!cJSON_IsString(item) || !item->valuestring)
+      continue;
+    if (strcmp(item->valuestring, value) == 0)
+      return 1;
+    if (strcmp(item->valuestring, "number") == 0 &&
+        (strcmp(value, "int") == 0 || strcmp(value, "float") == 0))
+      return 1;
+  }
+  return 0;
+}
+
+// Choose the model route of a prompt site from the "routes" section: the
+// first route listing the site's meaning, otherwise the first listing its
+// type class. Returns NULL if none matches.
+static const char *resolve_prompt_route(const char *decoder,
+                                        const char *meaning) {
+  cJSON *routes = cJSON_GetObjectItem(config_json, "routes");
+  if (!cJSON_IsObject(routes))
+    return NULL;
+
+  cJSON *route;
+  if (meaning) {
+    cJSON_ArrayForEach(route, routes) {
+      if (route_lists(route, "meanings", meaning))
+        return route->string;
+    }
+  }
+
+  // VIBE_DECODE_INT has class "int" and so on
+  char type_class[16];
+  const char *name = decoder + strlen("VIBE_DECODE_");
+  size_t length = 0;
+  for (; name[length] && length < sizeof(type_class) - 1; length++)
+    type_class[length] = (char)tolower((unsigned char)name[length]);
+  type_class[length] = '\0';
+  cJSON_ArrayForEach(route, routes) {
+    if (route_lists(route, "types", type_class))
+      return route->string;
+  }
+  return NULL;
+}
+
+// Decode the escapes of a template, which generated code used to leave to
+// the C compiler. Unknown escapes are kept as written.
+static char *decode_template(const char *template, size_t *length) {
+  char *text = malloc(strlen(template) + 1);
+  if (!text)
+    return NULL;
+
+  size_t n = 0;
+  for (const char *p = template; *p; p++) {
+    if (*p != '\\' || !p[1]) {
+      text[n++] = *p;
+      continue;
+    }
+    switch (*++p) {
+    case 'n':
+      text[n++] = '\n';
+      break;
+    case 't':
+      text[n++] = '\t';
+      break;
+    case 'r':
+      text[n++] = '\r';
+      break;
+    case '\\':
+    case '"':
+    case '\'':
+      text[n++] = *p;
+      break;
+    default:
+      text[n++] = '\\';
+      text[n++] = *p;
+      break;
+    }
+  }
+  text[n] = '\0';
+  *length = n;
+  return text;
+}
+
+// Slot of a template variable, appending it to the list if it is new.
+// Returns -1 if out of memory.
+static int template_slot(char ***variables, int *count, const char *name,
+                         size_t length) {
+  for (int i = 0; i < *count; i++) {
+    if (strncmp((*variables)[i], name, length) == 0 &&
+        !(*variables)[i][length])
+      return i;
+  }
+
+  char **grown = realloc(*variables, (*count + 1) * sizeof(char *));
+  if (!grown)
+    return -1;
+  *variables = grown;
+  grown[*count] = strndup(name, length);
+  if (!grown[*count])
+    return -1;
+  return (*count)++;
+}
+
+// A literal segment of a prompt template and the slot rendered after it
+typedef struct {
+  size_t start;  // Offset of the literal in the decoded text
+  size_t length; // Bytes of the literal
+  int slot;      // Variable rendered after it, -1 for none
+} TemplateSegment;
+
+// A prompt template split into literal segments and variable slots, the same
+// way the runtime renders it
+typedef struct {
+  char *text;                // The template with its escapes decoded
+  TemplateSegment *segments; // In order; only the last has no slot
+  int segment_count;
+  char **variables;      // Distinct variable names in slot order
+  int var_count;
+  size_t literal_length; // Bytes of all segments together
+} SplitTemplate;
+
+static void split_template_free(SplitTemplate *split) {
+  for (int i = 0; i < split->var_count; i++)
+    free(split->variables[i]);
+  free(split->variables);
+  free(split->segments);
+  free(split->text);
+  memset(split, 0, sizeof(*split));
+}
+
+// Split a template at its {name} markers; anything else stays literal.
+// Returns 0 if out of memory.
+static int split_template(const char *template, SplitTemplate *split) {
+  memset(split, 0, sizeof(*split));
+  size_t length;
+  split->text = decode_template(template, &length);
+  if (!split->text) {
+    ERROR("Failed to allocate memory for prompt template");
+    return 0;
+  }
+
+  const char *text = split->text;
+  size_t start = 0;
+  for (size_t i = 0;; i++) {
+    int slot = -1;
+    size_t end = i;
+    if (i < length && text[i] == '{' &&
+        (isalpha((unsigned char)text[i + 1]) || text[i + 1] == '_')) {
+      end = i + 2;
+      while (isalnum((unsigned char)text[end]) || text[end] == '_')
+        end++;
+      if (text[end] != '}')
+        continue;
+      slot = template_slot(&split->variables, &split->var_count,
+                           text + i + 1, end - i - 1);
+      if (slot < 0) {
+        ERROR("Failed to allocate memory for prompt variables");
+        split_template_free(split);
+        return 0;
+      }
+    } else if (i < length) {
+      continue;
+    }
+
+    TemplateSegment *grown = realloc(
+        split->segments, (split->segment_count + 1) * sizeof(TemplateSegment));
+    if (!grown) {
+      ERROR("Failed to allocate memory for prompt template");
+      split_template_free(split);
+      return 0;
+    }
+    split->segments = grown;
+    grown[split->segment_count++] = (TemplateSegment){start, i - start, slot};
+    split->literal_length += i - start;
+    if (slot < 0)
+      return 1;
+    i = end;
+    start = end + 1;
+  }
+}
+
+// Render a split template with one value per slot, as the runtime would.
+// Returns NULL if out of memory.
+static char *render_split_template(const SplitTemplate *split,
+                                   char *const *values) {
+  size_t length = split->literal_length;
+  for (int i = 0; i < split->segment_count; i++) {
+    if (split->segments[i].slot >= 0)
+      length += strlen(values[split->segments[i].slot]);
+  }
+
+  char *prompt = malloc(length + 1);
+  if (!prompt)
+    return NULL;
+  char *p = prompt;
+  for (int i = 0; i < split->segment_count; i++) {
+    const TemplateSegment *segment = &split->segments[i];
+    memcpy(p, split->text + segment->start, segment->length);
+    p += segment->length;
+    if (segment->slot >= 0) {
+      size_t value_length = strlen(values[segment->slot]);
+      memcpy(p, values[segment->slot], value_length);
+      p += value_length;
+    }
+  }
+  *p = '\0';
+  return prompt;
+}
+
+// Emit a split template as static segments named prompt_segments and its
+// descriptor named prompt_template
+static void generate_prompt_template(const SplitTemplate *split, FILE *file,
+                                     int indent) {
+  add_indent(file, indent);
+  fprintf(file, "static const VibePromptSegment prompt_segments[] = {\n");
+  for (int i = 0; i < split->segment_count; i++) {
+    const TemplateSegment *segment = &split->segments[i];
+    add_indent(file, indent + 1);
+    fputc('{', file);
+    write_c_bytes(file, split->text + segment->start, segment->length);
+    fprintf(file, ", %zu, %d},\n", segment->length, segment->slot);
+  }
+  add_indent(file, indent);
+  fprintf(file, "};\n");
+  add_indent(file, indent);
+  fprintf(file,
+          "static const VibePromptTemplate prompt_template = "
+          "{prompt_segments, %d, %d, %zu};\n",
+          split->segment_count, split->var_count, split->literal_length);
+}
+
+// Answers a constant prompt at build time, as declared in codegen.h
+typedef char *(*codegen_resolver_t)(const VibePromptSite *site,
+                                    const char *prompt,
+                                    VibeGenerationParams *used);
+
+// Resolver of constant prompts, NULL to leave them to run time
+static codegen_resolver_t prompt_resolver = NULL;
+
+// A constant prompt and its build-time answer. Prompt blocks are generated
+// once per function variant, but each prompt is resolved only once.
+typedef struct {
+  ast_node_t *prompt; // The prompt block
+  char **args;        // The literal value of each slot
+  int arg_count;
+  char *response; // The answer, NULL if it could not be resolved
+} MaterializedPrompt;
+
+// Constant prompts of the module being generated and its manifest
+static MaterializedPrompt *materialized = NULL;
+static int materialized_count = 0;
+static cJSON *manifest = NULL;
+
+static void free_string_list(char **list, int count) {
+  if (!list)
+    return;
+  for (int i = 0; i < count; i++)
+    free(list[i]);
+  free(list);
+}
+
+// Map the name of a decoder, as emitted, to its value
+static VibeDecoder decoder_value(const char *decoder) {
+  if (strcmp(decoder, "VIBE_DECODE_INT") == 0)
+    return VIBE_DECODE_INT;
+  if (strcmp(decoder, "VIBE_DECODE_FLOAT") == 0)
+    return VIBE_DECODE_FLOAT;
+  if (strcmp(decoder, "VIBE_DECODE_BOOL") == 0)
+    return VIBE_DECODE_BOOL;
+  if (strcmp(decoder, "VIBE_DECODE_CUSTOM") == 0)
+    return VIBE_DECODE_CUSTOM;
+  return VIBE_DECODE_STRING;
+}
+
+// Start the manifest of a module. SOURCE_DATE_EPOCH fixes the date for
+// reproducible builds.
+static int manifest_begin(void) {
+  const char *epoch = getenv("SOURCE_DATE_EPOCH");
+  time_t now = epoch && *epoch ? (time_t)strtoll(epoch, NULL, 10) : time(NULL);
+  struct tm utc;
+  char date[32];
+  gmtime_r(&now, &utc);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+  manifest = cJSON_CreateObject();
+  if (!manifest || !cJSON_AddStringToObject(manifest, "generated", date) ||
+      !cJSON_AddArrayToObject(manifest, "sites")) {
+    ERROR("Failed to allocate the materialization manifest");
+    cJSON_Delete(manifest);
+    manifest = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+// Record a materialized prompt in the manifest with the parameters its
+// request was sent with
+static void manifest_add(const VibePromptSite *site, const char *prompt,
+                         char *const *args, int arg_count,
+                         const VibeGenerationParams *used,
+                         const char *response) {
+  cJSON *entry = cJSON_CreateObject();
+  if (!entry) {
+    WARN("Failed to add a materialized prompt to the manifest");
+    return;
+  }
+  if (site->function_name)
+    cJSON_AddStringToObject(entry, "function", site->function_name);
+  if (arg_count > 0) {
+    cJSON *arguments = cJSON_AddArrayToObject(entry, "arguments");
+    for (int i = 0; arguments && i < arg_count; i++)
+      cJSON_AddItemToArray(arguments, cJSON_CreateString(args[i]));
+  }
+  cJSON_AddStringToObject(entry, "prompt", prompt);
+  if (used->model)
+    cJSON_AddStringToObject(entry, "model", used->model);
+  cJSON_AddNumberToObject(entry, "temperature", used->temperature);
+  cJSON_AddNumberToObject(entry, "max_tokens", used->max_tokens);
+  if (used->stop) {
+    cJSON *stop = cJSON_AddArrayToObject(entry, "stop");
+    for (const char *const *item = used->stop; stop && *item; item++)
+      cJSON_AddItemToArray(stop, cJSON_CreateString(*item));
+  }
+  if (used->instruction)
+    cJSON_AddStringToObject(entry, "instruction", used->instruction);
+  if (used->response_format) {
+    cJSON *format = cJSON_Parse(used->response_format);
+    if (format)
+      cJSON_AddItemToObject(entry, "response_format", format);
+    else
+      cJSON_AddStringToObject(entry, "response_format",
+                              used->response_format);
+  }
+  cJSON_AddStringToObject(entry, "response", response);
+  cJSON_AddItemToArray(cJSON_GetObjectItem(manifest, "sites"), entry);
+}
+
+// Write the manifest next to the generated file, as <name>.materialized.json
+// for <name>.c
+static int manifest_write(const char *output_file) {
+  if (cJSON_GetArraySize(cJSON_GetObjectItem(manifest, "sites")) == 0)
+    return 1;
+
+  size_t length = strlen(output_file);
+  if (length > 2 && strcmp(output_file + length - 2, ".c") == 0)
+    length -= 2;
+  char *path = malloc(length + sizeof(".materialized.json"));
+  char *json = cJSON_Print(manifest);
+  FILE *file = NULL;
+  if (path && json) {
+    memcpy(path, output_file, length);
+    strcpy(path + length, ".materialized.json");
+    file = fopen(path, "w");
+  }
+  int written = file && fputs(json, file) >= 0 && fputc('\n', file) != EOF;
+  if (file && fclose(file) != 0)
+    written = 0;
+  if (written)
+    INFO("Materialization manifest written to %s", path);
+  else
+    ERROR("Failed to write materialization manifest for %s", output_file);
+  free(path);
+  free(json);
+  return written;
+}
+
+static void materialized_free(void) {
+  for (int i = 0; i < materialized_count; i++) {
+    free_string_list(materialized[i].args, materialized[i].arg_count);
+    free(materialized[i].response);
+  }
+  free(materialized);
+  materialized = NULL;
+  materialized_count = 0;
+  cJSON_Delete(manifest);
+  manifest = NULL;
+}
+
+// Check that an answer decodes to its site's type, as it will when the
+// module runs. Classes are read from the first JSON object in the text.
+static int answer_decodes(const VibePromptSite *site, const char *response) {
+  size_t length = strlen(response);
+  long long integer;
+  double number;
+  int answer;
+  switch (site->decoder) {
+  case VIBE_DECODE_INT:
+    return response_decode_int(response, length, &integer);
+  case VIBE_DECODE_FLOAT:
+    return response_decode_float(response, length, &number);
+  case VIBE_DECODE_BOOL:
+    return response_decode_bool(response, length, &answer);
+  default:
+    break;
+  }
+  if (!site->limits || !site->limits->response_format)
+    return 1;
+  const char *object = strchr(response, '{');
+  cJSON *json = object ? cJSON_ParseWithOpts(object, NULL, 0) : NULL;
+  int decodes = cJSON_IsObject(json);
+  cJSON_Delete(json);
+  return decodes;
+}
+
+// Find the answer to a prompt block for a set of slot values, resolving it
+// on first sight. Takes over args. Returns NULL if there is no answer.
+static const char *materialize(ast_node_t *prompt, const SplitTemplate *split,
+                               char **args, const VibePromptSite *site) {
+  int count = split->var_count;
+  for (int i = 0; i < materialized_count; i++) {
+    MaterializedPrompt *known = &materialized[i];
+    int same = known->prompt == prompt;
+    for (int j = 0; same && j < count; j++)
+      same = strcmp(known->args[j], args[j]) == 0;
+    if (same) {
+      free_string_list(args, count);
+      return known->response;
+    }
+  }
+
+  MaterializedPrompt *grown = realloc(
+      materialized, (materialized_count + 1) * sizeof(MaterializedPrompt));
+  char *text = grown ? render_split_template(split, args) : NULL;
+  if (grown)
+    materialized = grown;
+  if (!text) {
+    ERROR("Failed to allocate memory for a constant prompt");
+    free_string_list(args, count);
+    return NULL;
+  }
+
+  const char *function_name =
+      site->function_name ? site->function_name : "the module";
+  VibeGenerationParams used;
+  memset(&used, 0, sizeof(used));
+  char *response = prompt_resolver(site, text, &used);
+  if (response && !answer_decodes(site, response)) {
+    WARN("Leaving prompt of %s to run time, its answer does not decode: %s",
+         function_name, response);
+    free(response);
+    response = NULL;
+  } else if (response) {
+    INFO("Materialized prompt of %s: %s", function_name, text);
+    if (manifest)
+      manifest_add(site, text, args, count, &used, response);
+  } else {
+    WARN("Leaving prompt of %s to run time, no answer at build time: %s",
+         function_name, text);
+  }
+  free(text);
+  materialized[materialized_count++] =
+      (MaterializedPrompt){prompt, args, count, response};
+  return response;
+}
+
+// Check whether a parameter is a String, possibly with a meaning
+static int parameter_is_string(ast_node_t *param) {
+  for (int i = 0; i < param->child_count; i++) {
+    ast_node_t *type = param->children[i];
+    if (type->type == AST_MEANING_TYPE && type->child_count > 0)
+      type = type->children[0];
+    if (type->type == AST_BASIC_TYPE) {
+      const char *name = ast_get_string(type, "type");
+      return name && strcmp(name, "String") == 0;
+    }
+  }
+  return 0;
+}
+
+// Materialize the prompt block for every call in a subtree that passes
+// string literals for the template's slots. slot_params maps each slot to
+// its parameter.
+static void materialize_calls(ast_node_t *node, ast_node_t *prompt,
+                              const SplitTemplate *split,
+                              const int *slot_params, int param_count,
+                              const VibePromptSite *site) {
+  const char *callee = ast_get_string(node, "function");
+
+  // The arguments are the call's children or sit in a list under it
+  ast_node_t *arg_list = node;
+  if (node->type == AST_CALL_EXPR && node->child_count == 1 &&
+      node->children[0]->type == AST_PARAM_LIST)
+    arg_list = node->children[0];
+
+  if (node->type == AST_CALL_EXPR && arg_list->child_count == param_count &&
+      callee && strcmp(callee, site->function_name) == 0) {
+    char **args = calloc(split->var_count, sizeof(char *));
+    int literal = args != NULL;
+    for (int i = 0; literal && i < split->var_count; i++) {
+      ast_node_t *arg = arg_list->children[slot_params[i]];
+      const char *value = ast_get_string(arg, "value");
+      size_t length;
+      literal = arg->type == AST_STRING_LITERAL &&
+                (args[i] = decode_template(value ? value : "", &length));
+    }
+    if (literal)
+      materialize(prompt, split, args, site);
+    else
+      free_string_list(args, split->var_count);
+  }
+
+  for (int i = 0; i < node->child_count; i++)
+    materialize_calls(node->children[i], prompt, split, slot_params,
+                      param_count, site);
+}
+
+// Answer a prompt block at build time: once if its template has no
+// variables, otherwise once per distinct set of literal arguments its
+// function is called with in the module
+static void materialize_prompt(ast_node_t *prompt, ast_node_t *func,
+                               const SplitTemplate *split,
+                               const VibePromptSite *site) {
+  if (split->var_count == 0) {
+    materialize(prompt, split, NULL, site);
+    return;
+  }
+  if (!func || !site->function_name)
+    return;
+
+  ast_node_t *param_list = NULL;
+  for (int i = 0; i < func->child_count; i++) {
+    if (func->children[i]->type == AST_PARAM_LIST)
+      param_list = func->children[i];
+  }
+  if (!param_list)
+    return;
+
+  // Every slot must be a string parameter for a call to fix the prompt
+  int *slot_params = malloc(split->var_count * sizeof(int));
+  if (!slot_params)
+    return;
+  for (int i = 0; i < split->var_count; i++) {
+    slot_params[i] = -1;
+    for (int j = 0; j < param_list->child_count; j++) {
+      ast_node_t *param = param_list->children[j];
+      const char *name = ast_get_string(param, "name");
+      if (name && strcmp(name, split->variables[i]) == 0 &&
+          parameter_is_string(param))
+        slot_params[i] = j;
+    }
+    if (slot_params[i] < 0) {
+      free(slot_params);
+      return;
+    }
+  }
+
+  ast_node_t *root = func;
+  while (root->parent)
+    root = root->parent;
+  materialize_calls(root, prompt, split, slot_params, param_list->child_count,
+                    site);
+  free(slot_params);
+}
+
+/**
+ * Generate code from the AST and write it to an output file
+ *
+ * @param ast The root AST node
+ * @param output_file The path to the output file
+ * @return 1 on success, 0 on error
+ */
+int generate_code(ast_node_t *ast, const char *output_file) {
+  FILE *file = NULL;
+
+  // Check parameters
+  if (!ast || !output_file) {
+    ERROR("Invalid parameters for code generation");
+    return 0;
+  }
+
+  INFO("Generating code to %s", output_file);
+
+  // Open the output file
+  file = fopen(output_file, "w");
+  if (!file) {
+    ERROR("Failed to open output file: %s", output_file);
+    return 0;
+  }
+
+  // Function overrides are looked up while prompt blocks are generated
+  config_json = load_codegen_config();
+  int result = !prompt_resolver || manifest_begin();
+  if (result)
+    result = generate_module(ast, file);
+  cJSON_Delete(config_json);
+  config_json = NULL;
+
   // Close the file
   fclose(file);
+  if (result && manifest)
+    result = manifest_write(output_file);
+  materialized_free();
+  if (!result)
+    return 0;
 
   INFO("Code generation completed successfully");
   return 1;
 }
 
+/**
+ * Set the configuration file whose overrides are compiled into modules
+ */
+void codegen_set_config_file(const char *config_file) {
+  free(config_file_path);
+  config_file_path = config_file ? strdup(config_file) : NULL;
+  config_file_set = 1;
+}
+
+/**
+ * Set the function that answers constant prompts at build time
+ */
+void codegen_set_resolver(codegen_resolver_t resolver) {
+  prompt_resolver = resolver;
+}
+
 /**
  * Generate the required runtime headers and includes
  *
@@ -192,6 +1356,7 @@ static int generate_headers(FILE *file) {
   fprintf(file, " * Generated by VibeLanguage Compiler\n");
   fprintf(file, " */\n\n");
 
+  fprintf(file, "#include <stddef.h>\n");
   fprintf(file, "#include <stdio.h>\n");
   fprintf(file, "#include <stdlib.h>\n");
   fprintf(file, "#include <string.h>\n");
@@ -199,22 +1364,25 @@ static int generate_headers(FILE *file) {
   fprintf(file, "#include \"vibelang.h\"\n\n");
 
   fprintf(file, "// Forward declarations for runtime functions\n");
-  fprintf(file,
-          "extern VibeValue vibe_execute_prompt(const char *prompt, const char *meaning);\n");
-  fprintf(file, "extern char *format_prompt(const char *template, char **var_names,\n");
-  fprintf(file, "                           char **var_values, int var_count);\n\n");
+  fprintf(file, "extern VibeValue vibe_execute_template(const VibePromptSite *site,\n");
+  fprintf(file, "                                       const VibePromptTemplate *template, VibePromptArg *args);\n");
+  fprintf(file, "extern VibeValue vibe_execute_template_stream(const VibePromptSite *site,\n");
+  fprintf(file, "                                              const VibePromptTemplate *template, VibePromptArg *args,\n");
+  fprintf(file, "                                              VibeTokenCallback on_token, void *user_data);\n\n");
 
   return 1;
 }
 
 /**
- * Generate code for a function declaration
+ * Generate code for one variant of a function declaration
  *
  * @param func The function declaration AST node
  * @param file The file to write to
+ * @param stream Whether to emit the streaming variant
  * @return 1 on success, 0 on error
  */
-static int generate_function(ast_node_t *func, FILE *file) {
+static int generate_function_variant(ast_node_t *func, FILE *file,
+                                     int stream) {
   if (!func || !file)
     return 0;
 
@@ -272,7 +1440,7 @@ static int generate_function(ast_node_t *func, FILE *file) {
   }
 
   // Write function signature
-  fprintf(file, "%s %s(", c_type, func_name);
+  fprintf(file, "%s %s%s(", c_type, func_name, stream ? "_stream" : "");
 
   // Find parameter list and write parameters
   ast_node_t *param_list = NULL;
@@ -332,6 +1500,13 @@ static int generate_function(ast_node_t *func, FILE *file) {
     }
   }
 
+  if (stream) {
+    if (param_list && param_list->child_count > 0) {
+      fprintf(file, ", ");
+    }
+    fprintf(file, "VibeTokenCallback on_token, void *user_data");
+  }
+
   fprintf(file, ") {\n");
 
   // Find function body and generate code
@@ -345,18 +1520,47 @@ static int generate_function(ast_node_t *func, FILE *file) {
 
   if (body) {
     // Generate statements in the function body
+    generating_stream_variant = stream;
     for (int i = 0; i < body->child_count; i++) {
       if (!generate_statement(body->children[i], file, 1)) {
         ERROR("Failed to generate statement");
+        generating_stream_variant = 0;
         return 0;
       }
     }
+    generating_stream_variant = 0;
   }
 
   fprintf(file, "}\n\n");
   return 1;
 }
 
+/**
+ * Generate code for a function declaration. Prompt-backed functions returning
+ * a string also get a <name>_stream variant that takes a token callback.
+ *
+ * @param func The function declaration AST node
+ * @param file The file to write to
+ * @return 1 on success, 0 on error
+ */
+static int generate_function(ast_node_t *func, FILE *file) {
+  if (!generate_function_variant(func, file, 0))
+    return 0;
+
+  if (!contains_prompt_block(func))
+    return 1;
+
+  // Only text can be streamed
+  const char *decoder = "VIBE_DECODE_STRING";
+  const char *meaning_value = NULL;
+  resolve_prompt_return(func, &decoder, &meaning_value);
+  if (strcmp(decoder, "VIBE_DECODE_STRING") != 0 &&
+      strcmp(decoder, "VIBE_DECODE_CUSTOM") != 0)
+    return 1;
+
+  return generate_function_variant(func, file, 1);
+}
+
 /**
  * Generate code for a type declaration
  *
@@ -676,74 +1880,74 @@ static int generate_prompt_block(ast_node_t *prompt, FILE *file, int indent) {
     return 0;
   }
 
-  // Extract variables from the template
-  int var_count = 0;
-  char **variables = extract_variables(template_str, &var_count);
-
   // Get the expected return type and meaning from the parent function
-  const char *return_type = "char*"; // Default to string
-  const char *meaning_value = NULL;
+  const char *decoder = "VIBE_DECODE_STRING"; // Default to string
+  const char *meaning_literal = NULL;
   ast_node_t *parent = prompt->parent;
   while (parent && parent->type != AST_FUNCTION_DECL) {
     parent = parent->parent;
   }
 
+  const char *function_name = NULL;
+  ast_node_t *result_class = NULL;
   if (parent && parent->type == AST_FUNCTION_DECL) {
-    // Look for the return type in the function declaration
-    for (int i = 0; i < parent->child_count; i++) {
-      if (parent->children[i]->type == AST_BASIC_TYPE) {
-        const char *type_name = ast_get_string(parent->children[i], "type");
-        if (strcmp(type_name, "Int") == 0) {
-          return_type = "int";
-        } else if (strcmp(type_name, "Float") == 0) {
-          return_type = "double";
-        } else if (strcmp(type_name, "Bool") == 0) {
-          return_type = "int";
-        }
+    function_name = ast_get_string(parent, "name");
+    resolve_prompt_return(parent, &decoder, &meaning_literal);
+    result_class = prompt_return_class(parent);
+  }
 
-        // Check for alias meaning types
-        ast_node_t *root = parent;
-        while (root->parent)
-          root = root->parent;
-        ast_node_t *decl = find_type_decl(root, type_name);
-        if (decl && decl->child_count > 0 &&
-            decl->children[0]->type == AST_MEANING_TYPE) {
-          ast_node_t *meaning_type = decl->children[0];
-          meaning_value = ast_get_string(meaning_type, "meaning");
-          if (meaning_type->child_count > 0 &&
-              meaning_type->children[0]->type == AST_BASIC_TYPE) {
-            const char *base_type =
-                ast_get_string(meaning_type->children[0], "type");
-            if (strcmp(base_type, "Int") == 0) {
-              return_type = "int";
-            } else if (strcmp(base_type, "Float") == 0) {
-              return_type = "double";
-            } else if (strcmp(base_type, "Bool") == 0) {
-              return_type = "int";
-            }
-          }
-        }
+  // The meaning is decoded once, so the site, its instruction and its route
+  // all see the same text
+  size_t meaning_length;
+  char *meaning_value =
+      meaning_literal ? decode_template(meaning_literal, &meaning_length)
+                      : NULL;
+  if (meaning_literal && !meaning_value) {
+    ERROR("Failed to allocate memory for a meaning");
+    return 0;
+  }
 
-        break;
-      } else if (parent->children[i]->type == AST_MEANING_TYPE) {
-        // For Meaning types, use the base type
-        ast_node_t *meaning_type = parent->children[i];
-        meaning_value = ast_get_string(meaning_type, "meaning");
-        if (meaning_type->child_count > 0) {
-          const char *base_type =
-              ast_get_string(meaning_type->children[0], "type");
-          if (strcmp(base_type, "Int") == 0) {
-            return_type = "int";
-          } else if (strcmp(base_type, "Float") == 0) {
-            return_type = "double";
-          } else if (strcmp(base_type, "Bool") == 0) {
-            return_type = "int";
-          }
-          // String remains the default "char*"
-        }
-        break;
+  // Split the template into literal segments and one slot per variable, and
+  // build the parameters of the site
+  SplitTemplate split;
+  if (!split_template(template_str, &split)) {
+    free(meaning_value);
+    return 0;
+  }
+  SiteParams params, limits;
+  int has_params = build_prompt_params(function_name, &params);
+  int has_limits = result_class
+                       ? build_prompt_format(result_class, &limits)
+                       : build_prompt_limits(decoder, meaning_value, &limits);
+  if (has_params < 0 || has_limits < 0) {
+    split_template_free(&split);
+    site_params_free(&params);
+    site_params_free(&limits);
+    free(meaning_value);
+    return 0;
+  }
+  const char *route = resolve_prompt_route(decoder, meaning_value);
+
+  // Constant prompts are answered now when a resolver is set, so that
+  // running the module costs no request for them
+  int answer_count = 0;
+  const char *constant = NULL;
+  if (prompt_resolver) {
+    VibePromptSite site = {function_name,
+                           meaning_value,
+                           has_params ? &params.params : NULL,
+                           decoder_value(decoder),
+                           has_limits ? &limits.params : NULL,
+                           route};
+    materialize_prompt(prompt, parent, &split, &site);
+    for (int i = 0; i < materialized_count; i++) {
+      if (materialized[i].prompt == prompt && materialized[i].response) {
+        constant = materialized[i].response;
+        answer_count++;
       }
     }
+    if (split.var_count > 0)
+      constant = NULL;
   }
 
   // Generate code to call the LLM API
@@ -751,57 +1955,107 @@ static int generate_prompt_block(ast_node_t *prompt, FILE *file, int indent) {
   fprintf(file, "{\n");
   add_indent(file, indent + 1);
   fprintf(file, "// Prompt block: \"%s\"\n", template_str);
-  add_indent(file, indent + 1);
-  fprintf(file, "const char* prompt_template = \"%s\";\n", template_str);
-  add_indent(file, indent + 1);
-  fprintf(file, "int var_count = %d;\n", var_count);
-  add_indent(file, indent + 1);
-  fprintf(file, "char** var_names = malloc(sizeof(char*) * var_count);\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "char** var_values = malloc(sizeof(char*) * var_count);\n");
-
-  // Initialize variable names and values
-  if (variables) {
-    for (int i = 0; i < var_count; i++) {
-      add_indent(file, indent + 1);
-      fprintf(file, "var_names[%d] = \"%s\";\n", i, variables[i]);
-      add_indent(file, indent + 1);
-      fprintf(file, "var_values[%d] = %s ? strdup(%s) : strdup(\"\");\n", i,
-              variables[i], variables[i]);
+  if (!constant)
+    generate_prompt_template(&split, file, indent + 1);
+
+  // Borrow the arguments through a descriptor on the stack
+  if (split.var_count > 0) {
+    add_indent(file, indent + 1);
+    fprintf(file, "VibePromptArg prompt_args[%d] = {\n", split.var_count);
+    for (int i = 0; i < split.var_count; i++) {
+      const char *variable = split.variables[i];
+      add_indent(file, indent + 2);
+      fprintf(file, "{%s, %s ? strlen(%s) : 0},\n", variable, variable,
+              variable);
     }
+    add_indent(file, indent + 1);
+    fprintf(file, "};\n");
   }
 
-  // Format the prompt and call the LLM API
-  add_indent(file, indent + 1);
-  fprintf(file, "char* formatted_prompt = format_prompt(prompt_template, "
-                "var_names, var_values, var_count);\n");
+  // Describe the site and call the LLM API
+  if (has_params)
+    generate_generation_params("prompt_params", &params, file, indent + 1);
+  if (has_limits)
+    generate_generation_params("prompt_limits", &limits, file, indent + 1);
   add_indent(file, indent + 1);
+  fprintf(file, "static const VibePromptSite prompt_site = {");
+  if (function_name) {
+    fprintf(file, ".function_name = ");
+    write_c_string(file, function_name);
+    fprintf(file, ", ");
+  }
   if (meaning_value) {
-    fprintf(file,
-            "VibeValue prompt_result = vibe_execute_prompt(formatted_prompt, \"%s\");\n",
-            meaning_value);
+    fprintf(file, ".meaning = ");
+    write_c_string(file, meaning_value);
+    fprintf(file, ", ");
+  }
+  if (has_params)
+    fprintf(file, ".params = &prompt_params, ");
+  fprintf(file, ".decoder = %s", decoder);
+  if (has_limits)
+    fprintf(file, ", .limits = &prompt_limits");
+  if (route) {
+    fprintf(file, ", .route = ");
+    write_c_string(file, route);
+  }
+  fprintf(file, "};\n");
+
+  const char *stream_args =
+      generating_stream_variant ? ", on_token, user_data" : "";
+  const char *decode = generating_stream_variant ? "vibe_decode_site_stream"
+                                                 : "vibe_decode_site";
+  char execute[160];
+  snprintf(execute, sizeof(execute), "%s(&prompt_site, &prompt_template, %s%s)",
+           generating_stream_variant ? "vibe_execute_template_stream"
+                                     : "vibe_execute_template",
+           split.var_count > 0 ? "prompt_args" : "NULL", stream_args);
+  if (constant) {
+    add_indent(file, indent + 1);
+    fprintf(file, "// Answered at build time\n");
+    add_indent(file, indent + 1);
+    fprintf(file, "VibeValue prompt_result = %s(&prompt_site, ", decode);
+    write_c_string(file, constant);
+    fprintf(file, "%s);\n", stream_args);
+  } else if (answer_count > 0) {
+    // Literal arguments seen in the module select their answer
+    add_indent(file, indent + 1);
+    fprintf(file, "// Literal arguments answered at build time\n");
+    add_indent(file, indent + 1);
+    fprintf(file, "VibeValue prompt_result;\n");
+    const char *keyword = "if";
+    for (int i = 0; i < materialized_count; i++) {
+      const MaterializedPrompt *answer = &materialized[i];
+      if (answer->prompt != prompt || !answer->response)
+        continue;
+      add_indent(file, indent + 1);
+      fprintf(file, "%s (", keyword);
+      for (int j = 0; j < answer->arg_count; j++) {
+        size_t length = strlen(answer->args[j]);
+        fprintf(file, "%sprompt_args[%d].length == %zu", j ? " && " : "", j,
+                length);
+        if (length > 0) {
+          fprintf(file, " && memcmp(prompt_args[%d].text, ", j);
+          write_c_string(file, answer->args[j]);
+          fprintf(file, ", %zu) == 0", length);
+        }
+      }
+      fprintf(file, ")\n");
+      add_indent(file, indent + 2);
+      fprintf(file, "prompt_result = %s(&prompt_site, ", decode);
+      write_c_string(file, answer->response);
+      fprintf(file, "%s);\n", stream_args);
+      keyword = "else if";
+    }
+    add_indent(file, indent + 1);
+    fprintf(file, "else\n");
+    add_indent(file, indent + 2);
+    fprintf(file, "prompt_result = %s;\n", execute);
   } else {
-    fprintf(file,
-            "VibeValue prompt_result = vibe_execute_prompt(formatted_prompt, NULL);\n");
+    add_indent(file, indent + 1);
+    fprintf(file, "VibeValue prompt_result = %s;\n", execute);
   }
   add_indent(file, indent + 1);
   fprintf(file, "\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "// Free resources\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "free(formatted_prompt);\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "for (int i = 0; i < var_count; i++) {\n");
-  add_indent(file, indent + 2);
-  fprintf(file, "free(var_values[i]);\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "}\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "free(var_names);\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "free(var_values);\n");
-  add_indent(file, indent + 1);
-  fprintf(file, "\n");
 
   // Return the result with proper type conversion
   add_indent(file, indent + 1);
@@ -809,12 +2063,23 @@ static int generate_prompt_block(ast_node_t *prompt, FILE *file, int indent) {
   add_indent(file, indent + 1);
 
   // Convert the result to the appropriate return type
-  if (strcmp(return_type, "int") == 0) {
+  if (strcmp(decoder, "VIBE_DECODE_INT") == 0) {
     fprintf(file, "return vibe_value_get_int(&prompt_result);\n");
-  } else if (strcmp(return_type, "double") == 0) {
+  } else if (strcmp(decoder, "VIBE_DECODE_FLOAT") == 0) {
     fprintf(file, "return vibe_get_number(&prompt_result);\n");
-  } else if (strcmp(return_type, "Bool") == 0) {
+  } else if (strcmp(decoder, "VIBE_DECODE_BOOL") == 0) {
     fprintf(file, "return vibe_get_bool(&prompt_result);\n");
+  } else if (result_class) {
+    // Decode in place into the class's struct
+    const char *class_name = ast_get_string(result_class, "name");
+    fprintf(file, "%s prompt_object;\n", class_name);
+    add_indent(file, indent + 1);
+    fprintf(file,
+            "vibe_value_get_object(&prompt_result, &%s_shape, "
+            "&prompt_object);\n",
+            class_name);
+    add_indent(file, indent + 1);
+    fprintf(file, "return prompt_object;\n");
   } else {
     // Default to string
     fprintf(file, "return (char*)vibe_get_string(&prompt_result);\n");
@@ -823,14 +2088,10 @@ static int generate_prompt_block(ast_node_t *prompt, FILE *file, int indent) {
   add_indent(file, indent);
   fprintf(file, "}\n");
 
-  // Free the extracted variables
-  if (variables) {
-    for (int i = 0; i < var_count; i++) {
-      free(variables[i]);
-    }
-    free(variables);
-  }
-
+  split_template_free(&split);
+  site_params_free(&params);
+  site_params_free(&limits);
+  free(meaning_value);
   return 1;
 }
 
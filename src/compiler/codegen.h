@@ -9,6 +9,7 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include "../../include/runtime.h"
 #include "../utils/ast.h"
 
 /**
@@ -20,6 +21,41 @@
  */
 int generate_code(ast_node_t *ast, const char *output_file);
 
+/**
+ * Set the configuration file whose function overrides are compiled into the
+ * prompt sites of generated modules, as static VibeGenerationParams
+ * descriptors. Without a call, vibeconfig.json in the working directory is
+ * used if it exists.
+ *
+ * @param config_file The configuration file, or NULL for none
+ */
+void codegen_set_config_file(const char *config_file);
+
+/**
+ * Answers a constant prompt at build time
+ *
+ * @param site The prompt site, as the generated module describes it
+ * @param prompt The prompt
+ * @param used Receives the generation parameters the request was sent with
+ * @return The response, which the caller frees, or NULL to leave the prompt
+ * to run time
+ */
+typedef char *(*codegen_resolver_t)(const VibePromptSite *site,
+                                    const char *prompt,
+                                    VibeGenerationParams *used);
+
+/**
+ * Set the function that answers constant prompts while modules are
+ * generated. A prompt is constant when its template has no variables, or
+ * for each call in the module that passes string literals for all of them.
+ * Answers are embedded in the generated code, which decodes them instead of
+ * sending the request, and recorded with the parameters used and the date in
+ * <name>.materialized.json next to the output file <name>.c.
+ *
+ * @param resolver The resolver, or NULL to leave every prompt to run time
+ */
+void codegen_set_resolver(codegen_resolver_t resolver);
+
 /**
  * Generate code for a function declaration
  *
@@ -0,0 +1,364 @@
+/**
+ * @file admission.c
+ * @brief Client-side admission control for LLM requests
+ */
+
+#include "admission.h"
+#include "../utils/log_utils.h"
+#include "call_context.h"
+#include "retry_policy.h"
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+// The buckets hold ten seconds' worth of budget, so a quiet minute cannot
+// be spent in one burst
+#define BUCKET_BURST_MS 10000.0
+
+// Smoothing of the per-token latency baseline, and the samples it needs
+// before spikes are judged against it
+#define LATENCY_EWMA_ALPHA 0.1
+#define LATENCY_MIN_SAMPLES 10
+
+// A per-minute budget refilling continuously. A rate of 0 means unlimited.
+typedef struct {
+  double rate_per_ms;
+  double capacity;
+  double level;
+  int64_t updated_ms;
+} TokenBucket;
+
+// A request waiting for admission; the queue is served in FIFO order
+typedef struct Waiter {
+  pthread_cond_t cond;
+  int cancelled; // Set by the call's cancel hook
+  struct Waiter *next;
+} Waiter;
+
+static pthread_mutex_t admission_lock = PTHREAD_MUTEX_INITIALIZER;
+static AdmissionConfig settings;
+static int active = 0; // Admission control configured and enabled
+
+static TokenBucket request_bucket;
+static TokenBucket token_bucket;
+
+static double limit;
+static int in_flight = 0;
+static int64_t last_decrease_ms = 0;
+static double latency_per_token = 0.0; // EWMA of ms per token
+static int latency_samples = 0;
+
+static Waiter *queue_head = NULL;
+static Waiter *queue_tail = NULL;
+static int queued = 0;
+
+static AdmissionStats counters;
+
+static void bucket_init(TokenBucket *bucket, double per_minute, int64_t now) {
+  bucket->rate_per_ms = per_minute / 60000.0;
+  bucket->capacity = bucket->rate_per_ms * BUCKET_BURST_MS;
+  if (bucket->capacity < 1.0)
+    bucket->capacity = 1.0;
+  bucket->level = bucket->capacity;
+  bucket->updated_ms = now;
+}
+
+static void bucket_refill(TokenBucket *bucket, int64_t now) {
+  if (bucket->rate_per_ms <= 0)
+    return;
+  bucket->level += (double)(now - bucket->updated_ms) * bucket->rate_per_ms;
+  if (bucket->level > bucket->capacity)
+    bucket->level = bucket->capacity;
+  bucket->updated_ms = now;
+}
+
+// Milliseconds until the bucket can pay for cost, 0 if it can now. A cost
+// larger than the bucket is admitted once the bucket is full, running it
+// into debt, so oversized requests are slowed down rather than starved.
+static int64_t bucket_wait_ms(TokenBucket *bucket, double cost, int64_t now) {
+  if (bucket->rate_per_ms <= 0)
+    return 0;
+  bucket_refill(bucket, now);
+  double needed = cost < bucket->capacity ? cost : bucket->capacity;
+  if (bucket->level >= needed)
+    return 0;
+  return (int64_t)((needed - bucket->level) / bucket->rate_per_ms) + 1;
+}
+
+// How long a request must wait before it can be admitted: 0 if it can be
+// now, -1 if it waits for a concurrency slot. Caller holds admission_lock.
+static int64_t admission_wait_ms(double tokens, int64_t now) {
+  if (in_flight >= (int)limit)
+    return -1;
+  int64_t requests_wait = bucket_wait_ms(&request_bucket, 1.0, now);
+  int64_t tokens_wait = bucket_wait_ms(&token_bucket, tokens, now);
+  return requests_wait > tokens_wait ? requests_wait : tokens_wait;
+}
+
+// Take a slot and charge the budgets. Caller holds admission_lock.
+static void admit(double tokens, int64_t now, AdmissionTicket *ticket) {
+  in_flight++;
+  if (request_bucket.rate_per_ms > 0)
+    request_bucket.level -= 1.0;
+  if (token_bucket.rate_per_ms > 0)
+    token_bucket.level -= tokens;
+  counters.admitted++;
+
+  ticket->admitted_at_ms = now;
+  ticket->tokens = tokens;
+  ticket->counted = 1;
+}
+
+static void queue_remove(Waiter *waiter) {
+  Waiter **link = &queue_head;
+  Waiter *prev = NULL;
+  while (*link && *link != waiter) {
+    prev = *link;
+    link = &(*link)->next;
+  }
+  if (!*link)
+    return;
+  *link = waiter->next;
+  if (queue_tail == waiter)
+    queue_tail = prev;
+  queued--;
+}
+
+// Let the request at the head of the queue re-check. Caller holds
+// admission_lock.
+static void wake_head(void) {
+  if (queue_head)
+    pthread_cond_signal(&queue_head->cond);
+}
+
+// Cancel hook ending a queued request's wait. Hooks run under the token's
+// lock, so admission_lock is never held while hooking or unhooking.
+static void wake_cancelled(void *arg) {
+  Waiter *waiter = (Waiter *)arg;
+  pthread_mutex_lock(&admission_lock);
+  waiter->cancelled = 1;
+  pthread_cond_signal(&waiter->cond);
+  pthread_mutex_unlock(&admission_lock);
+}
+
+/**
+ * Apply admission settings and reset the limit and budgets
+ */
+void admission_init(const AdmissionConfig *config) {
+  pthread_mutex_lock(&admission_lock);
+  int64_t now = retry_now_ms();
+  settings = *config;
+  active = config->enabled;
+  bucket_init(&request_bucket, config->requests_per_minute, now);
+  bucket_init(&token_bucket, config->tokens_per_minute, now);
+  limit = config->initial_concurrency;
+  in_flight = 0;
+  last_decrease_ms = 0;
+  latency_per_token = 0.0;
+  latency_samples = 0;
+  memset(&counters, 0, sizeof(counters));
+  pthread_mutex_unlock(&admission_lock);
+}
+
+/**
+ * Wait until a request may be sent
+ */
+AdmissionResult admission_acquire(double tokens, long timeout_ms,
+                                  VibeCancelToken *cancel,
+                                  AdmissionTicket *ticket) {
+  memset(ticket, 0, sizeof(*ticket));
+  pthread_mutex_lock(&admission_lock);
+  if (!active) {
+    pthread_mutex_unlock(&admission_lock);
+    return ADMISSION_ADMITTED;
+  }
+
+  int64_t now = retry_now_ms();
+  if (!queue_head && admission_wait_ms(tokens, now) == 0) {
+    admit(tokens, now, ticket);
+    pthread_mutex_unlock(&admission_lock);
+    return ADMISSION_ADMITTED;
+  }
+
+  if (queued >= settings.max_queue) {
+    counters.rejected++;
+    pthread_mutex_unlock(&admission_lock);
+    return ADMISSION_QUEUE_FULL;
+  }
+
+  int64_t deadline = 0;
+  if (settings.queue_timeout_ms > 0)
+    deadline = now + settings.queue_timeout_ms;
+  if (timeout_ms > 0 && (!deadline || now + timeout_ms < deadline))
+    deadline = now + timeout_ms;
+
+  Waiter waiter = {.cancelled = 0, .next = NULL};
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&waiter.cond, &attr);
+  pthread_condattr_destroy(&attr);
+  if (queue_tail)
+    queue_tail->next = &waiter;
+  else
+    queue_head = &waiter;
+  queue_tail = &waiter;
+  queued++;
+
+  // A wake-up missed while unlocked is harmless: the loop checks first
+  CancelHook hook;
+  int hooked = 0;
+  if (cancel) {
+    pthread_mutex_unlock(&admission_lock);
+    hooked = call_context_hook(cancel, &hook, wake_cancelled, &waiter);
+    pthread_mutex_lock(&admission_lock);
+    if (!hooked)
+      waiter.cancelled = 1; // Cancelled before it could be hooked
+  }
+
+  AdmissionResult result;
+  for (;;) {
+    if (waiter.cancelled) {
+      queue_remove(&waiter);
+      counters.cancelled++;
+      wake_head();
+      result = ADMISSION_CANCELLED;
+      break;
+    }
+
+    now = retry_now_ms();
+    int64_t until = 0;
+    if (queue_head == &waiter) {
+      int64_t wait = admission_wait_ms(tokens, now);
+      if (wait == 0) {
+        queue_remove(&waiter);
+        admit(tokens, now, ticket);
+        wake_head();
+        result = ADMISSION_ADMITTED;
+        break;
+      }
+      if (wait > 0)
+        until = now + wait; // Wait for the buckets to refill
+    }
+
+    if (deadline && now >= deadline) {
+      queue_remove(&waiter);
+      counters.timed_out++;
+      wake_head();
+      result = ADMISSION_TIMED_OUT;
+      break;
+    }
+    if (deadline && (!until || deadline < until))
+      until = deadline;
+
+    if (until) {
+      struct timespec ts = {(time_t)(until / 1000),
+                            (long)(until % 1000) * 1000000L};
+      pthread_cond_timedwait(&waiter.cond, &admission_lock, &ts);
+    } else {
+      pthread_cond_wait(&waiter.cond, &admission_lock);
+    }
+  }
+
+  pthread_mutex_unlock(&admission_lock);
+  if (hooked)
+    call_context_unhook(cancel, &hook);
+  pthread_cond_destroy(&waiter.cond);
+  return result;
+}
+
+/**
+ * Admit a request only if that is possible without waiting
+ */
+int admission_try_acquire(double tokens, AdmissionTicket *ticket) {
+  memset(ticket, 0, sizeof(*ticket));
+  pthread_mutex_lock(&admission_lock);
+  int admitted = !active;
+  if (active && !queue_head) {
+    int64_t now = retry_now_ms();
+    if (admission_wait_ms(tokens, now) == 0) {
+      admit(tokens, now, ticket);
+      admitted = 1;
+    }
+  }
+  pthread_mutex_unlock(&admission_lock);
+  return admitted;
+}
+
+// Check a successful request's latency against the per-token baseline and
+// fold it in. Caller holds admission_lock.
+static int latency_spiked(long latency_ms, long tokens) {
+  // Completion length dominates latency, so compare time per token
+  if (latency_ms < 0 || tokens <= 0)
+    return 0;
+  double per_token = (double)latency_ms / (double)tokens;
+  int spiked = settings.latency_spike_ratio > 0 &&
+               latency_samples >= LATENCY_MIN_SAMPLES &&
+               per_token > settings.latency_spike_ratio * latency_per_token;
+
+  if (latency_samples == 0)
+    latency_per_token = per_token;
+  else
+    latency_per_token += LATENCY_EWMA_ALPHA * (per_token - latency_per_token);
+  latency_samples++;
+  return spiked;
+}
+
+/**
+ * Release an admitted request and feed its outcome back to the limit
+ */
+void admission_release(AdmissionTicket *ticket, AdmissionOutcome outcome,
+                       long latency_ms, long actual_tokens) {
+  if (!ticket->counted)
+    return;
+  ticket->counted = 0;
+
+  pthread_mutex_lock(&admission_lock);
+  in_flight--;
+
+  // Settle the token estimate against what the provider reported
+  if (actual_tokens >= 0 && token_bucket.rate_per_ms > 0) {
+    token_bucket.level += ticket->tokens - (double)actual_tokens;
+    if (token_bucket.level > token_bucket.capacity)
+      token_bucket.level = token_bucket.capacity;
+  }
+
+  int overloaded = outcome == ADMISSION_OVERLOADED;
+  if (outcome == ADMISSION_SUCCEEDED)
+    overloaded = latency_spiked(latency_ms, actual_tokens);
+
+  if (overloaded) {
+    // React once per congestion episode: requests admitted before the last
+    // cut were already sent under the old limit
+    if (ticket->admitted_at_ms >= last_decrease_ms) {
+      limit *= settings.backoff_ratio;
+      if (limit < settings.min_concurrency)
+        limit = settings.min_concurrency;
+      last_decrease_ms = retry_now_ms();
+      counters.decreases++;
+      WARN("LLM provider overloaded; concurrency limit lowered to %d",
+           (int)limit);
+    }
+  } else if (outcome == ADMISSION_SUCCEEDED) {
+    // Additive increase: about one slot per round of successful requests
+    limit += 1.0 / limit;
+    if (limit > settings.max_concurrency)
+      limit = settings.max_concurrency;
+  }
+
+  wake_head();
+  pthread_mutex_unlock(&admission_lock);
+}
+
+/**
+ * Get the admission counters
+ */
+void admission_stats(AdmissionStats *stats) {
+  pthread_mutex_lock(&admission_lock);
+  *stats = counters;
+  stats->limit = limit;
+  stats->in_flight = in_flight;
+  stats->queued = queued;
+  pthread_mutex_unlock(&admission_lock);
+}
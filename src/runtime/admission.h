@@ -0,0 +1,122 @@
+/**
+ * @file admission.h
+ * @brief Client-side admission control for LLM requests
+ *
+ * Every request passes through admission before it reaches the transport.
+ * Two token buckets keep requests and tokens per minute under the provider's
+ * rate limits, and an AIMD limit on concurrent requests grows by one per
+ * round of successful requests and is cut multiplicatively when the provider
+ * signals overload (429, 503, time outs or latency spikes). Requests that
+ * cannot be admitted wait in a bounded FIFO queue; when it is full, or a
+ * request has waited too long, the request is refused instead of adding to
+ * the storm. A queued request whose call is cancelled leaves the queue at
+ * once.
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "../../include/runtime.h"
+#include "config.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ADMISSION_ADMITTED,
+  ADMISSION_QUEUE_FULL, // Too many requests already waiting
+  ADMISSION_TIMED_OUT,  // Waited longer than allowed
+  ADMISSION_CANCELLED   // The call was cancelled while waiting
+} AdmissionResult;
+
+/**
+ * How an admitted request ended, which drives the concurrency limit
+ */
+typedef enum {
+  ADMISSION_SUCCEEDED,  // Completed normally
+  ADMISSION_OVERLOADED, // The provider pushed back; shrink the limit
+  ADMISSION_FAILED,     // Failed for reasons that say nothing about load
+  ADMISSION_ABANDONED   // Cancelled by the caller
+} AdmissionOutcome;
+
+/**
+ * Proof of admission, handed back on release
+ */
+typedef struct {
+  int64_t admitted_at_ms; // Monotonic time of admission
+  double tokens;          // Tokens charged against the per-minute budget
+  int counted;            // Whether the request holds a concurrency slot
+} AdmissionTicket;
+
+/**
+ * Counters describing admission control
+ */
+typedef struct {
+  double limit;       // Current concurrency limit
+  int in_flight;      // Requests holding a slot
+  int queued;         // Requests waiting for admission
+  uint64_t admitted;  // Requests admitted since the runtime started
+  uint64_t rejected;  // Requests refused because the queue was full
+  uint64_t timed_out; // Requests refused after waiting too long
+  uint64_t cancelled; // Requests whose call was cancelled while waiting
+  uint64_t decreases; // Times the limit was cut for overload
+} AdmissionStats;
+
+/**
+ * Apply admission settings and reset the limit and budgets
+ *
+ * @param config The admission settings
+ */
+void admission_init(const AdmissionConfig *config);
+
+/**
+ * Wait until a request may be sent
+ *
+ * @param tokens Estimated tokens the request will consume
+ * @param timeout_ms Longest the caller can wait, on top of the configured
+ * queue timeout (0 = no limit of its own)
+ * @param cancel The call's cancel token, which ends the wait when cancelled,
+ * may be NULL
+ * @param ticket Receives the admission, to be passed to admission_release
+ * @return ADMISSION_ADMITTED, or why the request was refused
+ */
+AdmissionResult admission_acquire(double tokens, long timeout_ms,
+                                  VibeCancelToken *cancel,
+                                  AdmissionTicket *ticket);
+
+/**
+ * Admit a request only if that is possible without waiting, for optional
+ * extra traffic such as hedged duplicates
+ *
+ * @param tokens Estimated tokens the request will consume
+ * @param ticket Receives the admission
+ * @return 1 if admitted, 0 otherwise
+ */
+int admission_try_acquire(double tokens, AdmissionTicket *ticket);
+
+/**
+ * Release an admitted request and feed its outcome back to the limit
+ *
+ * @param ticket The ticket from admission
+ * @param outcome How the request ended
+ * @param latency_ms How long the request took, or -1 if not comparable
+ * (streams)
+ * @param actual_tokens Tokens the provider reported, or -1 if unknown
+ */
+void admission_release(AdmissionTicket *ticket, AdmissionOutcome outcome,
+                       long latency_ms, long actual_tokens);
+
+/**
+ * Get the admission counters
+ *
+ * @param stats Receives the counters
+ */
+void admission_stats(AdmissionStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADMISSION_H */
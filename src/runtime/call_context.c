@@ -0,0 +1,206 @@
+/**
+ * @file call_context.c
+ * @brief Deadlines and cancellation for prompt calls
+ */
+
+#include "call_context.h"
+#include "../utils/log_utils.h"
+#include "retry_policy.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct VibeCancelToken {
+  pthread_mutex_t lock;
+  pthread_cond_t cond; // Monotonic; wakes cancellable sleeps
+  int cancelled;
+  CancelHook *hooks;
+};
+
+// The calling thread's context; generated code never sees it directly
+static _Thread_local VibeCallContext current_context = {0, NULL};
+
+/**
+ * Create a cancellation token
+ */
+VibeCancelToken *vibe_cancel_token_create(void) {
+  VibeCancelToken *token = calloc(1, sizeof(VibeCancelToken));
+  if (!token) {
+    ERROR("Failed to allocate cancellation token");
+    return NULL;
+  }
+
+  pthread_mutex_init(&token->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&token->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  return token;
+}
+
+/**
+ * Cancel every prompt call attached to the token
+ */
+void vibe_cancel_token_cancel(VibeCancelToken *token) {
+  if (!token)
+    return;
+
+  pthread_mutex_lock(&token->lock);
+  if (!token->cancelled) {
+    token->cancelled = 1;
+    for (CancelHook *hook = token->hooks; hook; hook = hook->next)
+      hook->fn(hook->arg);
+    pthread_cond_broadcast(&token->cond);
+  }
+  pthread_mutex_unlock(&token->lock);
+}
+
+/**
+ * Check whether a token has been cancelled
+ */
+int vibe_cancel_token_is_cancelled(VibeCancelToken *token) {
+  return call_context_cancelled(token);
+}
+
+/**
+ * Free a token
+ */
+void vibe_cancel_token_free(VibeCancelToken *token) {
+  if (!token)
+    return;
+  pthread_cond_destroy(&token->cond);
+  pthread_mutex_destroy(&token->lock);
+  free(token);
+}
+
+/**
+ * Bound the prompt calls the calling thread makes from now on
+ */
+VibeCallContext vibe_call_context_enter(long timeout_ms,
+                                        VibeCancelToken *cancel) {
+  VibeCallContext previous = current_context;
+  if (timeout_ms > 0) {
+    long long deadline = (long long)retry_now_ms() + timeout_ms;
+    if (!current_context.deadline_ms || deadline < current_context.deadline_ms)
+      current_context.deadline_ms = deadline;
+  }
+  if (cancel)
+    current_context.cancel = cancel;
+  return previous;
+}
+
+/**
+ * Restore the context that vibe_call_context_enter replaced
+ */
+void vibe_call_context_restore(VibeCallContext previous) {
+  current_context = previous;
+}
+
+/**
+ * Get the calling thread's context
+ */
+VibeCallContext vibe_call_context_current(void) { return current_context; }
+
+/**
+ * Check whether a token has been cancelled
+ */
+int call_context_cancelled(VibeCancelToken *token) {
+  if (!token)
+    return 0;
+  pthread_mutex_lock(&token->lock);
+  int cancelled = token->cancelled;
+  pthread_mutex_unlock(&token->lock);
+  return cancelled;
+}
+
+/**
+ * Register a hook to run when a token is cancelled
+ */
+int call_context_hook(VibeCancelToken *token, CancelHook *hook,
+                      cancel_hook_fn fn, void *arg) {
+  hook->fn = fn;
+  hook->arg = arg;
+  hook->prev = NULL;
+  hook->next = NULL;
+  if (!token)
+    return 1;
+
+  pthread_mutex_lock(&token->lock);
+  int cancelled = token->cancelled;
+  if (!cancelled) {
+    hook->next = token->hooks;
+    if (token->hooks)
+      token->hooks->prev = hook;
+    token->hooks = hook;
+  }
+  pthread_mutex_unlock(&token->lock);
+  return !cancelled;
+}
+
+/**
+ * Remove a hook registered with call_context_hook
+ */
+void call_context_unhook(VibeCancelToken *token, CancelHook *hook) {
+  if (!token)
+    return;
+
+  pthread_mutex_lock(&token->lock);
+  if (hook->prev)
+    hook->prev->next = hook->next;
+  else
+    token->hooks = hook->next;
+  if (hook->next)
+    hook->next->prev = hook->prev;
+  pthread_mutex_unlock(&token->lock);
+}
+
+/**
+ * Sleep unless or until the token is cancelled
+ */
+int call_context_sleep(VibeCancelToken *token, long delay_ms) {
+  if (!token) {
+    retry_sleep_ms(delay_ms);
+    return 1;
+  }
+
+  struct timespec until;
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  until.tv_sec += delay_ms / 1000;
+  until.tv_nsec += (delay_ms % 1000) * 1000000L;
+  if (until.tv_nsec >= 1000000000L) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&token->lock);
+  while (!token->cancelled &&
+         pthread_cond_timedwait(&token->cond, &token->lock, &until) !=
+             ETIMEDOUT)
+    ;
+  int slept = !token->cancelled;
+  pthread_mutex_unlock(&token->lock);
+  return slept;
+}
+
+/**
+ * Tell whether a context has ended
+ */
+VibeError call_context_status(VibeCallContext context) {
+  if (call_context_cancelled(context.cancel))
+    return VIBE_ERROR_CANCELLED;
+  if (context.deadline_ms && context.deadline_ms <= retry_now_ms())
+    return VIBE_ERROR_TIMEOUT;
+  return VIBE_SUCCESS;
+}
+
+/**
+ * Get the time left before a deadline
+ */
+long call_context_remaining_ms(int64_t deadline_ms, long limit_ms) {
+  if (!deadline_ms)
+    return limit_ms;
+  int64_t remaining = deadline_ms - retry_now_ms();
+  return remaining < limit_ms ? (long)remaining : limit_ms;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file call_context.h
+ * @brief Deadlines and cancellation for prompt calls
+ *
+ * Every thread has an ambient call context: a deadline on the runtime's
+ * monotonic clock and a cancellation token, both optional. Prompt calls take
+ * the context of the thread that makes them, so generated functions honour
+ * their caller's budget without any extra parameter. Work that can block for
+ * long (transfers, retry backoff, waits for a coalesced request) registers a
+ * hook with the token so that cancelling it interrupts the work at once.
+ */
+
+#ifndef CALL_CONTEXT_H
+#define CALL_CONTEXT_H
+
+#include "../../include/runtime.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Action run when a token is cancelled. It runs with the token locked, so it
+ * must not block or touch the token.
+ */
+typedef void (*cancel_hook_fn)(void *arg);
+
+/**
+ * Registration of a cancel hook, owned by the caller (usually on its stack)
+ */
+typedef struct CancelHook {
+  cancel_hook_fn fn;
+  void *arg;
+  struct CancelHook *prev;
+  struct CancelHook *next;
+} CancelHook;
+
+/**
+ * Check whether a token has been cancelled
+ *
+ * @param token The token, may be NULL
+ * @return 1 if cancelled, 0 otherwise or for a NULL token
+ */
+int call_context_cancelled(VibeCancelToken *token);
+
+/**
+ * Register a hook to run when a token is cancelled
+ *
+ * @param token The token, may be NULL
+ * @param hook The registration to link in
+ * @param fn The action to run
+ * @param arg Passed to fn
+ * @return 1 if registered, 0 if the token is already cancelled (fn is not
+ * run and the hook must not be removed)
+ */
+int call_context_hook(VibeCancelToken *token, CancelHook *hook,
+                      cancel_hook_fn fn, void *arg);
+
+/**
+ * Remove a hook registered with call_context_hook. Once this returns, the
+ * hook's action is not running and will not run.
+ *
+ * @param token The token the hook was registered with, may be NULL
+ * @param hook The registration to unlink
+ */
+void call_context_unhook(VibeCancelToken *token, CancelHook *hook);
+
+/**
+ * Sleep unless or until the token is cancelled
+ *
+ * @param token The token, may be NULL
+ * @param delay_ms The delay
+ * @return 1 if the full delay elapsed, 0 if cancelled
+ */
+int call_context_sleep(VibeCancelToken *token, long delay_ms);
+
+/**
+ * Tell whether a context has ended
+ *
+ * @param context The context
+ * @return VIBE_ERROR_CANCELLED if its token was cancelled, VIBE_ERROR_TIMEOUT
+ * if its deadline passed, VIBE_SUCCESS otherwise
+ */
+VibeError call_context_status(VibeCallContext context);
+
+/**
+ * Get the time left before a deadline
+ *
+ * @param deadline_ms The deadline on the monotonic clock, 0 for none
+ * @param limit_ms Returned when the deadline is further away or absent
+ * @return Milliseconds left, capped at limit_ms; 0 or less once passed
+ */
+long call_context_remaining_ms(int64_t deadline_ms, long limit_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CALL_CONTEXT_H */
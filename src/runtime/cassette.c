@@ -0,0 +1,473 @@
+/**
+ * @file cassette.c
+ * @brief Record/replay of LLM calls through an indexed cassette file
+ */
+
+#include "cassette.h"
+#include "../utils/log_utils.h"
+#include "retry_policy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CASSETTE_MAGIC "VIBECAS1"
+#define INDEX_MAGIC "VIBEIDX1"
+#define MAGIC_LENGTH 8
+#define RECORD_MAGIC 0x43455256u // "VREC"
+
+// The index is kept at most half full so probes stay short
+#define MIN_INDEX_SLOTS 16
+
+typedef struct {
+  uint32_t magic;
+  uint32_t latency_ms;
+  uint64_t hash;
+  uint32_t key_length;
+  uint32_t response_length;
+} RecordHeader;
+
+typedef struct {
+  uint64_t hash;
+  uint64_t offset; // Of the record; 0 marks an empty slot
+} IndexSlot;
+
+typedef struct {
+  uint64_t index_offset; // Also the end of the records
+  uint64_t slot_count;
+  char magic[MAGIC_LENGTH];
+} IndexFooter;
+
+// Published with release once the state below is ready
+static atomic_int mode = CASSETTE_OFF;
+static CassetteConfig settings;
+
+// Replay: the mapped cassette and the index probed in it
+static const unsigned char *mapped = NULL;
+static size_t mapped_size = 0;
+static size_t records_end = 0;
+static const IndexSlot *slots = NULL;
+static IndexSlot *built_slots = NULL; // Owned when indexed in memory
+static uint64_t slot_mask = 0;
+
+// Record: appends are serialized
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static int record_fd = -1;
+static size_t record_end = 0;
+
+static size_t record_size(const RecordHeader *header) {
+  size_t size = sizeof(RecordHeader) + (size_t)header->key_length +
+                (size_t)header->response_length;
+  return (size + 7) & ~(size_t)7;
+}
+
+// Find the end of the complete records before end, counting them
+static size_t scan_records(const unsigned char *base, size_t end,
+                           size_t *count) {
+  size_t offset = MAGIC_LENGTH;
+  *count = 0;
+  while (end - offset >= sizeof(RecordHeader)) {
+    RecordHeader header;
+    memcpy(&header, base + offset, sizeof(header));
+    if (header.magic != RECORD_MAGIC || record_size(&header) > end - offset)
+      break;
+    offset += record_size(&header);
+    (*count)++;
+  }
+  return offset;
+}
+
+// Check for an index written by a completed recording
+static int read_footer(const unsigned char *base, size_t size,
+                       IndexFooter *footer) {
+  if (size < MAGIC_LENGTH + sizeof(IndexFooter))
+    return 0;
+  memcpy(footer, base + size - sizeof(IndexFooter), sizeof(IndexFooter));
+  if (memcmp(footer->magic, INDEX_MAGIC, MAGIC_LENGTH) != 0)
+    return 0;
+
+  uint64_t count = footer->slot_count;
+  if (count == 0 || (count & (count - 1)) != 0 ||
+      count > size / sizeof(IndexSlot) ||
+      footer->index_offset < MAGIC_LENGTH || footer->index_offset % 8 != 0)
+    return 0;
+  return footer->index_offset + count * sizeof(IndexSlot) +
+             sizeof(IndexFooter) ==
+         size;
+}
+
+static int record_key_equals(const unsigned char *base, uint64_t offset,
+                             const char *key, size_t length) {
+  RecordHeader header;
+  memcpy(&header, base + offset, sizeof(header));
+  return header.key_length == length &&
+         memcmp(base + offset + sizeof(header), key, length) == 0;
+}
+
+// Index the complete records before end. A request recorded more than once
+// is answered with its first recording.
+static IndexSlot *build_index(const unsigned char *base, size_t end,
+                              size_t count, uint64_t *slot_count) {
+  uint64_t size = MIN_INDEX_SLOTS;
+  while (size < (uint64_t)count * 2)
+    size <<= 1;
+
+  IndexSlot *table = calloc(size, sizeof(IndexSlot));
+  if (!table) {
+    ERROR("Failed to allocate cassette index");
+    return NULL;
+  }
+
+  for (size_t offset = MAGIC_LENGTH; offset < end;) {
+    RecordHeader header;
+    memcpy(&header, base + offset, sizeof(header));
+    const char *key = (const char *)base + offset + sizeof(header);
+
+    for (uint64_t i = header.hash & (size - 1);; i = (i + 1) & (size - 1)) {
+      if (table[i].offset == 0) {
+        table[i].hash = header.hash;
+        table[i].offset = offset;
+        break;
+      }
+      if (table[i].hash == header.hash &&
+          record_key_equals(base, table[i].offset, key, header.key_length))
+        break;
+    }
+    offset += record_size(&header);
+  }
+
+  *slot_count = size;
+  return table;
+}
+
+static int write_all(int fd, const void *data, size_t length) {
+  const char *cursor = data;
+  while (length > 0) {
+    ssize_t written = write(fd, cursor, length);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    cursor += written;
+    length -= (size_t)written;
+  }
+  return 1;
+}
+
+static int open_replay(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    ERROR("Cannot open cassette %s: %s", path, strerror(errno));
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < MAGIC_LENGTH) {
+    ERROR("Not a cassette: %s", path);
+    close(fd);
+    return 0;
+  }
+
+  void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    ERROR("Cannot map cassette %s: %s", path, strerror(errno));
+    return 0;
+  }
+  if (memcmp(base, CASSETTE_MAGIC, MAGIC_LENGTH) != 0) {
+    ERROR("Not a cassette: %s", path);
+    munmap(base, (size_t)st.st_size);
+    return 0;
+  }
+
+  mapped = base;
+  mapped_size = (size_t)st.st_size;
+
+  IndexFooter footer;
+  if (read_footer(mapped, mapped_size, &footer)) {
+    records_end = footer.index_offset;
+    slots = (const IndexSlot *)(mapped + footer.index_offset);
+    slot_mask = footer.slot_count - 1;
+  } else {
+    // The recording was interrupted before it wrote an index
+    size_t count;
+    records_end = scan_records(mapped, mapped_size, &count);
+    WARN("Cassette %s has no index, indexing %zu records", path, count);
+
+    uint64_t slot_count;
+    built_slots = build_index(mapped, records_end, count, &slot_count);
+    if (!built_slots) {
+      munmap((void *)mapped, mapped_size);
+      mapped = NULL;
+      return 0;
+    }
+    slots = built_slots;
+    slot_mask = slot_count - 1;
+  }
+
+  INFO("Replaying LLM calls from %s", path);
+  return 1;
+}
+
+static int open_record(const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    ERROR("Cannot open cassette %s: %s", path, strerror(errno));
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ERROR("Cannot open cassette %s: %s", path, strerror(errno));
+    close(fd);
+    return 0;
+  }
+
+  size_t end = MAGIC_LENGTH;
+  if (st.st_size == 0) {
+    if (!write_all(fd, CASSETTE_MAGIC, MAGIC_LENGTH)) {
+      ERROR("Cannot write cassette %s: %s", path, strerror(errno));
+      close(fd);
+      return 0;
+    }
+  } else {
+    // Extend an existing cassette: keep its records and drop the index,
+    // which is rewritten on close
+    size_t size = (size_t)st.st_size;
+    void *base = size >= MAGIC_LENGTH
+                     ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    if (base == MAP_FAILED || memcmp(base, CASSETTE_MAGIC, MAGIC_LENGTH)) {
+      ERROR("Refusing to record over %s, which is not a cassette", path);
+      if (base != MAP_FAILED)
+        munmap(base, size);
+      close(fd);
+      return 0;
+    }
+
+    IndexFooter footer;
+    size_t count;
+    end = read_footer(base, size, &footer)
+              ? (size_t)footer.index_offset
+              : scan_records(base, size, &count);
+    munmap(base, size);
+
+    if (ftruncate(fd, (off_t)end) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+      ERROR("Cannot truncate cassette %s: %s", path, strerror(errno));
+      close(fd);
+      return 0;
+    }
+  }
+
+  record_fd = fd;
+  record_end = end;
+  INFO("Recording LLM calls to %s", path);
+  return 1;
+}
+
+// Append the index over everything recorded
+static void write_index(void) {
+  void *base = mmap(NULL, record_end, PROT_READ, MAP_SHARED, record_fd, 0);
+  if (base == MAP_FAILED) {
+    WARN("Cannot index cassette: %s", strerror(errno));
+    return;
+  }
+
+  size_t count;
+  scan_records(base, record_end, &count);
+  IndexFooter footer = {record_end, 0, INDEX_MAGIC};
+  IndexSlot *table = build_index(base, record_end, count, &footer.slot_count);
+  munmap(base, record_end);
+  if (!table)
+    return;
+
+  if (!write_all(record_fd, table, footer.slot_count * sizeof(IndexSlot)) ||
+      !write_all(record_fd, &footer, sizeof(footer))) {
+    WARN("Cannot index cassette: %s", strerror(errno));
+    // Without an index the cassette is still usable, just slower to open
+    if (ftruncate(record_fd, (off_t)record_end) != 0)
+      WARN("Cannot truncate cassette: %s", strerror(errno));
+  }
+  free(table);
+}
+
+/**
+ * Open the cassette the configuration names
+ */
+int cassette_open(const CassetteConfig *config) {
+  cassette_close();
+  if (config->mode == CASSETTE_OFF)
+    return 1;
+
+  settings = *config;
+  settings.path = NULL; // Owned by the configuration
+  int opened = config->mode == CASSETTE_RECORD ? open_record(config->path)
+                                               : open_replay(config->path);
+  if (opened)
+    atomic_store_explicit(&mode, config->mode, memory_order_release);
+  return opened;
+}
+
+/**
+ * Close the cassette
+ */
+void cassette_close(void) {
+  CassetteMode previous = (CassetteMode)atomic_exchange_explicit(
+      &mode, CASSETTE_OFF, memory_order_acq_rel);
+
+  if (previous == CASSETTE_RECORD) {
+    pthread_mutex_lock(&record_lock);
+    write_index();
+    close(record_fd);
+    record_fd = -1;
+    pthread_mutex_unlock(&record_lock);
+  } else if (previous == CASSETTE_REPLAY) {
+    munmap((void *)mapped, mapped_size);
+    free(built_slots);
+    mapped = NULL;
+    built_slots = NULL;
+    slots = NULL;
+  }
+}
+
+/**
+ * Get the mode of the open cassette
+ */
+CassetteMode cassette_mode(void) {
+  return (CassetteMode)atomic_load_explicit(&mode, memory_order_acquire);
+}
+
+// Draw the delay for a replayed call
+static long simulated_latency_ms(uint32_t recorded_ms) {
+  switch (settings.latency) {
+  case LATENCY_RECORDED:
+    return (long)recorded_ms;
+  case LATENCY_FIXED:
+    return (long)settings.median_ms;
+  case LATENCY_UNIFORM:
+    return (long)(settings.min_ms +
+                  retry_random() * (settings.max_ms - settings.min_ms));
+  case LATENCY_LOGNORMAL: {
+    // Box-Muller; 1 - u keeps the logarithm finite
+    double u = 1.0 - retry_random();
+    double v = retry_random();
+    double normal = sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+    return (long)(settings.median_ms * exp(settings.sigma * normal));
+  }
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Answer a call from the cassette
+ */
+char *cassette_replay(const ResponseCacheKey *key, VibeCallContext context,
+                      VibeError *error) {
+  *error = VIBE_ERROR_GENERAL;
+  if (cassette_mode() != CASSETTE_REPLAY)
+    return NULL;
+
+  // A call that has ended gets no answer, recorded or not
+  *error = call_context_status(context);
+  if (*error != VIBE_SUCCESS)
+    return NULL;
+  *error = VIBE_ERROR_GENERAL;
+
+  for (uint64_t probe = 0, i = key->hash & slot_mask; probe <= slot_mask;
+       probe++, i = (i + 1) & slot_mask) {
+    IndexSlot slot = slots[i];
+    if (slot.offset == 0)
+      break;
+    if (slot.hash != key->hash || slot.offset < MAGIC_LENGTH ||
+        slot.offset + sizeof(RecordHeader) > records_end)
+      continue;
+
+    RecordHeader header;
+    memcpy(&header, mapped + slot.offset, sizeof(header));
+    if (record_size(&header) > records_end - slot.offset ||
+        !record_key_equals(mapped, slot.offset, key->material, key->length))
+      continue;
+
+    char *response = malloc((size_t)header.response_length + 1);
+    if (!response) {
+      ERROR("Failed to allocate replayed response");
+      return NULL;
+    }
+    memcpy(response, mapped + slot.offset + sizeof(header) + key->length,
+           header.response_length);
+    response[header.response_length] = '\0';
+
+    // The simulated wait ends with the call, like a real transfer would
+    long delay_ms = simulated_latency_ms(header.latency_ms);
+    if (delay_ms > 0) {
+      long wait_ms = call_context_remaining_ms(context.deadline_ms, delay_ms);
+      int slept = wait_ms > 0 && call_context_sleep(context.cancel, wait_ms);
+      if (!slept || wait_ms < delay_ms) {
+        // Cut short by the deadline even if the clock reads just before it
+        free(response);
+        *error = call_context_status(context);
+        if (*error == VIBE_SUCCESS)
+          *error = VIBE_ERROR_TIMEOUT;
+        return NULL;
+      }
+    }
+    *error = VIBE_SUCCESS;
+    return response;
+  }
+  return NULL;
+}
+
+/**
+ * Append a call to the cassette being recorded
+ */
+void cassette_record(const ResponseCacheKey *key, const char *response,
+                     long latency_ms) {
+  if (cassette_mode() != CASSETTE_RECORD)
+    return;
+
+  size_t response_length = strlen(response);
+  if (key->length > UINT32_MAX || response_length > UINT32_MAX) {
+    WARN("Not recording a call too large for the cassette");
+    return;
+  }
+
+  RecordHeader header = {RECORD_MAGIC,
+                         latency_ms < 0            ? 0
+                         : latency_ms > UINT32_MAX ? UINT32_MAX
+                                                   : (uint32_t)latency_ms,
+                         key->hash, (uint32_t)key->length,
+                         (uint32_t)response_length};
+  size_t size = record_size(&header);
+  unsigned char *record = calloc(1, size);
+  if (!record) {
+    ERROR("Failed to allocate cassette record");
+    return;
+  }
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), key->material, key->length);
+  memcpy(record + sizeof(header) + key->length, response, response_length);
+
+  pthread_mutex_lock(&record_lock);
+  if (record_fd >= 0) {
+    if (write_all(record_fd, record, size)) {
+      record_end += size;
+    } else {
+      // Cut off the partial record so later appends stay readable
+      WARN("Cannot append to cassette: %s", strerror(errno));
+      if (ftruncate(record_fd, (off_t)record_end) != 0 ||
+          lseek(record_fd, 0, SEEK_END) < 0)
+        WARN("Cannot truncate cassette: %s", strerror(errno));
+    }
+  }
+  pthread_mutex_unlock(&record_lock);
+  free(record);
+}
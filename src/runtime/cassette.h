@@ -0,0 +1,86 @@
+/**
+ * @file cassette.h
+ * @brief Record/replay of LLM calls through an indexed cassette file
+ *
+ * In record mode every successful call is appended to the cassette as a
+ * request/response pair, keyed like the response cache: endpoint, model,
+ * generation parameters, meaning and prompt. Closing the cassette writes a
+ * hash index after the records. In replay mode the file is memory-mapped and
+ * calls are answered by probing that index, with no network involved and an
+ * optional simulated latency, so compiled modules can be benchmarked and
+ * tested deterministically.
+ *
+ * Layout, in host byte order:
+ *
+ *   "VIBECAS1"
+ *   record*   {magic, latency_ms, hash, key_length, response_length,
+ *              key, response, padding to 8 bytes}
+ *   slot*     {hash, record offset}, a power of two, 0 offset = empty
+ *   footer    {index offset, slot count, "VIBEIDX1"}
+ *
+ * A cassette whose recording was interrupted has no footer; it is replayed by
+ * indexing its complete records in memory and extended when recorded again.
+ */
+
+#ifndef CASSETTE_H
+#define CASSETTE_H
+
+#include "call_context.h"
+#include "config.h"
+#include "response_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Open the cassette the configuration names. Does nothing when the mode is
+ * off.
+ *
+ * @param config The cassette settings
+ * @return 1 on success, 0 if the file cannot be opened or is not a cassette
+ */
+int cassette_open(const CassetteConfig *config);
+
+/**
+ * Close the cassette, writing the index if it was being recorded
+ */
+void cassette_close(void);
+
+/**
+ * Get the mode of the open cassette
+ *
+ * @return CASSETTE_OFF unless a cassette is open
+ */
+CassetteMode cassette_mode(void);
+
+/**
+ * Answer a call from the cassette, after the simulated latency. The latency
+ * is cut short when the call's deadline passes or its token is cancelled,
+ * and a call that has already ended is not answered.
+ *
+ * @param key The request key
+ * @param context The call's deadline and cancellation token
+ * @param error Receives VIBE_SUCCESS, VIBE_ERROR_TIMEOUT or
+ * VIBE_ERROR_CANCELLED if the call ended first, or VIBE_ERROR_GENERAL if
+ * the request was never recorded
+ * @return A copy of the recorded response the caller must free, or NULL
+ */
+char *cassette_replay(const ResponseCacheKey *key, VibeCallContext context,
+                      VibeError *error);
+
+/**
+ * Append a call to the cassette being recorded
+ *
+ * @param key The request key
+ * @param response The response the call produced
+ * @param latency_ms How long the call took
+ */
+void cassette_record(const ResponseCacheKey *key, const char *response,
+                     long latency_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CASSETTE_H */
@@ -0,0 +1,382 @@
+/**
+ * @file completion_parser.c
+ * @brief Single-pass extraction of fields from chat completion responses
+ */
+
+#include "completion_parser.h"
+#include <stdint.h>
+#include <string.h>
+
+// Position in the document being scanned
+typedef struct {
+  char *p;
+  char *end;
+} Scanner;
+
+typedef int (*member_fn)(Scanner *s, const char *key, size_t key_length,
+                         CompletionFields *fields);
+
+static inline char peek(const Scanner *s) { return s->p < s->end ? *s->p : 0; }
+
+static inline void skip_whitespace(Scanner *s) {
+  while (s->p < s->end &&
+         (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t'))
+    s->p++;
+}
+
+static inline int expect(Scanner *s, char c) {
+  skip_whitespace(s);
+  if (peek(s) != c)
+    return 0;
+  s->p++;
+  return 1;
+}
+
+static inline int key_is(const char *key, size_t length, const char *name) {
+  size_t name_length = strlen(name);
+  return length == name_length && memcmp(key, name, length) == 0;
+}
+
+// Skip a string starting at its opening quote. Quotes are found with memchr;
+// one is escaped only if an odd run of backslashes precedes it.
+static int skip_string(Scanner *s) {
+  char *start = ++s->p;
+  for (;;) {
+    char *quote = memchr(s->p, '"', (size_t)(s->end - s->p));
+    if (!quote)
+      return 0;
+
+    size_t backslashes = 0;
+    while (quote - backslashes > start && quote[-1 - (long)backslashes] == '\\')
+      backslashes++;
+
+    s->p = quote + 1;
+    if (backslashes % 2 == 0)
+      return 1;
+  }
+}
+
+// Skip any value; containers are skipped iteratively by tracking depth
+static int skip_value(Scanner *s) {
+  skip_whitespace(s);
+  char c = peek(s);
+
+  if (c == '"')
+    return skip_string(s);
+
+  if (c == '{' || c == '[') {
+    int depth = 0;
+    while (s->p < s->end) {
+      c = *s->p;
+      if (c == '"') {
+        if (!skip_string(s))
+          return 0;
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 0) {
+          s->p++;
+          return 1;
+        }
+      }
+      s->p++;
+    }
+    return 0;
+  }
+
+  // Numbers and literals run until the next delimiter
+  char *start = s->p;
+  while (s->p < s->end && *s->p != ',' && *s->p != '}' && *s->p != ']' &&
+         *s->p != ' ' && *s->p != '\n' && *s->p != '\r' && *s->p != '\t')
+    s->p++;
+  return s->p > start;
+}
+
+static int hex_value(const char *digits, uint32_t *value) {
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = digits[i];
+    *value <<= 4;
+    if (c >= '0' && c <= '9')
+      *value |= (uint32_t)(c - '0');
+    else if (c >= 'a' && c <= 'f')
+      *value |= (uint32_t)(c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F')
+      *value |= (uint32_t)(c - 'A' + 10);
+    else
+      return 0;
+  }
+  return 1;
+}
+
+static char *put_utf8(char *out, uint32_t code) {
+  if (code < 0x80) {
+    *out++ = (char)code;
+  } else if (code < 0x800) {
+    *out++ = (char)(0xC0 | (code >> 6));
+    *out++ = (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    *out++ = (char)(0xE0 | (code >> 12));
+    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (code & 0x3F));
+  } else {
+    *out++ = (char)(0xF0 | (code >> 18));
+    *out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (code & 0x3F));
+  }
+  return out;
+}
+
+// Decode a \u escape (the scanner is past the 'u'), combining surrogate
+// pairs. Lone surrogates become U+FFFD.
+static int decode_unicode(Scanner *s, char **out) {
+  uint32_t code;
+  if (s->end - s->p < 4 || !hex_value(s->p, &code))
+    return 0;
+  s->p += 4;
+
+  if (code >= 0xD800 && code <= 0xDBFF) {
+    uint32_t low;
+    if (s->end - s->p >= 6 && s->p[0] == '\\' && s->p[1] == 'u' &&
+        hex_value(s->p + 2, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+      s->p += 6;
+      code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    } else {
+      code = 0xFFFD;
+    }
+  } else if (code >= 0xDC00 && code <= 0xDFFF) {
+    code = 0xFFFD;
+  }
+
+  *out = put_utf8(*out, code);
+  return 1;
+}
+
+// Unescape a string in place. Decoded text never outgrows its source, so
+// the write cursor trails the read cursor; clean runs between escapes are
+// located with memchr and moved in bulk.
+static int parse_string(Scanner *s, char **value, size_t *length) {
+  char *out = ++s->p;
+  *value = out;
+
+  for (;;) {
+    char *quote = memchr(s->p, '"', (size_t)(s->end - s->p));
+    if (!quote)
+      return 0;
+    char *escape = memchr(s->p, '\\', (size_t)(quote - s->p));
+    char *run_end = escape ? escape : quote;
+
+    size_t run = (size_t)(run_end - s->p);
+    if (out != s->p)
+      memmove(out, s->p, run);
+    out += run;
+    s->p = run_end;
+
+    if (!escape) {
+      s->p = quote + 1;
+      break;
+    }
+
+    if (s->end - s->p < 2)
+      return 0;
+    char c = s->p[1];
+    s->p += 2;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      *out++ = c;
+      break;
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'u':
+      if (!decode_unicode(s, &out))
+        return 0;
+      break;
+    default:
+      return 0;
+    }
+  }
+
+  *length = (size_t)(out - *value);
+  *out = '\0'; // At worst this overwrites the closing quote
+  return 1;
+}
+
+// Parse a string that may also be null
+static int parse_nullable_string(Scanner *s, char **value, size_t *length) {
+  skip_whitespace(s);
+  if (peek(s) == '"') {
+    size_t ignored;
+    return parse_string(s, value, length ? length : &ignored);
+  }
+
+  *value = NULL;
+  if (length)
+    *length = 0;
+  return skip_value(s);
+}
+
+// Parse an integer without strtol, so the C locale never matters
+static int parse_long(Scanner *s, long *value) {
+  skip_whitespace(s);
+  int negative = peek(s) == '-';
+  if (negative)
+    s->p++;
+
+  long result = 0;
+  char *start = s->p;
+  while (s->p < s->end && *s->p >= '0' && *s->p <= '9')
+    result = result * 10 + (*s->p++ - '0');
+  if (s->p == start)
+    return skip_value(s); // null or something unexpected; leave -1
+
+  *value = negative ? -result : result;
+  // Tolerate a fraction or exponent even though counts never have one
+  if (peek(s) == '.' || peek(s) == 'e' || peek(s) == 'E')
+    return skip_value(s);
+  return 1;
+}
+
+// Walk an object, handing each member's value to fn
+static int parse_object(Scanner *s, member_fn fn, CompletionFields *fields) {
+  if (!expect(s, '{'))
+    return 0;
+  skip_whitespace(s);
+  if (peek(s) == '}') {
+    s->p++;
+    return 1;
+  }
+
+  for (;;) {
+    skip_whitespace(s);
+    if (peek(s) != '"')
+      return 0;
+    const char *key = s->p + 1;
+    if (!skip_string(s))
+      return 0;
+    size_t key_length = (size_t)(s->p - 1 - key);
+
+    if (!expect(s, ':'))
+      return 0;
+    if (!fn(s, key, key_length, fields))
+      return 0;
+
+    skip_whitespace(s);
+    char c = peek(s);
+    s->p++;
+    if (c == '}')
+      return 1;
+    if (c != ',')
+      return 0;
+  }
+}
+
+// Parse an object if one is there, otherwise skip whatever the value is
+static int parse_object_or_skip(Scanner *s, member_fn fn,
+                                CompletionFields *fields) {
+  skip_whitespace(s);
+  if (peek(s) == '{')
+    return parse_object(s, fn, fields);
+  return skip_value(s);
+}
+
+static int message_member(Scanner *s, const char *key, size_t key_length,
+                          CompletionFields *fields) {
+  if (key_is(key, key_length, "content"))
+    return parse_nullable_string(s, &fields->content, &fields->content_length);
+  return skip_value(s);
+}
+
+static int choice_member(Scanner *s, const char *key, size_t key_length,
+                         CompletionFields *fields) {
+  // Full responses carry a message, stream chunks a delta
+  if (key_is(key, key_length, "message") || key_is(key, key_length, "delta"))
+    return parse_object_or_skip(s, message_member, fields);
+  if (key_is(key, key_length, "finish_reason"))
+    return parse_nullable_string(s, &fields->finish_reason, NULL);
+  return skip_value(s);
+}
+
+static int usage_member(Scanner *s, const char *key, size_t key_length,
+                        CompletionFields *fields) {
+  if (key_is(key, key_length, "prompt_tokens"))
+    return parse_long(s, &fields->prompt_tokens);
+  if (key_is(key, key_length, "completion_tokens"))
+    return parse_long(s, &fields->completion_tokens);
+  if (key_is(key, key_length, "total_tokens"))
+    return parse_long(s, &fields->total_tokens);
+  return skip_value(s);
+}
+
+// Only the first choice matters; the rest are skipped
+static int parse_choices(Scanner *s, CompletionFields *fields) {
+  skip_whitespace(s);
+  if (peek(s) != '[')
+    return skip_value(s);
+  s->p++;
+
+  skip_whitespace(s);
+  if (peek(s) == ']') {
+    s->p++;
+    return 1;
+  }
+
+  if (!parse_object_or_skip(s, choice_member, fields))
+    return 0;
+
+  for (;;) {
+    skip_whitespace(s);
+    char c = peek(s);
+    s->p++;
+    if (c == ']')
+      return 1;
+    if (c != ',' || !skip_value(s))
+      return 0;
+  }
+}
+
+static int root_member(Scanner *s, const char *key, size_t key_length,
+                       CompletionFields *fields) {
+  if (key_is(key, key_length, "choices"))
+    return parse_choices(s, fields);
+  if (key_is(key, key_length, "usage"))
+    return parse_object_or_skip(s, usage_member, fields);
+  return skip_value(s);
+}
+
+/**
+ * Extract the completion fields from a response
+ */
+int completion_extract(char *json, size_t length, CompletionFields *fields) {
+  memset(fields, 0, sizeof(*fields));
+  fields->prompt_tokens = -1;
+  fields->completion_tokens = -1;
+  fields->total_tokens = -1;
+
+  if (!json)
+    return 0;
+
+  Scanner s = {json, json + length};
+  if (!parse_object(&s, root_member, fields))
+    return 0;
+
+  skip_whitespace(&s);
+  return s.p == s.end;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file completion_parser.h
+ * @brief Single-pass extraction of fields from chat completion responses
+ *
+ * Instead of building a JSON tree for every response, the extractor walks
+ * the document once. It picks out choices[0].message.content (or
+ * choices[0].delta.content for stream chunks), choices[0].finish_reason and
+ * the usage counters, and skips everything else. Strings are unescaped in
+ * place, so the results point into the caller's buffer and nothing is
+ * allocated.
+ */
+
+#ifndef COMPLETION_PARSER_H
+#define COMPLETION_PARSER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fields of a chat completion. Strings point into the parsed buffer, are NUL
+ * terminated and stay valid as long as the buffer does.
+ */
+typedef struct {
+  char *content; // NULL if absent or JSON null
+  size_t content_length;
+  char *finish_reason; // NULL if absent or JSON null
+  long prompt_tokens;  // -1 if absent
+  long completion_tokens;
+  long total_tokens;
+} CompletionFields;
+
+/**
+ * Extract the completion fields from a response. The buffer is modified:
+ * extracted strings are unescaped in place.
+ *
+ * @param json The response body; must be writable and NUL terminated
+ * @param length Length of the body in bytes
+ * @param fields Receives the extracted fields
+ * @return 1 if the document is well formed, 0 otherwise
+ */
+int completion_extract(char *json, size_t length, CompletionFields *fields);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPLETION_PARSER_H */
@@ -7,6 +7,8 @@
 #include "../utils/file_utils.h"
 #include "../utils/log_utils.h"
 #include "../vendor/cjson/cJSON.h"
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,52 +18,497 @@
 
 // Global variables to store configuration
 static char *api_key = NULL;
-static char *model_name = NULL;
-static int max_tokens = 2048;
-static int config_loaded = 0;
+
+// Global generation parameters and the per-function overrides built on them
+#define DEFAULT_ENDPOINT "https://api.openai.com/v1/chat/completions"
+#define DEFAULT_TEMPERATURE 0.7
+#define DEFAULT_MAX_TOKENS 2048
+// Retry defaults: three attempts with half-jittered backoff from 500 ms to
+// 8 s, within a minute overall, for timeouts, rate limits and server errors
+#define DEFAULT_RETRY                                                          \
+  {3, 500, 8000, 0.5, 1, 60000, {408, 429, 500, 502, 503, 504}, 6}
+static const RetryConfig default_retry = DEFAULT_RETRY;
+// Hedging is opt-in; once on, duplicates past the p95 latency, up to 10%
+#define DEFAULT_HEDGE {0, 95.0, 100, 0.1}
+static const HedgeConfig default_hedge = DEFAULT_HEDGE;
+static FunctionConfig default_function = {.temperature = DEFAULT_TEMPERATURE,
+                                          .max_tokens = DEFAULT_MAX_TOKENS,
+                                          .cache = 1,
+                                          .coalesce = 1,
+                                          .retry = DEFAULT_RETRY,
+                                          .hedge = DEFAULT_HEDGE};
+static FunctionConfig *function_overrides = NULL;
+static int function_override_count = 0;
+static RouteConfig *routes = NULL;
+static int route_count = 0;
+
+// The configuration is loaded once under config_lock and is read-only
+// afterwards, so getters only need an acquire load of config_loaded
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int config_loaded = 0;
+
+// Transport defaults: a modest connection pool with HTTP/2 multiplexing, and
+// batch workers kept for 30 seconds between batches
+#define DEFAULT_MAX_CONNECTIONS 32
+#define DEFAULT_MAX_HOST_CONNECTIONS 32
+#define DEFAULT_BATCH_IDLE_MS 30000
+static TransportConfig transport_config = {
+    DEFAULT_MAX_CONNECTIONS, DEFAULT_MAX_HOST_CONNECTIONS, 1,
+    DEFAULT_BATCH_IDLE_MS};
+
+// Cache defaults: five minute lifetime within a 16 MiB budget
+#define DEFAULT_CACHE_TTL_SECONDS 300
+#define DEFAULT_CACHE_MAX_BYTES (16u * 1024u * 1024u)
+static CacheConfig cache_config = {1, DEFAULT_CACHE_TTL_SECONDS,
+                                   DEFAULT_CACHE_MAX_BYTES};
+
+// Admission defaults: no rate budgets, a concurrency limit starting at 32
+// that halves on overload, and up to 1024 requests waiting a minute at most
+#define DEFAULT_ADMISSION {1, 0.0, 0.0, 32, 1, 256, 0.5, 3.0, 1024, 60000}
+static const AdmissionConfig default_admission = DEFAULT_ADMISSION;
+static AdmissionConfig admission_config = DEFAULT_ADMISSION;
+
+// Cassettes are off unless configured; a configured mode without a path uses
+// this file in the working directory
+#define DEFAULT_CASSETTE_PATH "vibelang.cassette"
+#define DEFAULT_CASSETTE {CASSETTE_OFF, NULL, LATENCY_NONE, 0.0, 0.0, 0.0, 0.5}
+static const CassetteConfig default_cassette = DEFAULT_CASSETTE;
+static CassetteConfig cassette_config = DEFAULT_CASSETTE;
+
+// Token counts are estimated and prompts unbounded unless a vocabulary and
+// context window are configured
+static TokenizerConfig tokenizer_config = {NULL, 0};
 
 // Forward declaration of create_default_config function
 static int create_default_config(void);
 
-/**
- * Load configuration from the default configuration file
- *
- * @return 1 on success, 0 on failure
- */
-int load_config(void) {
+// Apply the admission settings present in a JSON object
+static void parse_admission_config(cJSON *admission, AdmissionConfig *config) {
+  cJSON *item = cJSON_GetObjectItem(admission, "enabled");
+  if (cJSON_IsBool(item))
+    config->enabled = cJSON_IsTrue(item);
+
+  item = cJSON_GetObjectItem(admission, "requests_per_minute");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    config->requests_per_minute = item->valuedouble;
+
+  item = cJSON_GetObjectItem(admission, "tokens_per_minute");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    config->tokens_per_minute = item->valuedouble;
+
+  item = cJSON_GetObjectItem(admission, "initial_concurrency");
+  if (cJSON_IsNumber(item) && item->valueint >= 1)
+    config->initial_concurrency = item->valueint;
+
+  item = cJSON_GetObjectItem(admission, "min_concurrency");
+  if (cJSON_IsNumber(item) && item->valueint >= 1)
+    config->min_concurrency = item->valueint;
+
+  item = cJSON_GetObjectItem(admission, "max_concurrency");
+  if (cJSON_IsNumber(item) && item->valueint >= 1)
+    config->max_concurrency = item->valueint;
+
+  item = cJSON_GetObjectItem(admission, "backoff_ratio");
+  if (cJSON_IsNumber(item) && item->valuedouble > 0 && item->valuedouble < 1)
+    config->backoff_ratio = item->valuedouble;
+
+  item = cJSON_GetObjectItem(admission, "latency_spike_ratio");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    config->latency_spike_ratio = item->valuedouble;
+
+  item = cJSON_GetObjectItem(admission, "max_queue");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->max_queue = item->valueint;
+
+  item = cJSON_GetObjectItem(admission, "queue_timeout_ms");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->queue_timeout_ms = item->valueint;
+
+  // Keep the limits consistent whatever order they were given in
+  if (config->max_concurrency < config->min_concurrency)
+    config->max_concurrency = config->min_concurrency;
+  if (config->initial_concurrency < config->min_concurrency)
+    config->initial_concurrency = config->min_concurrency;
+  if (config->initial_concurrency > config->max_concurrency)
+    config->initial_concurrency = config->max_concurrency;
+}
+
+// Apply the retry settings present in a JSON object
+static void parse_retry_config(cJSON *retry, RetryConfig *config) {
+  cJSON *item = cJSON_GetObjectItem(retry, "max_attempts");
+  if (cJSON_IsNumber(item) && item->valueint >= 1)
+    config->max_attempts = item->valueint;
+
+  item = cJSON_GetObjectItem(retry, "base_delay_ms");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->base_delay_ms = item->valueint;
+
+  item = cJSON_GetObjectItem(retry, "max_delay_ms");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->max_delay_ms = item->valueint;
+
+  item = cJSON_GetObjectItem(retry, "jitter");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0 &&
+      item->valuedouble <= 1)
+    config->jitter = item->valuedouble;
+
+  item = cJSON_GetObjectItem(retry, "respect_retry_after");
+  if (cJSON_IsBool(item))
+    config->respect_retry_after = cJSON_IsTrue(item);
+
+  item = cJSON_GetObjectItem(retry, "deadline_ms");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->deadline_ms = item->valueint;
+
+  item = cJSON_GetObjectItem(retry, "retryable_status");
+  if (cJSON_IsArray(item)) {
+    config->retryable_status_count = 0;
+    cJSON *status = NULL;
+    cJSON_ArrayForEach(status, item) {
+      if (!cJSON_IsNumber(status))
+        continue;
+      if (config->retryable_status_count == RETRY_MAX_STATUS_CODES) {
+        WARN("Ignoring retryable statuses beyond the first %d",
+             RETRY_MAX_STATUS_CODES);
+        break;
+      }
+      config->retryable_status[config->retryable_status_count++] =
+          status->valueint;
+    }
+  }
+}
+
+// Apply the hedging settings present in a JSON object
+static void parse_hedge_config(cJSON *hedge, HedgeConfig *config) {
+  cJSON *item = cJSON_GetObjectItem(hedge, "enabled");
+  if (cJSON_IsBool(item))
+    config->enabled = cJSON_IsTrue(item);
+
+  item = cJSON_GetObjectItem(hedge, "percentile");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0 &&
+      item->valuedouble <= 100)
+    config->percentile = item->valuedouble;
+
+  item = cJSON_GetObjectItem(hedge, "min_delay_ms");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->min_delay_ms = item->valueint;
+
+  item = cJSON_GetObjectItem(hedge, "budget");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0 &&
+      item->valuedouble <= 1)
+    config->budget = item->valuedouble;
+}
+
+// Map a cassette mode name onto the mode, -1 if unknown
+static int parse_cassette_mode(const char *value) {
+  if (strcmp(value, "off") == 0)
+    return CASSETTE_OFF;
+  if (strcmp(value, "record") == 0)
+    return CASSETTE_RECORD;
+  if (strcmp(value, "replay") == 0)
+    return CASSETTE_REPLAY;
+  WARN("Ignoring unknown cassette mode: %s", value);
+  return -1;
+}
+
+static void set_cassette_path(const char *path) {
+  char *copy = strdup(path);
+  if (!copy) {
+    ERROR("Memory allocation failed for cassette path");
+    return;
+  }
+  free(cassette_config.path);
+  cassette_config.path = copy;
+}
+
+// VIBELANG_CASSETTE_MODE and VIBELANG_CASSETTE take precedence over the file,
+// so a benchmark can switch modes without editing it
+static void apply_cassette_environment(void) {
+  const char *mode = getenv("VIBELANG_CASSETTE_MODE");
+  if (mode && *mode) {
+    int parsed = parse_cassette_mode(mode);
+    if (parsed >= 0)
+      cassette_config.mode = (CassetteMode)parsed;
+  }
+
+  const char *path = getenv("VIBELANG_CASSETTE");
+  if (path && *path)
+    set_cassette_path(path);
+}
+
+// Apply the record/replay settings present in a JSON object
+static void parse_cassette_config(cJSON *cassette) {
+  cJSON *item = cJSON_GetObjectItem(cassette, "mode");
+  if (cJSON_IsString(item) && item->valuestring != NULL) {
+    int mode = parse_cassette_mode(item->valuestring);
+    if (mode >= 0)
+      cassette_config.mode = (CassetteMode)mode;
+  }
+
+  item = cJSON_GetObjectItem(cassette, "path");
+  if (cJSON_IsString(item) && item->valuestring != NULL)
+    set_cassette_path(item->valuestring);
+
+  cJSON *latency = cJSON_GetObjectItem(cassette, "latency");
+  if (!cJSON_IsObject(latency))
+    return;
+
+  item = cJSON_GetObjectItem(latency, "distribution");
+  if (cJSON_IsString(item) && item->valuestring != NULL) {
+    const char *name = item->valuestring;
+    if (strcmp(name, "none") == 0)
+      cassette_config.latency = LATENCY_NONE;
+    else if (strcmp(name, "recorded") == 0)
+      cassette_config.latency = LATENCY_RECORDED;
+    else if (strcmp(name, "fixed") == 0)
+      cassette_config.latency = LATENCY_FIXED;
+    else if (strcmp(name, "uniform") == 0)
+      cassette_config.latency = LATENCY_UNIFORM;
+    else if (strcmp(name, "lognormal") == 0)
+      cassette_config.latency = LATENCY_LOGNORMAL;
+    else
+      WARN("Ignoring unknown latency distribution: %s", name);
+  }
+
+  item = cJSON_GetObjectItem(latency, "median_ms");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    cassette_config.median_ms = item->valuedouble;
+
+  item = cJSON_GetObjectItem(latency, "min_ms");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    cassette_config.min_ms = item->valuedouble;
+
+  item = cJSON_GetObjectItem(latency, "max_ms");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    cassette_config.max_ms = item->valuedouble;
+
+  item = cJSON_GetObjectItem(latency, "sigma");
+  if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+    cassette_config.sigma = item->valuedouble;
+
+  if (cassette_config.max_ms < cassette_config.min_ms)
+    cassette_config.max_ms = cassette_config.min_ms;
+}
+
+// Set a function's endpoint from a URL or "unix:<socket>[:<path>]". The
+// socket form talks plain HTTP to a local server; the path defaults to the
+// OpenAI one.
+static int parse_endpoint(const char *value, FunctionConfig *config) {
+  char *endpoint = NULL;
+  char *unix_socket = NULL;
+
+  if (strncmp(value, "unix:", 5) == 0) {
+    const char *socket_path = value + 5;
+    const char *path = strchr(socket_path, ':');
+    size_t socket_length = path ? (size_t)(path - socket_path)
+                                : strlen(socket_path);
+    path = path ? path + 1 : "/v1/chat/completions";
+    if (socket_length == 0 || *path != '/') {
+      WARN("Ignoring malformed endpoint: %s", value);
+      return 0;
+    }
+
+    // The host only fills in the Host header; curl never resolves it
+    size_t url_length = strlen("http://localhost") + strlen(path) + 1;
+    endpoint = malloc(url_length);
+    unix_socket = strndup(socket_path, socket_length);
+    if (!unix_socket) {
+      free(endpoint);
+      endpoint = NULL;
+    } else if (endpoint) {
+      snprintf(endpoint, url_length, "http://localhost%s", path);
+    }
+  } else if (strncmp(value, "http://", 7) == 0 ||
+             strncmp(value, "https://", 8) == 0) {
+    endpoint = strdup(value);
+  } else {
+    WARN("Ignoring endpoint with unsupported scheme: %s", value);
+    return 0;
+  }
+
+  if (!endpoint) {
+    ERROR("Memory allocation failed for endpoint %s", value);
+    free(unix_socket);
+    return 0;
+  }
+
+  free(config->endpoint);
+  free(config->unix_socket);
+  config->endpoint = endpoint;
+  config->unix_socket = unix_socket;
+  return 1;
+}
+
+// Apply the generation parameters present in a JSON object
+static void parse_function_params(cJSON *params, FunctionConfig *config) {
+  cJSON *item = cJSON_GetObjectItem(params, "model");
+  if (cJSON_IsString(item) && item->valuestring != NULL) {
+    free(config->model);
+    config->model = strdup(item->valuestring);
+  }
+
+  item = cJSON_GetObjectItem(params, "endpoint");
+  if (cJSON_IsString(item) && item->valuestring != NULL)
+    parse_endpoint(item->valuestring, config);
+
+  item = cJSON_GetObjectItem(params, "temperature");
+  if (cJSON_IsNumber(item))
+    config->temperature = item->valuedouble;
+
+  item = cJSON_GetObjectItem(params, "max_tokens");
+  if (cJSON_IsNumber(item))
+    config->max_tokens = item->valueint;
+
+  item = cJSON_GetObjectItem(params, "max_prompt_tokens");
+  if (cJSON_IsNumber(item) && item->valueint >= 0)
+    config->max_prompt_tokens = item->valueint;
+
+  item = cJSON_GetObjectItem(params, "cache");
+  if (cJSON_IsBool(item))
+    config->cache = cJSON_IsTrue(item);
+
+  item = cJSON_GetObjectItem(params, "coalesce");
+  if (cJSON_IsBool(item))
+    config->coalesce = cJSON_IsTrue(item);
+
+  item = cJSON_GetObjectItem(params, "retry");
+  if (cJSON_IsObject(item))
+    parse_retry_config(item, &config->retry);
+
+  item = cJSON_GetObjectItem(params, "hedge");
+  if (cJSON_IsObject(item))
+    parse_hedge_config(item, &config->hedge);
+}
+
+// Build a function's configuration from the global defaults and its override
+static int parse_function_override(cJSON *override, FunctionConfig *config) {
+  *config = default_function;
+  config->name = strdup(override->string);
+  config->model = default_function.model ? strdup(default_function.model)
+                                         : NULL;
+  config->endpoint = default_function.endpoint
+                         ? strdup(default_function.endpoint)
+                         : NULL;
+  config->unix_socket = default_function.unix_socket
+                            ? strdup(default_function.unix_socket)
+                            : NULL;
+  if (!config->name || (default_function.endpoint && !config->endpoint) ||
+      (default_function.unix_socket && !config->unix_socket)) {
+    ERROR("Memory allocation failed for override of %s", override->string);
+    free(config->name);
+    free(config->model);
+    free(config->endpoint);
+    free(config->unix_socket);
+    return 0;
+  }
+
+  parse_function_params(override, config);
+  // Routes and limits compiled in for the result type give way to the
+  // function's own model and max_tokens
+  cJSON *model = cJSON_GetObjectItem(override, "model");
+  config->model_set = cJSON_IsString(model) && model->valuestring != NULL;
+  config->max_tokens_set =
+      cJSON_IsNumber(cJSON_GetObjectItem(override, "max_tokens"));
+  return 1;
+}
+
+static void free_function_overrides(void) {
+  for (int i = 0; i < function_override_count; i++) {
+    free(function_overrides[i].name);
+    free(function_overrides[i].model);
+    free(function_overrides[i].endpoint);
+    free(function_overrides[i].unix_socket);
+  }
+  free(function_overrides);
+  function_overrides = NULL;
+  function_override_count = 0;
+}
+
+static void free_routes(void) {
+  for (int i = 0; i < route_count; i++) {
+    free(routes[i].name);
+    free(routes[i].model);
+  }
+  free(routes);
+  routes = NULL;
+  route_count = 0;
+}
+
+// Read the model of every route. Which sites take a route is the compiler's
+// business, so "types" and "meanings" are not looked at here.
+static int parse_routes(cJSON *section) {
+  free_routes();
+  int count = cJSON_IsObject(section) ? cJSON_GetArraySize(section) : 0;
+  if (count == 0)
+    return 1;
+
+  routes = calloc(count, sizeof(RouteConfig));
+  if (!routes) {
+    ERROR("Memory allocation failed for model routes");
+    return 0;
+  }
+
+  cJSON *route = NULL;
+  cJSON_ArrayForEach(route, section) {
+    cJSON *model = cJSON_GetObjectItem(route, "model");
+    if (!cJSON_IsString(model) || model->valuestring == NULL) {
+      WARN("Ignoring route without a model: %s", route->string);
+      continue;
+    }
+    RouteConfig *entry = &routes[route_count];
+    entry->name = strdup(route->string);
+    entry->model = strdup(model->valuestring);
+    if (!entry->name || !entry->model) {
+      ERROR("Memory allocation failed for route %s", route->string);
+      free(entry->name);
+      free(entry->model);
+      free_routes();
+      return 0;
+    }
+    route_count++;
+  }
+  return 1;
+}
+
+// Load the configuration. Caller holds config_lock.
+static int load_config_locked(void) {
   INFO("Loading configuration from %s", CONFIG_FILE_PATH);
 
   // Initialize with default values so we don't crash if config is missing
   if (!api_key)
     api_key = strdup("YOUR_API_KEY_HERE"); // Default placeholder
-  if (!model_name)
-    model_name = strdup("gpt-3.5-turbo"); // Default model
-
-  // Check environment variables first - they override config file
+  if (!default_function.model)
+    default_function.model = strdup("gpt-3.5-turbo"); // Default model
+  if (!default_function.endpoint)
+    default_function.endpoint = strdup(DEFAULT_ENDPOINT);
+  if (!cassette_config.path)
+    set_cassette_path(DEFAULT_CASSETTE_PATH);
+  apply_cassette_environment();
+
+  // Environment variables override the API key from the config file, but the
+  // rest of the file still applies
   const char *env_api_key = getenv("OPENAI_API_KEY");
   const char *generic_env_key = getenv("VIBELANG_API_KEY");
+  const char *override_key = NULL;
 
   if (env_api_key && strlen(env_api_key) > 0) {
     DEBUG("Using API key from OPENAI_API_KEY environment variable");
-    if (api_key)
-      free(api_key);
-    api_key = strdup(env_api_key);
-    config_loaded = 1;
-    return 1;
+    override_key = env_api_key;
   } else if (generic_env_key && strlen(generic_env_key) > 0) {
     DEBUG("Using API key from VIBELANG_API_KEY environment variable");
+    override_key = generic_env_key;
+  }
+  if (override_key) {
     if (api_key)
       free(api_key);
-    api_key = strdup(generic_env_key);
-    config_loaded = 1;
-    return 1;
+    api_key = strdup(override_key);
   }
 
   // Read the configuration file
   if (!file_exists(CONFIG_FILE_PATH)) {
     WARN("Configuration file not found: %s", CONFIG_FILE_PATH);
     // We already initialized with default values, so we can continue
-    config_loaded = 1;
+    atomic_store_explicit(&config_loaded, 1, memory_order_release);
     return 1; // Return success to avoid crashing, we'll use defaults
   }
 
@@ -69,7 +516,7 @@ int load_config(void) {
   if (!config_file) {
     WARN("Could not open configuration file: %s", CONFIG_FILE_PATH);
     // We already initialized with default values, so we can continue
-    config_loaded = 1;
+    atomic_store_explicit(&config_loaded, 1, memory_order_release);
     return 1;
   }
 
@@ -111,39 +558,153 @@ int load_config(void) {
   if (global) {
     cJSON *api_key_json = cJSON_GetObjectItem(global, "api_key");
     if (cJSON_IsString(api_key_json) && api_key_json->valuestring != NULL) {
-      // Free previous value if it exists
-      if (api_key)
-        free(api_key);
-      api_key = strdup(api_key_json->valuestring);
+      if (!override_key) {
+        // Free previous value if it exists
+        if (api_key)
+          free(api_key);
+        api_key = strdup(api_key_json->valuestring);
+      }
     }
 
-    // Get model name from default_params if available
+    // The endpoint may sit directly under global or in default_params
+    cJSON *endpoint = cJSON_GetObjectItem(global, "endpoint");
+    if (cJSON_IsString(endpoint) && endpoint->valuestring != NULL)
+      parse_endpoint(endpoint->valuestring, &default_function);
+
+    // Get the model and generation parameters from default_params
     cJSON *default_params = cJSON_GetObjectItem(global, "default_params");
-    if (default_params) {
-      cJSON *model_name_json = cJSON_GetObjectItem(default_params, "model");
-      if (cJSON_IsString(model_name_json) &&
-          model_name_json->valuestring != NULL) {
-        // Free previous value if it exists
-        if (model_name)
-          free(model_name);
-        model_name = strdup(model_name_json->valuestring);
+    if (default_params)
+      parse_function_params(default_params, &default_function);
+
+    // The retry and hedging policies may also sit directly under global
+    cJSON *retry = cJSON_GetObjectItem(global, "retry");
+    if (cJSON_IsObject(retry))
+      parse_retry_config(retry, &default_function.retry);
+    cJSON *hedge = cJSON_GetObjectItem(global, "hedge");
+    if (cJSON_IsObject(hedge))
+      parse_hedge_config(hedge, &default_function.hedge);
+
+    cJSON *transport = cJSON_GetObjectItem(global, "transport");
+    if (transport) {
+      cJSON *item = cJSON_GetObjectItem(transport, "max_connections");
+      if (cJSON_IsNumber(item) && item->valueint > 0)
+        transport_config.max_connections = item->valueint;
+
+      item = cJSON_GetObjectItem(transport, "max_host_connections");
+      if (cJSON_IsNumber(item) && item->valueint >= 0)
+        transport_config.max_host_connections = item->valueint;
+
+      item = cJSON_GetObjectItem(transport, "http2");
+      if (cJSON_IsBool(item))
+        transport_config.http2 = cJSON_IsTrue(item);
+
+      item = cJSON_GetObjectItem(transport, "batch_idle_ms");
+      if (cJSON_IsNumber(item) && item->valueint > 0)
+        transport_config.batch_idle_ms = item->valueint;
+    }
+
+    cJSON *admission = cJSON_GetObjectItem(global, "admission");
+    if (cJSON_IsObject(admission))
+      parse_admission_config(admission, &admission_config);
+
+    cJSON *cassette = cJSON_GetObjectItem(global, "cassette");
+    if (cJSON_IsObject(cassette)) {
+      parse_cassette_config(cassette);
+      apply_cassette_environment();
+    }
+
+    cJSON *tokenizer = cJSON_GetObjectItem(global, "tokenizer");
+    if (cJSON_IsObject(tokenizer)) {
+      cJSON *item = cJSON_GetObjectItem(tokenizer, "vocab");
+      if (cJSON_IsString(item) && item->valuestring != NULL) {
+        free(tokenizer_config.vocab);
+        tokenizer_config.vocab = strdup(item->valuestring);
       }
 
-      cJSON *max_tokens_json =
-          cJSON_GetObjectItem(default_params, "max_tokens");
-      if (cJSON_IsNumber(max_tokens_json)) {
-        max_tokens = max_tokens_json->valueint;
+      item = cJSON_GetObjectItem(tokenizer, "context_window");
+      if (cJSON_IsNumber(item) && item->valueint >= 0)
+        tokenizer_config.context_window = item->valueint;
+    }
+
+    cJSON *cache = cJSON_GetObjectItem(global, "cache");
+    if (cache) {
+      cJSON *item = cJSON_GetObjectItem(cache, "enabled");
+      if (cJSON_IsBool(item))
+        cache_config.enabled = cJSON_IsTrue(item);
+
+      item = cJSON_GetObjectItem(cache, "ttl_seconds");
+      if (cJSON_IsNumber(item) && item->valueint >= 0)
+        cache_config.ttl_seconds = item->valueint;
+
+      item = cJSON_GetObjectItem(cache, "max_bytes");
+      if (cJSON_IsNumber(item) && item->valuedouble >= 0)
+        cache_config.max_bytes = (size_t)item->valuedouble;
+    }
+  }
+
+  // Function-specific overrides inherit everything they do not set
+  cJSON *overrides = cJSON_GetObjectItem(json, "overrides");
+  int override_count = cJSON_IsObject(overrides)
+                           ? cJSON_GetArraySize(overrides)
+                           : 0;
+  free_function_overrides();
+  if (override_count > 0) {
+    function_overrides = calloc(override_count, sizeof(FunctionConfig));
+    if (!function_overrides) {
+      ERROR("Memory allocation failed for function overrides");
+      cJSON_Delete(json);
+      return 0;
+    }
+
+    cJSON *override = NULL;
+    cJSON_ArrayForEach(override, overrides) {
+      if (!cJSON_IsObject(override))
+        continue;
+      if (!parse_function_override(
+              override, &function_overrides[function_override_count])) {
+        free_function_overrides();
+        cJSON_Delete(json);
+        return 0;
       }
+      function_override_count++;
     }
   }
 
+  if (!parse_routes(cJSON_GetObjectItem(json, "routes"))) {
+    cJSON_Delete(json);
+    return 0;
+  }
+
   cJSON_Delete(json);
-  config_loaded = 1;
+  atomic_store_explicit(&config_loaded, 1, memory_order_release);
 
   INFO("Configuration loaded successfully");
   return 1;
 }
 
+/**
+ * Load configuration from the default configuration file
+ *
+ * @return 1 on success, 0 on failure
+ */
+int load_config(void) {
+  pthread_mutex_lock(&config_lock);
+  int result = load_config_locked();
+  pthread_mutex_unlock(&config_lock);
+  return result;
+}
+
+// Load the configuration on first use from whichever thread gets there first
+static void ensure_config_loaded(void) {
+  if (atomic_load_explicit(&config_loaded, memory_order_acquire))
+    return;
+
+  pthread_mutex_lock(&config_lock);
+  if (!atomic_load_explicit(&config_loaded, memory_order_relaxed))
+    load_config_locked();
+  pthread_mutex_unlock(&config_lock);
+}
+
 /**
  * Create a default configuration file
  *
@@ -157,11 +718,11 @@ static int create_default_config(void) {
     free(api_key);
   api_key = strdup("YOUR_API_KEY_HERE"); // Placeholder
 
-  if (model_name)
-    free(model_name);
-  model_name = strdup("gpt-3.5-turbo");
+  if (default_function.model)
+    free(default_function.model);
+  default_function.model = strdup("gpt-3.5-turbo");
 
-  max_tokens = 2048;
+  default_function.max_tokens = DEFAULT_MAX_TOKENS;
 
   // Create JSON
   cJSON *json = cJSON_CreateObject();
@@ -173,9 +734,10 @@ static int create_default_config(void) {
   cJSON *default_params = cJSON_CreateObject();
   cJSON_AddItemToObject(global, "default_params", default_params);
 
-  cJSON_AddStringToObject(default_params, "model", model_name);
-  cJSON_AddNumberToObject(default_params, "max_tokens", max_tokens);
-  cJSON_AddNumberToObject(default_params, "temperature", 0.7);
+  cJSON_AddStringToObject(default_params, "model", default_function.model);
+  cJSON_AddNumberToObject(default_params, "max_tokens",
+                          default_function.max_tokens);
+  cJSON_AddNumberToObject(default_params, "temperature", DEFAULT_TEMPERATURE);
 
   // Write to file
   char *config_content = cJSON_Print(json);
@@ -209,25 +771,132 @@ static int create_default_config(void) {
  * @return The API key string, or NULL if not found or not loaded
  */
 const char *get_api_key(void) {
-  // Ensure config is loaded
-  if (!config_loaded) {
-    load_config();
-  }
+  ensure_config_loaded();
   return api_key;
 }
 
+/**
+ * Get the HTTP transport settings
+ *
+ * @return The transport configuration (defaults if not configured)
+ */
+const TransportConfig *get_transport_config(void) {
+  ensure_config_loaded();
+  return &transport_config;
+}
+
+/**
+ * Get the response cache settings
+ *
+ * @return The cache configuration (defaults if not configured)
+ */
+const CacheConfig *get_cache_config(void) {
+  ensure_config_loaded();
+  return &cache_config;
+}
+
+/**
+ * Get the admission control settings
+ *
+ * @return The admission configuration (defaults if not configured)
+ */
+const AdmissionConfig *get_admission_config(void) {
+  ensure_config_loaded();
+  return &admission_config;
+}
+
+/**
+ * Get the record/replay settings
+ *
+ * @return The cassette configuration (disabled if not configured)
+ */
+const CassetteConfig *get_cassette_config(void) {
+  ensure_config_loaded();
+  return &cassette_config;
+}
+
+/**
+ * Get the local tokenizer settings
+ *
+ * @return The tokenizer configuration (no vocabulary if not configured)
+ */
+const TokenizerConfig *get_tokenizer_config(void) {
+  ensure_config_loaded();
+  return &tokenizer_config;
+}
+
+/**
+ * Get the generation parameters for a function
+ *
+ * @param function_name The function name, or NULL for the global defaults
+ * @return The function's override if one exists, otherwise the defaults
+ */
+const FunctionConfig *get_function_config(const char *function_name) {
+  ensure_config_loaded();
+  if (function_name) {
+    for (int i = 0; i < function_override_count; i++) {
+      if (strcmp(function_overrides[i].name, function_name) == 0)
+        return &function_overrides[i];
+    }
+  }
+  return &default_function;
+}
+
+/**
+ * Get the model of a route
+ *
+ * @param route_name The route name compiled into a prompt site
+ * @return The route's model, or NULL if no route of that name is configured
+ */
+const char *get_route_model(const char *route_name) {
+  ensure_config_loaded();
+  if (route_name) {
+    for (int i = 0; i < route_count; i++) {
+      if (strcmp(routes[i].name, route_name) == 0)
+        return routes[i].model;
+    }
+  }
+  return NULL;
+}
+
 /**
  * Free all resources allocated for the configuration
  */
 void free_config(void) {
+  pthread_mutex_lock(&config_lock);
   if (api_key) {
     free(api_key);
     api_key = NULL;
   }
-  if (model_name) {
-    free(model_name);
-    model_name = NULL;
-  }
-  config_loaded = 0;
+  free(default_function.model);
+  default_function.model = NULL;
+  free(default_function.endpoint);
+  default_function.endpoint = NULL;
+  free(default_function.unix_socket);
+  default_function.unix_socket = NULL;
+  default_function.temperature = DEFAULT_TEMPERATURE;
+  default_function.max_tokens = DEFAULT_MAX_TOKENS;
+  default_function.max_prompt_tokens = 0;
+  default_function.cache = 1;
+  default_function.coalesce = 1;
+  default_function.retry = default_retry;
+  default_function.hedge = default_hedge;
+  free_function_overrides();
+  free_routes();
+  transport_config.max_connections = DEFAULT_MAX_CONNECTIONS;
+  transport_config.max_host_connections = DEFAULT_MAX_HOST_CONNECTIONS;
+  transport_config.http2 = 1;
+  transport_config.batch_idle_ms = DEFAULT_BATCH_IDLE_MS;
+  cache_config.enabled = 1;
+  cache_config.ttl_seconds = DEFAULT_CACHE_TTL_SECONDS;
+  cache_config.max_bytes = DEFAULT_CACHE_MAX_BYTES;
+  admission_config = default_admission;
+  free(cassette_config.path);
+  cassette_config = default_cassette;
+  free(tokenizer_config.vocab);
+  tokenizer_config.vocab = NULL;
+  tokenizer_config.context_window = 0;
+  atomic_store_explicit(&config_loaded, 0, memory_order_release);
+  pthread_mutex_unlock(&config_lock);
   INFO("Configuration resources freed");
 }
@@ -6,10 +6,152 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * HTTP transport settings, read from the "transport" section of the global
+ * configuration
+ */
+typedef struct {
+  int max_connections;      // Size of the shared connection pool
+  int max_host_connections; // Parallel connections per host (0 = unlimited)
+  int http2;                // Multiplex requests over HTTP/2 when possible
+  int batch_idle_ms;        // Wait of an idle batch worker before it exits
+} TransportConfig;
+
+/**
+ * Response cache settings, read from the "cache" section of the global
+ * configuration
+ */
+typedef struct {
+  int enabled;      // Serve repeated prompts from memory
+  int ttl_seconds;  // Lifetime of a cached response (0 = no expiry)
+  size_t max_bytes; // Memory budget for keys and responses
+} CacheConfig;
+
+/**
+ * Client-side admission control, read from the "admission" section of the
+ * global configuration
+ */
+typedef struct {
+  int enabled;                // Apply admission control at all
+  double requests_per_minute; // Request budget (0 = unlimited)
+  double tokens_per_minute;   // Prompt plus completion token budget (0 = none)
+  int initial_concurrency;    // Starting limit on requests in flight
+  int min_concurrency;        // Floor the limit never drops below
+  int max_concurrency;        // Ceiling the limit never grows past
+  double backoff_ratio;       // Factor applied to the limit on overload
+  double latency_spike_ratio; // Time per token above this multiple of the
+                              // average counts as overload (0 = ignore)
+  int max_queue;              // Waiting requests beyond this are refused
+  int queue_timeout_ms;       // Longest wait for admission (0 = no limit)
+} AdmissionConfig;
+
+// Whether LLM calls are recorded to or answered from a cassette file
+typedef enum { CASSETTE_OFF, CASSETTE_RECORD, CASSETTE_REPLAY } CassetteMode;
+
+// Delay added to replayed calls
+typedef enum {
+  LATENCY_NONE,      // Answer immediately
+  LATENCY_RECORDED,  // Take as long as the recorded call did
+  LATENCY_FIXED,     // Always median_ms
+  LATENCY_UNIFORM,   // Uniform between min_ms and max_ms
+  LATENCY_LOGNORMAL  // Log-normal around median_ms with spread sigma
+} LatencyDistribution;
+
+/**
+ * Record/replay of LLM calls, read from the "cassette" section of the global
+ * configuration. VIBELANG_CASSETTE_MODE and VIBELANG_CASSETTE override the
+ * mode and path.
+ */
+typedef struct {
+  CassetteMode mode;
+  char *path;                  // Cassette file
+  LatencyDistribution latency; // Simulated latency when replaying
+  double median_ms;            // Fixed or log-normal median
+  double min_ms;               // Uniform lower bound
+  double max_ms;               // Uniform upper bound
+  double sigma;                // Log-normal shape, 0.5 is a typical LLM tail
+} CassetteConfig;
+
+/**
+ * Local tokenizer settings, read from the "tokenizer" section of the global
+ * configuration
+ */
+typedef struct {
+  char *vocab;        // tiktoken rank file, NULL to estimate token counts
+  int context_window; // Model context in tokens (0 = unknown, no budget)
+} TokenizerConfig;
+
+// Most HTTP statuses a retry policy can list as retryable
+#define RETRY_MAX_STATUS_CODES 16
+
+/**
+ * When and how to retry a failed LLM request, read from "retry" in the
+ * global configuration or a function's override
+ */
+typedef struct {
+  int max_attempts;        // Attempts including the first (1 = never retry)
+  int base_delay_ms;       // Backoff before the first retry, doubled after
+  int max_delay_ms;        // Upper bound for a single backoff
+  double jitter;           // Fraction of each backoff that is randomized, 0-1
+  int respect_retry_after; // Wait as long as a Retry-After header asks
+  int deadline_ms;         // Budget for all attempts and waits (0 = none)
+  int retryable_status[RETRY_MAX_STATUS_CODES]; // Statuses worth retrying
+  int retryable_status_count;
+} RetryConfig;
+
+/**
+ * When to send a duplicate of a slow LLM request, read from "hedge" in the
+ * global configuration or a function's override
+ */
+typedef struct {
+  int enabled;       // Hedge requests of this function
+  double percentile; // Recent latency percentile that triggers a duplicate
+  int min_delay_ms;  // Never send a duplicate sooner than this
+  double budget;     // Duplicates allowed per request, e.g. 0.1 for 10%
+} HedgeConfig;
+
+/**
+ * Generation parameters for one function. Entries from the "overrides"
+ * section start from the global default_params and replace what they set.
+ * Stop sequences, the instruction and the response format only come from a
+ * prompt site's compiled-in parameters, so the configuration never owns
+ * them.
+ */
+typedef struct {
+  char *name;                  // Function name, NULL for the global defaults
+  char *model;                 // Model to request
+  char *endpoint;              // Chat completions URL
+  char *unix_socket;           // Unix-domain socket for the endpoint, or NULL
+  double temperature;          // Sampling temperature
+  int max_tokens;              // Completion length limit
+  int max_prompt_tokens;       // Prompt budget (0 = window less max_tokens)
+  int cache;                   // 0 to bypass the response cache
+  int coalesce;                // 0 to send identical requests separately
+  RetryConfig retry;           // Retry policy for failed requests
+  HedgeConfig hedge;           // Duplicate slow requests to cut tail latency
+  int model_set;               // The function's own override sets model
+  int max_tokens_set;          // The function's own override sets max_tokens
+  const char *const *stop;     // Stop sequences ending in NULL, or NULL
+  const char *instruction;     // System message for the prompt, or NULL
+  const char *response_format; // JSON object sent as response_format, or NULL
+} FunctionConfig;
+
+/**
+ * A model route, read from the "routes" section. The compiler picks a route
+ * for each prompt site from its result type and meaning and bakes in the
+ * name; the runtime only maps the name to a model.
+ */
+typedef struct {
+  char *name;  // Route name compiled into prompt sites
+  char *model; // Model requested for sites on the route
+} RouteConfig;
+
 /**
  * Load configuration from the default configuration file
  *
@@ -24,6 +166,57 @@ int load_config(void);
  */
 const char *get_api_key(void);
 
+/**
+ * Get the HTTP transport settings
+ *
+ * @return The transport configuration (defaults if not configured)
+ */
+const TransportConfig *get_transport_config(void);
+
+/**
+ * Get the response cache settings
+ *
+ * @return The cache configuration (defaults if not configured)
+ */
+const CacheConfig *get_cache_config(void);
+
+/**
+ * Get the admission control settings
+ *
+ * @return The admission configuration (defaults if not configured)
+ */
+const AdmissionConfig *get_admission_config(void);
+
+/**
+ * Get the record/replay settings
+ *
+ * @return The cassette configuration (disabled if not configured)
+ */
+const CassetteConfig *get_cassette_config(void);
+
+/**
+ * Get the local tokenizer settings
+ *
+ * @return The tokenizer configuration (no vocabulary if not configured)
+ */
+const TokenizerConfig *get_tokenizer_config(void);
+
+/**
+ * Get the generation parameters for a function
+ *
+ * @param function_name The function name, or NULL for the global defaults
+ * @return The function's override if one exists, otherwise the defaults
+ */
+const FunctionConfig *get_function_config(const char *function_name);
+
+/**
+ * Get the model of a route
+ *
+ * @param route_name The route name compiled into a prompt site
+ * @return The route's model, or NULL if no route of that name is configured
+ */
+const char *get_route_model(const char *route_name);
+
 /**
  * Free all resources allocated for the configuration
  */
@@ -0,0 +1,120 @@
+/**
+ * @file hedging.c
+ * @brief Latency tracking and budget for hedged LLM requests
+ */
+
+#include "hedging.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Latencies of the most recent successful requests
+#define LATENCY_WINDOW 256
+
+// Observations needed before a percentile is trusted
+#define MIN_LATENCY_SAMPLES 20
+
+// Most credits that can be saved up, bounding a burst of duplicates
+#define MAX_HEDGE_CREDITS 10.0
+
+static pthread_mutex_t hedge_lock = PTHREAD_MUTEX_INITIALIZER;
+static long latencies[LATENCY_WINDOW];
+static int latency_count = 0; // Valid entries, up to LATENCY_WINDOW
+static int latency_next = 0;  // Ring position of the next entry
+static double credits = 0.0;
+static HedgeStats stats = {0, 0, 0};
+
+static int compare_long(const void *a, const void *b) {
+  long x = *(const long *)a;
+  long y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Record the latency of a successful request
+ */
+void hedge_record_latency(long latency_ms) {
+  pthread_mutex_lock(&hedge_lock);
+  latencies[latency_next] = latency_ms;
+  latency_next = (latency_next + 1) % LATENCY_WINDOW;
+  if (latency_count < LATENCY_WINDOW)
+    latency_count++;
+  pthread_mutex_unlock(&hedge_lock);
+}
+
+/**
+ * Get how long to wait before hedging a request
+ */
+long hedge_delay_ms(const HedgeConfig *config) {
+  if (!config->enabled)
+    return -1;
+
+  long window[LATENCY_WINDOW];
+  pthread_mutex_lock(&hedge_lock);
+  credits += config->budget;
+  if (credits > MAX_HEDGE_CREDITS)
+    credits = MAX_HEDGE_CREDITS;
+  int count = latency_count;
+  memcpy(window, latencies, (size_t)count * sizeof(long));
+  pthread_mutex_unlock(&hedge_lock);
+
+  if (count < MIN_LATENCY_SAMPLES)
+    return -1;
+
+  // Sorting a few hundred samples is noise next to an LLM round trip
+  qsort(window, (size_t)count, sizeof(long), compare_long);
+  int rank = (int)(config->percentile / 100.0 * (count - 1) + 0.5);
+  if (rank < 0)
+    rank = 0;
+  if (rank >= count)
+    rank = count - 1;
+
+  long delay = window[rank];
+  return delay < config->min_delay_ms ? config->min_delay_ms : delay;
+}
+
+/**
+ * Spend a credit on sending a duplicate
+ */
+int hedge_acquire(void) {
+  pthread_mutex_lock(&hedge_lock);
+  int allowed = credits >= 1.0;
+  if (allowed) {
+    credits -= 1.0;
+    stats.hedges++;
+  } else {
+    stats.denied++;
+  }
+  pthread_mutex_unlock(&hedge_lock);
+  return allowed;
+}
+
+/**
+ * Count a duplicate that finished before the original
+ */
+void hedge_record_win(void) {
+  pthread_mutex_lock(&hedge_lock);
+  stats.hedge_wins++;
+  pthread_mutex_unlock(&hedge_lock);
+}
+
+/**
+ * Get the hedging counters
+ */
+void hedge_stats(HedgeStats *out) {
+  pthread_mutex_lock(&hedge_lock);
+  *out = stats;
+  pthread_mutex_unlock(&hedge_lock);
+}
+
+/**
+ * Forget observed latencies, budget and counters
+ */
+void hedge_reset(void) {
+  pthread_mutex_lock(&hedge_lock);
+  latency_count = 0;
+  latency_next = 0;
+  credits = 0.0;
+  memset(&stats, 0, sizeof(stats));
+  pthread_mutex_unlock(&hedge_lock);
+}
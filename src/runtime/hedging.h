@@ -0,0 +1,77 @@
+/**
+ * @file hedging.h
+ * @brief Latency tracking and budget for hedged LLM requests
+ *
+ * A hedged request sends a duplicate when the original has been running
+ * longer than a percentile of recently observed latencies; whichever copy
+ * succeeds first is used and the other is cancelled. This module keeps a
+ * window of recent latencies to derive the trigger from, and a credit budget
+ * that caps how much extra traffic hedging may add: every request earns a
+ * fraction of a credit and every duplicate spends a whole one.
+ */
+
+#ifndef HEDGING_H
+#define HEDGING_H
+
+#include "config.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Counters describing hedging activity
+ */
+typedef struct {
+  uint64_t hedges;     // Duplicates sent
+  uint64_t hedge_wins; // Duplicates that finished before the original
+  uint64_t denied;     // Duplicates skipped because the budget was spent
+} HedgeStats;
+
+/**
+ * Record the latency of a successful request
+ *
+ * @param latency_ms Time from sending the request to receiving the response
+ */
+void hedge_record_latency(long latency_ms);
+
+/**
+ * Get how long to wait before hedging a request. Every call counts as a
+ * request and earns budget.
+ *
+ * @param config The function's hedging settings
+ * @return The delay in milliseconds, or -1 if the request should not be
+ * hedged (disabled, or too few latencies observed yet)
+ */
+long hedge_delay_ms(const HedgeConfig *config);
+
+/**
+ * Spend a credit on sending a duplicate
+ *
+ * @return 1 if the budget allows a duplicate, 0 otherwise
+ */
+int hedge_acquire(void);
+
+/**
+ * Count a duplicate that finished before the original
+ */
+void hedge_record_win(void);
+
+/**
+ * Get the hedging counters
+ *
+ * @param stats Receives the counters
+ */
+void hedge_stats(HedgeStats *stats);
+
+/**
+ * Forget observed latencies, budget and counters
+ */
+void hedge_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEDGING_H */
@@ -0,0 +1,379 @@
+/**
+ * @file llm_engine.c
+ * @brief Concurrent transfer engine for LLM requests built on curl multi
+ */
+
+#include "llm_engine.h"
+#include "../utils/log_utils.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+// How long the engine thread sleeps in curl_multi_poll when idle (ms)
+#define ENGINE_POLL_TIMEOUT_MS 1000
+
+typedef struct {
+  CURLM *multi;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int running;
+
+  // Transfers submitted but not yet added to the multi handle (FIFO)
+  LLMTransfer *queue_head;
+  LLMTransfer *queue_tail;
+
+  // Transfers currently added to the multi handle
+  LLMTransfer *active;
+  int cancel_count;
+} LLMEngine;
+
+static LLMEngine engine = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Unlink a transfer from the active list. Caller holds engine.lock.
+static void active_remove(LLMTransfer *transfer) {
+  if (transfer->prev)
+    transfer->prev->next = transfer->next;
+  else
+    engine.active = transfer->next;
+  if (transfer->next)
+    transfer->next->prev = transfer->prev;
+  transfer->prev = transfer->next = NULL;
+}
+
+// Mark a transfer done and wake its waiter. Caller holds engine.lock; the lock
+// is released around the completion callback.
+static void complete_transfer(LLMTransfer *transfer, CURLcode result,
+                              int cancelled) {
+  transfer->result = result;
+  transfer->cancelled = cancelled;
+  if (transfer->cancel_requested) {
+    transfer->cancel_requested = 0;
+    engine.cancel_count--;
+  }
+
+  // Off the queue and the active list now; cancelling it must do nothing
+  transfer->state = LLM_TRANSFER_COMPLETING;
+  if (transfer->on_done) {
+    pthread_mutex_unlock(&engine.lock);
+    transfer->on_done(transfer, transfer->user_data);
+    pthread_mutex_lock(&engine.lock);
+  }
+
+  transfer->state = LLM_TRANSFER_DONE;
+  pthread_cond_broadcast(&transfer->done_cond);
+}
+
+// Move queued transfers into the multi handle. Caller holds engine.lock.
+static void admit_queued(void) {
+  while (engine.queue_head) {
+    LLMTransfer *transfer = engine.queue_head;
+    engine.queue_head = transfer->next;
+    if (!engine.queue_head)
+      engine.queue_tail = NULL;
+    transfer->next = NULL;
+
+    // Cancelled before it was ever sent
+    if (transfer->cancel_requested) {
+      complete_transfer(transfer, CURLE_ABORTED_BY_CALLBACK, 1);
+      continue;
+    }
+
+    curl_easy_setopt(transfer->easy, CURLOPT_PRIVATE, transfer);
+    CURLMcode mres = curl_multi_add_handle(engine.multi, transfer->easy);
+    if (mres != CURLM_OK) {
+      ERROR("curl_multi_add_handle() failed: %s", curl_multi_strerror(mres));
+      complete_transfer(transfer, CURLE_FAILED_INIT, 0);
+      continue;
+    }
+
+    transfer->state = LLM_TRANSFER_ACTIVE;
+    transfer->next = engine.active;
+    if (engine.active)
+      engine.active->prev = transfer;
+    engine.active = transfer;
+  }
+}
+
+// Remove transfers whose owners asked for cancellation. Caller holds
+// engine.lock.
+static void reap_cancelled(void) {
+  LLMTransfer *transfer = engine.active;
+  while (transfer && engine.cancel_count > 0) {
+    LLMTransfer *next = transfer->next;
+    if (transfer->cancel_requested) {
+      curl_multi_remove_handle(engine.multi, transfer->easy);
+      active_remove(transfer);
+      complete_transfer(transfer, CURLE_ABORTED_BY_CALLBACK, 1);
+    }
+    transfer = next;
+  }
+}
+
+// Collect finished transfers from the multi handle. Caller holds engine.lock.
+static void reap_finished(void) {
+  CURLMsg *msg;
+  int msgs_left;
+  while ((msg = curl_multi_info_read(engine.multi, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    LLMTransfer *transfer = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&transfer);
+    CURLcode result = msg->data.result;
+    curl_multi_remove_handle(engine.multi, msg->easy_handle);
+    if (!transfer || transfer->state != LLM_TRANSFER_ACTIVE)
+      continue;
+
+    curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE,
+                      &transfer->http_status);
+    active_remove(transfer);
+    complete_transfer(transfer, result, 0);
+  }
+}
+
+static void *engine_thread_main(void *arg) {
+  (void)arg;
+  DEBUG("LLM engine thread started");
+
+  pthread_mutex_lock(&engine.lock);
+  while (engine.running) {
+    admit_queued();
+    if (engine.cancel_count > 0)
+      reap_cancelled();
+    pthread_mutex_unlock(&engine.lock);
+
+    int still_running = 0;
+    CURLMcode mres = curl_multi_perform(engine.multi, &still_running);
+    if (mres != CURLM_OK)
+      ERROR("curl_multi_perform() failed: %s", curl_multi_strerror(mres));
+
+    pthread_mutex_lock(&engine.lock);
+    reap_finished();
+    int idle = engine.queue_head == NULL && engine.cancel_count == 0;
+    pthread_mutex_unlock(&engine.lock);
+
+    // Sleep until there is socket activity or curl_multi_wakeup() is called
+    if (idle)
+      curl_multi_poll(engine.multi, NULL, 0, ENGINE_POLL_TIMEOUT_MS, NULL);
+
+    pthread_mutex_lock(&engine.lock);
+  }
+
+  // Abort whatever is left so that no waiter blocks forever
+  while (engine.active) {
+    LLMTransfer *transfer = engine.active;
+    curl_multi_remove_handle(engine.multi, transfer->easy);
+    active_remove(transfer);
+    complete_transfer(transfer, CURLE_ABORTED_BY_CALLBACK, 1);
+  }
+  while (engine.queue_head) {
+    LLMTransfer *transfer = engine.queue_head;
+    engine.queue_head = transfer->next;
+    transfer->next = NULL;
+    complete_transfer(transfer, CURLE_ABORTED_BY_CALLBACK, 1);
+  }
+  engine.queue_tail = NULL;
+  pthread_mutex_unlock(&engine.lock);
+
+  DEBUG("LLM engine thread stopped");
+  return NULL;
+}
+
+/**
+ * Start the engine thread
+ */
+int llm_engine_start(void) {
+  pthread_mutex_lock(&engine.lock);
+  if (engine.running) {
+    pthread_mutex_unlock(&engine.lock);
+    return 1;
+  }
+
+  engine.multi = curl_multi_init();
+  if (!engine.multi) {
+    ERROR("curl_multi_init() failed");
+    pthread_mutex_unlock(&engine.lock);
+    return 0;
+  }
+
+  const TransportConfig *transport = get_transport_config();
+  curl_multi_setopt(engine.multi, CURLMOPT_PIPELINING,
+                    transport->http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+  curl_multi_setopt(engine.multi, CURLMOPT_MAXCONNECTS,
+                    (long)transport->max_connections);
+  curl_multi_setopt(engine.multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    (long)transport->max_host_connections);
+
+  engine.running = 1;
+  if (pthread_create(&engine.thread, NULL, engine_thread_main, NULL) != 0) {
+    ERROR("Failed to start LLM engine thread");
+    engine.running = 0;
+    curl_multi_cleanup(engine.multi);
+    engine.multi = NULL;
+    pthread_mutex_unlock(&engine.lock);
+    return 0;
+  }
+
+  pthread_mutex_unlock(&engine.lock);
+  DEBUG("LLM engine started (max_connections=%d, http2=%d)",
+        transport->max_connections, transport->http2);
+  return 1;
+}
+
+/**
+ * Stop the engine thread
+ */
+void llm_engine_stop(void) {
+  pthread_mutex_lock(&engine.lock);
+  if (!engine.running) {
+    pthread_mutex_unlock(&engine.lock);
+    return;
+  }
+  engine.running = 0;
+  pthread_mutex_unlock(&engine.lock);
+
+  curl_multi_wakeup(engine.multi);
+  pthread_join(engine.thread, NULL);
+
+  curl_multi_cleanup(engine.multi);
+  engine.multi = NULL;
+  DEBUG("LLM engine stopped");
+}
+
+/**
+ * Apply connection-reuse and HTTP/2 options to an easy handle
+ */
+void llm_engine_configure_handle(CURL *easy, const char *url) {
+  const TransportConfig *transport = get_transport_config();
+
+  // Signals are not safe with several threads driving transfers
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+
+  // HTTP/2 is only negotiated over TLS; waiting for a multiplexed stream on a
+  // cleartext endpoint would just serialize requests behind one connection
+  if (transport->http2 && url && strncmp(url, "https://", 8) == 0) {
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    // Prefer waiting for a multiplexed stream over opening a new connection
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+  } else {
+    // Session handles are reused across endpoints, so undo the above
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 0L);
+  }
+}
+
+/**
+ * Initialize a transfer around a configured easy handle
+ */
+void llm_transfer_init(LLMTransfer *transfer, CURL *easy) {
+  memset(transfer, 0, sizeof(*transfer));
+  transfer->easy = easy;
+  transfer->result = CURLE_OK;
+  transfer->state = LLM_TRANSFER_IDLE;
+  pthread_cond_init(&transfer->done_cond, NULL);
+}
+
+/**
+ * Release resources held by a transfer
+ */
+void llm_transfer_destroy(LLMTransfer *transfer) {
+  pthread_cond_destroy(&transfer->done_cond);
+}
+
+/**
+ * Queue a transfer for execution
+ */
+int llm_engine_submit(LLMTransfer *transfer) {
+  pthread_mutex_lock(&engine.lock);
+  if (!engine.running) {
+    pthread_mutex_unlock(&engine.lock);
+    ERROR("LLM engine is not running");
+    return 0;
+  }
+
+  transfer->state = LLM_TRANSFER_QUEUED;
+  transfer->cancelled = 0;
+  transfer->cancel_requested = 0;
+  transfer->http_status = 0;
+  transfer->next = NULL;
+  if (engine.queue_tail)
+    engine.queue_tail->next = transfer;
+  else
+    engine.queue_head = transfer;
+  engine.queue_tail = transfer;
+
+  // Under the lock, so llm_engine_stop cannot free the multi handle first
+  curl_multi_wakeup(engine.multi);
+  pthread_mutex_unlock(&engine.lock);
+  return 1;
+}
+
+/**
+ * Block until a submitted transfer is done
+ */
+void llm_engine_wait(LLMTransfer *transfer) {
+  pthread_mutex_lock(&engine.lock);
+  while (transfer->state == LLM_TRANSFER_QUEUED ||
+         transfer->state == LLM_TRANSFER_ACTIVE ||
+         transfer->state == LLM_TRANSFER_COMPLETING) {
+    pthread_cond_wait(&transfer->done_cond, &engine.lock);
+  }
+  pthread_mutex_unlock(&engine.lock);
+}
+
+/**
+ * Submit a transfer and wait for it to finish
+ */
+CURLcode llm_engine_perform(LLMTransfer *transfer) {
+  if (!llm_engine_submit(transfer))
+    return CURLE_FAILED_INIT;
+  llm_engine_wait(transfer);
+  return transfer->result;
+}
+
+// Ask the engine thread to remove a transfer, even one still queued, so
+// that completion callbacks only ever run there. A transfer that is
+// completing or done is left alone. Caller holds engine.lock.
+static void request_cancel_locked(LLMTransfer *transfer) {
+  if ((transfer->state == LLM_TRANSFER_QUEUED ||
+       transfer->state == LLM_TRANSFER_ACTIVE) &&
+      !transfer->cancel_requested) {
+    transfer->cancel_requested = 1;
+    engine.cancel_count++;
+    curl_multi_wakeup(engine.multi);
+  }
+}
+
+/**
+ * Cancel a submitted transfer
+ */
+void llm_engine_cancel(LLMTransfer *transfer) {
+  pthread_mutex_lock(&engine.lock);
+  request_cancel_locked(transfer);
+  while (transfer->state == LLM_TRANSFER_QUEUED ||
+         transfer->state == LLM_TRANSFER_ACTIVE ||
+         transfer->state == LLM_TRANSFER_COMPLETING) {
+    pthread_cond_wait(&transfer->done_cond, &engine.lock);
+  }
+  pthread_mutex_unlock(&engine.lock);
+}
+
+/**
+ * Ask for a submitted transfer to be cancelled without waiting
+ */
+void llm_engine_abort(LLMTransfer *transfer) {
+  pthread_mutex_lock(&engine.lock);
+  request_cancel_locked(transfer);
+  pthread_mutex_unlock(&engine.lock);
+}
+
+/**
+ * Check whether the engine thread has nothing to act on
+ */
+int llm_engine_idle(void) {
+  pthread_mutex_lock(&engine.lock);
+  int idle = engine.queue_head == NULL && engine.cancel_count == 0;
+  pthread_mutex_unlock(&engine.lock);
+  return idle;
+}
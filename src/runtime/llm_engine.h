@@ -0,0 +1,148 @@
+/**
+ * @file llm_engine.h
+ * @brief Concurrent transfer engine for LLM requests built on curl multi
+ *
+ * The engine owns a single curl multi handle driven by a dedicated I/O
+ * thread. Callers configure an easy handle, wrap it in an LLMTransfer and
+ * submit it; the engine keeps every submitted transfer in flight at once over
+ * a shared pool of reused connections, multiplexing them over HTTP/2 when the
+ * endpoint supports it.
+ */
+
+#ifndef LLM_ENGINE_H
+#define LLM_ENGINE_H
+
+#include <curl/curl.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct LLMTransfer LLMTransfer;
+
+/**
+ * Completion callback, invoked on the engine thread just before the transfer
+ * is marked done. It must not block and must not submit or wait on transfers.
+ */
+typedef void (*llm_transfer_done_fn)(LLMTransfer *transfer, void *user_data);
+
+typedef enum {
+  LLM_TRANSFER_IDLE,       // Initialized, not yet submitted
+  LLM_TRANSFER_QUEUED,     // Waiting for the engine thread to pick it up
+  LLM_TRANSFER_ACTIVE,     // Added to the multi handle
+  LLM_TRANSFER_COMPLETING, // Finished, its completion callback running
+  LLM_TRANSFER_DONE        // Finished, failed or cancelled
+} LLMTransferState;
+
+/**
+ * A single HTTP transfer tracked by the engine. The easy handle and any
+ * buffers it writes into are owned by the caller and must stay valid until
+ * the transfer is done.
+ */
+struct LLMTransfer {
+  CURL *easy;                   // Fully configured easy handle
+  CURLcode result;              // Transfer result once done
+  long http_status;             // HTTP response code once done
+  int cancelled;                // Set when cancelled before completion
+  llm_transfer_done_fn on_done; // Optional completion callback
+  void *user_data;              // Passed to on_done
+
+  // Engine bookkeeping
+  LLMTransferState state;
+  int cancel_requested;
+  pthread_cond_t done_cond;
+  LLMTransfer *prev;
+  LLMTransfer *next;
+};
+
+/**
+ * Start the engine thread. Safe to call more than once; only the first call
+ * after a stop has any effect.
+ *
+ * @return 1 on success, 0 on failure
+ */
+int llm_engine_start(void);
+
+/**
+ * Stop the engine thread. Transfers still in flight are cancelled.
+ */
+void llm_engine_stop(void);
+
+/**
+ * Apply the engine's connection-reuse and HTTP/2 options to an easy handle
+ *
+ * @param easy The easy handle to configure
+ * @param url The URL the handle will request
+ */
+void llm_engine_configure_handle(CURL *easy, const char *url);
+
+/**
+ * Initialize a transfer around a configured easy handle
+ *
+ * @param transfer The transfer to initialize
+ * @param easy The easy handle to drive
+ */
+void llm_transfer_init(LLMTransfer *transfer, CURL *easy);
+
+/**
+ * Release resources held by a transfer. The transfer must be done or idle.
+ *
+ * @param transfer The transfer to destroy
+ */
+void llm_transfer_destroy(LLMTransfer *transfer);
+
+/**
+ * Queue a transfer for execution and return immediately
+ *
+ * @param transfer The transfer to submit
+ * @return 1 on success, 0 if the engine is not running
+ */
+int llm_engine_submit(LLMTransfer *transfer);
+
+/**
+ * Block until a submitted transfer is done
+ *
+ * @param transfer The transfer to wait for
+ */
+void llm_engine_wait(LLMTransfer *transfer);
+
+/**
+ * Submit a transfer and wait for it to finish
+ *
+ * @param transfer The transfer to run
+ * @return The transfer's CURLcode
+ */
+CURLcode llm_engine_perform(LLMTransfer *transfer);
+
+/**
+ * Cancel a submitted transfer and wait until the engine has released it.
+ * Has no effect on transfers that are completing or already done.
+ *
+ * @param transfer The transfer to cancel
+ */
+void llm_engine_cancel(LLMTransfer *transfer);
+
+/**
+ * Ask for a submitted transfer to be cancelled and return immediately. The
+ * owner still waits for it with llm_engine_wait, which returns once the
+ * engine has released it. Has no effect on transfers that are completing or
+ * already done.
+ *
+ * @param transfer The transfer to abort
+ */
+void llm_engine_abort(LLMTransfer *transfer);
+
+/**
+ * Check whether the engine thread has no queued transfers and no
+ * cancellations to act on, so it sleeps until socket activity
+ *
+ * @return 1 if idle, 0 if work is pending
+ */
+int llm_engine_idle(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LLM_ENGINE_H */
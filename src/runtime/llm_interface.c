@@ -5,41 +5,58 @@
 
 #include "llm_interface.h"
 #include "../utils/log_utils.h"
+#include "admission.h"
+#include "call_context.h"
+#include "cassette.h"
+#include "completion_parser.h"
 #include "config.h"
-#include <cJSON.h>
+#include "hedging.h"
+#include "llm_engine.h"
+#include "llm_session.h"
+#include "request_serializer.h"
+#include "response_cache.h"
+#include "retry_policy.h"
+#include "sse_parser.h"
+#include "tokenizer.h"
+#include <ctype.h>
+#include <errno.h>
 #include <curl/curl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 
-// Memory struct for cURL response data
-typedef struct {
-  char *memory;
-  size_t size;
-} ResponseMemory;
+// Largest Content-Length trusted for presizing a response buffer
+#define MAX_PRESIZE_BYTES (64 * 1024 * 1024)
 
-// Global cURL handle
-static CURL *curl_handle = NULL;
-static char error_buffer[CURL_ERROR_SIZE];
+// Time limit for a single attempt; the retry deadline may shorten it
+#define ATTEMPT_TIMEOUT_MS 30000L
 
-// cURL write callback function
-static size_t write_memory_callback(void *contents, size_t size, size_t nmemb,
-                                    void *userp) {
+// Size the handle's response buffer for the whole body up front when the
+// server announced its length
+static void presize_response(LLMHandle *handle) {
+  curl_off_t content_length = -1;
+  if (curl_easy_getinfo(handle->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                        &content_length) == CURLE_OK &&
+      content_length > 0 && content_length <= MAX_PRESIZE_BYTES)
+    llm_buffer_reserve(&handle->response, (size_t)content_length);
+}
+
+// cURL write callback collecting the body into the handle's response buffer
+static size_t write_response_callback(void *contents, size_t size,
+                                      size_t nmemb, void *userp) {
   size_t real_size = size * nmemb;
-  ResponseMemory *mem = (ResponseMemory *)userp;
+  LLMHandle *handle = (LLMHandle *)userp;
 
-  char *ptr = realloc(mem->memory, mem->size + real_size + 1);
-  if (!ptr) {
+  if (handle->response.length == 0)
+    presize_response(handle);
+
+  if (!llm_buffer_append(&handle->response, contents, real_size)) {
     ERROR("Not enough memory for cURL response");
     return 0;
   }
-
-  mem->memory = ptr;
-  memcpy(&(mem->memory[mem->size]), contents, real_size);
-  mem->size += real_size;
-  mem->memory[mem->size] = 0;
-
   return real_size;
 }
 
@@ -56,14 +73,6 @@ int init_llm_connection(void) {
     return 0;
   }
 
-  // Create a persistent cURL handle
-  curl_handle = curl_easy_init();
-  if (!curl_handle) {
-    ERROR("curl_easy_init() failed");
-    curl_global_cleanup();
-    return 0;
-  }
-
   // Check for API key in environment variables first (higher priority)
   const char *env_api_key = getenv("OPENAI_API_KEY");
   const char *generic_env_key = getenv("VIBELANG_API_KEY");
@@ -77,23 +86,69 @@ int init_llm_connection(void) {
     if (!api_key || strlen(api_key) == 0) {
       ERROR("API key not set. Please set it in vibeconfig.json or via "
             "OPENAI_API_KEY environment variable");
-      curl_easy_cleanup(curl_handle);
-      curl_handle = NULL;
       curl_global_cleanup();
       return 0;
     }
   }
 
-  // Set up error buffer
-  curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, error_buffer);
+  // Shared connection/DNS/TLS caches for the per-thread sessions
+  if (!llm_sessions_init()) {
+    ERROR("Failed to initialize LLM sessions");
+    curl_global_cleanup();
+    return 0;
+  }
 
-  // Set a timeout of 30 seconds to prevent hanging on network issues
-  curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 30L);
+  // Start the transfer engine that all requests are multiplexed through
+  if (!llm_engine_start()) {
+    ERROR("Failed to start LLM transfer engine");
+    llm_sessions_cleanup();
+    curl_global_cleanup();
+    return 0;
+  }
 
   DEBUG("LLM connection initialized successfully");
   return 1;
 }
 
+// Index of the variable a {name} marker names, -1 if none
+static int find_variable(const char *name, size_t length, char **var_names,
+                         int var_count) {
+  for (int i = 0; i < var_count; i++) {
+    if (strncmp(var_names[i], name, length) == 0 && !var_names[i][length])
+      return i;
+  }
+  return -1;
+}
+
+// Substitute the variables of a template into out, or only measure the
+// result if out is NULL. Returns its length.
+static size_t substitute(const char *template, char **var_names,
+                         char **var_values, int var_count, char *out) {
+  size_t length = 0;
+  for (const char *p = template; *p;) {
+    const char *close = *p == '{' ? strchr(p + 1, '}') : NULL;
+    int index = close ? find_variable(p + 1, (size_t)(close - p - 1),
+                                      var_names, var_count)
+                      : -1;
+    const char *text = p;
+    size_t n;
+    if (index >= 0) {
+      text = var_values[index];
+      n = strlen(text);
+      p = close + 1;
+    } else {
+      // Copy up to the next possible marker
+      const char *next = strchr(p + 1, '{');
+      n = next ? (size_t)(next - p) : strlen(p);
+      p += n;
+    }
+    if (out)
+      memcpy(out + length, text, n);
+    length += n;
+  }
+  return length;
+}
+
 /**
  * Format a prompt template with variable values
  */
@@ -105,66 +160,61 @@ char *format_prompt(const char *template, char **var_names, char **var_values,
     return strdup(template); // No variables to substitute
   }
 
-  // Calculate the size of the formatted prompt
-  size_t formatted_size =
-      strlen(template) + 1; // Start with template size + null terminator
-  size_t template_len = strlen(template);
-
-  // First pass: calculate the required size
-  for (int i = 0; i < var_count; i++) {
-    char var_marker[256];
-    snprintf(var_marker, sizeof(var_marker), "{%s}", var_names[i]);
-
-    const char *pos = template;
-    while ((pos = strstr(pos, var_marker)) != NULL) {
-      // Remove marker size, add variable value size
-      formatted_size =
-          formatted_size - strlen(var_marker) + strlen(var_values[i]);
-      pos += strlen(var_marker);
-    }
-  }
-
-  // Allocate memory for the formatted prompt
-  char *formatted = malloc(formatted_size);
+  // Measure, then substitute into a buffer of the exact size
+  size_t length =
+      substitute(template, var_names, var_values, var_count, NULL);
+  char *formatted = malloc(length + 1);
   if (!formatted) {
     ERROR("Failed to allocate memory for formatted prompt");
     return NULL;
   }
+  substitute(template, var_names, var_values, var_count, formatted);
+  formatted[length] = '\0';
+  return formatted;
+}
 
-  // Initialize with template
-  strcpy(formatted, template);
-
-  // Second pass: perform substitutions
-  for (int i = 0; i < var_count; i++) {
-    char var_marker[256];
-    snprintf(var_marker, sizeof(var_marker), "{%s}", var_names[i]);
-
-    char *pos;
-    while ((pos = strstr(formatted, var_marker)) != NULL) {
-      size_t marker_len = strlen(var_marker);
-      size_t value_len = strlen(var_values[i]);
-
-      // Shift the remaining string to accommodate the value
-      if (marker_len != value_len) {
-        memmove(pos + value_len, pos + marker_len,
-                strlen(pos + marker_len) + 1);
-      }
-
-      // Copy the value in place of the marker
-      memcpy(pos, var_values[i], value_len);
+/**
+ * Render a precompiled prompt template in one pass
+ */
+size_t render_prompt(const VibePromptTemplate *template,
+                     const VibePromptArg *args, char *out) {
+  if (!out) {
+    size_t length = template->literal_length;
+    for (int i = 0; i < template->segment_count; i++) {
+      if (template->segments[i].slot >= 0)
+        length += args[template->segments[i].slot].length;
     }
+    return length;
   }
 
-  return formatted;
+  size_t length = 0;
+  for (int i = 0; i < template->segment_count; i++) {
+    const VibePromptSegment *segment = &template->segments[i];
+    memcpy(out + length, segment->text, segment->length);
+    length += segment->length;
+    if (segment->slot >= 0) {
+      const VibePromptArg *arg = &args[segment->slot];
+      if (arg->length)
+        memcpy(out + length, arg->text, arg->length);
+      length += arg->length;
+    }
+  }
+  out[length] = '\0';
+  return length;
 }
 
 /**
- * Parse the OpenAI API JSON response to extract the content message
+ * Parse the OpenAI API JSON response to extract the content message. The
+ * response is scanned once and the content is unescaped in place, so the
+ * buffer is modified.
  *
  * @param json_str The JSON response string from OpenAI API
+ * @param length Length of the response in bytes
+ * @param total_tokens Receives the reported token usage, -1 if absent
  * @return The extracted content message, or NULL on error
  */
-static char *parse_openai_response(const char *json_str) {
+static char *parse_openai_response(char *json_str, size_t length,
+                                   long *total_tokens) {
   if (!json_str) {
     ERROR("NULL JSON response");
     return NULL;
@@ -172,138 +222,113 @@ static char *parse_openai_response(const char *json_str) {
 
   DEBUG("Parsing OpenAI JSON response");
 
-  cJSON *root = cJSON_Parse(json_str);
-  if (!root) {
-    ERROR("Failed to parse JSON response: %s", cJSON_GetErrorPtr());
-    return NULL;
-  }
-
-  // First, get the "choices" array
-  cJSON *choices = cJSON_GetObjectItem(root, "choices");
-  if (!choices || !cJSON_IsArray(choices) || cJSON_GetArraySize(choices) == 0) {
-    ERROR("Invalid or empty choices array in response");
-    cJSON_Delete(root);
+  *total_tokens = -1;
+  CompletionFields fields;
+  if (!completion_extract(json_str, length, &fields)) {
+    ERROR("Failed to parse JSON response");
     return NULL;
   }
 
-  // Get the first choice (we only expect one in typical responses)
-  cJSON *choice = cJSON_GetArrayItem(choices, 0);
-  if (!choice) {
-    ERROR("Failed to get first choice from response");
-    cJSON_Delete(root);
+  if (!fields.content) {
+    ERROR("Content not found or not a string");
     return NULL;
   }
 
-  // Get the "message" object
-  cJSON *message = cJSON_GetObjectItem(choice, "message");
-  if (!message) {
-    ERROR("Message object not found in choice");
-    cJSON_Delete(root);
-    return NULL;
+  *total_tokens = fields.total_tokens;
+  if (fields.total_tokens >= 0) {
+    DEBUG("Token usage: %ld prompt, %ld completion, %ld total",
+          fields.prompt_tokens, fields.completion_tokens, fields.total_tokens);
   }
+  if (fields.finish_reason && strcmp(fields.finish_reason, "length") == 0)
+    WARN("Completion was truncated by the max_tokens limit");
 
-  // Get the "content" string
-  cJSON *content = cJSON_GetObjectItem(message, "content");
-  if (!content || !cJSON_IsString(content)) {
-    ERROR("Content not found or not a string");
-    cJSON_Delete(root);
+  // The only copy made: the content the caller takes ownership of
+  char *result = malloc(fields.content_length + 1);
+  if (!result) {
+    ERROR("Failed to allocate memory for response content");
     return NULL;
   }
-
-  // Extract the content string
-  char *result = strdup(content->valuestring);
-
-  // Clean up JSON objects
-  cJSON_Delete(root);
+  memcpy(result, fields.content, fields.content_length + 1);
 
   DEBUG("Successfully extracted message content from JSON");
   return result;
 }
 
-/**
- * Send a prompt to the LLM and get the response
- *
- * @param prompt The formatted prompt to send
- * @param meaning The semantic meaning of the prompt (used for response
- * processing)
- * @return The response from the LLM, or NULL on error
- */
-char *send_llm_prompt(const char *prompt, const char *meaning) {
-  // Very early debug to see if we get this far
-  fprintf(stderr, "DEBUG: Entering send_llm_prompt with prompt='%s'\n",
-          prompt ? prompt : "NULL");
-
-  if (!prompt) {
-    fprintf(stderr, "ERROR: NULL prompt provided to send_llm_prompt\n");
-    return NULL;
-  }
-
-  DEBUG("Sending prompt to LLM: %s", prompt);
+// Mock responses are enabled by VIBELANG_DEV_MODE=1, read once per process
+static pthread_once_t dev_mode_once = PTHREAD_ONCE_INIT;
+static int dev_mode = 0;
 
-  // Check for dev mode FIRST, before any API key checks
-  const char *dev_mode = getenv("VIBELANG_DEV_MODE");
-  fprintf(stderr, "DEBUG: VIBELANG_DEV_MODE=%s\n",
-          dev_mode ? dev_mode : "NULL");
+static void read_dev_mode(void) {
+  const char *value = getenv("VIBELANG_DEV_MODE");
+  dev_mode = value && strcmp(value, "1") == 0;
+  if (dev_mode)
+    INFO("Development mode: LLM calls return mock responses");
+}
 
-  if (dev_mode && strcmp(dev_mode, "1") == 0) {
-    fprintf(stderr, "DEBUG: Using mock LLM responses (dev mode)\n");
+static int is_dev_mode(void) {
+  pthread_once(&dev_mode_once, read_dev_mode);
+  return dev_mode;
+}
 
-    // Safe check for strings before using strstr
-    int has_weather_term = 0;
-    if (prompt) {
-      has_weather_term = (strstr(prompt, "weather") != NULL);
-    }
+// Produce a canned response for development mode
+static char *mock_llm_response(const char *prompt, const char *meaning) {
+  // Safe check for strings before using strstr
+  int has_weather_term = 0;
+  if (prompt) {
+    has_weather_term = (strstr(prompt, "weather") != NULL);
+  }
 
-    if (meaning) {
-      has_weather_term =
-          has_weather_term || (strstr(meaning, "weather") != NULL);
-    }
+  if (meaning) {
+    has_weather_term =
+        has_weather_term || (strstr(meaning, "weather") != NULL);
+  }
 
-    // Mock responses for testing based on keywords
-    if (has_weather_term) {
-      fprintf(stderr, "DEBUG: Returning mock weather response\n");
-      return strdup("Sunny with a high of 75°F");
-    }
+  // Mock responses for testing based on keywords
+  if (has_weather_term) {
+    DEBUG("Returning weather mock response");
+    return strdup("Sunny with a high of 75°F");
+  }
 
-    int has_temp_term = 0;
-    if (prompt) {
-      has_temp_term = (strstr(prompt, "temperature") != NULL);
-    }
+  int has_temp_term = 0;
+  if (prompt) {
+    has_temp_term = (strstr(prompt, "temperature") != NULL);
+  }
 
-    if (meaning) {
-      has_temp_term = has_temp_term || (strstr(meaning, "temperature") != NULL);
-    }
+  if (meaning) {
+    has_temp_term = has_temp_term || (strstr(meaning, "temperature") != NULL);
+  }
 
-    if (has_temp_term) {
-      DEBUG("Returning temperature mock response");
-      return strdup("25");
-    }
+  if (has_temp_term) {
+    DEBUG("Returning temperature mock response");
+    return strdup("25");
+  }
 
-    int has_greeting_term = 0;
-    if (prompt) {
-      has_greeting_term = (strstr(prompt, "greeting") != NULL);
-    }
+  int has_greeting_term = 0;
+  if (prompt) {
+    has_greeting_term = (strstr(prompt, "greeting") != NULL);
+  }
 
-    if (meaning) {
-      has_greeting_term =
-          has_greeting_term || (strstr(meaning, "greeting") != NULL);
-    }
+  if (meaning) {
+    has_greeting_term =
+        has_greeting_term || (strstr(meaning, "greeting") != NULL);
+  }
 
-    if (has_greeting_term) {
-      DEBUG("Returning greeting mock response");
-      char *formatted = malloc(100 + (prompt ? strlen(prompt) : 0));
-      if (formatted) {
-        strcpy(formatted, "Hello! Welcome to VibeLang.");
-        return formatted;
-      }
+  if (has_greeting_term) {
+    DEBUG("Returning greeting mock response");
+    char *formatted = malloc(100 + (prompt ? strlen(prompt) : 0));
+    if (formatted) {
+      strcpy(formatted, "Hello! Welcome to VibeLang.");
+      return formatted;
     }
-
-    // Default mock response - always returns something in dev mode
-    fprintf(stderr, "DEBUG: Returning default mock response\n");
-    return strdup("This is a mock response from the LLM");
   }
 
-  // After this point we're in production mode, so check API keys
+  // Default mock response - always returns something in dev mode
+  DEBUG("Returning default mock response");
+  return strdup("This is a mock response from the LLM");
+}
+
+// Resolve the API key, preferring the environment over the config file
+static const char *resolve_api_key(void) {
   const char *api_key = get_api_key();
   const char *env_api_key = getenv("OPENAI_API_KEY");
 
@@ -319,101 +344,749 @@ char *send_llm_prompt(const char *prompt, const char *meaning) {
     ERROR("API key not set");
     return NULL;
   }
+  return api_key;
+}
+
+// A chat completion request bound to a session handle. The body lives in the
+// handle's request buffer.
+typedef struct {
+  LLMHandle *handle;
+  char retry_after[64]; // Retry-After header of the response, if any
+} ChatRequest;
+
+// Why an attempt failed, for deciding whether to try again
+typedef struct {
+  int retryable;
+  long retry_after_ms; // -1 when the server sent no usable Retry-After
+} AttemptFailure;
+
+// curl header callback keeping the Retry-After value
+static size_t header_callback(char *buffer, size_t size, size_t nitems,
+                              void *userdata) {
+  size_t length = size * nitems;
+  ChatRequest *request = (ChatRequest *)userdata;
+  static const char name[] = "retry-after:";
+  size_t name_length = sizeof(name) - 1;
+
+  if (length <= name_length || strncasecmp(buffer, name, name_length) != 0)
+    return length;
+
+  const char *value = buffer + name_length;
+  size_t value_length = length - name_length;
+  while (value_length && isspace((unsigned char)*value)) {
+    value++;
+    value_length--;
+  }
+  while (value_length && isspace((unsigned char)value[value_length - 1]))
+    value_length--;
+
+  if (value_length < sizeof(request->retry_after)) {
+    memcpy(request->retry_after, value, value_length);
+    request->retry_after[value_length] = '\0';
+  }
+  return length;
+}
+
+// Configure a session handle for a chat completion request. The caller still
+// has to install a write callback.
+static int chat_request_prepare(ChatRequest *request, const char *prompt,
+                                const FunctionConfig *function, int stream,
+                                long timeout_ms) {
+  memset(request, 0, sizeof(*request));
+
+  const char *api_key = resolve_api_key();
+  if (!api_key)
+    return 0;
+
+  // Take a handle from this thread's session; connections, DNS results and
+  // TLS sessions are shared between all sessions
+  request->handle = llm_session_acquire();
+  if (!request->handle) {
+    ERROR("Failed to acquire an LLM session handle");
+    return 0;
+  }
+  CURL *easy = request->handle->easy;
+
+  // The endpoint comes from the configuration; a Unix-domain socket replaces
+  // the TCP connection but the URL still supplies the path and Host header.
+  // Both options stick to the reused handle, so they are always set.
+  const char *url = function->endpoint;
+  curl_easy_setopt(easy, CURLOPT_URL, url);
+  curl_easy_setopt(easy, CURLOPT_UNIX_SOCKET_PATH, function->unix_socket);
+
+  // Set a timeout to prevent hanging on network issues
+  curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, timeout_ms);
+  llm_engine_configure_handle(easy, url);
+
+  curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_callback);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, (void *)request);
+
+  // The session builds the header list once and keeps it
+  struct curl_slist *headers = llm_session_headers(api_key, stream);
+  if (!headers) {
+    llm_session_release(request->handle);
+    memset(request, 0, sizeof(*request));
+    return 0;
+  }
+  curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headers);
+
+  // Serialize the body into the handle's reusable request buffer
+  LLMBuffer *body = &request->handle->request;
+  if (!chat_request_serialize(body, function, prompt, stream)) {
+    ERROR("Failed to allocate memory for JSON payload");
+    llm_session_release(request->handle);
+    memset(request, 0, sizeof(*request));
+    return 0;
+  }
+
+  curl_easy_setopt(easy, CURLOPT_POSTFIELDS, body->data);
+  curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body->length);
+  return 1;
+}
+
+// Cancel hook aborting a submitted transfer
+static void abort_transfer(void *arg) { llm_engine_abort((LLMTransfer *)arg); }
+
+// Watch a submitted transfer for cancellation; if the token is already
+// cancelled the transfer is aborted at once. Returns whether a hook must be
+// removed once the transfer is done.
+static int watch_transfer(VibeCancelToken *cancel, CancelHook *hook,
+                          LLMTransfer *transfer) {
+  if (call_context_hook(cancel, hook, abort_transfer, transfer))
+    return 1;
+  llm_engine_abort(transfer);
+  return 0;
+}
+
+// Run a prepared request through the engine and wait for it to finish or be
+// cancelled
+static CURLcode chat_request_perform(ChatRequest *request,
+                                     VibeCancelToken *cancel,
+                                     long *response_code) {
+  LLMTransfer transfer;
+  llm_transfer_init(&transfer, request->handle->easy);
+  CURLcode res = CURLE_FAILED_INIT;
+  if (llm_engine_submit(&transfer)) {
+    CancelHook hook;
+    int watched = watch_transfer(cancel, &hook, &transfer);
+    llm_engine_wait(&transfer);
+    if (watched)
+      call_context_unhook(cancel, &hook);
+    res = transfer.result;
+  }
+  *response_code = transfer.http_status;
+  llm_transfer_destroy(&transfer);
+
+  if (res != CURLE_OK) {
+    ERROR("LLM request failed: %s", request->handle->error_buffer[0]
+                                        ? request->handle->error_buffer
+                                        : curl_easy_strerror(res));
+  }
+  return res;
+}
+
+static void chat_request_cleanup(ChatRequest *request) {
+  llm_session_release(request->handle);
+  memset(request, 0, sizeof(*request));
+}
+
+// Record whether a failed attempt is worth repeating
+static void classify_failure(const ChatRequest *request,
+                             const FunctionConfig *function, CURLcode res,
+                             long response_code, AttemptFailure *failure) {
+  if (res != CURLE_OK) {
+    failure->retryable = retry_transport_is_retryable(res);
+    return;
+  }
+  failure->retryable =
+      retry_status_is_retryable(&function->retry, response_code);
+  if (request->retry_after[0])
+    failure->retry_after_ms =
+        retry_parse_after(request->retry_after, time(NULL));
+}
+
+// A prompt to send, with everything an attempt needs
+typedef struct {
+  const char *prompt;
+  const char *meaning;
+  const FunctionConfig *function;
+  VibeTokenCallback on_token; // Streaming only
+  void *user_data;
+  int64_t deadline_ms;     // The caller's deadline, 0 for none
+  VibeCancelToken *cancel; // The caller's token, may be NULL
+} PromptAttempt;
+
+typedef char *(*attempt_fn)(PromptAttempt *attempt, long timeout_ms,
+                            AttemptFailure *failure);
+
+// Run attempts until one succeeds, a failure is not retryable, the attempts
+// are used up, the call is cancelled or the next wait would pass the
+// deadline. The deadline is the retry policy's or the caller's, whichever
+// comes first.
+static char *perform_with_retries(PromptAttempt *attempt, attempt_fn run) {
+  const RetryConfig *policy = &attempt->function->retry;
+  int64_t deadline =
+      policy->deadline_ms > 0 ? retry_now_ms() + policy->deadline_ms : 0;
+  if (attempt->deadline_ms && (!deadline || attempt->deadline_ms < deadline))
+    deadline = attempt->deadline_ms;
+
+  for (int attempts = 1;; attempts++) {
+    if (call_context_cancelled(attempt->cancel)) {
+      ERROR("LLM request cancelled");
+      return NULL;
+    }
+    long timeout_ms = call_context_remaining_ms(deadline, ATTEMPT_TIMEOUT_MS);
+    if (timeout_ms <= 0) {
+      ERROR("LLM request deadline exceeded");
+      return NULL;
+    }
+
+    AttemptFailure failure = {0, -1};
+    char *response = run(attempt, timeout_ms, &failure);
+    if (response || !failure.retryable || attempts >= policy->max_attempts)
+      return response;
+
+    long delay = retry_backoff_ms(policy, attempts, retry_random());
+    if (policy->respect_retry_after && failure.retry_after_ms > delay)
+      delay = failure.retry_after_ms;
+    if (deadline && retry_now_ms() + delay >= deadline) {
+      WARN("Not retrying: waiting %ld ms would pass the request deadline",
+           delay);
+      return NULL;
+    }
+
+    WARN("Retrying LLM request in %ld ms (attempt %d of %d)", delay,
+         attempts + 1, policy->max_attempts);
+    if (!call_context_sleep(attempt->cancel, delay)) {
+      ERROR("LLM request cancelled");
+      return NULL;
+    }
+  }
+}
+
+// Configure a request to collect its body into the handle's reusable
+// response buffer
+static int collecting_request_prepare(ChatRequest *request,
+                                      PromptAttempt *attempt,
+                                      long timeout_ms) {
+  if (!chat_request_prepare(request, attempt->prompt, attempt->function, 0,
+                            timeout_ms))
+    return 0;
+  curl_easy_setopt(request->handle->easy, CURLOPT_WRITEFUNCTION,
+                   write_response_callback);
+  curl_easy_setopt(request->handle->easy, CURLOPT_WRITEDATA,
+                   (void *)request->handle);
+  return 1;
+}
+
+// Turn a finished collecting request into its content, or classify why it
+// failed. total_tokens receives the reported usage, -1 if unknown.
+static char *collecting_request_finish(ChatRequest *request,
+                                       PromptAttempt *attempt, CURLcode res,
+                                       long response_code,
+                                       AttemptFailure *failure,
+                                       long *total_tokens) {
+  *total_tokens = -1;
+  if (res != CURLE_OK) {
+    classify_failure(request, attempt->function, res, 0, failure);
+    return NULL;
+  }
 
-  // Setup cURL for a real API call
-  if (!curl_handle) {
-    ERROR("curl_handle is NULL, LLM connection not initialized");
+  LLMBuffer *body = &request->handle->response;
+  if (response_code != 200) {
+    ERROR("API request failed with HTTP code %ld: %s", response_code,
+          body->length ? body->data : "unknown error");
+    classify_failure(request, attempt->function, res, response_code,
+                     failure);
     return NULL;
   }
 
-  // Reset the curl handle for a fresh request
-  curl_easy_reset(curl_handle);
+  // Parse straight out of the buffer before the handle goes back to the pool
+  DEBUG("Parsing OpenAI API response (production mode)");
+  char *parsed_content =
+      parse_openai_response(body->data, body->length, total_tokens);
+  if (!parsed_content)
+    ERROR("Failed to parse API response");
+  return parsed_content;
+}
 
-  // Set the URL for OpenAI's API
-  curl_easy_setopt(curl_handle, CURLOPT_URL,
-                   "https://api.openai.com/v1/chat/completions");
+// Estimate the tokens a request counts against a tokens-per-minute limit:
+// the prompt's tokens plus the completion allowance
+static double estimate_tokens(PromptAttempt *attempt) {
+  double tokens =
+      (double)tokenizer_count(attempt->prompt, strlen(attempt->prompt)) + 1.0;
+  if (attempt->function->max_tokens > 0)
+    tokens += attempt->function->max_tokens;
+  return tokens;
+}
 
-  // Set timeout and error buffer
-  curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 30L);
-  curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, error_buffer);
+// Wait for admission control to let a request through, charging the wait to
+// the attempt's timeout. Refusals are final: retrying would only add to the
+// overload the queue protects against.
+static int admit_request(PromptAttempt *attempt, long *timeout_ms,
+                         AdmissionTicket *ticket) {
+  int64_t start = retry_now_ms();
+  AdmissionResult result =
+      admission_acquire(estimate_tokens(attempt), *timeout_ms,
+                        attempt->cancel, ticket);
+  if (result == ADMISSION_QUEUE_FULL) {
+    ERROR("LLM request refused: admission queue is full");
+    return 0;
+  }
+  if (result == ADMISSION_TIMED_OUT) {
+    ERROR("LLM request refused: timed out waiting for admission");
+    return 0;
+  }
+  if (result == ADMISSION_CANCELLED) {
+    DEBUG("LLM request cancelled while waiting for admission");
+    return 0;
+  }
 
-  // Prepare headers
-  struct curl_slist *headers = NULL;
-  headers = curl_slist_append(headers, "Content-Type: application/json");
+  *timeout_ms -= (long)(retry_now_ms() - start);
+  if (*timeout_ms < 1)
+    *timeout_ms = 1;
+  return 1;
+}
+
+// Map a finished transfer onto the signal admission control learns from
+static AdmissionOutcome admission_outcome(CURLcode res, long response_code) {
+  if (res == CURLE_ABORTED_BY_CALLBACK)
+    return ADMISSION_ABANDONED;
+  if (res == CURLE_OPERATION_TIMEDOUT ||
+      (res == CURLE_OK && (response_code == 429 || response_code == 503)))
+    return ADMISSION_OVERLOADED;
+  if (res == CURLE_OK && response_code == 200)
+    return ADMISSION_SUCCEEDED;
+  return ADMISSION_FAILED;
+}
 
-  char auth_header[256];
-  snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s",
-           api_key);
-  headers = curl_slist_append(headers, auth_header);
+// Make one admitted attempt at a request, collecting the whole response
+static char *attempt_single(PromptAttempt *attempt, long timeout_ms,
+                            AdmissionTicket *ticket,
+                            AttemptFailure *failure) {
+  ChatRequest request;
+  if (!collecting_request_prepare(&request, attempt, timeout_ms)) {
+    admission_release(ticket, ADMISSION_ABANDONED, -1, -1);
+    return NULL;
+  }
 
-  curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+  // Hand the request to the engine and wait for it to complete
+  int64_t start = retry_now_ms();
+  long response_code = 0;
+  CURLcode res = chat_request_perform(&request, attempt->cancel,
+                                      &response_code);
+  long latency = (long)(retry_now_ms() - start);
+  if (res == CURLE_OK && response_code == 200)
+    hedge_record_latency(latency);
+
+  long total_tokens;
+  char *content = collecting_request_finish(&request, attempt, res,
+                                            response_code, failure,
+                                            &total_tokens);
+  chat_request_cleanup(&request);
+  admission_release(ticket, admission_outcome(res, response_code), latency,
+                    total_tokens);
+  return content;
+}
 
-  // Prepare the request JSON
-  char *json_payload = malloc(strlen(prompt) + 200);
-  if (!json_payload) {
-    ERROR("Failed to allocate memory for JSON payload");
-    curl_slist_free_all(headers);
+// The copies of a hedged request racing each other
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int finished;        // Copies that have completed in any way
+  LLMTransfer *winner; // First copy to succeed
+} HedgeRace;
+
+// Engine completion callback recording a copy's outcome
+static void hedge_race_done(LLMTransfer *transfer, void *user_data) {
+  HedgeRace *race = (HedgeRace *)user_data;
+  pthread_mutex_lock(&race->lock);
+  race->finished++;
+  if (!race->winner && !transfer->cancelled &&
+      transfer->result == CURLE_OK && transfer->http_status == 200)
+    race->winner = transfer;
+  pthread_cond_broadcast(&race->cond);
+  pthread_mutex_unlock(&race->lock);
+}
+
+// Wait until a copy succeeds, all `copies` have finished, or the monotonic
+// clock reaches until_ms (0 to wait without a limit)
+static LLMTransfer *hedge_race_wait(HedgeRace *race, int copies,
+                                    int64_t until_ms) {
+  struct timespec until = {(time_t)(until_ms / 1000),
+                           (long)(until_ms % 1000) * 1000000L};
+  pthread_mutex_lock(&race->lock);
+  while (!race->winner && race->finished < copies) {
+    if (!until_ms) {
+      pthread_cond_wait(&race->cond, &race->lock);
+    } else if (pthread_cond_timedwait(&race->cond, &race->lock, &until) ==
+               ETIMEDOUT) {
+      break;
+    }
+  }
+  LLMTransfer *winner = race->winner;
+  pthread_mutex_unlock(&race->lock);
+  return winner;
+}
+
+// Prepare and submit one copy of a hedged request, watching it for
+// cancellation. watched tells whether hook must be removed afterwards.
+static int hedge_copy_start(ChatRequest *request, LLMTransfer *transfer,
+                            PromptAttempt *attempt, long timeout_ms,
+                            HedgeRace *race, CancelHook *hook, int *watched) {
+  if (!collecting_request_prepare(request, attempt, timeout_ms))
+    return 0;
+  llm_transfer_init(transfer, request->handle->easy);
+  transfer->on_done = hedge_race_done;
+  transfer->user_data = race;
+  if (!llm_engine_submit(transfer)) {
+    llm_transfer_destroy(transfer);
+    chat_request_cleanup(request);
+    return 0;
+  }
+  *watched = watch_transfer(attempt->cancel, hook, transfer);
+  return 1;
+}
+
+// Make one admitted attempt at a request, sending a duplicate if the
+// original is still running after delay_ms. The first copy to succeed wins
+// and the other is cancelled.
+static char *attempt_hedged(PromptAttempt *attempt, long timeout_ms,
+                            long delay_ms, AdmissionTicket *ticket,
+                            AttemptFailure *failure) {
+  HedgeRace race = {.finished = 0, .winner = NULL};
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&race.cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&race.lock, NULL);
+
+  ChatRequest requests[2];
+  LLMTransfer transfers[2];
+  AdmissionTicket tickets[2];
+  int64_t started_at[2];
+  CancelHook hooks[2];
+  int watched[2] = {0, 0};
+  int copies = 1;
+
+  tickets[0] = *ticket;
+  started_at[0] = retry_now_ms();
+  if (!hedge_copy_start(&requests[0], &transfers[0], attempt, timeout_ms,
+                        &race, &hooks[0], &watched[0])) {
+    admission_release(&tickets[0], ADMISSION_ABANDONED, -1, -1);
+    pthread_cond_destroy(&race.cond);
+    pthread_mutex_destroy(&race.lock);
     return NULL;
   }
 
-  // Create a simple JSON payload for the OpenAI Chat API
-  snprintf(json_payload, strlen(prompt) + 200,
-           "{\"model\":\"gpt-3.5-turbo\",\"messages\":[{\"role\":\"user\","
-           "\"content\":\"%s\"}],\"temperature\":0.7}",
-           prompt);
+  LLMTransfer *winner =
+      hedge_race_wait(&race, copies, started_at[0] + delay_ms);
+  if (!winner && race.finished == 0) {
+    // The duplicate is optional traffic: it never waits for admission
+    long elapsed = (long)(retry_now_ms() - started_at[0]);
+    if (elapsed < timeout_ms &&
+        admission_try_acquire(estimate_tokens(attempt), &tickets[1])) {
+      if (hedge_acquire()) {
+        DEBUG("Hedging LLM request still running after %ld ms", elapsed);
+        started_at[1] = retry_now_ms();
+        if (hedge_copy_start(&requests[1], &transfers[1], attempt,
+                             timeout_ms - elapsed, &race, &hooks[1],
+                             &watched[1]))
+          copies = 2;
+      }
+      if (copies < 2)
+        admission_release(&tickets[1], ADMISSION_ABANDONED, -1, -1);
+    }
+  }
+  if (!winner)
+    winner = hedge_race_wait(&race, copies, 0);
+
+  // Cancel the loser. The winner's callback has run, but the engine may not
+  // have marked it done yet.
+  for (int i = 0; i < copies; i++) {
+    if (&transfers[i] == winner)
+      llm_engine_wait(&transfers[i]);
+    else
+      llm_engine_cancel(&transfers[i]);
+    if (watched[i])
+      call_context_unhook(attempt->cancel, &hooks[i]);
+  }
 
-  curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, json_payload);
+  // Report the winner, or the original when every copy failed
+  int chosen = winner == &transfers[1] ? 1 : 0;
+  LLMTransfer *transfer = &transfers[chosen];
+  if (winner) {
+    hedge_record_latency((long)(retry_now_ms() - started_at[chosen]));
+    if (chosen == 1)
+      hedge_record_win();
+  } else if (transfer->result != CURLE_OK) {
+    ERROR("LLM request failed: %s", requests[chosen].handle->error_buffer[0]
+                                        ? requests[chosen].handle->error_buffer
+                                        : curl_easy_strerror(transfer->result));
+  }
+  long total_tokens;
+  char *content = collecting_request_finish(&requests[chosen], attempt,
+                                            transfer->result,
+                                            transfer->http_status, failure,
+                                            &total_tokens);
+
+  int64_t finished_at = retry_now_ms();
+  for (int i = 0; i < copies; i++) {
+    AdmissionOutcome outcome =
+        transfers[i].cancelled
+            ? ADMISSION_ABANDONED
+            : admission_outcome(transfers[i].result, transfers[i].http_status);
+    admission_release(&tickets[i], outcome,
+                      (long)(finished_at - started_at[i]),
+                      i == chosen ? total_tokens : -1);
+    llm_transfer_destroy(&transfers[i]);
+    chat_request_cleanup(&requests[i]);
+  }
+  pthread_cond_destroy(&race.cond);
+  pthread_mutex_destroy(&race.lock);
+  return content;
+}
 
-  // Response data structure
-  ResponseMemory chunk;
-  chunk.memory = malloc(1);
-  chunk.size = 0;
+// Make one attempt at a request, hedged if the function asks for it and
+// enough latencies have been observed to pick a trigger
+static char *attempt_prompt(PromptAttempt *attempt, long timeout_ms,
+                            AttemptFailure *failure) {
+  AdmissionTicket ticket;
+  if (!admit_request(attempt, &timeout_ms, &ticket))
+    return NULL;
 
-  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_memory_callback);
-  curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
+  // The call may have been cancelled just as it was admitted
+  if (call_context_cancelled(attempt->cancel)) {
+    admission_release(&ticket, ADMISSION_ABANDONED, -1, -1);
+    return NULL;
+  }
 
-  // Perform the request
-  CURLcode res = curl_easy_perform(curl_handle);
+  long delay_ms = hedge_delay_ms(&attempt->function->hedge);
+  if (delay_ms >= 0 && delay_ms < timeout_ms)
+    return attempt_hedged(attempt, timeout_ms, delay_ms, &ticket, failure);
+  return attempt_single(attempt, timeout_ms, &ticket, failure);
+}
 
-  // Cleanup
-  curl_slist_free_all(headers);
-  free(json_payload);
+// Answer from the open cassette, or perform the request and record it. A
+// replayed stream delivers the whole response as a single delta.
+static char *perform_with_cassette(PromptAttempt *attempt, attempt_fn run) {
+  CassetteMode mode = cassette_mode();
+  if (mode == CASSETTE_OFF)
+    return perform_with_retries(attempt, run);
 
-  if (res != CURLE_OK) {
-    ERROR("curl_easy_perform() failed: %s", curl_easy_strerror(res));
-    if (chunk.memory)
-      free(chunk.memory);
+  ResponseCacheKey key;
+  if (!response_cache_key_init(&key, attempt->prompt, attempt->meaning,
+                               attempt->function))
     return NULL;
+
+  char *response;
+  if (mode == CASSETTE_REPLAY) {
+    VibeCallContext context = {attempt->deadline_ms, attempt->cancel};
+    VibeError error;
+    response = cassette_replay(&key, context, &error);
+    if (error == VIBE_ERROR_GENERAL)
+      ERROR("No recorded response for prompt: %s", attempt->prompt);
+    else if (!response)
+      ERROR("Replayed LLM request %s",
+            error == VIBE_ERROR_CANCELLED ? "cancelled" : "deadline exceeded");
+    else if (attempt->on_token)
+      attempt->on_token(response, strlen(response), attempt->user_data);
+  } else {
+    int64_t start = retry_now_ms();
+    response = perform_with_retries(attempt, run);
+    if (response)
+      cassette_record(&key, response, (long)(retry_now_ms() - start));
   }
 
+  response_cache_key_free(&key);
+  return response;
+}
+
+/**
+ * Send a prompt to the LLM and get the response
+ *
+ * @param prompt The formatted prompt to send
+ * @param meaning The semantic meaning of the prompt (used for response
+ * processing)
+ * @param function Model and generation parameters, or NULL for the defaults
+ * @return The response from the LLM, or NULL on error
+ */
+char *send_llm_prompt(const char *prompt, const char *meaning,
+                      const FunctionConfig *function) {
+  if (!prompt) {
+    ERROR("NULL prompt provided to send_llm_prompt");
+    return NULL;
+  }
+
+  DEBUG("Sending prompt to LLM: %s", prompt);
+
+  // Check for dev mode FIRST, before any API key checks
+  if (is_dev_mode())
+    return mock_llm_response(prompt, meaning);
+
+  VibeCallContext context = vibe_call_context_current();
+  PromptAttempt attempt = {prompt,
+                           meaning,
+                           function ? function : get_function_config(NULL),
+                           NULL,
+                           NULL,
+                           context.deadline_ms,
+                           context.cancel};
+  return perform_with_cassette(&attempt, attempt_prompt);
+}
+
+// State for a streaming completion, shared with the curl write callback
+typedef struct {
+  SSEParser parser;
+  LLMBuffer content; // Concatenated content deltas, handed to the caller
+  LLMHandle *handle; // Its response buffer keeps a non-200 body
   long response_code;
-  curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response_code);
+  int finished; // Set once the [DONE] sentinel arrives
+  VibeTokenCallback on_token;
+  void *user_data;
+} StreamState;
+
+// Handle one SSE event carrying a chat.completion.chunk
+static int handle_stream_event(char *data, size_t length,
+                               void *user_data) {
+  StreamState *state = (StreamState *)user_data;
+
+  if (length == 6 && memcmp(data, "[DONE]", 6) == 0) {
+    state->finished = 1;
+    return 0;
+  }
 
-  if (response_code != 200) {
+  CompletionFields fields;
+  if (!completion_extract(data, length, &fields)) {
+    WARN("Skipping malformed stream event");
+    return 1;
+  }
+
+  int ok = 1;
+  if (fields.content && fields.content_length > 0) {
+    ok = llm_buffer_append(&state->content, fields.content,
+                           fields.content_length);
+    if (ok && state->on_token)
+      state->on_token(fields.content, fields.content_length, state->user_data);
+  }
+  if (fields.finish_reason && strcmp(fields.finish_reason, "length") == 0)
+    WARN("Completion was truncated by the max_tokens limit");
+  return ok;
+}
+
+// curl write callback feeding the SSE parser
+static size_t stream_write_callback(void *contents, size_t size, size_t nmemb,
+                                    void *userp) {
+  size_t real_size = size * nmemb;
+  StreamState *state = (StreamState *)userp;
+
+  if (state->response_code == 0)
+    curl_easy_getinfo(state->handle->easy, CURLINFO_RESPONSE_CODE,
+                      &state->response_code);
+
+  // Error bodies are plain JSON, keep them for the log
+  if (state->response_code != 200)
+    return write_response_callback(contents, size, nmemb, state->handle);
+
+  if (state->finished)
+    return real_size;
+  if (!sse_parser_feed(&state->parser, contents, real_size) &&
+      !state->finished)
+    return 0;
+  return real_size;
+}
+
+// Make one attempt at a streaming request
+static char *attempt_stream(PromptAttempt *attempt, long timeout_ms,
+                            AttemptFailure *failure) {
+  AdmissionTicket ticket;
+  if (!admit_request(attempt, &timeout_ms, &ticket))
+    return NULL;
+  if (call_context_cancelled(attempt->cancel)) {
+    admission_release(&ticket, ADMISSION_ABANDONED, -1, -1);
+    return NULL;
+  }
+
+  ChatRequest request;
+  if (!chat_request_prepare(&request, attempt->prompt, attempt->function, 1,
+                            timeout_ms)) {
+    admission_release(&ticket, ADMISSION_ABANDONED, -1, -1);
+    return NULL;
+  }
+
+  StreamState state;
+  memset(&state, 0, sizeof(state));
+  sse_parser_init(&state.parser, handle_stream_event, &state);
+  state.handle = request.handle;
+  state.on_token = attempt->on_token;
+  state.user_data = attempt->user_data;
+
+  curl_easy_setopt(request.handle->easy, CURLOPT_WRITEFUNCTION,
+                   stream_write_callback);
+  curl_easy_setopt(request.handle->easy, CURLOPT_WRITEDATA, (void *)&state);
+
+  long response_code = 0;
+  CURLcode res = chat_request_perform(&request, attempt->cancel,
+                                      &response_code);
+  sse_parser_free(&state.parser);
+
+  if (res == CURLE_OK && response_code != 200) {
+    LLMBuffer *body = &request.handle->response;
     ERROR("API request failed with HTTP code %ld: %s", response_code,
-          chunk.memory ? chunk.memory : "unknown error");
-    if (chunk.memory)
-      free(chunk.memory);
+          body->length ? body->data : "unknown error");
+  }
+  // Once deltas reached the callback a retry would repeat them
+  if ((res != CURLE_OK || response_code != 200) && state.content.length == 0)
+    classify_failure(&request, attempt->function, res, response_code,
+                     failure);
+  chat_request_cleanup(&request);
+  // A stream's duration tracks its length, so it says nothing about load
+  admission_release(&ticket, admission_outcome(res, response_code), -1, -1);
+
+  // The caller owns the accumulated content, which must exist even when the
+  // model produced nothing
+  if (res != CURLE_OK || response_code != 200 ||
+      !llm_buffer_reserve(&state.content, 0)) {
+    llm_buffer_free(&state.content);
     return NULL;
   }
 
-  // For non-development mode, parse the OpenAI response
-  if (!dev_mode || strcmp(dev_mode, "0") == 0) {
-    DEBUG("Parsing OpenAI API response (production mode)");
-    char *parsed_content = parse_openai_response(chunk.memory);
-    free(chunk.memory); // Free the raw response
+  if (!state.finished)
+    WARN("Stream ended without a [DONE] event");
+  return state.content.data;
+}
 
-    if (!parsed_content) {
-      ERROR("Failed to parse API response");
-      return NULL;
-    }
+/**
+ * Send a prompt to the LLM and stream the response
+ */
+char *send_llm_prompt_stream(const char *prompt, const char *meaning,
+                             const FunctionConfig *function,
+                             VibeTokenCallback on_token, void *user_data) {
+  if (!prompt) {
+    ERROR("NULL prompt provided to send_llm_prompt_stream");
+    return NULL;
+  }
 
-    return parsed_content;
+  DEBUG("Streaming prompt to LLM: %s", prompt);
+
+  // Development mode delivers the whole mock response as a single delta
+  if (is_dev_mode()) {
+    char *response = mock_llm_response(prompt, meaning);
+    if (response && on_token)
+      on_token(response, strlen(response), user_data);
+    return response;
   }
 
-  // For development mode, return the raw response (which is already a plain
-  // text mock)
-  return chunk.memory;
+  VibeCallContext context = vibe_call_context_current();
+  PromptAttempt attempt = {prompt,
+                           meaning,
+                           function ? function : get_function_config(NULL),
+                           on_token,
+                           user_data,
+                           context.deadline_ms,
+                           context.cancel};
+  return perform_with_cassette(&attempt, attempt_stream);
 }
 
 /**
@@ -422,10 +1095,7 @@ char *send_llm_prompt(const char *prompt, const char *meaning) {
 void close_llm_connection(void) {
   DEBUG("Closing LLM connection");
 
-  if (curl_handle) {
-    curl_easy_cleanup(curl_handle);
-    curl_handle = NULL;
-  }
-
+  llm_engine_stop();
+  llm_sessions_cleanup();
   curl_global_cleanup();
 }
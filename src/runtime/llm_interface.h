@@ -6,7 +6,9 @@
 #ifndef LLM_INTERFACE_H
 #define LLM_INTERFACE_H
 
+#include "../../include/runtime.h"
 #include "../../include/vibelang.h"
+#include "config.h"
 
 /**
  * Initialize the LLM connection
@@ -21,9 +23,25 @@ int init_llm_connection(void);
  * @param prompt The formatted prompt to send
  * @param meaning The semantic meaning of the prompt (used for response
  * processing)
+ * @param function Model and generation parameters, or NULL for the defaults
  * @return The response from the LLM, or NULL on error
  */
-char *send_llm_prompt(const char *prompt, const char *meaning);
+char *send_llm_prompt(const char *prompt, const char *meaning,
+                      const FunctionConfig *function);
+
+/**
+ * Send a prompt to the LLM and stream the response as server-sent events
+ *
+ * @param prompt The formatted prompt to send
+ * @param meaning The semantic meaning of the prompt
+ * @param function Model and generation parameters, or NULL for the defaults
+ * @param on_token Callback receiving each content delta, may be NULL
+ * @param user_data Passed to on_token
+ * @return The complete response from the LLM, or NULL on error
+ */
+char *send_llm_prompt_stream(const char *prompt, const char *meaning,
+                             const FunctionConfig *function,
+                             VibeTokenCallback on_token, void *user_data);
 
 /**
  * Close the LLM connection
@@ -42,4 +60,15 @@ void close_llm_connection(void);
 char *format_prompt(const char *template, char **var_names, char **var_values,
                     int var_count);
 
+/**
+ * Render a precompiled prompt template in one pass, or only measure it
+ *
+ * @param template The template
+ * @param args One argument per slot
+ * @param out Receives the prompt and a terminating NUL, NULL to measure
+ * @return The length of the prompt
+ */
+size_t render_prompt(const VibePromptTemplate *template,
+                     const VibePromptArg *args, char *out);
+
 #endif /* LLM_INTERFACE_H */
@@ -0,0 +1,385 @@
+/**
+ * @file llm_session.c
+ * @brief Per-thread LLM sessions sharing connection, DNS and TLS caches
+ */
+
+#include "llm_session.h"
+#include "../utils/log_utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Idle handles a session keeps around for reuse
+#define SESSION_MAX_IDLE_HANDLES 8
+
+// Cache keys a call holds at once: its own and the cassette's
+#define SESSION_KEY_BUFFERS 2
+
+// Smallest allocation for a buffer, and the largest one a pooled handle
+// keeps after an unusually big response
+#define BUFFER_MIN_CAPACITY 4096
+#define BUFFER_MAX_RETAINED (1024 * 1024)
+
+typedef struct LLMSession {
+  LLMHandle *idle[SESSION_MAX_IDLE_HANDLES];
+  int idle_count;
+  int detached; // Set when the runtime shut down under this session
+
+  LLMBuffer keys[SESSION_KEY_BUFFERS];
+  int keys_in_use[SESSION_KEY_BUFFERS];
+  struct curl_slist *headers[2]; // For plain and streaming requests
+  char *headers_key;             // The API key both lists carry
+
+  // Registry links so shutdown can reach every thread's session
+  struct LLMSession *prev;
+  struct LLMSession *next;
+} LLMSession;
+
+static pthread_key_t session_key;
+static pthread_once_t session_key_once = PTHREAD_ONCE_INIT;
+
+// Registry of live sessions and the share handle they attach to
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static LLMSession *registry = NULL;
+static CURLSH *share_handle = NULL;
+
+// One lock per kind of shared data so DNS lookups do not contend with the
+// connection cache
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+static void share_lock(CURL *handle, curl_lock_data data,
+                       curl_lock_access access, void *userptr) {
+  (void)handle;
+  (void)access;
+  (void)userptr;
+  pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+  (void)handle;
+  (void)userptr;
+  pthread_mutex_unlock(&share_locks[data]);
+}
+
+int llm_buffer_reserve(LLMBuffer *buffer, size_t length) {
+  if (length < buffer->capacity)
+    return 1;
+
+  size_t capacity = buffer->capacity ? buffer->capacity : BUFFER_MIN_CAPACITY;
+  while (capacity <= length)
+    capacity *= 2;
+
+  char *grown = realloc(buffer->data, capacity);
+  if (!grown) {
+    ERROR("Failed to grow LLM buffer to %zu bytes", capacity);
+    return 0;
+  }
+  buffer->data = grown;
+  buffer->capacity = capacity;
+  buffer->data[buffer->length] = '\0';
+  return 1;
+}
+
+int llm_buffer_append(LLMBuffer *buffer, const char *bytes, size_t length) {
+  if (!llm_buffer_reserve(buffer, buffer->length + length))
+    return 0;
+  memcpy(buffer->data + buffer->length, bytes, length);
+  buffer->length += length;
+  buffer->data[buffer->length] = '\0';
+  return 1;
+}
+
+void llm_buffer_reset(LLMBuffer *buffer) {
+  buffer->length = 0;
+  if (buffer->data)
+    buffer->data[0] = '\0';
+}
+
+void llm_buffer_free(LLMBuffer *buffer) {
+  free(buffer->data);
+  buffer->data = NULL;
+  buffer->length = buffer->capacity = 0;
+}
+
+static void free_handle(LLMHandle *handle) {
+  if (!handle)
+    return;
+  if (handle->easy)
+    curl_easy_cleanup(handle->easy);
+  llm_buffer_free(&handle->request);
+  llm_buffer_free(&handle->response);
+  free(handle);
+}
+
+static void session_release_headers(LLMSession *session) {
+  curl_slist_free_all(session->headers[0]);
+  curl_slist_free_all(session->headers[1]);
+  session->headers[0] = session->headers[1] = NULL;
+  free(session->headers_key);
+  session->headers_key = NULL;
+}
+
+// Drop a session's pooled handles, header lists and idle key buffers. Caller
+// holds registry_lock.
+static void session_release_handles(LLMSession *session) {
+  for (int i = 0; i < session->idle_count; i++)
+    free_handle(session->idle[i]);
+  session->idle_count = 0;
+  session_release_headers(session);
+  for (int i = 0; i < SESSION_KEY_BUFFERS; i++) {
+    if (!session->keys_in_use[i])
+      llm_buffer_free(&session->keys[i]);
+  }
+}
+
+static void registry_remove(LLMSession *session) {
+  if (session->prev)
+    session->prev->next = session->next;
+  else
+    registry = session->next;
+  if (session->next)
+    session->next->prev = session->prev;
+  session->prev = session->next = NULL;
+}
+
+// Thread-exit destructor for a thread's session
+static void session_destroy(void *ptr) {
+  LLMSession *session = (LLMSession *)ptr;
+  pthread_mutex_lock(&registry_lock);
+  if (!session->detached) {
+    registry_remove(session);
+    session_release_handles(session);
+  }
+  pthread_mutex_unlock(&registry_lock);
+  for (int i = 0; i < SESSION_KEY_BUFFERS; i++)
+    llm_buffer_free(&session->keys[i]);
+  free(session);
+}
+
+static void make_session_key(void) {
+  pthread_key_create(&session_key, session_destroy);
+  for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_init(&share_locks[i], NULL);
+}
+
+/**
+ * Create the shared connection/DNS/TLS caches
+ */
+int llm_sessions_init(void) {
+  pthread_once(&session_key_once, make_session_key);
+
+  pthread_mutex_lock(&registry_lock);
+  if (share_handle) {
+    pthread_mutex_unlock(&registry_lock);
+    return 1;
+  }
+
+  share_handle = curl_share_init();
+  if (!share_handle) {
+    pthread_mutex_unlock(&registry_lock);
+    ERROR("curl_share_init() failed");
+    return 0;
+  }
+
+  curl_share_setopt(share_handle, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(share_handle, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+  pthread_mutex_unlock(&registry_lock);
+  DEBUG("LLM session caches initialized");
+  return 1;
+}
+
+/**
+ * Release every session's handles and the shared caches
+ */
+void llm_sessions_cleanup(void) {
+  pthread_mutex_lock(&registry_lock);
+
+  // Sessions stay allocated until their thread exits; they are only emptied
+  // and marked so the next acquire starts over
+  while (registry) {
+    LLMSession *session = registry;
+    registry_remove(session);
+    session_release_handles(session);
+    session->detached = 1;
+  }
+
+  if (share_handle) {
+    CURLSHcode code = curl_share_cleanup(share_handle);
+    if (code != CURLSHE_OK)
+      ERROR("curl_share_cleanup() failed: %s", curl_share_strerror(code));
+    share_handle = NULL;
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+}
+
+// Get the calling thread's session, creating or reattaching it as needed
+static LLMSession *current_session(void) {
+  pthread_once(&session_key_once, make_session_key);
+
+  LLMSession *session = pthread_getspecific(session_key);
+  if (session && !session->detached)
+    return session;
+
+  if (!session) {
+    session = calloc(1, sizeof(LLMSession));
+    if (!session) {
+      ERROR("Failed to allocate LLM session");
+      return NULL;
+    }
+    pthread_setspecific(session_key, session);
+  }
+
+  pthread_mutex_lock(&registry_lock);
+  session->detached = 0;
+  session->prev = NULL;
+  session->next = registry;
+  if (registry)
+    registry->prev = session;
+  registry = session;
+  pthread_mutex_unlock(&registry_lock);
+
+  DEBUG("Created LLM session for thread");
+  return session;
+}
+
+/**
+ * Take a request handle from the calling thread's session
+ */
+LLMHandle *llm_session_acquire(void) {
+  LLMSession *session = current_session();
+  if (!session)
+    return NULL;
+
+  LLMHandle *handle = NULL;
+  if (session->idle_count > 0) {
+    handle = session->idle[--session->idle_count];
+    // Reset options but keep the handle's caches and connection affinity
+    curl_easy_reset(handle->easy);
+  } else {
+    handle = calloc(1, sizeof(LLMHandle));
+    if (!handle) {
+      ERROR("Failed to allocate LLM handle");
+      return NULL;
+    }
+    handle->easy = curl_easy_init();
+    if (!handle->easy) {
+      ERROR("curl_easy_init() failed");
+      free(handle);
+      return NULL;
+    }
+  }
+
+  handle->error_buffer[0] = '\0';
+  llm_buffer_reset(&handle->request);
+  llm_buffer_reset(&handle->response);
+  curl_easy_setopt(handle->easy, CURLOPT_ERRORBUFFER, handle->error_buffer);
+  if (share_handle)
+    curl_easy_setopt(handle->easy, CURLOPT_SHARE, share_handle);
+  return handle;
+}
+
+/**
+ * Return a handle to the calling thread's session
+ */
+void llm_session_release(LLMHandle *handle) {
+  if (!handle)
+    return;
+
+  LLMSession *session = pthread_getspecific(session_key);
+  if (!session || session->detached ||
+      session->idle_count >= SESSION_MAX_IDLE_HANDLES) {
+    free_handle(handle);
+    return;
+  }
+
+  // Keep the buffers for the next request unless one outlier blew them up
+  if (handle->request.capacity > BUFFER_MAX_RETAINED)
+    llm_buffer_free(&handle->request);
+  if (handle->response.capacity > BUFFER_MAX_RETAINED)
+    llm_buffer_free(&handle->response);
+  session->idle[session->idle_count++] = handle;
+}
+
+/**
+ * Take an empty buffer for a cache key from the calling thread's session
+ */
+LLMBuffer *llm_session_key_acquire(void) {
+  LLMSession *session = current_session();
+  if (!session)
+    return NULL;
+
+  for (int i = 0; i < SESSION_KEY_BUFFERS; i++) {
+    if (!session->keys_in_use[i]) {
+      session->keys_in_use[i] = 1;
+      llm_buffer_reset(&session->keys[i]);
+      return &session->keys[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Return a key buffer to the calling thread's session
+ */
+void llm_session_key_release(LLMBuffer *buffer) {
+  LLMSession *session = pthread_getspecific(session_key);
+  if (!session || buffer < session->keys ||
+      buffer >= session->keys + SESSION_KEY_BUFFERS)
+    return;
+
+  if (buffer->capacity > BUFFER_MAX_RETAINED)
+    llm_buffer_free(buffer);
+  session->keys_in_use[buffer - session->keys] = 0;
+}
+
+// Append a header to a list, freeing the whole list if that fails
+static struct curl_slist *append_header(struct curl_slist *headers,
+                                        const char *header) {
+  struct curl_slist *appended = curl_slist_append(headers, header);
+  if (!appended)
+    curl_slist_free_all(headers);
+  return appended;
+}
+
+/**
+ * Get the headers of a chat completion request from the calling thread's
+ * session
+ */
+struct curl_slist *llm_session_headers(const char *api_key, int stream) {
+  LLMSession *session = current_session();
+  if (!session)
+    return NULL;
+
+  stream = stream ? 1 : 0;
+  if (session->headers_key && strcmp(session->headers_key, api_key) != 0)
+    session_release_headers(session);
+  if (session->headers[stream])
+    return session->headers[stream];
+
+  if (!session->headers_key && !(session->headers_key = strdup(api_key))) {
+    ERROR("Failed to allocate request headers");
+    return NULL;
+  }
+
+  char auth_header[256];
+  snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s",
+           api_key);
+  struct curl_slist *headers =
+      append_header(NULL, "Content-Type: application/json");
+  if (headers && stream)
+    headers = append_header(headers, "Accept: text/event-stream");
+  if (headers)
+    headers = append_header(headers, auth_header);
+  if (!headers) {
+    ERROR("Failed to allocate request headers");
+    return NULL;
+  }
+  session->headers[stream] = headers;
+  return headers;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file llm_session.h
+ * @brief Per-thread LLM sessions sharing connection, DNS and TLS caches
+ *
+ * Every thread that issues prompts gets its own lazily created session. A
+ * session keeps a small pool of reusable easy handles so that no state is
+ * shared between threads on the request path. All handles are attached to a
+ * single curl share handle, which lets sessions reuse each other's
+ * connections, DNS results and TLS sessions. A session also keeps the
+ * buffers cache keys are built in and the request header lists, so a request
+ * in the steady state allocates nothing before its body is serialized.
+ */
+
+#ifndef LLM_SESSION_H
+#define LLM_SESSION_H
+
+#include <curl/curl.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A growable byte buffer that keeps its storage between requests. The
+ * contents are always NUL terminated once anything has been reserved.
+ */
+typedef struct LLMBuffer {
+  char *data;
+  size_t length;
+  size_t capacity; // Bytes allocated, including room for the terminator
+} LLMBuffer;
+
+/**
+ * A reusable request handle owned by a thread's session
+ */
+typedef struct LLMHandle {
+  CURL *easy;                         // Easy handle attached to the share
+  char error_buffer[CURL_ERROR_SIZE]; // Error details for the last transfer
+  LLMBuffer request;                  // Body of the request being sent
+  LLMBuffer response;                 // Body of the last response
+} LLMHandle;
+
+/**
+ * Make room for at least `length` bytes of content. Capacity grows
+ * geometrically so appending byte by byte stays amortized O(1).
+ *
+ * @param buffer The buffer
+ * @param length Content length the buffer must be able to hold
+ * @return 1 on success, 0 on allocation failure
+ */
+int llm_buffer_reserve(LLMBuffer *buffer, size_t length);
+
+/**
+ * Append bytes to a buffer
+ *
+ * @param buffer The buffer
+ * @param bytes The bytes to append
+ * @param length Number of bytes
+ * @return 1 on success, 0 on allocation failure
+ */
+int llm_buffer_append(LLMBuffer *buffer, const char *bytes, size_t length);
+
+/**
+ * Empty a buffer without releasing its storage
+ *
+ * @param buffer The buffer
+ */
+void llm_buffer_reset(LLMBuffer *buffer);
+
+/**
+ * Release a buffer's storage
+ *
+ * @param buffer The buffer
+ */
+void llm_buffer_free(LLMBuffer *buffer);
+
+/**
+ * Create the shared connection/DNS/TLS caches. Must be called after
+ * curl_global_init().
+ *
+ * @return 1 on success, 0 on failure
+ */
+int llm_sessions_init(void);
+
+/**
+ * Release every session's handles and the shared caches. No thread may be
+ * using a handle while this runs.
+ */
+void llm_sessions_cleanup(void);
+
+/**
+ * Take a request handle from the calling thread's session, creating the
+ * session on first use. The handle comes back reset, attached to the shared
+ * caches and with its error buffer installed.
+ *
+ * @return A handle, or NULL on failure
+ */
+LLMHandle *llm_session_acquire(void);
+
+/**
+ * Return a handle to the calling thread's session for reuse. Must be called
+ * from the thread that acquired it.
+ *
+ * @param handle The handle to release
+ */
+void llm_session_release(LLMHandle *handle);
+
+/**
+ * Take an empty buffer for a cache key from the calling thread's session. A
+ * call holds at most a couple of keys at once; beyond that NULL is returned
+ * and the caller allocates.
+ *
+ * @return A buffer, or NULL if none is free
+ */
+LLMBuffer *llm_session_key_acquire(void);
+
+/**
+ * Return a key buffer to the calling thread's session. Must be called from
+ * the thread that acquired it.
+ *
+ * @param buffer The buffer to release
+ */
+void llm_session_key_release(LLMBuffer *buffer);
+
+/**
+ * Get the headers of a chat completion request from the calling thread's
+ * session. The list is built on first use and again only when the API key
+ * changes; it stays owned by the session and is valid until the thread's
+ * next call with another key.
+ *
+ * @param api_key The API key to send
+ * @param stream Whether the request asks for server-sent events
+ * @return The header list, or NULL on failure
+ */
+struct curl_slist *llm_session_headers(const char *api_key, int stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LLM_SESSION_H */
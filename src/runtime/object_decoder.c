@@ -0,0 +1,704 @@
+/**
+ * @file object_decoder.c
+ * @brief In-place decoding of JSON object responses into generated structs
+ * and tapes
+ */
+
+#include "object_decoder.h"
+#include "../utils/log_utils.h"
+#include "../utils/response_decoder.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char *p;
+  char *end;
+} Cursor;
+
+static inline int is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Characters that end a bare number or literal
+static inline int is_delimiter(char c) {
+  return c == ',' || c == '}' || c == ']' || is_space(c);
+}
+
+static void skip_space(Cursor *c) {
+  while (c->p < c->end && is_space(*c->p))
+    c->p++;
+}
+
+static int read_hex4(Cursor *c, unsigned *code) {
+  if (c->end - c->p < 4)
+    return 0;
+  unsigned value = 0;
+  for (int i = 0; i < 4; i++) {
+    char h = c->p[i];
+    value <<= 4;
+    if (h >= '0' && h <= '9')
+      value |= (unsigned)(h - '0');
+    else if ((h | 0x20) >= 'a' && (h | 0x20) <= 'f')
+      value |= (unsigned)((h | 0x20) - 'a' + 10);
+    else
+      return 0;
+  }
+  c->p += 4;
+  *code = value;
+  return 1;
+}
+
+// Write a code point as UTF-8. The escape it came from is at least as long.
+static char *put_utf8(char *out, unsigned code) {
+  if (code < 0x80) {
+    *out++ = (char)code;
+  } else if (code < 0x800) {
+    *out++ = (char)(0xC0 | (code >> 6));
+    *out++ = (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    *out++ = (char)(0xE0 | (code >> 12));
+    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (code & 0x3F));
+  } else {
+    *out++ = (char)(0xF0 | (code >> 18));
+    *out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+    *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (code & 0x3F));
+  }
+  return out;
+}
+
+// Decode a \u escape, joining surrogate pairs. A lone surrogate becomes
+// U+FFFD.
+static int read_unicode(Cursor *c, unsigned *code) {
+  if (!read_hex4(c, code))
+    return 0;
+  if (*code >= 0xDC00 && *code < 0xE000) {
+    *code = 0xFFFD;
+  } else if (*code >= 0xD800 && *code < 0xDC00) {
+    Cursor low_cursor = {c->p + 2, c->end};
+    unsigned low;
+    if (c->end - c->p >= 6 && c->p[0] == '\\' && c->p[1] == 'u' &&
+        read_hex4(&low_cursor, &low) && low >= 0xDC00 && low < 0xE000) {
+      *code = 0x10000 + ((*code - 0xD800) << 10) + (low - 0xDC00);
+      c->p = low_cursor.p;
+    } else {
+      *code = 0xFFFD;
+    }
+  }
+  return 1;
+}
+
+// Unescape the string whose opening quote was just consumed, in place, and
+// move past its closing quote. Returns where the text starts, or NULL if the
+// string is malformed.
+static char *read_string(Cursor *c, size_t *length) {
+  char *start = c->p;
+  char *out = c->p;
+  while (c->p < c->end) {
+    char ch = *c->p++;
+    if (ch == '"') {
+      *length = (size_t)(out - start);
+      return start;
+    }
+    if (ch != '\\') {
+      *out++ = ch;
+      continue;
+    }
+    if (c->p == c->end)
+      return NULL;
+    switch (ch = *c->p++) {
+    case '"':
+    case '\\':
+    case '/':
+      *out++ = ch;
+      break;
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'u': {
+      unsigned code;
+      if (!read_unicode(c, &code))
+        return NULL;
+      out = put_utf8(out, code);
+      break;
+    }
+    default:
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+// Move past a string without unescaping it
+static int skip_string(Cursor *c) {
+  for (c->p++; c->p < c->end; c->p++) {
+    if (*c->p == '\\')
+      c->p++;
+    else if (*c->p == '"') {
+      c->p++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Move past a value of any type. Nesting is tracked with a counter, so deep
+// input cannot exhaust the stack.
+static int skip_value(Cursor *c) {
+  int depth = 0;
+  while (c->p < c->end) {
+    char ch = *c->p;
+    if (ch == '"') {
+      if (!skip_string(c))
+        return 0;
+      if (depth == 0)
+        return 1;
+      continue;
+    }
+    if (ch == '{' || ch == '[') {
+      depth++;
+    } else if (ch == '}' || ch == ']') {
+      if (depth == 0)
+        return 1; // The end of the enclosing object
+      if (--depth == 0) {
+        c->p++;
+        return 1;
+      }
+    } else if (ch == ',' && depth == 0) {
+      return 1;
+    }
+    c->p++;
+  }
+  return depth == 0;
+}
+
+static const VibeField *find_field(const VibeObjectShape *shape,
+                                   const char *name, size_t length) {
+  for (int i = 0; i < shape->field_count; i++) {
+    const char *field = shape->fields[i].name;
+    if (strncmp(field, name, length) == 0 && field[length] == '\0')
+      return &shape->fields[i];
+  }
+  return NULL;
+}
+
+// Store a number or boolean read from a value's text
+static void store_scalar(const VibeField *field, char *member, const char *text,
+                         size_t length) {
+  switch (field->kind) {
+  case VIBE_FIELD_INT: {
+    long long value;
+    if (response_decode_int(text, length, &value))
+      *(int *)member = value > INT_MAX   ? INT_MAX
+                       : value < INT_MIN ? INT_MIN
+                                         : (int)value;
+    break;
+  }
+  case VIBE_FIELD_FLOAT:
+    response_decode_float(text, length, (double *)member);
+    break;
+  case VIBE_FIELD_BOOL:
+    response_decode_bool(text, length, (int *)member);
+    break;
+  default:
+    break;
+  }
+}
+
+static int decode_object(Cursor *c, const VibeObjectShape *shape, char *out);
+
+// Decode a property's value into its member. Values of the wrong type are
+// skipped and leave the member zero.
+static int decode_field(Cursor *c, const VibeField *field, char *member) {
+  if (*c->p == '"') {
+    c->p++;
+    size_t length;
+    char *text = read_string(c, &length);
+    if (!text)
+      return 0;
+    if (field->kind == VIBE_FIELD_STRING) {
+      text[length] = '\0'; // At or before the closing quote
+      *(char **)member = text;
+    } else {
+      store_scalar(field, member, text, length);
+    }
+    return 1;
+  }
+
+  if (*c->p == '{' && field->kind == VIBE_FIELD_OBJECT)
+    return decode_object(c, field->shape, member);
+  if (*c->p == '{' || *c->p == '[')
+    return skip_value(c);
+
+  // A number or a literal; null leaves the member zero
+  char *start = c->p;
+  while (c->p < c->end && !is_delimiter(*c->p))
+    c->p++;
+  if (c->p == start)
+    return 0;
+  store_scalar(field, member, start, (size_t)(c->p - start));
+  return 1;
+}
+
+// Decode the object at the cursor. Nesting follows the shapes, which the
+// compiler only generates without cycles.
+static int decode_object(Cursor *c, const VibeObjectShape *shape, char *out) {
+  if (c->p == c->end || *c->p != '{')
+    return 0;
+  c->p++;
+  skip_space(c);
+  if (c->p < c->end && *c->p == '}') {
+    c->p++;
+    return 1;
+  }
+
+  while (c->p < c->end) {
+    if (*c->p != '"')
+      return 0;
+    c->p++;
+    size_t name_length;
+    char *name = read_string(c, &name_length);
+    if (!name)
+      return 0;
+    skip_space(c);
+    if (c->p == c->end || *c->p != ':')
+      return 0;
+    c->p++;
+    skip_space(c);
+    if (c->p == c->end)
+      return 0;
+
+    const VibeField *field = find_field(shape, name, name_length);
+    if (!(field ? decode_field(c, field, out + field->offset) : skip_value(c)))
+      return 0;
+
+    skip_space(c);
+    if (c->p == c->end)
+      return 0;
+    if (*c->p == '}') {
+      c->p++;
+      return 1;
+    }
+    if (*c->p != ',')
+      return 0;
+    c->p++;
+    skip_space(c);
+  }
+  return 0;
+}
+
+/**
+ * Decode the first JSON object in a text into a struct
+ */
+int object_decode(char *text, size_t length, const VibeObjectShape *shape,
+                  void *out) {
+  memset(out, 0, shape->size);
+  char *start = memchr(text, '{', length);
+  if (!start)
+    return 0;
+
+  Cursor cursor = {start, text + length};
+  if (!decode_object(&cursor, shape, out)) {
+    memset(out, 0, shape->size);
+    return 0;
+  }
+  return 1;
+}
+
+// Entry types of the tape beyond the node types
+#define TAPE_KEY ((uint32_t)VIBE_NODE_OBJECT + 1)
+#define TAPE_END ((uint32_t)VIBE_NODE_OBJECT + 2)
+
+// Parent link of the outermost container while the tape is filled
+#define NO_PARENT SIZE_MAX
+
+typedef struct {
+  uint32_t type;   // A VibeNodeType, TAPE_KEY or TAPE_END
+  uint32_t length; // Bytes of a string or key, children of a container
+  union {
+    double number;
+    int boolean;
+    size_t offset; // Where a string or key starts in the text
+    size_t end;    // A container's TAPE_END entry, and the reverse
+  } as;
+} TapeEntry;
+
+struct VibeTape {
+  size_t count;        // Entries in use
+  char *text;          // The response, unescaped in place
+  TapeEntry entries[]; // The root first; the text follows the last entry
+};
+
+// Count the entries the value at the start of a text needs: one per string,
+// scalar and bracket. Returns 0 if the value does not end.
+static size_t tape_count(char *text, size_t length) {
+  Cursor c = {text, text + length};
+  size_t count = 0, depth = 0;
+  while (c.p < c.end) {
+    char ch = *c.p;
+    if (ch == '"') {
+      if (!skip_string(&c))
+        return 0;
+      count++;
+    } else if (ch == '{' || ch == '[') {
+      depth++;
+      count++;
+      c.p++;
+    } else if (ch == '}' || ch == ']') {
+      count++;
+      c.p++;
+      if (--depth == 0)
+        return count;
+    } else if (ch == ',' || ch == ':' || is_space(ch)) {
+      c.p++;
+    } else {
+      count++;
+      while (c.p < c.end && !is_delimiter(*c.p) && *c.p != ':' &&
+             *c.p != '"' && *c.p != '{' && *c.p != '[')
+        c.p++;
+    }
+  }
+  return 0;
+}
+
+// Append an entry. Returns NULL if the count pass reserved too few, which
+// only malformed input can cause.
+static TapeEntry *tape_push(VibeTape *tape, size_t capacity, uint32_t type) {
+  if (tape->count == capacity)
+    return NULL;
+  TapeEntry *entry = &tape->entries[tape->count++];
+  entry->type = type;
+  entry->length = 0;
+  return entry;
+}
+
+// Unescape the string at the cursor and append it as a string or key
+static int tape_string(Cursor *c, VibeTape *tape, size_t capacity,
+                       uint32_t type) {
+  c->p++;
+  size_t length;
+  char *text = read_string(c, &length);
+  if (!text || length > UINT32_MAX)
+    return 0;
+  TapeEntry *entry = tape_push(tape, capacity, type);
+  if (!entry)
+    return 0;
+  text[length] = '\0'; // At or before the closing quote
+  entry->length = (uint32_t)length;
+  entry->as.offset = (size_t)(text - tape->text);
+  return 1;
+}
+
+// Append an object member's name and move past its colon
+static int tape_key(Cursor *c, VibeTape *tape, size_t capacity) {
+  skip_space(c);
+  if (c->p == c->end || *c->p != '"' ||
+      !tape_string(c, tape, capacity, TAPE_KEY))
+    return 0;
+  skip_space(c);
+  if (c->p == c->end || *c->p != ':')
+    return 0;
+  c->p++;
+  return 1;
+}
+
+// Append a number or a literal
+static int tape_scalar(Cursor *c, VibeTape *tape, size_t capacity) {
+  char *start = c->p;
+  while (c->p < c->end && !is_delimiter(*c->p))
+    c->p++;
+  size_t length = (size_t)(c->p - start);
+  TapeEntry *entry = tape_push(tape, capacity, VIBE_NODE_NULL);
+  if (!entry)
+    return 0;
+
+  if (length == 4 && memcmp(start, "null", 4) == 0)
+    return 1;
+  if ((length == 4 && memcmp(start, "true", 4) == 0) ||
+      (length == 5 && memcmp(start, "false", 5) == 0)) {
+    entry->type = VIBE_NODE_BOOL;
+    entry->as.boolean = *start == 't';
+    return 1;
+  }
+
+  if (length == 0 || !(*start == '-' || (*start >= '0' && *start <= '9')))
+    return 0;
+  for (size_t i = 0; i < length; i++) {
+    if (!strchr("0123456789+-.eE", start[i]))
+      return 0;
+  }
+  entry->type = VIBE_NODE_NUMBER;
+  return response_decode_float(start, length, &entry->as.number);
+}
+
+// Fill the tape from the container at the cursor. Open containers are
+// chained through their end field, so nesting needs no stack.
+static int tape_fill(Cursor *c, VibeTape *tape, size_t capacity) {
+  size_t open = NO_PARENT;
+  for (;;) {
+    // A value, the first of its container or after a separator
+    skip_space(c);
+    if (c->p == c->end)
+      return 0;
+    if (open != NO_PARENT && tape->entries[open].length++ == UINT32_MAX)
+      return 0;
+    char ch = *c->p;
+    if (ch == '{' || ch == '[') {
+      TapeEntry *entry = tape_push(
+          tape, capacity, ch == '{' ? VIBE_NODE_OBJECT : VIBE_NODE_ARRAY);
+      if (!entry)
+        return 0;
+      entry->as.end = open;
+      open = tape->count - 1;
+      c->p++;
+      skip_space(c);
+      if (c->p == c->end || *c->p != (ch == '{' ? '}' : ']')) {
+        if (ch == '{' && !tape_key(c, tape, capacity))
+          return 0;
+        continue;
+      }
+    } else if (ch == '"') {
+      if (!tape_string(c, tape, capacity, VIBE_NODE_STRING))
+        return 0;
+    } else if (!tape_scalar(c, tape, capacity)) {
+      return 0;
+    }
+
+    // Close containers until a separator starts the next value
+    for (;;) {
+      if (open == NO_PARENT)
+        return 1;
+      skip_space(c);
+      if (c->p == c->end)
+        return 0;
+      TapeEntry *container = &tape->entries[open];
+      int object = container->type == VIBE_NODE_OBJECT;
+      if (*c->p == ',') {
+        c->p++;
+        if (object && !tape_key(c, tape, capacity))
+          return 0;
+        break;
+      }
+      if (*c->p != (object ? '}' : ']'))
+        return 0;
+      c->p++;
+      TapeEntry *end = tape_push(tape, capacity, TAPE_END);
+      if (!end)
+        return 0;
+      size_t parent = container->as.end;
+      container->as.end = tape->count - 1;
+      end->as.end = open;
+      open = parent;
+    }
+  }
+}
+
+/**
+ * Parse the first JSON object or array in a text into a tape
+ */
+VibeTape *object_tape_parse(char *text) {
+  size_t length = strlen(text);
+  char *start = strpbrk(text, "{[");
+  size_t count = start ? tape_count(start, length - (size_t)(start - text)) : 0;
+  if (count == 0) {
+    free(text);
+    return NULL;
+  }
+
+  // Grow the response's own allocation and move the JSON behind the entries
+  size_t skip = (size_t)(start - text);
+  length -= skip;
+  size_t header = offsetof(VibeTape, entries) + count * sizeof(TapeEntry);
+  VibeTape *tape = realloc(text, header + length + 1);
+  if (!tape) {
+    free(text);
+    return NULL;
+  }
+  memmove((char *)tape + header, (char *)tape + skip, length + 1);
+  tape->count = 0;
+  tape->text = (char *)tape + header;
+
+  Cursor cursor = {tape->text, tape->text + length};
+  if (!tape_fill(&cursor, tape, count)) {
+    free(tape);
+    return NULL;
+  }
+  return tape;
+}
+
+/**
+ * Parse the JSON object or array in a string value into an object value
+ */
+int vibe_value_to_object(VibeValue *value) {
+  if (!value || value->type != VIBE_STRING || !value->data.string_val)
+    return 0;
+
+  VibeTape *tape = object_tape_parse(value->data.string_val);
+  value->data.string_val = NULL;
+  if (!tape) {
+    WARN("No well-formed JSON object or array in response");
+    value->type = VIBE_NULL;
+    return 0;
+  }
+  value->type = VIBE_OBJECT;
+  value->data.object_val = tape;
+  return 1;
+}
+
+/**
+ * Get the root of an object value
+ */
+VibeNode vibe_value_root(const VibeValue *value) {
+  VibeNode root = {NULL, 0, 0};
+  if (value && value->type == VIBE_OBJECT)
+    root.tape = value->data.object_val;
+  return root;
+}
+
+// Entry of a node, NULL for a missing node
+static inline const TapeEntry *node_entry(VibeNode node) {
+  return node.tape ? &node.tape->entries[node.index] : NULL;
+}
+
+/**
+ * Get the type of a node
+ */
+VibeNodeType vibe_node_type(VibeNode node) {
+  const TapeEntry *entry = node_entry(node);
+  return entry ? (VibeNodeType)entry->type : VIBE_NODE_MISSING;
+}
+
+/**
+ * Count the members of an object or the elements of an array
+ */
+size_t vibe_node_count(VibeNode node) {
+  const TapeEntry *entry = node_entry(node);
+  return entry && (entry->type == VIBE_NODE_OBJECT ||
+                   entry->type == VIBE_NODE_ARRAY)
+             ? entry->length
+             : 0;
+}
+
+/**
+ * Get the first member of an object or element of an array
+ */
+VibeNode vibe_node_first(VibeNode node) {
+  VibeNode child = {NULL, 0, 0};
+  if (vibe_node_count(node) == 0)
+    return child;
+  child.tape = node.tape;
+  if (node.tape->entries[node.index].type == VIBE_NODE_OBJECT) {
+    child.key = node.index + 1;
+    child.index = node.index + 2;
+  } else {
+    child.index = node.index + 1;
+  }
+  return child;
+}
+
+/**
+ * Get the member or element after a node
+ */
+VibeNode vibe_node_next(VibeNode node) {
+  VibeNode next = {NULL, 0, 0};
+  const TapeEntry *entry = node_entry(node);
+  if (!entry)
+    return next;
+  size_t after = entry->type == VIBE_NODE_OBJECT ||
+                         entry->type == VIBE_NODE_ARRAY
+                     ? entry->as.end + 1
+                     : node.index + 1;
+  if (after == node.tape->count || node.tape->entries[after].type == TAPE_END)
+    return next;
+  next.tape = node.tape;
+  if (node.key) {
+    next.key = after;
+    next.index = after + 1;
+  } else {
+    next.index = after;
+  }
+  return next;
+}
+
+/**
+ * Look up a member of an object by name
+ */
+VibeNode vibe_node_get(VibeNode object, const char *name) {
+  if (vibe_node_type(object) != VIBE_NODE_OBJECT)
+    return (VibeNode){NULL, 0, 0};
+  size_t length = strlen(name);
+  VibeNode member = vibe_node_first(object);
+  for (; member.tape; member = vibe_node_next(member)) {
+    const TapeEntry *key = &member.tape->entries[member.key];
+    if (key->length == length &&
+        memcmp(member.tape->text + key->as.offset, name, length) == 0)
+      break;
+  }
+  return member;
+}
+
+/**
+ * Get the name of an object member
+ */
+const char *vibe_node_key(VibeNode node) {
+  if (!node.tape || !node.key)
+    return NULL;
+  return node.tape->text + node.tape->entries[node.key].as.offset;
+}
+
+/**
+ * Get the text of a string node
+ */
+const char *vibe_node_string(VibeNode node, size_t *length) {
+  const TapeEntry *entry = node_entry(node);
+  if (!entry || entry->type != VIBE_NODE_STRING)
+    return NULL;
+  if (length)
+    *length = entry->length;
+  return node.tape->text + entry->as.offset;
+}
+
+/**
+ * Get the value of a number node
+ */
+double vibe_node_number(VibeNode node) {
+  const TapeEntry *entry = node_entry(node);
+  double number;
+  if (entry && entry->type == VIBE_NODE_NUMBER)
+    return entry->as.number;
+  if (entry && entry->type == VIBE_NODE_STRING &&
+      response_decode_float(node.tape->text + entry->as.offset, entry->length,
+                            &number))
+    return number;
+  return 0;
+}
+
+/**
+ * Get the value of a boolean node
+ */
+int vibe_node_bool(VibeNode node) {
+  const TapeEntry *entry = node_entry(node);
+  int answer;
+  if (entry && entry->type == VIBE_NODE_BOOL)
+    return entry->as.boolean;
+  if (entry && entry->type == VIBE_NODE_STRING &&
+      response_decode_bool(node.tape->text + entry->as.offset, entry->length,
+                           &answer))
+    return answer;
+  return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file object_decoder.h
+ * @brief In-place decoding of JSON object responses into generated structs
+ * and tapes
+ *
+ * A structured response is parsed once, straight into the struct the
+ * compiler generated for its class, guided by the class's field table.
+ * Strings are unescaped where they lie and NUL-terminated, so string fields
+ * point into the response text and decoding allocates nothing. Properties
+ * match fields by name in any order. Unknown properties are skipped and
+ * missing or null ones stay zero. A number or boolean sent as a string, such
+ * as "25", is still read.
+ *
+ * Responses without a generated struct are parsed into a tape instead, one
+ * entry per string, scalar, bracket and member name in document order, much
+ * like simdjson's. A container's entry links to its closing one, so a
+ * sibling is one step away however deep the container is. Entries and text
+ * share the response's allocation.
+ */
+
+#ifndef OBJECT_DECODER_H
+#define OBJECT_DECODER_H
+
+#include "../../include/runtime.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Decode the first JSON object in a text into a struct. Text before the
+ * object, such as a Markdown fence, is ignored. The text is modified.
+ *
+ * @param text The text, unescaped in place
+ * @param length Its length in bytes
+ * @param shape The layout of the struct
+ * @param out The struct, zeroed first and left zeroed on failure
+ * @return 1 on success, 0 if the text holds no well-formed object
+ */
+int object_decode(char *text, size_t length, const VibeObjectShape *shape,
+                  void *out);
+
+/**
+ * Parse the first JSON object or array in a text into a tape. The text's
+ * allocation is grown to hold the entries and becomes the tape's.
+ *
+ * @param text A heap-allocated NUL-terminated text, consumed either way
+ * @return The tape, released with free(), or NULL if the text holds no
+ * well-formed object or array
+ */
+VibeTape *object_tape_parse(char *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OBJECT_DECODER_H */
@@ -0,0 +1,185 @@
+/**
+ * @file request_serializer.c
+ * @brief Serialization of chat completion requests
+ */
+
+#include "request_serializer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static inline int append_literal(LLMBuffer *buffer, const char *literal) {
+  return llm_buffer_append(buffer, literal, strlen(literal));
+}
+
+// Bytes JSON requires to be escaped: quote, backslash and control characters
+static inline int needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Find the first byte that needs escaping, or end if there is none
+static const char *find_escape(const char *p, const char *end) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control_max = _mm_set1_epi8(0x1F);
+
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+    // Unsigned c <= 0x1F exactly when min(c, 0x1F) == c
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk);
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                   _mm_cmpeq_epi8(chunk, backslash));
+    int mask = _mm_movemask_epi8(_mm_or_si128(control, special));
+    if (mask)
+      return p + __builtin_ctz((unsigned)mask);
+    p += 16;
+  }
+#endif
+
+  while (p < end && !needs_escape((unsigned char)*p))
+    p++;
+  return p;
+}
+
+// Append the escape sequence for one byte
+static int append_escape(LLMBuffer *buffer, unsigned char c) {
+  char sequence[7] = {'\\', 0};
+  size_t length = 2;
+
+  switch (c) {
+  case '"':
+    sequence[1] = '"';
+    break;
+  case '\\':
+    sequence[1] = '\\';
+    break;
+  case '\b':
+    sequence[1] = 'b';
+    break;
+  case '\f':
+    sequence[1] = 'f';
+    break;
+  case '\n':
+    sequence[1] = 'n';
+    break;
+  case '\r':
+    sequence[1] = 'r';
+    break;
+  case '\t':
+    sequence[1] = 't';
+    break;
+  default: {
+    static const char hex[] = "0123456789abcdef";
+    memcpy(sequence + 1, "u00", 3);
+    sequence[4] = hex[c >> 4];
+    sequence[5] = hex[c & 0xF];
+    length = 6;
+    break;
+  }
+  }
+  return llm_buffer_append(buffer, sequence, length);
+}
+
+/**
+ * Append a string to a buffer as a quoted JSON string
+ */
+int json_append_string(LLMBuffer *buffer, const char *text, size_t length) {
+  // Escapes are rare in prose, so reserve for the unescaped size up front
+  if (!llm_buffer_reserve(buffer, buffer->length + length + 2) ||
+      !llm_buffer_append(buffer, "\"", 1))
+    return 0;
+
+  const char *p = text;
+  const char *end = text + length;
+  while (p < end) {
+    const char *escape = find_escape(p, end);
+    if (escape > p && !llm_buffer_append(buffer, p, (size_t)(escape - p)))
+      return 0;
+    if (escape == end)
+      break;
+    if (!append_escape(buffer, (unsigned char)*escape))
+      return 0;
+    p = escape + 1;
+  }
+
+  return llm_buffer_append(buffer, "\"", 1);
+}
+
+// Append a number as JSON. Fifteen significant digits keep 0.7 from turning
+// into 0.69999999999999996. printf honours LC_NUMERIC, which may use a
+// decimal comma, so the separator is normalized afterwards.
+static int append_double(LLMBuffer *buffer, double value) {
+  char number[32];
+  int length = snprintf(number, sizeof(number), "%.15g", value);
+  if (length <= 0 || (size_t)length >= sizeof(number))
+    return 0;
+  for (char *c = number; *c; c++) {
+    if (*c == ',')
+      *c = '.';
+  }
+  return llm_buffer_append(buffer, number, (size_t)length);
+}
+
+static int append_long(LLMBuffer *buffer, long value) {
+  char number[24];
+  int length = snprintf(number, sizeof(number), "%ld", value);
+  return length > 0 && llm_buffer_append(buffer, number, (size_t)length);
+}
+
+/**
+ * Serialize a chat completion request
+ */
+int chat_request_serialize(LLMBuffer *buffer, const FunctionConfig *function,
+                           const char *prompt, int stream) {
+  const char *model = function->model ? function->model : "gpt-3.5-turbo";
+  const char *instruction = function->instruction;
+  size_t prompt_length = strlen(prompt);
+  size_t instruction_length = instruction ? strlen(instruction) : 0;
+
+  llm_buffer_reset(buffer);
+  // Fixed fields take well under 256 bytes besides the model name
+  if (!llm_buffer_reserve(buffer, prompt_length + instruction_length +
+                                      strlen(model) + 256))
+    return 0;
+
+  int ok = append_literal(buffer, "{\"model\":") &&
+           json_append_string(buffer, model, strlen(model)) &&
+           append_literal(buffer, ",\"messages\":[");
+  if (ok && instruction) {
+    ok = append_literal(buffer, "{\"role\":\"system\",\"content\":") &&
+         json_append_string(buffer, instruction, instruction_length) &&
+         append_literal(buffer, "},");
+  }
+  ok = ok && append_literal(buffer, "{\"role\":\"user\",\"content\":") &&
+       json_append_string(buffer, prompt, prompt_length) &&
+       append_literal(buffer, "}],\"temperature\":") &&
+       append_double(buffer, function->temperature);
+
+  if (ok && function->max_tokens > 0) {
+    ok = append_literal(buffer, ",\"max_tokens\":") &&
+         append_long(buffer, function->max_tokens);
+  }
+  if (ok && function->stop && function->stop[0]) {
+    ok = append_literal(buffer, ",\"stop\":[");
+    for (int i = 0; ok && function->stop[i]; i++) {
+      ok = (i == 0 || llm_buffer_append(buffer, ",", 1)) &&
+           json_append_string(buffer, function->stop[i],
+                              strlen(function->stop[i]));
+    }
+    ok = ok && llm_buffer_append(buffer, "]", 1);
+  }
+  // The compiler wrote the format as JSON already
+  if (ok && function->response_format) {
+    ok = append_literal(buffer, ",\"response_format\":") &&
+         append_literal(buffer, function->response_format);
+  }
+  if (ok && stream)
+    ok = append_literal(buffer, ",\"stream\":true");
+
+  return ok && llm_buffer_append(buffer, "}", 1);
+}
@@ -0,0 +1,49 @@
+/**
+ * @file request_serializer.h
+ * @brief Serialization of chat completion requests
+ *
+ * Requests are written straight into a reusable buffer instead of being
+ * assembled with snprintf. Strings are JSON escaped with a vectorized scan
+ * that copies runs of clean bytes in bulk, so large prompts cost little more
+ * than a memcpy.
+ */
+
+#ifndef REQUEST_SERIALIZER_H
+#define REQUEST_SERIALIZER_H
+
+#include "config.h"
+#include "llm_session.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Append a string to a buffer as a quoted JSON string
+ *
+ * @param buffer The buffer to append to
+ * @param text The string, which may contain any bytes including NUL
+ * @param length Length of the string in bytes
+ * @return 1 on success, 0 on allocation failure
+ */
+int json_append_string(LLMBuffer *buffer, const char *text, size_t length);
+
+/**
+ * Serialize a chat completion request, replacing the buffer's contents
+ *
+ * @param buffer The buffer receiving the request body
+ * @param function Model and generation parameters for the request
+ * @param prompt The prompt, sent as the user message after the function's
+ * instruction, if any
+ * @param stream Whether to ask for a server-sent event stream
+ * @return 1 on success, 0 on allocation failure
+ */
+int chat_request_serialize(LLMBuffer *buffer, const FunctionConfig *function,
+                           const char *prompt, int stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REQUEST_SERIALIZER_H */
@@ -0,0 +1,418 @@
+/**
+ * @file response_cache.c
+ * @brief In-process LRU cache of LLM responses
+ */
+
+#include "response_cache.h"
+#include "../utils/log_utils.h"
+#include "llm_session.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CACHE_INITIAL_BUCKETS 64
+
+// An entry is a single allocation: the struct followed by the key material
+// and the NUL terminated response
+typedef struct CacheEntry {
+  uint64_t hash;
+  size_t key_length;
+  size_t value_length;
+  size_t bytes;           // Charged against the budget
+  uint64_t expires_at_ms; // 0 = never expires
+  struct CacheEntry *chain; // Next entry in the same bucket
+  struct CacheEntry *prev;  // LRU neighbours, head is most recently used
+  struct CacheEntry *next;
+} CacheEntry;
+
+static struct {
+  pthread_mutex_t lock;
+  CacheEntry **buckets;
+  size_t bucket_count; // Always a power of two
+  CacheEntry *head;
+  CacheEntry *tail;
+  size_t entries;
+  size_t bytes;
+
+  int enabled;
+  uint64_t ttl_ms;
+  size_t max_bytes;
+
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static inline char *entry_key(CacheEntry *entry) { return (char *)(entry + 1); }
+
+static inline char *entry_value(CacheEntry *entry) {
+  return entry_key(entry) + entry->key_length;
+}
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Hash eight bytes at a time; prompts are long enough that a byte-wise hash
+// would dominate the cost of a hit
+static uint64_t hash_bytes(const char *data, size_t length) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ (length * 0xff51afd7ed558ccdULL);
+
+  while (length >= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    h = (h ^ mix64(word)) * 0x9e3779b97f4a7c15ULL;
+    data += 8;
+    length -= 8;
+  }
+
+  uint64_t tail = 0;
+  memcpy(&tail, data, length);
+  h ^= mix64(tail ^ length);
+  return mix64(h);
+}
+
+static void lru_unlink(CacheEntry *entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache.head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache.tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(CacheEntry *entry) {
+  entry->prev = NULL;
+  entry->next = cache.head;
+  if (cache.head)
+    cache.head->prev = entry;
+  cache.head = entry;
+  if (!cache.tail)
+    cache.tail = entry;
+}
+
+// Find an entry and the link pointing at it. Caller holds the lock.
+static CacheEntry **find_slot(const ResponseCacheKey *key) {
+  if (!cache.buckets)
+    return NULL;
+
+  CacheEntry **slot = &cache.buckets[key->hash & (cache.bucket_count - 1)];
+  while (*slot) {
+    CacheEntry *entry = *slot;
+    if (entry->hash == key->hash && entry->key_length == key->length &&
+        memcmp(entry_key(entry), key->material, key->length) == 0)
+      return slot;
+    slot = &entry->chain;
+  }
+  return slot;
+}
+
+// Unlink and free the entry a slot points at. Caller holds the lock.
+static void remove_slot(CacheEntry **slot) {
+  CacheEntry *entry = *slot;
+  *slot = entry->chain;
+  lru_unlink(entry);
+  cache.entries--;
+  cache.bytes -= entry->bytes;
+  free(entry);
+}
+
+static void remove_entry(CacheEntry *entry) {
+  CacheEntry **slot = &cache.buckets[entry->hash & (cache.bucket_count - 1)];
+  while (*slot != entry)
+    slot = &(*slot)->chain;
+  remove_slot(slot);
+}
+
+// Double the bucket array once the load factor passes one
+static void maybe_grow(void) {
+  if (cache.buckets && cache.entries < cache.bucket_count)
+    return;
+
+  size_t new_count =
+      cache.buckets ? cache.bucket_count * 2 : CACHE_INITIAL_BUCKETS;
+  CacheEntry **buckets = calloc(new_count, sizeof(CacheEntry *));
+  if (!buckets)
+    return; // Keep the current table; chains just get longer
+
+  for (size_t i = 0; i < cache.bucket_count; i++) {
+    CacheEntry *entry = cache.buckets[i];
+    while (entry) {
+      CacheEntry *chain = entry->chain;
+      CacheEntry **slot = &buckets[entry->hash & (new_count - 1)];
+      entry->chain = *slot;
+      *slot = entry;
+      entry = chain;
+    }
+  }
+
+  free(cache.buckets);
+  cache.buckets = buckets;
+  cache.bucket_count = new_count;
+}
+
+/**
+ * Configure the cache. Existing entries are kept.
+ */
+void response_cache_init(const CacheConfig *config) {
+  pthread_mutex_lock(&cache.lock);
+  cache.enabled = config->enabled && config->max_bytes > 0;
+  cache.ttl_ms = (uint64_t)config->ttl_seconds * 1000u;
+  cache.max_bytes = config->max_bytes;
+  while (cache.tail && cache.bytes > cache.max_bytes) {
+    remove_entry(cache.tail);
+    cache.evictions++;
+  }
+  pthread_mutex_unlock(&cache.lock);
+
+  DEBUG("Response cache %s (ttl %ds, budget %zu bytes)",
+        cache.enabled ? "enabled" : "disabled", config->ttl_seconds,
+        config->max_bytes);
+}
+
+/**
+ * Drop every entry and reset the counters
+ */
+void response_cache_cleanup(void) {
+  pthread_mutex_lock(&cache.lock);
+  CacheEntry *entry = cache.head;
+  while (entry) {
+    CacheEntry *next = entry->next;
+    free(entry);
+    entry = next;
+  }
+  free(cache.buckets);
+  cache.buckets = NULL;
+  cache.bucket_count = 0;
+  cache.head = cache.tail = NULL;
+  cache.entries = cache.bytes = 0;
+  cache.hits = cache.misses = cache.evictions = 0;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+/**
+ * Build the key for a request
+ */
+int response_cache_key_init(ResponseCacheKey *key, const char *prompt,
+                            const char *meaning,
+                            const FunctionConfig *function) {
+  int stop_count = 0;
+  size_t stop_length = 0;
+  for (; function->stop && function->stop[stop_count]; stop_count++)
+    stop_length += strlen(function->stop[stop_count]) + 1;
+
+  // Requests without stop sequences, an instruction or a response format
+  // keep the key layout they always had, so that recorded cassettes still
+  // replay
+  const char *instruction = function->instruction;
+  const char *format = function->response_format;
+  int shaped = stop_count > 0 || instruction || format;
+  if (!instruction)
+    instruction = "";
+  if (!format)
+    format = "";
+  size_t instruction_length = shaped ? strlen(instruction) + 1 : 0;
+  size_t format_length = shaped ? strlen(format) + 1 : 0;
+
+  char params[80];
+  int params_length =
+      shaped ? snprintf(params, sizeof(params), "%.17g:%d:%d",
+                        function->temperature, function->max_tokens,
+                        stop_count)
+             : snprintf(params, sizeof(params), "%.17g:%d",
+                        function->temperature, function->max_tokens);
+  const char *endpoint = function->endpoint ? function->endpoint : "";
+  const char *unix_socket = function->unix_socket ? function->unix_socket : "";
+  const char *model = function->model ? function->model : "";
+  if (!meaning)
+    meaning = "";
+
+  size_t endpoint_length = strlen(endpoint);
+  size_t unix_socket_length = strlen(unix_socket);
+  size_t model_length = strlen(model);
+  size_t meaning_length = strlen(meaning);
+  size_t prompt_length = strlen(prompt);
+
+  // Fields are NUL separated so that no two requests share key material;
+  // params counts the stop sequences that follow it
+  key->length = endpoint_length + 1 + unix_socket_length + 1 + model_length +
+                1 + (size_t)params_length + 1 + stop_length +
+                instruction_length + format_length + meaning_length + 1 +
+                prompt_length;
+  key->storage = llm_session_key_acquire();
+  if (key->storage && !llm_buffer_reserve(key->storage, key->length)) {
+    llm_session_key_release(key->storage);
+    key->storage = NULL;
+  }
+  key->material = key->storage ? key->storage->data : malloc(key->length);
+  if (!key->material) {
+    ERROR("Failed to allocate response cache key");
+    return 0;
+  }
+
+  char *cursor = key->material;
+  memcpy(cursor, endpoint, endpoint_length + 1);
+  cursor += endpoint_length + 1;
+  memcpy(cursor, unix_socket, unix_socket_length + 1);
+  cursor += unix_socket_length + 1;
+  memcpy(cursor, model, model_length + 1);
+  cursor += model_length + 1;
+  memcpy(cursor, params, (size_t)params_length + 1);
+  cursor += params_length + 1;
+  for (int i = 0; i < stop_count; i++) {
+    size_t length = strlen(function->stop[i]) + 1;
+    memcpy(cursor, function->stop[i], length);
+    cursor += length;
+  }
+  memcpy(cursor, instruction, instruction_length);
+  cursor += instruction_length;
+  memcpy(cursor, format, format_length);
+  cursor += format_length;
+  memcpy(cursor, meaning, meaning_length + 1);
+  cursor += meaning_length + 1;
+  memcpy(cursor, prompt, prompt_length);
+
+  key->hash = hash_bytes(key->material, key->length);
+  return 1;
+}
+
+/**
+ * Release a key's material
+ */
+void response_cache_key_free(ResponseCacheKey *key) {
+  if (key->storage)
+    llm_session_key_release(key->storage);
+  else
+    free(key->material);
+  key->storage = NULL;
+  key->material = NULL;
+  key->length = 0;
+}
+
+/**
+ * Look up a cached response
+ */
+char *response_cache_get(const ResponseCacheKey *key) {
+  pthread_mutex_lock(&cache.lock);
+  if (!cache.enabled) {
+    pthread_mutex_unlock(&cache.lock);
+    return NULL;
+  }
+
+  CacheEntry **slot = find_slot(key);
+  CacheEntry *entry = slot ? *slot : NULL;
+  if (entry && entry->expires_at_ms && entry->expires_at_ms <= now_ms()) {
+    remove_slot(slot);
+    cache.evictions++;
+    entry = NULL;
+  }
+
+  if (!entry) {
+    cache.misses++;
+    pthread_mutex_unlock(&cache.lock);
+    return NULL;
+  }
+
+  // Copy while holding the lock; the entry may be evicted right after
+  char *response = malloc(entry->value_length + 1);
+  if (response) {
+    memcpy(response, entry_value(entry), entry->value_length + 1);
+    lru_unlink(entry);
+    lru_push_front(entry);
+    cache.hits++;
+  }
+  pthread_mutex_unlock(&cache.lock);
+  return response;
+}
+
+/**
+ * Store a response
+ */
+void response_cache_put(const ResponseCacheKey *key, const char *response) {
+  size_t value_length = strlen(response);
+  size_t bytes = sizeof(CacheEntry) + key->length + value_length + 1;
+
+  pthread_mutex_lock(&cache.lock);
+  if (!cache.enabled || bytes > cache.max_bytes) {
+    pthread_mutex_unlock(&cache.lock);
+    return;
+  }
+  pthread_mutex_unlock(&cache.lock);
+
+  // Build the entry outside the lock
+  CacheEntry *entry = malloc(bytes);
+  if (!entry) {
+    WARN("Failed to allocate response cache entry");
+    return;
+  }
+  entry->hash = key->hash;
+  entry->key_length = key->length;
+  entry->value_length = value_length;
+  entry->bytes = bytes;
+  entry->expires_at_ms = 0;
+  memcpy(entry_key(entry), key->material, key->length);
+  memcpy(entry_value(entry), response, value_length + 1);
+
+  pthread_mutex_lock(&cache.lock);
+  if (!cache.enabled || bytes > cache.max_bytes) {
+    pthread_mutex_unlock(&cache.lock);
+    free(entry);
+    return;
+  }
+  if (cache.ttl_ms)
+    entry->expires_at_ms = now_ms() + cache.ttl_ms;
+
+  // Replace an existing entry for the same request
+  CacheEntry **slot = find_slot(key);
+  if (slot && *slot)
+    remove_slot(slot);
+
+  while (cache.tail && cache.bytes + bytes > cache.max_bytes) {
+    remove_entry(cache.tail);
+    cache.evictions++;
+  }
+
+  maybe_grow();
+  if (!cache.buckets) {
+    pthread_mutex_unlock(&cache.lock);
+    free(entry);
+    return;
+  }
+
+  CacheEntry **bucket = &cache.buckets[key->hash & (cache.bucket_count - 1)];
+  entry->chain = *bucket;
+  *bucket = entry;
+  lru_push_front(entry);
+  cache.entries++;
+  cache.bytes += bytes;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+/**
+ * Read the cache counters
+ */
+void response_cache_stats(ResponseCacheStats *stats) {
+  pthread_mutex_lock(&cache.lock);
+  stats->hits = cache.hits;
+  stats->misses = cache.misses;
+  stats->evictions = cache.evictions;
+  stats->entries = cache.entries;
+  stats->bytes = cache.bytes;
+  pthread_mutex_unlock(&cache.lock);
+}
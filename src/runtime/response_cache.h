@@ -0,0 +1,109 @@
+/**
+ * @file response_cache.h
+ * @brief In-process LRU cache of LLM responses
+ *
+ * Responses are keyed by everything that determines what the model is asked:
+ * the formatted prompt, the meaning, the endpoint, the model name and the
+ * generation parameters, stop sequences, instruction and response format
+ * included. Entries expire after a configurable lifetime and the least
+ * recently used ones are evicted once the byte budget is exceeded. All
+ * operations are thread-safe.
+ */
+
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Identifies a cacheable request. The key material is assembled once and
+ * reused for the lookup and the subsequent store. It is built in one of the
+ * calling thread's session buffers when one is free, so a key must be freed
+ * on the thread that built it.
+ */
+typedef struct {
+  char *material; // Endpoint, model, parameters, meaning and prompt, NUL
+                  // separated
+  size_t length;
+  uint64_t hash;
+  struct LLMBuffer *storage; // Session buffer holding the material, NULL if
+                             // it was allocated
+} ResponseCacheKey;
+
+/**
+ * Counters describing cache activity since the runtime started
+ */
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions; // Entries dropped for the byte budget or expiry
+  size_t entries;
+  size_t bytes;
+} ResponseCacheStats;
+
+/**
+ * Configure the cache. Existing entries are kept.
+ *
+ * @param config The cache settings
+ */
+void response_cache_init(const CacheConfig *config);
+
+/**
+ * Drop every entry and reset the counters. The settings are kept.
+ */
+void response_cache_cleanup(void);
+
+/**
+ * Build the key for a request
+ *
+ * @param key The key to fill in
+ * @param prompt The formatted prompt
+ * @param meaning The meaning string, may be NULL
+ * @param function The generation parameters the request will use
+ * @return 1 on success, 0 on allocation failure
+ */
+int response_cache_key_init(ResponseCacheKey *key, const char *prompt,
+                            const char *meaning,
+                            const FunctionConfig *function);
+
+/**
+ * Release a key's material
+ *
+ * @param key The key
+ */
+void response_cache_key_free(ResponseCacheKey *key);
+
+/**
+ * Look up a cached response
+ *
+ * @param key The request key
+ * @return A copy of the response for the caller to free, or NULL on a miss
+ */
+char *response_cache_get(const ResponseCacheKey *key);
+
+/**
+ * Store a response. Responses larger than the whole budget are not cached.
+ *
+ * @param key The request key
+ * @param response The response text
+ */
+void response_cache_put(const ResponseCacheKey *key, const char *response);
+
+/**
+ * Read the cache counters
+ *
+ * @param stats Filled with the current counters
+ */
+void response_cache_stats(ResponseCacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RESPONSE_CACHE_H */
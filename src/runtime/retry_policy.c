@@ -0,0 +1,141 @@
+/**
+ * @file retry_policy.c
+ * @brief Retry decisions and backoff for failed LLM requests
+ */
+
+#include "retry_policy.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Longest backoff or Retry-After honoured, whatever the configuration says
+#define RETRY_MAX_DELAY_MS (10L * 60L * 1000L)
+
+static atomic_uint_fast64_t random_state;
+static pthread_once_t random_once = PTHREAD_ONCE_INIT;
+
+// Seed per process so that separate processes do not back off in lockstep
+static void seed_random(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t seed = ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec) ^
+                  ((uint64_t)getpid() << 32);
+  atomic_store_explicit(&random_state, seed, memory_order_relaxed);
+}
+
+/**
+ * Check whether an HTTP status is listed as retryable
+ */
+int retry_status_is_retryable(const RetryConfig *policy, long status) {
+  for (int i = 0; i < policy->retryable_status_count; i++) {
+    if (policy->retryable_status[i] == status)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * Check whether a transport error is transient
+ */
+int retry_transport_is_retryable(CURLcode code) {
+  switch (code) {
+  case CURLE_COULDNT_RESOLVE_HOST:
+  case CURLE_COULDNT_CONNECT:
+  case CURLE_OPERATION_TIMEDOUT:
+  case CURLE_SSL_CONNECT_ERROR:
+  case CURLE_SEND_ERROR:
+  case CURLE_RECV_ERROR:
+  case CURLE_GOT_NOTHING:
+  case CURLE_PARTIAL_FILE:
+  case CURLE_HTTP2:
+  case CURLE_HTTP2_STREAM:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Compute the backoff before a retry
+ */
+long retry_backoff_ms(const RetryConfig *policy, int attempt, double random) {
+  long delay = policy->base_delay_ms;
+  for (int i = 1; i < attempt && delay < policy->max_delay_ms; i++)
+    delay *= 2;
+  if (delay > policy->max_delay_ms)
+    delay = policy->max_delay_ms;
+  if (delay > RETRY_MAX_DELAY_MS)
+    delay = RETRY_MAX_DELAY_MS;
+
+  // Spread retries from many callers so they do not arrive in lockstep
+  double jittered = (double)delay * (1.0 - policy->jitter * random);
+  return (long)jittered;
+}
+
+/**
+ * Parse a Retry-After header value
+ */
+long retry_parse_after(const char *value, time_t now) {
+  if (!value)
+    return -1;
+  while (isspace((unsigned char)*value))
+    value++;
+
+  if (isdigit((unsigned char)*value)) {
+    char *end;
+    errno = 0;
+    long seconds = strtol(value, &end, 10);
+    while (isspace((unsigned char)*end))
+      end++;
+    if (errno || *end)
+      return -1;
+    return seconds > RETRY_MAX_DELAY_MS / 1000 ? RETRY_MAX_DELAY_MS
+                                                : seconds * 1000;
+  }
+
+  // An HTTP date such as "Wed, 21 Oct 2015 07:28:00 GMT"
+  time_t when = curl_getdate(value, NULL);
+  if (when == (time_t)-1)
+    return -1;
+  if (when <= now)
+    return 0;
+  double delay = difftime(when, now) * 1000.0;
+  return delay > RETRY_MAX_DELAY_MS ? RETRY_MAX_DELAY_MS : (long)delay;
+}
+
+/**
+ * Get a uniformly distributed value in [0, 1) for jitter
+ */
+double retry_random(void) {
+  pthread_once(&random_once, seed_random);
+
+  // Splitmix64 over a shared counter; quality is ample for jitter
+  uint64_t z = atomic_fetch_add_explicit(&random_state,
+                                         0x9e3779b97f4a7c15ULL,
+                                         memory_order_relaxed);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return (double)(z >> 11) / (double)(1ULL << 53);
+}
+
+/**
+ * Get a monotonic timestamp for measuring deadlines
+ */
+int64_t retry_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Sleep for a number of milliseconds
+ */
+void retry_sleep_ms(long delay_ms) {
+  struct timespec remaining = {delay_ms / 1000, (delay_ms % 1000) * 1000000L};
+  while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR)
+    ;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file retry_policy.h
+ * @brief Retry decisions and backoff for failed LLM requests
+ *
+ * A request that fails with a retryable HTTP status or a transient transport
+ * error is tried again after an exponentially growing, jittered backoff. A
+ * Retry-After header from the server takes precedence when it asks for a
+ * longer wait, and no wait may run past the policy's overall deadline.
+ */
+
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+
+#include "config.h"
+#include <curl/curl.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Check whether an HTTP status is listed as retryable
+ *
+ * @param policy The retry policy
+ * @param status The HTTP status of the failed attempt
+ * @return 1 if the request should be retried, 0 otherwise
+ */
+int retry_status_is_retryable(const RetryConfig *policy, long status);
+
+/**
+ * Check whether a transport error is transient: failures to connect, time
+ * outs and connections dropped mid-transfer
+ *
+ * @param code The curl result of the failed attempt
+ * @return 1 if the request should be retried, 0 otherwise
+ */
+int retry_transport_is_retryable(CURLcode code);
+
+/**
+ * Compute the backoff before a retry. The full delay is
+ * min(max_delay_ms, base_delay_ms * 2^(attempt - 1)), of which the jitter
+ * fraction is scaled by `random`.
+ *
+ * @param policy The retry policy
+ * @param attempt The number of attempts made so far (1 after the first)
+ * @param random A value in [0, 1) used for the jitter
+ * @return The delay in milliseconds
+ */
+long retry_backoff_ms(const RetryConfig *policy, int attempt, double random);
+
+/**
+ * Parse a Retry-After header value, given either in seconds or as an HTTP
+ * date
+ *
+ * @param value The header value
+ * @param now The current wall-clock time, for HTTP dates
+ * @return The requested delay in milliseconds, or -1 if it cannot be parsed
+ */
+long retry_parse_after(const char *value, time_t now);
+
+/**
+ * Get a uniformly distributed value in [0, 1) for jitter. Thread-safe.
+ *
+ * @return The random value
+ */
+double retry_random(void);
+
+/**
+ * Get a monotonic timestamp for measuring deadlines
+ *
+ * @return Milliseconds since an arbitrary fixed point
+ */
+int64_t retry_now_ms(void);
+
+/**
+ * Sleep for a number of milliseconds, resuming after signals
+ *
+ * @param delay_ms The delay
+ */
+void retry_sleep_ms(long delay_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RETRY_POLICY_H */
@@ -1,24 +1,49 @@
 #include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../../include/runtime.h"
 #include "../../include/vibelang.h"
 #include "../utils/file_utils.h"
 #include "../utils/log_utils.h"
+#include "../utils/response_decoder.h"
+#include "admission.h"
+#include "call_context.h"
+#include "cassette.h"
 #include "config.h"        // Added missing header
+#include "hedging.h"
 #include "llm_interface.h" // Added missing header
+#include "object_decoder.h"
+#include "response_cache.h"
+#include "single_flight.h"
+#include "tokenizer.h"
 
-// Track whether the runtime has been initialized
-static int runtime_initialized = 0;
+// Track whether the runtime has been initialized. Initialization and shutdown
+// serialize on runtime_lock; the hot path only does an acquire load.
+static atomic_int runtime_initialized = 0;
+static pthread_mutex_t runtime_lock = PTHREAD_MUTEX_INITIALIZER;
+static int shutdown_registered = 0;
 
-static void auto_shutdown(void) {
-  if (runtime_initialized) {
-    vibe_runtime_shutdown();
-  }
-}
+static void auto_shutdown(void) { vibe_runtime_shutdown(); }
+static void batch_pool_stop(void);
+
+// Why the thread's last prompt call failed, for vibe_last_error
+static _Thread_local VibeError last_error = VIBE_SUCCESS;
+
+// Batch workers used when neither the caller nor the transport sets a limit
+#define VIBE_BATCH_DEFAULT_CONCURRENCY 8
+
+// Most pool workers kept at once, whatever a batch asks for; items beyond
+// the workers queue on them
+#define VIBE_BATCH_MAX_WORKERS 64
 
 // Internal runtime structures that extend the public ones
 typedef struct {
@@ -36,14 +61,21 @@ typedef enum {
 
 // Function to initialize the LLM runtime
 VibeError vibe_runtime_init() {
-  if (runtime_initialized)
+  if (atomic_load_explicit(&runtime_initialized, memory_order_acquire))
+    return VIBE_SUCCESS;
+
+  pthread_mutex_lock(&runtime_lock);
+  if (atomic_load_explicit(&runtime_initialized, memory_order_relaxed)) {
+    pthread_mutex_unlock(&runtime_lock);
     return VIBE_SUCCESS;
+  }
 
   INFO("Initializing Vibe language runtime");
 
   // Load configuration
   if (!load_config()) {
     ERROR("Failed to load runtime configuration");
+    pthread_mutex_unlock(&runtime_lock);
     return VIBE_ERROR_RUNTIME;
   }
 
@@ -51,86 +83,809 @@ VibeError vibe_runtime_init() {
   const char *api_key = get_api_key();
   if (!api_key || strlen(api_key) == 0) {
     ERROR("LLM API key not set");
+    pthread_mutex_unlock(&runtime_lock);
     return VIBE_ERROR_RUNTIME;
   }
 
   // Initialize LLM connection
   if (!init_llm_connection()) {
     ERROR("Failed to initialize LLM connection");
+    pthread_mutex_unlock(&runtime_lock);
     return VIBE_ERROR_LLM_CONNECTION_FAILED;
   }
 
+  response_cache_init(get_cache_config());
+  admission_init(get_admission_config());
+
+  if (!cassette_open(get_cassette_config())) {
+    ERROR("Failed to open the configured cassette");
+    close_llm_connection();
+    pthread_mutex_unlock(&runtime_lock);
+    return VIBE_ERROR_RUNTIME;
+  }
+
+  // Without the vocabulary token counts are estimated, which is still good
+  // enough to enforce budgets roughly
+  const TokenizerConfig *tokenizer = get_tokenizer_config();
+  if (tokenizer->vocab && !tokenizer_load(tokenizer->vocab))
+    WARN("Estimating token counts instead");
+
   INFO("Vibe language runtime initialized successfully");
-  runtime_initialized = 1;
-  atexit(auto_shutdown);
+  atomic_store_explicit(&runtime_initialized, 1, memory_order_release);
+  if (!shutdown_registered) {
+    atexit(auto_shutdown);
+    shutdown_registered = 1;
+  }
+  pthread_mutex_unlock(&runtime_lock);
   return VIBE_SUCCESS;
 }
 
 // Function to shut down the runtime
 void vibe_runtime_shutdown() {
-  if (!runtime_initialized)
+  pthread_mutex_lock(&runtime_lock);
+  if (!atomic_load_explicit(&runtime_initialized, memory_order_relaxed)) {
+    pthread_mutex_unlock(&runtime_lock);
     return;
+  }
 
   INFO("Shutting down Vibe language runtime");
 
+  // Batch workers hold LLM sessions, which go with the connection
+  batch_pool_stop();
+
   // Close LLM connection
   close_llm_connection();
+  cassette_close();
+  tokenizer_free();
+  response_cache_cleanup();
+  hedge_reset();
 
   // Cleanup resources
   free_config();
 
-  runtime_initialized = 0;
+  atomic_store_explicit(&runtime_initialized, 0, memory_order_release);
+  pthread_mutex_unlock(&runtime_lock);
   INFO("Vibe language runtime shut down successfully");
 }
 
-// Function to execute a prompt-based function
-VibeValue vibe_execute_prompt(const char *prompt, const char *meaning) {
+// Convert an LLM response into a value of the site's type. The response is
+// consumed.
+static VibeValue response_to_value(char *llm_response, VibeDecoder decoder) {
   VibeValue result;
+  size_t length = strlen(llm_response);
+  long long integer;
+  double number;
+  int answer;
+
+  switch (decoder) {
+  case VIBE_DECODE_INT:
+    if (!response_decode_int(llm_response, length, &integer))
+      break;
+    result.type = VIBE_NUMBER;
+    result.data.number_val = (double)integer;
+    free(llm_response);
+    return result;
+  case VIBE_DECODE_FLOAT:
+    if (!response_decode_float(llm_response, length, &number))
+      break;
+    result.type = VIBE_NUMBER;
+    result.data.number_val = number;
+    free(llm_response);
+    return result;
+  case VIBE_DECODE_BOOL:
+    if (!response_decode_bool(llm_response, length, &answer))
+      break;
+    result.type = VIBE_BOOLEAN;
+    result.data.bool_val = answer;
+    free(llm_response);
+    return result;
+  case VIBE_DECODE_JSON:
+    result.type = VIBE_STRING;
+    result.data.string_val = llm_response;
+    vibe_value_to_object(&result); // VIBE_NULL if malformed
+    return result;
+  case VIBE_DECODE_STRING:
+  case VIBE_DECODE_CUSTOM:
+  default:
+    result.type = VIBE_STRING;
+    result.data.string_val = llm_response; // Transfer ownership
+    return result;
+  }
 
-  // Initialize result as NULL in case of failure
+  WARN("No value of the expected type in response: %s", llm_response);
+  free(llm_response);
   result.type = VIBE_NULL;
+  return result;
+}
+
+// Resolve the configuration a site's requests use: the function's runtime
+// configuration, then its route and the limits of the result type, then the
+// parameters compiled into the site on top
+static const FunctionConfig *site_function_config(const VibePromptSite *site,
+                                                  FunctionConfig *tuned) {
+  const FunctionConfig *function =
+      get_function_config(site ? site->function_name : NULL);
+  const VibeGenerationParams *params = site ? site->params : NULL;
+  const VibeGenerationParams *limits = site ? site->limits : NULL;
+  const char *route_model =
+      site && site->route && !function->model_set
+          ? get_route_model(site->route)
+          : NULL;
+  if (!params && !limits && !route_model)
+    return function;
+
+  *tuned = *function;
+  if (route_model)
+    tuned->model = (char *)route_model;
+  if (limits) {
+    // The type's limit only replaces a max_tokens nobody chose for the
+    // function; a global default is not a choice
+    if (limits->max_tokens > 0 && !function->max_tokens_set)
+      tuned->max_tokens = limits->max_tokens;
+    if (limits->stop)
+      tuned->stop = limits->stop;
+    if (limits->instruction)
+      tuned->instruction = limits->instruction;
+    if (limits->response_format)
+      tuned->response_format = limits->response_format;
+  }
+  if (params) {
+    if (params->model)
+      tuned->model = (char *)params->model;
+    if (params->temperature >= 0)
+      tuned->temperature = params->temperature;
+    if (params->max_tokens > 0)
+      tuned->max_tokens = params->max_tokens;
+    if (params->stop)
+      tuned->stop = params->stop;
+    if (params->instruction)
+      tuned->instruction = params->instruction;
+    if (params->response_format)
+      tuned->response_format = params->response_format;
+  }
+  return tuned;
+}
+
+// Tokens a function's prompts may use, 0 for no limit
+static size_t prompt_token_budget(const FunctionConfig *function) {
+  if (function->max_prompt_tokens > 0)
+    return (size_t)function->max_prompt_tokens;
+  int window = get_tokenizer_config()->context_window;
+  if (window <= 0)
+    return 0;
+  // A completion allowance that fills the window leaves no room at all
+  return window > function->max_tokens
+             ? (size_t)(window - function->max_tokens)
+             : 1;
+}
+
+// Get a response for a prompt. The response cache is consulted first, then
+// an identical request already in flight is joined; only if both fail is a
+// new request sent. All of it is bounded by the thread's call context.
+static char *fetch_response(const VibePromptSite *site,
+                            const FunctionConfig *function, const char *prompt,
+                            int stream, VibeTokenCallback on_token,
+                            void *user_data) {
+  const char *meaning = site ? site->meaning : NULL;
+
+  int use_cache = get_cache_config()->enabled && function->cache;
+  int use_flight = function->coalesce;
+  ResponseCacheKey key;
+  if ((use_cache || use_flight) &&
+      !response_cache_key_init(&key, prompt, meaning, function)) {
+    use_cache = use_flight = 0;
+  }
+
+  if (use_cache) {
+    char *cached = response_cache_get(&key);
+    if (cached) {
+      DEBUG("Response cache hit for prompt: %s", prompt);
+      response_cache_key_free(&key);
+      if (stream && on_token)
+        on_token(cached, strlen(cached), user_data);
+      return cached;
+    }
+  }
+
+  VibeCallContext context = vibe_call_context_current();
+  SingleFlightCall *flight = NULL;
+  while (use_flight) {
+    int role = single_flight_join(&key, &flight);
+    if (role != 0) {
+      if (role < 0)
+        flight = NULL;
+      break;
+    }
 
-  if (!runtime_initialized) {
-    if (vibe_runtime_init() != VIBE_SUCCESS) {
-      ERROR("Runtime initialization failed");
-      return result;
+    DEBUG("Waiting for identical in-flight request: %s", prompt);
+    int abandoned;
+    char *shared = single_flight_wait(flight, context, &abandoned);
+    flight = NULL;
+    if (abandoned) {
+      DEBUG("In-flight request abandoned by its caller, joining again");
+      continue;
     }
+    response_cache_key_free(&key);
+    if (shared && stream && on_token)
+      on_token(shared, strlen(shared), user_data);
+    return shared;
+  }
+
+  char *llm_response =
+      stream ? send_llm_prompt_stream(prompt, meaning, function, on_token,
+                                      user_data)
+             : send_llm_prompt(prompt, meaning, function);
+
+  // Fill the cache before landing the flight so that callers arriving in
+  // between find the response in one place or the other
+  if (use_cache && llm_response)
+    response_cache_put(&key, llm_response);
+  if (flight) {
+    // A failure caused by this caller's own deadline or token says nothing
+    // about the request, so followers get to try it themselves
+    if (!llm_response && call_context_status(context) != VIBE_SUCCESS)
+      single_flight_abandon(flight);
+    else
+      single_flight_complete(flight, llm_response);
+  }
+  if (use_cache || use_flight)
+    response_cache_key_free(&key);
+  return llm_response;
+}
+
+// Token count of a prompt nobody has measured yet
+#define PROMPT_UNCOUNTED SIZE_MAX
+
+// Get the response to a prompt for a site, reporting why it failed through
+// error. *function is the configuration a caller already resolved, or NULL
+// to resolve it into tuned; it receives the configuration the request used.
+// tokens is the prompt's count if the caller took it, PROMPT_UNCOUNTED
+// otherwise.
+static char *site_response(const VibePromptSite *site, const char *prompt,
+                           size_t tokens, int stream,
+                           VibeTokenCallback on_token, void *user_data,
+                           FunctionConfig *tuned,
+                           const FunctionConfig **function, VibeError *error) {
+  const char *meaning = site ? site->meaning : NULL;
+
+  if (vibe_runtime_init() != VIBE_SUCCESS) {
+    ERROR("Runtime initialization failed");
+    *error = VIBE_ERROR_RUNTIME;
+    return NULL;
   }
 
   if (!prompt) {
     ERROR("Invalid prompt parameter");
-    return result;
+    *error = VIBE_ERROR_GENERAL;
+    return NULL;
   }
 
-  DEBUG("Executing LLM prompt: %s (meaning: %s)", prompt, meaning);
+  DEBUG("%s LLM prompt: %s (meaning: %s)", stream ? "Streaming" : "Executing",
+        prompt, meaning);
+
+  // A prompt over its budget would only be rejected for context length
+  if (!*function)
+    *function = site_function_config(site, tuned);
+  size_t budget = prompt_token_budget(*function);
+  if (budget) {
+    if (tokens == PROMPT_UNCOUNTED)
+      tokens = tokenizer_count(prompt, strlen(prompt));
+    if (tokens > budget) {
+      ERROR("Prompt of %zu tokens exceeds its budget of %zu", tokens, budget);
+      *error = VIBE_ERROR_CONTEXT_LENGTH;
+      return NULL;
+    }
+    DEBUG("Prompt uses %zu of %zu tokens", tokens, budget);
+  }
 
   // Send the prompt to the LLM
-  char *llm_response = send_llm_prompt(prompt, meaning);
+  char *llm_response =
+      fetch_response(site, *function, prompt, stream, on_token, user_data);
   if (!llm_response) {
-    ERROR("Failed to get response from LLM");
+    *error = call_context_status(vibe_call_context_current());
+    if (*error == VIBE_SUCCESS) {
+      ERROR("Failed to get response from LLM");
+      *error = VIBE_ERROR_LLM_CONNECTION_FAILED;
+    }
+    return NULL;
+  }
+
+  *error = VIBE_SUCCESS;
+  return llm_response;
+}
+
+// Execute a prompt for a site, reporting why it failed through error
+static VibeValue execute_site(const VibePromptSite *site, const char *prompt,
+                              int stream, VibeTokenCallback on_token,
+                              void *user_data, VibeError *error) {
+  VibeValue result;
+  result.type = VIBE_NULL;
+
+  FunctionConfig tuned;
+  const FunctionConfig *function = NULL;
+  char *llm_response =
+      site_response(site, prompt, PROMPT_UNCOUNTED, stream, on_token,
+                    user_data, &tuned, &function, error);
+  last_error = *error;
+  if (!llm_response)
     return result;
+  return response_to_value(llm_response,
+                           site ? site->decoder : VIBE_DECODE_STRING);
+}
+
+// Shorten the arguments of a rendered prompt that exceeds its function's
+// token budget, rendering it again over the same buffer. Returns the final
+// token count, or PROMPT_UNCOUNTED if the function has no budget.
+static size_t fit_template_prompt(const FunctionConfig *function,
+                                  const VibePromptTemplate *template,
+                                  VibePromptArg *args, char *prompt,
+                                  size_t length) {
+  size_t budget = prompt_token_budget(function);
+  if (!budget)
+    return PROMPT_UNCOUNTED;
+  size_t tokens = tokenizer_count(prompt, length);
+  int var_count = template->slot_count;
+  if (tokens <= budget || var_count == 0)
+    return tokens;
+
+  // The template's own text stays; the arguments share what is left
+  size_t variable_tokens = 0;
+  for (int i = 0; i < template->segment_count; i++) {
+    int slot = template->segments[i].slot;
+    if (slot >= 0)
+      variable_tokens += tokenizer_count(args[slot].text, args[slot].length);
+  }
+  size_t fixed = tokens > variable_tokens ? tokens - variable_tokens : 0;
+  if (fixed >= budget) {
+    WARN("Prompt template alone exceeds the budget of %zu tokens", budget);
+    return tokens;
   }
 
-  // Parse the response based on the meaning
-  if (meaning && strcmp(meaning, "temperature in Celsius") == 0) {
-    // Parse as a number
-    double temperature = atof(llm_response);
-    result.type = VIBE_NUMBER;
-    result.data.number_val = temperature;
-    DEBUG("Parsed temperature: %f", temperature);
-  } else if (meaning && strcmp(meaning, "weather description") == 0) {
-    // Parse as a string
-    result.type = VIBE_STRING;
-    result.data.string_val = llm_response; // Transfer ownership
-    DEBUG("Parsed weather description: %s", llm_response);
-  } else {
-    // Default to string
-    result.type = VIBE_STRING;
-    result.data.string_val = llm_response; // Transfer ownership
-    DEBUG("Parsed as generic string: %s", llm_response);
+  // Tokens do not quite add up across boundaries and a variable used more
+  // than once takes its share again, so shrink the share by any overshoot.
+  // Shortening never lengthens the prompt, so it fits the same buffer.
+  size_t original = tokens;
+  size_t share = budget - fixed;
+  for (int round = 0; round < 3 && tokens > budget; round++) {
+    tokenizer_fit(args, var_count, share);
+    length = render_prompt(template, args, prompt);
+    tokens = tokenizer_count(prompt, length);
+    if (tokens > budget)
+      share = share > tokens - budget ? share - (tokens - budget) : 0;
   }
+  WARN("Shortened prompt variables from %zu to %zu tokens to fit a budget "
+       "of %zu",
+       original, tokens, budget);
+  return tokens;
+}
 
-  return result;
+// Prompts shorter than this are rendered on the stack
+#define PROMPT_STACK_SIZE 4096
+
+// Render a template for a site and execute it. The prompt lives on the stack
+// unless it is too long.
+static VibeValue execute_template(const VibePromptSite *site,
+                                  const VibePromptTemplate *template,
+                                  VibePromptArg *args, int stream,
+                                  VibeTokenCallback on_token, void *user_data) {
+  VibeValue result;
+  result.type = VIBE_NULL;
+  if (!template) {
+    ERROR("Invalid prompt template parameter");
+    last_error = VIBE_ERROR_GENERAL;
+    return result;
+  }
+  if (vibe_runtime_init() != VIBE_SUCCESS) {
+    ERROR("Runtime initialization failed");
+    last_error = VIBE_ERROR_RUNTIME;
+    return result;
+  }
+
+  char stack_prompt[PROMPT_STACK_SIZE];
+  size_t length = render_prompt(template, args, NULL);
+  char *prompt =
+      length < sizeof(stack_prompt) ? stack_prompt : malloc(length + 1);
+  if (!prompt) {
+    ERROR("Failed to allocate memory for rendered prompt");
+    last_error = VIBE_ERROR_RUNTIME;
+    return result;
+  }
+  render_prompt(template, args, prompt);
+
+  // The configuration and the count taken while fitting serve the request
+  FunctionConfig tuned;
+  const FunctionConfig *function = site_function_config(site, &tuned);
+  size_t tokens = fit_template_prompt(function, template, args, prompt, length);
+
+  char *llm_response = site_response(site, prompt, tokens, stream, on_token,
+                                     user_data, &tuned, &function,
+                                     &last_error);
+  if (prompt != stack_prompt)
+    free(prompt);
+  if (!llm_response)
+    return result;
+  return response_to_value(llm_response,
+                           site ? site->decoder : VIBE_DECODE_STRING);
+}
+
+/**
+ * Fetch the response to a prompt for a site without decoding it
+ */
+char *vibe_fetch_site(const VibePromptSite *site, const char *prompt,
+                      VibeGenerationParams *used) {
+  FunctionConfig tuned;
+  const FunctionConfig *function = NULL;
+  VibeError error;
+  char *response = site_response(site, prompt, PROMPT_UNCOUNTED, 0, NULL,
+                                 NULL, &tuned, &function, &error);
+  last_error = error;
+  if (response && used) {
+    used->model = function->model;
+    used->temperature = function->temperature;
+    used->max_tokens = function->max_tokens;
+    used->stop = function->stop;
+    used->instruction = function->instruction;
+    used->response_format = function->response_format;
+  }
+  return response;
+}
+
+/**
+ * Turn a response recorded at build time into the value of a site
+ */
+VibeValue vibe_decode_site(const VibePromptSite *site, const char *response) {
+  return vibe_decode_site_stream(site, response, NULL, NULL);
+}
+
+/**
+ * Turn a response recorded at build time into the value of a site, passing
+ * the text to a token callback first
+ */
+VibeValue vibe_decode_site_stream(const VibePromptSite *site,
+                                  const char *response,
+                                  VibeTokenCallback on_token,
+                                  void *user_data) {
+  VibeValue result;
+  result.type = VIBE_NULL;
+  char *text = response ? strdup(response) : NULL;
+  if (!text) {
+    ERROR("Failed to copy materialized response");
+    return result;
+  }
+  if (on_token)
+    on_token(text, strlen(text), user_data);
+  return response_to_value(text, site ? site->decoder : VIBE_DECODE_STRING);
+}
+
+/**
+ * Get why the calling thread's last prompt call failed
+ */
+VibeError vibe_last_error(void) { return last_error; }
+
+// Count tokens with the configured vocabulary, or estimate them
+size_t vibe_count_tokens(const char *text) {
+  if (!text)
+    return 0;
+  vibe_runtime_init();
+  return tokenizer_count(text, strlen(text));
+}
+
+// The ad hoc entry points predate decoders and typed their result by the
+// meaning. The one meaning they read as a number still is.
+static VibeDecoder meaning_decoder(const char *meaning) {
+  if (meaning && strcmp(meaning, "temperature in Celsius") == 0)
+    return VIBE_DECODE_FLOAT;
+  return VIBE_DECODE_STRING;
+}
+
+// Function to execute a prompt-based function
+VibeValue vibe_execute_prompt(const char *prompt, const char *meaning) {
+  VibePromptSite site = {.meaning = meaning,
+                         .decoder = meaning_decoder(meaning)};
+  return vibe_execute_site(&site, prompt);
+}
+
+VibeValue vibe_execute_site(const VibePromptSite *site, const char *prompt) {
+  VibeError error;
+  return execute_site(site, prompt, 0, NULL, NULL, &error);
+}
+
+// Function to execute a prompt-based function with a streamed response
+VibeValue vibe_execute_prompt_stream(const char *prompt, const char *meaning,
+                                     VibeTokenCallback on_token,
+                                     void *user_data) {
+  VibePromptSite site = {.meaning = meaning,
+                         .decoder = meaning_decoder(meaning)};
+  return vibe_execute_site_stream(&site, prompt, on_token, user_data);
+}
+
+VibeValue vibe_execute_site_stream(const VibePromptSite *site,
+                                   const char *prompt,
+                                   VibeTokenCallback on_token,
+                                   void *user_data) {
+  VibeError error;
+  return execute_site(site, prompt, 1, on_token, user_data, &error);
+}
+
+// Function to execute a precompiled prompt template
+VibeValue vibe_execute_template(const VibePromptSite *site,
+                                const VibePromptTemplate *template,
+                                VibePromptArg *args) {
+  return execute_template(site, template, args, 0, NULL, NULL);
+}
+
+VibeValue vibe_execute_template_stream(const VibePromptSite *site,
+                                       const VibePromptTemplate *template,
+                                       VibePromptArg *args,
+                                       VibeTokenCallback on_token,
+                                       void *user_data) {
+  return execute_template(site, template, args, 1, on_token, user_data);
+}
+
+// Shared state of a batch; workers claim items by bumping next_item
+typedef struct BatchState {
+  const VibePromptRequest *requests;
+  size_t count;
+  atomic_size_t next_item;
+  VibeValue *results;
+  VibeError *errors;
+  atomic_int failures;
+  VibeCallContext context; // The caller's, shared by every worker
+
+  // Guarded by batch_pool.lock
+  size_t wanted;           // Pool workers still to join
+  size_t running;          // Pool workers inside the batch
+  pthread_cond_t done;     // Signalled when the last pool worker leaves
+  struct BatchState *next; // Next batch wanting workers
+} BatchState;
+
+// Batch workers kept between batches, so their LLM sessions, and the warm
+// connections those hold, serve every batch rather than just one. Workers
+// idle for the transport's batch_idle_ms exit and leave their thread to be
+// joined.
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;   // Signalled when a batch wants workers or on stop
+  pthread_cond_t exited; // Signalled when a worker exits
+  BatchState *head;      // Batches wanting workers, oldest first
+  BatchState *tail;
+  size_t count; // Live workers
+  pthread_t retired[VIBE_BATCH_MAX_WORKERS]; // Exited workers to join
+  size_t retired_count;
+  int stopping;
+} batch_pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                .work = PTHREAD_COND_INITIALIZER,
+                .exited = PTHREAD_COND_INITIALIZER};
+
+static void *batch_worker(void *arg) {
+  BatchState *batch = (BatchState *)arg;
+  VibeCallContext previous = vibe_call_context_current();
+  vibe_call_context_restore(batch->context);
+
+  for (;;) {
+    size_t index = atomic_fetch_add(&batch->next_item, 1);
+    if (index >= batch->count)
+      break;
+
+    const VibePromptRequest *request = &batch->requests[index];
+    VibePromptSite site = {.function_name = request->function_name,
+                           .meaning = request->meaning,
+                           .decoder = request->decoder};
+    VibeError error;
+    batch->results[index] = execute_site(&site, request->prompt, 0, NULL,
+                                         NULL, &error);
+    if (batch->errors)
+      batch->errors[index] = error;
+    if (error != VIBE_SUCCESS)
+      atomic_fetch_add(&batch->failures, 1);
+  }
+
+  vibe_call_context_restore(previous);
+  return NULL;
+}
+
+// Take a batch out of the list of those wanting workers. Caller holds
+// batch_pool.lock.
+static void batch_pool_unlink(BatchState *batch) {
+  BatchState **link = &batch_pool.head;
+  BatchState *prev = NULL;
+  while (*link && *link != batch) {
+    prev = *link;
+    link = &(*link)->next;
+  }
+  if (!*link)
+    return;
+  *link = batch->next;
+  if (batch_pool.tail == batch)
+    batch_pool.tail = prev;
+  batch->next = NULL;
+}
+
+static void *batch_pool_thread(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&batch_pool.lock);
+  for (;;) {
+    // The work condition uses the realtime clock; a clock jump only moves
+    // when an idle worker exits
+    long idle_ms = get_transport_config()->batch_idle_ms;
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += idle_ms / 1000;
+    until.tv_nsec += (idle_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000L;
+    }
+    int idle = 0;
+    while (!batch_pool.stopping && !batch_pool.head && !idle)
+      idle = pthread_cond_timedwait(&batch_pool.work, &batch_pool.lock,
+                                    &until) == ETIMEDOUT;
+    if (batch_pool.stopping || !batch_pool.head)
+      break;
+
+    BatchState *batch = batch_pool.head;
+    if (--batch->wanted == 0)
+      batch_pool_unlink(batch);
+    batch->running++;
+    pthread_mutex_unlock(&batch_pool.lock);
+
+    batch_worker(batch);
+
+    pthread_mutex_lock(&batch_pool.lock);
+    if (--batch->running == 0)
+      pthread_cond_signal(&batch->done);
+  }
+
+  // Whoever starts workers next, or stops the pool, joins this thread
+  batch_pool.retired[batch_pool.retired_count++] = pthread_self();
+  batch_pool.count--;
+  pthread_cond_broadcast(&batch_pool.exited);
+  pthread_mutex_unlock(&batch_pool.lock);
+  return NULL;
+}
+
+// Join the workers that have exited
+static void batch_pool_reap(void) {
+  pthread_t retired[VIBE_BATCH_MAX_WORKERS];
+  pthread_mutex_lock(&batch_pool.lock);
+  size_t count = batch_pool.retired_count;
+  memcpy(retired, batch_pool.retired, count * sizeof(pthread_t));
+  batch_pool.retired_count = 0;
+  pthread_mutex_unlock(&batch_pool.lock);
+
+  for (size_t i = 0; i < count; i++)
+    pthread_join(retired[i], NULL);
+}
+
+// Grow the pool to at least count workers, never past the workers that may
+// exist at once. Caller holds batch_pool.lock.
+static void batch_pool_grow(size_t count) {
+  // Exited workers not joined yet still hold a slot in retired
+  size_t limit = VIBE_BATCH_MAX_WORKERS - batch_pool.retired_count;
+  if (count > limit)
+    count = limit;
+  while (batch_pool.count < count) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, batch_pool_thread, NULL) != 0) {
+      WARN("Failed to start batch worker %zu", batch_pool.count);
+      return;
+    }
+    batch_pool.count++;
+  }
+}
+
+// Stop and join the batch workers; the next batch starts new ones
+static void batch_pool_stop(void) {
+  pthread_mutex_lock(&batch_pool.lock);
+  batch_pool.stopping = 1;
+  pthread_cond_broadcast(&batch_pool.work);
+  while (batch_pool.count > 0)
+    pthread_cond_wait(&batch_pool.exited, &batch_pool.lock);
+  pthread_mutex_unlock(&batch_pool.lock);
+
+  batch_pool_reap();
+
+  pthread_mutex_lock(&batch_pool.lock);
+  batch_pool.stopping = 0;
+  pthread_mutex_unlock(&batch_pool.lock);
+}
+
+// Execute a batch of prompts with overlapping requests
+VibeError vibe_execute_prompts_batch(const VibePromptRequest *requests,
+                                     size_t count, int max_concurrency,
+                                     VibeValue *results, VibeError *errors) {
+  if (!requests || !results) {
+    ERROR("Invalid batch parameters");
+    return VIBE_ERROR_GENERAL;
+  }
+  if (count == 0)
+    return VIBE_SUCCESS;
+
+  if (vibe_runtime_init() != VIBE_SUCCESS) {
+    ERROR("Runtime initialization failed");
+    return VIBE_ERROR_RUNTIME;
+  }
+
+  // Every request the engine can keep in flight at once gets a worker. More
+  // would only wait for a connection, so the pool never outgrows the
+  // transport's per-host limit.
+  size_t connections = (size_t)get_transport_config()->max_host_connections;
+  size_t workers = max_concurrency > 0 ? (size_t)max_concurrency : connections;
+  if (workers == 0)
+    workers = VIBE_BATCH_DEFAULT_CONCURRENCY;
+  if (connections > 0 && workers > connections)
+    workers = connections;
+  if (workers > count)
+    workers = count;
+
+  BatchState batch = {.requests = requests,
+                      .count = count,
+                      .results = results,
+                      .errors = errors,
+                      .context = vibe_call_context_current()};
+  atomic_init(&batch.next_item, 0);
+  atomic_init(&batch.failures, 0);
+  pthread_cond_init(&batch.done, NULL);
+
+  // The calling thread is one of the workers; pool workers busy with other
+  // batches join this one when they are done
+  batch_pool_reap();
+  pthread_mutex_lock(&batch_pool.lock);
+  batch_pool_grow(workers - 1);
+  size_t helpers = workers - 1 < batch_pool.count ? workers - 1
+                                                  : batch_pool.count;
+  batch.wanted = helpers;
+  if (helpers > 0) {
+    if (batch_pool.tail)
+      batch_pool.tail->next = &batch;
+    else
+      batch_pool.head = &batch;
+    batch_pool.tail = &batch;
+    pthread_cond_broadcast(&batch_pool.work);
+  }
+  pthread_mutex_unlock(&batch_pool.lock);
+
+  DEBUG("Executing batch of %zu prompts with up to %zu workers", count,
+        helpers + 1);
+  batch_worker(&batch);
+
+  // Every item is claimed; wait for the workers still finishing theirs
+  pthread_mutex_lock(&batch_pool.lock);
+  batch_pool_unlink(&batch);
+  while (batch.running > 0)
+    pthread_cond_wait(&batch.done, &batch_pool.lock);
+  pthread_mutex_unlock(&batch_pool.lock);
+  pthread_cond_destroy(&batch.done);
+
+  // The caller's last error describes the batch, not its last item
+  int failures = atomic_load(&batch.failures);
+  last_error = failures > 0 ? VIBE_ERROR_RUNTIME : VIBE_SUCCESS;
+  if (failures > 0) {
+    WARN("%d of %zu batch prompts failed", failures, count);
+    return VIBE_ERROR_RUNTIME;
+  }
+  return VIBE_SUCCESS;
+}
+
+// Read the response cache counters
+void vibe_cache_stats(VibeCacheStats *stats) {
+  if (!stats)
+    return;
+
+  ResponseCacheStats counters;
+  response_cache_stats(&counters);
+  stats->hits = counters.hits;
+  stats->misses = counters.misses;
+  stats->evictions = counters.evictions;
+  stats->coalesced = single_flight_coalesced();
+  stats->entries = counters.entries;
+  stats->bytes = counters.bytes;
+}
+
+// Drop every cached response
+void vibe_cache_clear(void) {
+  response_cache_cleanup();
+  single_flight_reset_stats();
 }
 
 // Function to load a module
@@ -272,7 +1027,7 @@ VibeValue *vibe_call_function(VibeModule *module, const char *function_name,
   if (!module || !function_name) {
     ERROR("Invalid module or function name");
     // Create a static error value to return
-    static VibeValue error_value;
+    static _Thread_local VibeValue error_value;
     error_value = vibe_string_value("Error: Invalid parameters");
     return &error_value;
   }
@@ -285,7 +1040,7 @@ VibeValue *vibe_call_function(VibeModule *module, const char *function_name,
   if (!func_ptr) {
     ERROR("Function not found: %s", function_name);
     // Create a static error value to return
-    static VibeValue error_value;
+    static _Thread_local VibeValue error_value;
     error_value = vibe_string_value("Error: Function not found");
     return &error_value;
   }
@@ -296,7 +1051,7 @@ VibeValue *vibe_call_function(VibeModule *module, const char *function_name,
   INFO("Calling function: %s", function_name);
 
   // Return a dummy value for now
-  static VibeValue result;
+  static _Thread_local VibeValue result;
   result = vibe_null_value();
   return &result;
 }
@@ -374,8 +1129,14 @@ int vibe_value_get_int(VibeValue *value) {
   case VIBE_NUMBER:
     return (int)value->data.number_val;
   case VIBE_STRING:
-    if (value->data.string_val)
-      return atoi(value->data.string_val);
+    if (value->data.string_val) {
+      long long integer;
+      if (response_decode_int(value->data.string_val,
+                              strlen(value->data.string_val), &integer))
+        return integer > INT_MAX   ? INT_MAX
+               : integer < INT_MIN ? INT_MIN
+                                   : (int)integer;
+    }
     break;
   case VIBE_BOOLEAN:
     return value->data.bool_val;
@@ -385,3 +1146,25 @@ int vibe_value_get_int(VibeValue *value) {
   }
   return 0;
 }
+
+/**
+ * Decode a JSON object response into the struct generated for a class
+ */
+int vibe_value_get_object(VibeValue *value, const VibeObjectShape *shape,
+                          void *out) {
+  memset(out, 0, shape->size);
+  if (!value || value->type != VIBE_STRING || !value->data.string_val)
+    return 0;
+
+  // The struct's strings point into the text, so the struct keeps it
+  char *text = value->data.string_val;
+  value->type = VIBE_NULL;
+  value->data.string_val = NULL;
+  if (!object_decode(text, strlen(text), shape, out)) {
+    WARN("No JSON object of the expected shape in response: %s", text);
+    free(text);
+    return 0;
+  }
+  *(char **)((char *)out + shape->response_offset) = text;
+  return 1;
+}
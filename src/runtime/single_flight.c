@@ -0,0 +1,225 @@
+/**
+ * @file single_flight.c
+ * @brief Coalescing of identical in-flight LLM requests
+ */
+
+#include "single_flight.h"
+#include "../utils/log_utils.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// In-flight requests are bounded by the caller's concurrency, so a small
+// fixed table is enough
+#define FLIGHT_BUCKETS 256
+
+// Landed flights kept for reuse, so that starting one does not allocate
+#define FLIGHT_SPARES 32
+
+struct SingleFlightCall {
+  uint64_t hash;
+  const char *key; // The leader's key material, only read while in the table
+  size_t key_length;
+  int references; // Leader plus followers still to collect the result
+  int done;
+  int abandoned;  // The leader's own context ended
+  char *response; // Copy of the leader's response once done
+  pthread_cond_t done_cond; // Monotonic, for follower deadlines
+  struct SingleFlightCall *chain;
+};
+
+static pthread_mutex_t flight_lock = PTHREAD_MUTEX_INITIALIZER;
+static SingleFlightCall *flights[FLIGHT_BUCKETS];
+static SingleFlightCall *spares; // Linked through chain
+static int spare_count = 0;
+static uint64_t coalesced = 0;
+
+// A follower waiting on a flight, woken by its cancel hook
+typedef struct {
+  SingleFlightCall *call;
+  int cancelled;
+} FlightWaiter;
+
+// Keep a landed flight for reuse, or free it if enough are spare. Caller
+// does not hold flight_lock.
+static void free_call(SingleFlightCall *call) {
+  free(call->response);
+  call->response = NULL;
+  call->key = NULL;
+
+  pthread_mutex_lock(&flight_lock);
+  if (spare_count < FLIGHT_SPARES) {
+    call->chain = spares;
+    spares = call;
+    spare_count++;
+    pthread_mutex_unlock(&flight_lock);
+    return;
+  }
+  pthread_mutex_unlock(&flight_lock);
+  pthread_cond_destroy(&call->done_cond);
+  free(call);
+}
+
+// Take a spare flight or allocate one. Caller holds flight_lock.
+static SingleFlightCall *new_call(void) {
+  SingleFlightCall *call = spares;
+  if (call) {
+    spares = call->chain;
+    spare_count--;
+    return call;
+  }
+
+  call = calloc(1, sizeof(SingleFlightCall));
+  if (!call)
+    return NULL;
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&call->done_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  return call;
+}
+
+/**
+ * Join the flight for a request, starting one if none is in progress
+ */
+int single_flight_join(const ResponseCacheKey *key, SingleFlightCall **call) {
+  SingleFlightCall **bucket = &flights[key->hash % FLIGHT_BUCKETS];
+
+  pthread_mutex_lock(&flight_lock);
+  for (SingleFlightCall *existing = *bucket; existing;
+       existing = existing->chain) {
+    if (existing->hash == key->hash && existing->key_length == key->length &&
+        memcmp(existing->key, key->material, key->length) == 0) {
+      existing->references++;
+      coalesced++;
+      pthread_mutex_unlock(&flight_lock);
+      *call = existing;
+      return 0;
+    }
+  }
+
+  // Nobody is asking yet. The flight leaves the table before its leader
+  // frees the key, so it can point at the leader's material.
+  SingleFlightCall *created = new_call();
+  if (!created) {
+    pthread_mutex_unlock(&flight_lock);
+    WARN("Failed to allocate single-flight call");
+    return -1;
+  }
+  created->hash = key->hash;
+  created->key = key->material;
+  created->key_length = key->length;
+  created->references = 1;
+  created->done = 0;
+  created->abandoned = 0;
+  created->chain = *bucket;
+  *bucket = created;
+  pthread_mutex_unlock(&flight_lock);
+
+  *call = created;
+  return 1;
+}
+
+// Cancel hook waking a follower. Runs with the token locked, so the follower
+// must never check its token while holding flight_lock.
+static void wake_waiter(void *arg) {
+  FlightWaiter *waiter = (FlightWaiter *)arg;
+  pthread_mutex_lock(&flight_lock);
+  waiter->cancelled = 1;
+  pthread_cond_broadcast(&waiter->call->done_cond);
+  pthread_mutex_unlock(&flight_lock);
+}
+
+/**
+ * Wait for the leader of a flight and take a copy of its response
+ */
+char *single_flight_wait(SingleFlightCall *call, VibeCallContext context,
+                         int *abandoned) {
+  FlightWaiter waiter = {call, 0};
+  CancelHook hook;
+  int watched = call_context_hook(context.cancel, &hook, wake_waiter, &waiter);
+  struct timespec until = {(time_t)(context.deadline_ms / 1000),
+                           (long)(context.deadline_ms % 1000) * 1000000L};
+
+  pthread_mutex_lock(&flight_lock);
+  int expired = !watched;
+  while (!call->done && !waiter.cancelled && !expired) {
+    if (context.deadline_ms)
+      expired = pthread_cond_timedwait(&call->done_cond, &flight_lock,
+                                       &until) == ETIMEDOUT;
+    else
+      pthread_cond_wait(&call->done_cond, &flight_lock);
+  }
+
+  *abandoned = call->done && call->abandoned;
+  char *response =
+      call->done && call->response ? strdup(call->response) : NULL;
+  int last = --call->references == 0;
+  pthread_mutex_unlock(&flight_lock);
+
+  // The hook points at the flight, so it goes before the flight can
+  if (watched)
+    call_context_unhook(context.cancel, &hook);
+  if (last)
+    free_call(call);
+  return response;
+}
+
+// Take a flight out of the table and wake its followers
+static void land_flight(SingleFlightCall *call, const char *response,
+                        int abandoned) {
+  pthread_mutex_lock(&flight_lock);
+
+  // Later callers start a new flight (or hit the response cache)
+  SingleFlightCall **slot = &flights[call->hash % FLIGHT_BUCKETS];
+  while (*slot != call)
+    slot = &(*slot)->chain;
+  *slot = call->chain;
+
+  if (call->references > 1 && response)
+    call->response = strdup(response);
+  call->abandoned = abandoned;
+  call->done = 1;
+  pthread_cond_broadcast(&call->done_cond);
+  int last = --call->references == 0;
+  pthread_mutex_unlock(&flight_lock);
+
+  if (last)
+    free_call(call);
+}
+
+/**
+ * Publish the leader's response and end the flight
+ */
+void single_flight_complete(SingleFlightCall *call, const char *response) {
+  land_flight(call, response, 0);
+}
+
+/**
+ * End a flight whose leader gave up, sending the followers back to join
+ */
+void single_flight_abandon(SingleFlightCall *call) {
+  land_flight(call, NULL, 1);
+}
+
+/**
+ * Get the number of requests answered by joining another caller's flight
+ */
+uint64_t single_flight_coalesced(void) {
+  pthread_mutex_lock(&flight_lock);
+  uint64_t count = coalesced;
+  pthread_mutex_unlock(&flight_lock);
+  return count;
+}
+
+/**
+ * Reset the coalesced request counter
+ */
+void single_flight_reset_stats(void) {
+  pthread_mutex_lock(&flight_lock);
+  coalesced = 0;
+  pthread_mutex_unlock(&flight_lock);
+}
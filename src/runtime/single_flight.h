@@ -0,0 +1,86 @@
+/**
+ * @file single_flight.h
+ * @brief Coalescing of identical in-flight LLM requests
+ *
+ * When several threads issue the same request at the same time, only the
+ * first one (the leader) talks to the API. The others join its flight, wait
+ * for it to land and receive a copy of its response. A follower stops
+ * waiting when its own deadline passes or its token is cancelled; a leader
+ * whose call ends that way abandons the flight so that followers with time
+ * left start over rather than share its failure.
+ */
+
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include "call_context.h"
+#include "response_cache.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SingleFlightCall SingleFlightCall;
+
+/**
+ * Join the flight for a request, starting one if none is in progress. A
+ * flight borrows its leader's key material, so a leader must keep the key
+ * until it completes or abandons the flight.
+ *
+ * @param key The request key
+ * @param call Set to the flight to complete (leader) or wait on (follower)
+ * @return 1 if the caller is the leader, 0 if it joined an existing flight,
+ * -1 on allocation failure (the caller should just perform the request)
+ */
+int single_flight_join(const ResponseCacheKey *key, SingleFlightCall **call);
+
+/**
+ * Wait for the leader of a flight and take a copy of its response. Releases
+ * the caller's reference to the flight.
+ *
+ * @param call The flight returned by single_flight_join
+ * @param context The follower's deadline and cancellation token
+ * @param abandoned Set to 1 if the leader abandoned the flight, in which case
+ * the caller should join again
+ * @return A copy of the response for the caller to free, or NULL if the
+ * leader's request failed, the flight was abandoned or the follower's
+ * context ended first
+ */
+char *single_flight_wait(SingleFlightCall *call, VibeCallContext context,
+                         int *abandoned);
+
+/**
+ * Publish the leader's response to every waiting follower and end the
+ * flight. Releases the leader's reference to the flight.
+ *
+ * @param call The flight returned by single_flight_join
+ * @param response The response, or NULL if the request failed
+ */
+void single_flight_complete(SingleFlightCall *call, const char *response);
+
+/**
+ * End a flight whose leader gave up because its own context ended, sending
+ * the followers back to join again. Releases the leader's reference.
+ *
+ * @param call The flight returned by single_flight_join
+ */
+void single_flight_abandon(SingleFlightCall *call);
+
+/**
+ * Get the number of requests answered by joining another caller's flight
+ *
+ * @return The number of coalesced requests
+ */
+uint64_t single_flight_coalesced(void);
+
+/**
+ * Reset the coalesced request counter
+ */
+void single_flight_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SINGLE_FLIGHT_H */
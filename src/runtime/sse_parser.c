@@ -0,0 +1,133 @@
+/**
+ * @file sse_parser.c
+ * @brief Incremental parser for server-sent event streams
+ */
+
+#include "sse_parser.h"
+#include "../utils/log_utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Grow a buffer so it can hold at least `needed` bytes plus a terminator
+static int reserve(char **buffer, size_t *capacity, size_t needed) {
+  if (needed + 1 <= *capacity)
+    return 1;
+
+  size_t new_capacity = *capacity ? *capacity : 256;
+  while (new_capacity < needed + 1)
+    new_capacity *= 2;
+
+  char *grown = realloc(*buffer, new_capacity);
+  if (!grown) {
+    ERROR("Not enough memory for SSE parser buffer");
+    return 0;
+  }
+  *buffer = grown;
+  *capacity = new_capacity;
+  return 1;
+}
+
+void sse_parser_init(SSEParser *parser, sse_event_fn on_event,
+                     void *user_data) {
+  memset(parser, 0, sizeof(*parser));
+  parser->on_event = on_event;
+  parser->user_data = user_data;
+}
+
+// Deliver the event assembled so far and start a new one
+static int dispatch_event(SSEParser *parser) {
+  if (!parser->has_data)
+    return 1;
+
+  parser->data[parser->data_length] = '\0';
+  int keep_going =
+      parser->on_event(parser->data, parser->data_length, parser->user_data);
+  parser->data_length = 0;
+  parser->has_data = 0;
+  if (!keep_going)
+    parser->stopped = 1;
+  return keep_going;
+}
+
+// Handle one complete line (without its terminator)
+static int process_line(SSEParser *parser, const char *line, size_t length) {
+  if (length == 0)
+    return dispatch_event(parser);
+
+  // Comment lines start with a colon
+  if (line[0] == ':')
+    return 1;
+
+  const char *colon = memchr(line, ':', length);
+  size_t name_length = colon ? (size_t)(colon - line) : length;
+  if (name_length != 4 || memcmp(line, "data", 4) != 0)
+    return 1; // Only the data field matters for completions
+
+  const char *value = colon ? colon + 1 : line + length;
+  size_t value_length = length - (size_t)(value - line);
+  if (value_length > 0 && value[0] == ' ') {
+    value++;
+    value_length--;
+  }
+
+  size_t needed = parser->data_length + value_length + 1;
+  if (!reserve(&parser->data, &parser->data_capacity, needed))
+    return 0;
+  if (parser->has_data)
+    parser->data[parser->data_length++] = '\n';
+  memcpy(parser->data + parser->data_length, value, value_length);
+  parser->data_length += value_length;
+  parser->has_data = 1;
+  return 1;
+}
+
+int sse_parser_feed(SSEParser *parser, const char *chunk, size_t length) {
+  if (parser->stopped)
+    return 0;
+
+  size_t pos = 0;
+  while (pos < length) {
+    const char *newline = memchr(chunk + pos, '\n', length - pos);
+    if (!newline) {
+      // Keep the partial line until the rest of it arrives
+      size_t rest = length - pos;
+      if (!reserve(&parser->line, &parser->line_capacity,
+                   parser->line_length + rest))
+        return 0;
+      memcpy(parser->line + parser->line_length, chunk + pos, rest);
+      parser->line_length += rest;
+      return 1;
+    }
+
+    size_t segment = (size_t)(newline - (chunk + pos));
+    const char *line = chunk + pos;
+    size_t line_length = segment;
+
+    // Join with any partial line from the previous chunk
+    if (parser->line_length > 0) {
+      if (!reserve(&parser->line, &parser->line_capacity,
+                   parser->line_length + segment))
+        return 0;
+      memcpy(parser->line + parser->line_length, chunk + pos, segment);
+      line = parser->line;
+      line_length = parser->line_length + segment;
+      parser->line_length = 0;
+    }
+
+    if (line_length > 0 && line[line_length - 1] == '\r')
+      line_length--;
+
+    if (!process_line(parser, line, line_length))
+      return 0;
+    pos += segment + 1;
+  }
+  return 1;
+}
+
+void sse_parser_free(SSEParser *parser) {
+  free(parser->line);
+  free(parser->data);
+  parser->line = parser->data = NULL;
+  parser->line_length = parser->line_capacity = 0;
+  parser->data_length = parser->data_capacity = 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file sse_parser.h
+ * @brief Incremental parser for server-sent event streams
+ *
+ * The parser accepts the response body in arbitrarily sized chunks, exactly
+ * as curl hands them to a write callback, and dispatches the data field of
+ * every complete event as soon as its terminating blank line arrives.
+ */
+
+#ifndef SSE_PARSER_H
+#define SSE_PARSER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Called with the data of each complete event. Multi-line data fields are
+ * joined with '\n' as the SSE specification requires. The buffer is only
+ * valid for the duration of the call, is NUL terminated and may be modified,
+ * for example to unescape strings in place.
+ *
+ * @return 1 to continue parsing, 0 to stop
+ */
+typedef int (*sse_event_fn)(char *data, size_t length, void *user_data);
+
+typedef struct {
+  char *line; // Partial line carried over between chunks
+  size_t line_length;
+  size_t line_capacity;
+  char *data; // Data field of the event being assembled
+  size_t data_length;
+  size_t data_capacity;
+  int has_data;
+  int stopped; // Set once the callback asks to stop
+  sse_event_fn on_event;
+  void *user_data;
+} SSEParser;
+
+/**
+ * Initialize a parser
+ *
+ * @param parser The parser to initialize
+ * @param on_event Callback receiving each event's data
+ * @param user_data Passed to on_event
+ */
+void sse_parser_init(SSEParser *parser, sse_event_fn on_event,
+                     void *user_data);
+
+/**
+ * Feed a chunk of the stream to the parser
+ *
+ * @param parser The parser
+ * @param chunk Bytes received from the server
+ * @param length Number of bytes in chunk
+ * @return 1 on success, 0 on allocation failure or if the callback stopped
+ */
+int sse_parser_feed(SSEParser *parser, const char *chunk, size_t length);
+
+/**
+ * Release the parser's buffers
+ *
+ * @param parser The parser
+ */
+void sse_parser_free(SSEParser *parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SSE_PARSER_H */
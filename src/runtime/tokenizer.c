@@ -0,0 +1,474 @@
+/**
+ * @file tokenizer.c
+ * @brief Local byte-pair-encoding tokenizer for prompt token budgets
+ */
+
+#include "tokenizer.h"
+#include "../utils/file_utils.h"
+#include "../utils/log_utils.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Rank of a byte sequence that is not a token
+#define NO_RANK UINT32_MAX
+
+// Pieces up to this many bytes are merged without allocating
+#define STACK_PIECE 128
+
+typedef struct {
+  uint32_t hash;   // Low bits of the token's hash
+  uint32_t offset; // Token bytes in vocab.bytes
+  uint32_t length; // 0 for an empty slot
+  uint32_t rank;   // Merge priority, lower merges first
+} VocabSlot;
+
+// Open-addressed table of every token, at most half full
+static struct {
+  unsigned char *bytes;
+  VocabSlot *slots;
+  size_t mask;
+  size_t count;
+} vocab;
+
+static uint64_t hash_bytes(const unsigned char *p, size_t n) {
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  for (size_t i = 0; i < n; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Rank of a byte sequence, NO_RANK if it is not a token
+static uint32_t lookup(const unsigned char *p, size_t n) {
+  uint64_t hash = hash_bytes(p, n);
+  for (size_t slot = hash & vocab.mask;; slot = (slot + 1) & vocab.mask) {
+    const VocabSlot *entry = &vocab.slots[slot];
+    if (!entry->length)
+      return NO_RANK;
+    if (entry->hash == (uint32_t)hash && entry->length == n &&
+        memcmp(vocab.bytes + entry->offset, p, n) == 0)
+      return entry->rank;
+  }
+}
+
+static int base64_value(unsigned char c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+// Decode base64 text into out, returning the length or -1 if malformed
+static long base64_decode(const char *in, size_t n, unsigned char *out) {
+  uint32_t bits = 0;
+  int pending = 0;
+  long length = 0;
+  for (size_t i = 0; i < n && in[i] != '='; i++) {
+    int value = base64_value((unsigned char)in[i]);
+    if (value < 0)
+      return -1;
+    bits = (bits << 6) | (uint32_t)value;
+    pending += 6;
+    if (pending >= 8) {
+      pending -= 8;
+      out[length++] = (unsigned char)(bits >> pending);
+    }
+  }
+  return length;
+}
+
+/**
+ * Load a vocabulary, replacing any loaded before
+ */
+int tokenizer_load(const char *path) {
+  char *content = read_file(path);
+  if (!content) {
+    ERROR("Failed to read tokenizer vocabulary: %s", path);
+    return 0;
+  }
+
+  // Every line is one token; decoded tokens are shorter than their base64
+  size_t size = strlen(content);
+  size_t lines = 1;
+  for (const char *p = content; (p = strchr(p, '\n')) != NULL; p++)
+    lines++;
+  size_t slot_count = 16;
+  while (slot_count < lines * 2)
+    slot_count <<= 1;
+
+  tokenizer_free();
+  vocab.bytes = malloc(size + 1);
+  vocab.slots = calloc(slot_count, sizeof(VocabSlot));
+  if (!vocab.bytes || !vocab.slots) {
+    ERROR("Failed to allocate tokenizer vocabulary");
+    free(content);
+    tokenizer_free();
+    return 0;
+  }
+  vocab.mask = slot_count - 1;
+
+  size_t used = 0;
+  int malformed = 0;
+  for (char *line = content; *line;) {
+    char *end = strchr(line, '\n');
+    char *next = end ? end + 1 : line + strlen(line);
+    char *space = memchr(line, ' ', (size_t)(next - line));
+    long length = -1;
+    if (space)
+      length = base64_decode(line, (size_t)(space - line), vocab.bytes + used);
+    if (length <= 0) {
+      if (next - line > 1)
+        malformed++;
+      line = next;
+      continue;
+    }
+
+    unsigned char *token = vocab.bytes + used;
+    uint32_t rank = (uint32_t)strtoul(space + 1, NULL, 10);
+    uint64_t hash = hash_bytes(token, (size_t)length);
+    size_t slot = hash & vocab.mask;
+    while (vocab.slots[slot].length &&
+           !(vocab.slots[slot].length == (uint32_t)length &&
+             memcmp(vocab.bytes + vocab.slots[slot].offset, token,
+                    (size_t)length) == 0))
+      slot = (slot + 1) & vocab.mask;
+    if (!vocab.slots[slot].length) {
+      vocab.slots[slot] = (VocabSlot){(uint32_t)hash, (uint32_t)used,
+                                      (uint32_t)length, rank};
+      used += (size_t)length;
+      vocab.count++;
+    }
+    line = next;
+  }
+  free(content);
+
+  if (vocab.count == 0) {
+    ERROR("No tokens found in tokenizer vocabulary: %s", path);
+    tokenizer_free();
+    return 0;
+  }
+  if (malformed)
+    WARN("Skipped %d malformed lines in %s", malformed, path);
+  INFO("Loaded %zu tokens from %s", vocab.count, path);
+  return 1;
+}
+
+/**
+ * Release the vocabulary
+ */
+void tokenizer_free(void) {
+  free(vocab.bytes);
+  free(vocab.slots);
+  memset(&vocab, 0, sizeof(vocab));
+}
+
+/**
+ * Check whether a vocabulary is loaded
+ */
+int tokenizer_loaded(void) { return vocab.slots != NULL; }
+
+static inline int is_letter(unsigned char c) {
+  return (unsigned char)((c | 0x20) - 'a') < 26 || c >= 0x80;
+}
+
+static inline int is_digit(unsigned char c) {
+  return (unsigned char)(c - '0') < 10;
+}
+
+static inline int is_space(unsigned char c) {
+  return c == ' ' || (unsigned char)(c - '\t') < 5;
+}
+
+static inline int is_newline(unsigned char c) { return c == '\n' || c == '\r'; }
+
+static inline int is_punct(unsigned char c) {
+  return !is_letter(c) && !is_digit(c) && !is_space(c);
+}
+
+// Byte classes the pre-tokenizer scans runs of
+enum { RUN_LETTER, RUN_SPACE, RUN_PUNCT };
+
+static inline int in_run(unsigned char c, int kind) {
+  return kind == RUN_LETTER  ? is_letter(c)
+         : kind == RUN_SPACE ? is_space(c)
+                             : is_punct(c);
+}
+
+#if defined(__SSE2__)
+// Bit i set when byte i of the chunk belongs to the class
+static inline int run_mask(__m128i chunk, int kind) {
+  __m128i lower = _mm_sub_epi8(_mm_or_si128(chunk, _mm_set1_epi8(0x20)),
+                               _mm_set1_epi8('a'));
+  __m128i ascii_letter =
+      _mm_cmpeq_epi8(_mm_min_epu8(lower, _mm_set1_epi8(25)), lower);
+  int letters = _mm_movemask_epi8(ascii_letter) | _mm_movemask_epi8(chunk);
+  if (kind == RUN_LETTER)
+    return letters;
+
+  __m128i control = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+  __m128i space = _mm_or_si128(
+      _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control),
+      _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+  int spaces = _mm_movemask_epi8(space);
+  if (kind == RUN_SPACE)
+    return spaces;
+
+  __m128i digit = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+  int digits = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit));
+  return ~(letters | spaces | digits) & 0xFFFF;
+}
+#endif
+
+// End of the run of a class starting at i, 16 bytes at a time where SSE2 is
+// available
+static size_t run_end(const unsigned char *s, size_t i, size_t n, int kind) {
+#if defined(__SSE2__)
+  while (i + 16 <= n) {
+    int mask = run_mask(_mm_loadu_si128((const __m128i *)(s + i)), kind);
+    if (mask != 0xFFFF)
+      return i + (size_t)__builtin_ctz(~mask);
+    i += 16;
+  }
+#endif
+  while (i < n && in_run(s[i], kind))
+    i++;
+  return i;
+}
+
+// End of the pre-tokenizer piece starting at i
+static size_t next_piece(const unsigned char *s, size_t i, size_t n) {
+  unsigned char c = s[i];
+
+  // Contractions: 's 't 'm 'd 're 've 'll in any case
+  if (c == '\'' && i + 1 < n) {
+    unsigned char a = s[i + 1] | 0x20;
+    if (a == 's' || a == 't' || a == 'm' || a == 'd')
+      return i + 2;
+    if (i + 2 < n) {
+      unsigned char b = s[i + 2] | 0x20;
+      if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') ||
+          (a == 'l' && b == 'l'))
+        return i + 3;
+    }
+  }
+
+  // Letters, optionally after one byte that is not a digit or line break
+  if (is_letter(c))
+    return run_end(s, i + 1, n, RUN_LETTER);
+  if (!is_digit(c) && !is_newline(c) && i + 1 < n && is_letter(s[i + 1]))
+    return run_end(s, i + 2, n, RUN_LETTER);
+
+  // Up to three digits
+  if (is_digit(c)) {
+    size_t end = i + 1;
+    while (end < n && end < i + 3 && is_digit(s[end]))
+      end++;
+    return end;
+  }
+
+  // Punctuation, optionally after one space, then any line breaks
+  size_t start = c == ' ' && i + 1 < n && is_punct(s[i + 1]) ? i + 1 : i;
+  if (is_punct(s[start])) {
+    size_t end = run_end(s, start + 1, n, RUN_PUNCT);
+    while (end < n && is_newline(s[end]))
+      end++;
+    return end;
+  }
+
+  // Whitespace up to its last line break; otherwise all of it but the last
+  // byte before a word, which joins that word
+  size_t end = run_end(s, i + 1, n, RUN_SPACE);
+  for (size_t k = end; k > i; k--) {
+    if (is_newline(s[k - 1]))
+      return k;
+  }
+  return end < n && end - i > 1 ? end - 1 : end;
+}
+
+// Merge a piece into tokens, lowest-ranked pair first. starts receives the
+// token boundaries (tokens + 1 of them); both arrays hold n + 1 entries.
+static size_t merge_piece(const unsigned char *p, size_t n, size_t *starts,
+                          uint32_t *ranks) {
+  size_t parts = n + 1;
+  for (size_t i = 0; i < parts; i++) {
+    starts[i] = i;
+    ranks[i] = i + 2 < parts ? lookup(p + i, 2) : NO_RANK;
+  }
+
+  while (parts > 2) {
+    size_t best = 0;
+    for (size_t i = 1; i + 1 < parts; i++) {
+      if (ranks[i] < ranks[best])
+        best = i;
+    }
+    if (ranks[best] == NO_RANK)
+      break;
+
+    // Join tokens best and best + 1, then rank the pairs around the result
+    ranks[best] = best + 3 < parts
+                      ? lookup(p + starts[best], starts[best + 3] - starts[best])
+                      : NO_RANK;
+    if (best > 0)
+      ranks[best - 1] =
+          lookup(p + starts[best - 1], starts[best + 2] - starts[best - 1]);
+    memmove(&starts[best + 1], &starts[best + 2],
+            (parts - best - 2) * sizeof(size_t));
+    memmove(&ranks[best + 1], &ranks[best + 2],
+            (parts - best - 2) * sizeof(uint32_t));
+    parts--;
+  }
+  return parts - 1;
+}
+
+// Count a piece's tokens. If cut is given it is set to the end of the
+// piece's first max_tokens tokens.
+static size_t piece_tokens(const unsigned char *p, size_t n, size_t max_tokens,
+                           size_t *cut) {
+  if (n == 1 || lookup(p, n) != NO_RANK) {
+    if (cut)
+      *cut = max_tokens ? n : 0;
+    return 1;
+  }
+
+  size_t stack_starts[STACK_PIECE + 1];
+  uint32_t stack_ranks[STACK_PIECE + 1];
+  size_t *starts = stack_starts;
+  uint32_t *ranks = stack_ranks;
+  if (n > STACK_PIECE) {
+    starts = malloc((n + 1) * sizeof(size_t));
+    ranks = malloc((n + 1) * sizeof(uint32_t));
+    if (!starts || !ranks) {
+      // Out of memory: a byte per token is an upper bound
+      free(starts);
+      free(ranks);
+      if (cut)
+        *cut = max_tokens < n ? max_tokens : n;
+      return n;
+    }
+  }
+
+  size_t tokens = merge_piece(p, n, starts, ranks);
+  if (cut)
+    *cut = starts[max_tokens < tokens ? max_tokens : tokens];
+
+  if (starts != stack_starts) {
+    free(starts);
+    free(ranks);
+  }
+  return tokens;
+}
+
+/**
+ * Count the tokens of a text
+ */
+size_t tokenizer_count(const char *text, size_t length) {
+  if (!vocab.slots)
+    return (length + 3) / 4;
+
+  const unsigned char *s = (const unsigned char *)text;
+  size_t tokens = 0;
+  for (size_t i = 0; i < length;) {
+    size_t end = next_piece(s, i, length);
+    tokens += piece_tokens(s + i, end - i, 0, NULL);
+    i = end;
+  }
+  return tokens;
+}
+
+/**
+ * Find the longest prefix of a text that fits in a number of tokens
+ */
+size_t tokenizer_prefix(const char *text, size_t length, size_t max_tokens) {
+  const unsigned char *s = (const unsigned char *)text;
+  size_t cut = length;
+
+  if (!vocab.slots) {
+    if (max_tokens < length / 4)
+      cut = max_tokens * 4;
+  } else {
+    size_t used = 0;
+    for (size_t i = 0; i < length;) {
+      size_t end = next_piece(s, i, length);
+      size_t piece_cut;
+      size_t tokens = piece_tokens(s + i, end - i, max_tokens - used,
+                                   &piece_cut);
+      if (used + tokens > max_tokens) {
+        cut = i + piece_cut;
+        break;
+      }
+      used += tokens;
+      i = end;
+    }
+  }
+
+  // Never leave half a UTF-8 sequence behind
+  while (cut > 0 && cut < length && (s[cut] & 0xC0) == 0x80)
+    cut--;
+  return cut;
+}
+
+// Sum of token counts with each one capped
+static size_t capped_total(const size_t *tokens, int count, size_t cap) {
+  size_t total = 0;
+  for (int i = 0; i < count; i++)
+    total += tokens[i] < cap ? tokens[i] : cap;
+  return total;
+}
+
+/**
+ * Shorten prompt arguments until their tokens fit a budget
+ */
+int tokenizer_fit(VibePromptArg *args, int count, size_t budget) {
+  size_t stack_tokens[16];
+  size_t *tokens = count <= 16 ? stack_tokens : malloc(count * sizeof(size_t));
+  if (!tokens) {
+    ERROR("Failed to allocate token counts");
+    return 0;
+  }
+
+  size_t total = 0, largest = 0;
+  for (int i = 0; i < count; i++) {
+    tokens[i] = tokenizer_count(args[i].text, args[i].length);
+    total += tokens[i];
+    if (tokens[i] > largest)
+      largest = tokens[i];
+  }
+
+  int shortened = 0;
+  if (total > budget) {
+    // The largest cap that fits: capped_total(low) <= budget < high's
+    size_t low = 0, high = largest;
+    while (high - low > 1) {
+      size_t mid = low + (high - low) / 2;
+      if (capped_total(tokens, count, mid) <= budget)
+        low = mid;
+      else
+        high = mid;
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (tokens[i] > low) {
+        args[i].length = tokenizer_prefix(args[i].text, args[i].length, low);
+        shortened++;
+      }
+    }
+  }
+
+  if (tokens != stack_tokens)
+    free(tokens);
+  return shortened;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file tokenizer.h
+ * @brief Local byte-pair-encoding tokenizer for prompt token budgets
+ *
+ * The vocabulary is a tiktoken rank file, one "<base64 token> <rank>" pair
+ * per line, such as cl100k_base.tiktoken. Text is split into pieces by a
+ * pre-tokenizer modelled on cl100k's: contractions, letter runs with one
+ * leading non-letter, up to three digits, punctuation runs and whitespace.
+ * Bytes of 0x80 and up count as letters, so non-ASCII text splits a little
+ * differently from the reference regex. Each piece is then merged pair by
+ * pair, lowest rank first, until no adjacent pair is in the vocabulary.
+ *
+ * Without a vocabulary, counts are estimated at four bytes per token, the
+ * same estimate admission control has always used.
+ */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include "../../include/runtime.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Load a vocabulary, replacing any loaded before. Not thread-safe: call it
+ * before prompts are executed.
+ *
+ * @param path The tiktoken rank file
+ * @return 1 on success, 0 if the file cannot be read or holds no tokens
+ */
+int tokenizer_load(const char *path);
+
+/**
+ * Release the vocabulary; counts fall back to the estimate
+ */
+void tokenizer_free(void);
+
+/**
+ * Check whether a vocabulary is loaded
+ *
+ * @return 1 if counts are exact, 0 if they are estimates
+ */
+int tokenizer_loaded(void);
+
+/**
+ * Count the tokens of a text
+ *
+ * @param text The text, not necessarily NUL-terminated
+ * @param length Its length in bytes
+ * @return The number of tokens
+ */
+size_t tokenizer_count(const char *text, size_t length);
+
+/**
+ * Find the longest prefix of a text that fits in a number of tokens. The cut
+ * never splits a UTF-8 sequence.
+ *
+ * @param text The text
+ * @param length Its length in bytes
+ * @param max_tokens The token budget
+ * @return The length of the prefix in bytes
+ */
+size_t tokenizer_prefix(const char *text, size_t length, size_t max_tokens);
+
+/**
+ * Shorten prompt arguments until their tokens sum to at most a budget. The
+ * longest ones are cut first, down to a common cap, so short arguments
+ * survive whole. Only the lengths change, never the text.
+ *
+ * @param args The arguments
+ * @param count Number of arguments
+ * @param budget Tokens the arguments may use together
+ * @return The number of arguments shortened
+ */
+int tokenizer_fit(VibePromptArg *args, int count, size_t budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TOKENIZER_H */
@@ -17,6 +17,9 @@ typedef struct {
   int version;        // Show version
   const char *input;  // Input file
   const char *output; // Output file
+  const char *config; // Configuration compiled in, NULL for the default
+  int no_config;      // Compile no configuration in
+  int materialize;    // Answer constant prompts at build time
   int optimization;   // Optimization level (0-3)
 } cli_options;
 
@@ -32,6 +35,13 @@ static void print_usage(const char *program_name) {
   printf(
       "  -c, --check               Only check syntax, don't generate output\n");
   printf("  -O<level>                 Optimization level (0-3)\n");
+  printf("  --config <file>           Compile function overrides from <file>\n");
+  printf("                            (default: vibeconfig.json if present)\n");
+  printf("  --no-config               Compile no function overrides in\n");
+  printf("  --materialize             Answer constant prompts now and embed\n");
+  printf("                            the answers, listed in\n");
+  printf("                            <name>.materialized.json for the\n");
+  printf("                            output file <name>.c\n");
   printf("  --verbose                 Verbose output\n");
 }
 
@@ -74,6 +84,14 @@ static cli_options parse_options(int argc, char *argv[]) {
         if (i + 1 < argc) {
           options.output = argv[++i];
         }
+      } else if (strcmp(argv[i], "--config") == 0) {
+        if (i + 1 < argc) {
+          options.config = argv[++i];
+        }
+      } else if (strcmp(argv[i], "--no-config") == 0) {
+        options.no_config = 1;
+      } else if (strcmp(argv[i], "--materialize") == 0) {
+        options.materialize = 1;
       } else if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] != '\0') {
         options.optimization = atoi(&argv[i][2]);
         if (options.optimization < 0 || options.optimization > 3) {
@@ -258,6 +276,16 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  // Function overrides are compiled into the module's prompt sites
+  if (options.no_config)
+    vibelang_set_config_file(NULL);
+  else if (options.config)
+    vibelang_set_config_file(options.config);
+
+  // Constant prompts are sent now, through the runtime's cache and cassette
+  if (options.materialize)
+    vibelang_set_materialize(1);
+
   // Compile the source
   int compile_result = vibelang_compile(source, output_file);
   if (compile_result != 0) {
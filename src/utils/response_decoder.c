@@ -0,0 +1,198 @@
+/**
+ * @file response_decoder.c
+ * @brief Tolerant extraction of typed values from LLM responses
+ */
+
+#include "response_decoder.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Significant digits a 64-bit mantissa always holds
+#define MANTISSA_DIGITS 19
+
+typedef struct {
+  int negative;
+  uint64_t integer;  // Integer part, saturated at UINT64_MAX
+  uint64_t mantissa; // Leading significant digits of the whole number
+  int exponent;      // Power of ten that scales the mantissa
+} ScannedNumber;
+
+static inline int is_digit(unsigned char c) { return c >= '0' && c <= '9'; }
+
+static inline int is_alpha(unsigned char c) {
+  return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+}
+
+static inline int is_word(unsigned char c) {
+  return is_digit(c) || is_alpha(c) || c == '_';
+}
+
+// Append a digit to the mantissa, or count it in the exponent once the
+// mantissa is full
+static void add_digit(ScannedNumber *number, int *digits, unsigned d) {
+  if (*digits < MANTISSA_DIGITS) {
+    number->mantissa = number->mantissa * 10 + d;
+    if (number->mantissa)
+      (*digits)++;
+  } else {
+    number->exponent++;
+  }
+}
+
+// Scan the first number that is not glued to a word
+static int scan_number(const unsigned char *s, size_t n, ScannedNumber *out) {
+  size_t i = 0;
+  for (;;) {
+    while (i < n && !is_digit(s[i]))
+      i++;
+    if (i == n)
+      return 0;
+    if (i == 0 || !(is_alpha(s[i - 1]) || s[i - 1] == '_'))
+      break;
+    while (i < n && is_word(s[i]))
+      i++;
+  }
+
+  memset(out, 0, sizeof(*out));
+  // A sign counts only if it is not a hyphen inside a word
+  if (i > 0 && (s[i - 1] == '-' || s[i - 1] == '+') &&
+      (i == 1 || !is_word(s[i - 2])))
+    out->negative = s[i - 1] == '-';
+  else if (i >= 3 && memcmp(s + i - 3, "\xe2\x88\x92", 3) == 0) // U+2212
+    out->negative = 1;
+
+  int digits = 0;
+  for (;;) {
+    for (; i < n && is_digit(s[i]); i++) {
+      unsigned d = s[i] - '0';
+      if (out->integer > (UINT64_MAX - d) / 10)
+        out->integer = UINT64_MAX;
+      else
+        out->integer = out->integer * 10 + d;
+      add_digit(out, &digits, d);
+    }
+    // Digit grouping: a comma followed by exactly three digits
+    if (i + 3 < n && s[i] == ',' && is_digit(s[i + 1]) &&
+        is_digit(s[i + 2]) && is_digit(s[i + 3]) &&
+        (i + 4 == n || !is_digit(s[i + 4]))) {
+      i++;
+      continue;
+    }
+    break;
+  }
+
+  if (i + 1 < n && s[i] == '.' && is_digit(s[i + 1])) {
+    for (i++; i < n && is_digit(s[i]); i++) {
+      if (digits < MANTISSA_DIGITS) {
+        add_digit(out, &digits, s[i] - '0');
+        out->exponent--;
+      }
+    }
+  }
+
+  if (i < n && (s[i] | 0x20) == 'e') {
+    size_t j = i + 1;
+    int negative = 0;
+    if (j < n && (s[j] == '-' || s[j] == '+'))
+      negative = s[j++] == '-';
+    if (j < n && is_digit(s[j])) {
+      int exponent = 0;
+      for (; j < n && is_digit(s[j]); j++) {
+        if (exponent < 10000)
+          exponent = exponent * 10 + (s[j] - '0');
+      }
+      out->exponent += negative ? -exponent : exponent;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Find the first integer in a text
+ */
+int response_decode_int(const char *text, size_t length, long long *value) {
+  ScannedNumber number;
+  if (!text || !scan_number((const unsigned char *)text, length, &number))
+    return 0;
+
+  if (number.negative)
+    *value = number.integer > (uint64_t)LLONG_MAX + 1
+                 ? LLONG_MIN
+                 : (long long)(0 - number.integer);
+  else
+    *value = number.integer > (uint64_t)LLONG_MAX ? LLONG_MAX
+                                                  : (long long)number.integer;
+  return 1;
+}
+
+/**
+ * Find the first decimal number in a text
+ */
+int response_decode_float(const char *text, size_t length, double *value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  ScannedNumber number;
+  if (!text || !scan_number((const unsigned char *)text, length, &number))
+    return 0;
+
+  // Both factors are exact in a double here, so one rounding gives the
+  // correctly rounded result; otherwise pow may be off by an ulp
+  double result;
+  double mantissa = (double)number.mantissa;
+  if (number.mantissa == 0)
+    result = 0.0;
+  else if (number.mantissa <= (1ULL << 53) && number.exponent >= -22 &&
+           number.exponent <= 22)
+    result = number.exponent < 0 ? mantissa / powers[-number.exponent]
+                                 : mantissa * powers[number.exponent];
+  else
+    result = mantissa * pow(10.0, number.exponent);
+
+  *value = number.negative ? -result : result;
+  return 1;
+}
+
+/**
+ * Find the first word that answers yes or no
+ */
+int response_decode_bool(const char *text, size_t length, int *value) {
+  static const struct {
+    const char *word;
+    int value;
+  } answers[] = {{"true", 1},     {"yes", 1},        {"y", 1},
+                 {"1", 1},        {"correct", 1},    {"affirmative", 1},
+                 {"false", 0},    {"no", 0},         {"n", 0},
+                 {"0", 0},        {"incorrect", 0},  {"negative", 0}};
+  if (!text)
+    return 0;
+
+  const unsigned char *s = (const unsigned char *)text;
+  for (size_t i = 0; i < length;) {
+    if (!is_word(s[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < length && is_word(s[i]))
+      i++;
+
+    size_t n = i - start;
+    for (size_t a = 0; a < sizeof(answers) / sizeof(answers[0]); a++) {
+      const char *word = answers[a].word;
+      if (strlen(word) != n)
+        continue;
+      size_t k = 0;
+      while (k < n && (s[start + k] | 0x20) == (unsigned char)word[k])
+        k++;
+      if (k == n) {
+        *value = answers[a].value;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
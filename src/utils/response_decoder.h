@@ -0,0 +1,58 @@
+/**
+ * @file response_decoder.h
+ * @brief Tolerant extraction of typed values from LLM responses
+ *
+ * Models answer "What is the temperature?" with "It is 25°C" as often as
+ * with "25", so the decoders look for the first value of their type in free
+ * text. Numbers glued to a word, such as the 3 in "Q3", are skipped.
+ * Parsing never calls locale-dependent libc functions and never copies the
+ * text.
+ */
+
+#ifndef RESPONSE_DECODER_H
+#define RESPONSE_DECODER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Find the first integer in a text. A fraction is truncated, and "1,234"
+ * style digit grouping is accepted.
+ *
+ * @param text The text
+ * @param length Its length in bytes
+ * @param value Receives the integer, saturated at the long long range
+ * @return 1 if an integer was found, 0 otherwise
+ */
+int response_decode_int(const char *text, size_t length, long long *value);
+
+/**
+ * Find the first decimal number in a text, with an optional fraction and
+ * exponent. The decimal separator is always '.'.
+ *
+ * @param text The text
+ * @param length Its length in bytes
+ * @param value Receives the number
+ * @return 1 if a number was found, 0 otherwise
+ */
+int response_decode_float(const char *text, size_t length, double *value);
+
+/**
+ * Find the first word that answers yes or no: true/false, yes/no, y/n,
+ * 1/0 and a few synonyms, in any case.
+ *
+ * @param text The text
+ * @param length Its length in bytes
+ * @param value Receives 1 or 0
+ * @return 1 if an answer was found, 0 otherwise
+ */
+int response_decode_bool(const char *text, size_t length, int *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RESPONSE_DECODER_H */
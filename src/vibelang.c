@@ -61,6 +61,16 @@ int vibe_generate_code(ast_node_t *ast, const char *output_file) {
   return generate_code(ast, output_file);
 }
 
+// Choose the configuration compiled into modules
+void vibelang_set_config_file(const char *config_file) {
+  codegen_set_config_file(config_file);
+}
+
+// Answer constant prompts through the runtime while compiling
+void vibelang_set_materialize(int enabled) {
+  codegen_set_resolver(enabled ? vibe_fetch_site : NULL);
+}
+
 // Expose AST handling
 void vibe_free_ast(ast_node_t *ast) { ast_node_free(ast); }
 
@@ -0,0 +1,207 @@
+#include "../../src/runtime/admission.h"
+#include "../../src/runtime/retry_policy.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+static AdmissionConfig make_config(void) {
+  AdmissionConfig config = {1, 0.0, 0.0, 2, 1, 8, 0.5, 0.0, 4, 0};
+  return config;
+}
+
+static void sleep_ms(long ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+// Test that the concurrency limit bounds requests in flight and adapts
+static void test_concurrency_limit() {
+  AdmissionConfig config = make_config();
+  admission_init(&config);
+
+  AdmissionTicket a, b, c;
+  assert(admission_try_acquire(10, &a));
+  assert(admission_try_acquire(10, &b));
+  assert(!admission_try_acquire(10, &c));
+
+  // One overload halves the limit; a second from a request sent before the
+  // cut does not cut again
+  sleep_ms(2);
+  admission_release(&a, ADMISSION_OVERLOADED, -1, -1);
+  admission_release(&b, ADMISSION_OVERLOADED, -1, -1);
+  AdmissionStats stats;
+  admission_stats(&stats);
+  assert(stats.limit == 1.0);
+  assert(stats.decreases == 1);
+  assert(stats.in_flight == 0);
+
+  // Successes grow the limit again, one slot per round
+  for (int i = 0; i < 3; i++) {
+    assert(admission_try_acquire(10, &a));
+    admission_release(&a, ADMISSION_SUCCEEDED, 100, 50);
+  }
+  admission_stats(&stats);
+  assert(stats.limit > 2.0 && stats.limit < 3.0);
+
+  // Abandoned requests leave the limit alone
+  assert(admission_try_acquire(10, &a));
+  admission_release(&a, ADMISSION_ABANDONED, -1, -1);
+  AdmissionStats after;
+  admission_stats(&after);
+  assert(after.limit == stats.limit);
+
+  printf("Concurrency limit test passed\n");
+}
+
+// Test that a full queue and a long wait both refuse requests
+static void test_queue_bounds() {
+  AdmissionConfig config = make_config();
+  config.initial_concurrency = 1;
+  config.max_queue = 0;
+  admission_init(&config);
+
+  AdmissionTicket held, ticket;
+  assert(admission_acquire(10, 0, NULL, &held) == ADMISSION_ADMITTED);
+  assert(admission_acquire(10, 0, NULL, &ticket) == ADMISSION_QUEUE_FULL);
+
+  config.max_queue = 4;
+  config.queue_timeout_ms = 30;
+  admission_init(&config);
+  assert(admission_acquire(10, 0, NULL, &held) == ADMISSION_ADMITTED);
+  assert(admission_acquire(10, 0, NULL, &ticket) == ADMISSION_TIMED_OUT);
+  assert(admission_acquire(10, 10, NULL, &ticket) == ADMISSION_TIMED_OUT);
+
+  AdmissionStats stats;
+  admission_stats(&stats);
+  assert(stats.timed_out == 2);
+  assert(stats.queued == 0);
+  admission_release(&held, ADMISSION_SUCCEEDED, -1, -1);
+
+  printf("Queue bounds test passed\n");
+}
+
+static void *release_later(void *arg) {
+  sleep_ms(20);
+  admission_release((AdmissionTicket *)arg, ADMISSION_SUCCEEDED, -1, -1);
+  return NULL;
+}
+
+// Test that a queued request is admitted as soon as a slot frees up
+static void test_queued_admission() {
+  AdmissionConfig config = make_config();
+  config.initial_concurrency = 1;
+  config.queue_timeout_ms = 5000;
+  admission_init(&config);
+
+  AdmissionTicket held, ticket;
+  assert(admission_acquire(10, 0, NULL, &held) == ADMISSION_ADMITTED);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, release_later, &held);
+  assert(admission_acquire(10, 0, NULL, &ticket) == ADMISSION_ADMITTED);
+  pthread_join(thread, NULL);
+  admission_release(&ticket, ADMISSION_SUCCEEDED, -1, -1);
+
+  printf("Queued admission test passed\n");
+}
+
+static void *cancel_later(void *arg) {
+  sleep_ms(20);
+  vibe_cancel_token_cancel((VibeCancelToken *)arg);
+  return NULL;
+}
+
+// Test that cancelling a call ends its wait for admission at once
+static void test_cancelled_wait() {
+  AdmissionConfig config = make_config();
+  config.initial_concurrency = 1;
+  config.queue_timeout_ms = 5000;
+  admission_init(&config);
+
+  AdmissionTicket held, ticket;
+  assert(admission_acquire(10, 0, NULL, &held) == ADMISSION_ADMITTED);
+
+  VibeCancelToken *token = vibe_cancel_token_create();
+  pthread_t thread;
+  pthread_create(&thread, NULL, cancel_later, token);
+  int64_t start = retry_now_ms();
+  assert(admission_acquire(10, 0, token, &ticket) == ADMISSION_CANCELLED);
+  assert(retry_now_ms() - start < 2000);
+  pthread_join(thread, NULL);
+
+  // A token cancelled beforehand refuses without waiting
+  assert(admission_acquire(10, 0, token, &ticket) == ADMISSION_CANCELLED);
+
+  AdmissionStats stats;
+  admission_stats(&stats);
+  assert(stats.cancelled == 2);
+  assert(stats.queued == 0);
+  admission_release(&held, ADMISSION_SUCCEEDED, -1, -1);
+  vibe_cancel_token_free(token);
+
+  printf("Cancelled wait test passed\n");
+}
+
+// Test the request and token budgets
+static void test_rate_limits() {
+  AdmissionConfig config = make_config();
+  config.max_concurrency = config.initial_concurrency = 100;
+
+  // 60 requests per minute hold a 10 request burst
+  config.requests_per_minute = 60;
+  admission_init(&config);
+  AdmissionTicket ticket;
+  for (int i = 0; i < 10; i++) {
+    assert(admission_try_acquire(1, &ticket));
+    admission_release(&ticket, ADMISSION_SUCCEEDED, -1, -1);
+  }
+  assert(!admission_try_acquire(1, &ticket));
+
+  // 6000 tokens per minute hold 1000; unused estimates are refunded
+  config.requests_per_minute = 0;
+  config.tokens_per_minute = 6000;
+  admission_init(&config);
+  assert(admission_try_acquire(600, &ticket));
+  AdmissionTicket second;
+  assert(!admission_try_acquire(600, &second));
+  admission_release(&ticket, ADMISSION_SUCCEEDED, -1, 100);
+  assert(admission_try_acquire(600, &second));
+  admission_release(&second, ADMISSION_SUCCEEDED, -1, -1);
+
+  printf("Rate limit test passed\n");
+}
+
+// Test that disabled admission control lets everything through
+static void test_disabled() {
+  AdmissionConfig config = make_config();
+  config.enabled = 0;
+  config.initial_concurrency = 1;
+  admission_init(&config);
+
+  AdmissionTicket tickets[16];
+  for (int i = 0; i < 16; i++)
+    assert(admission_acquire(10, 0, NULL, &tickets[i]) == ADMISSION_ADMITTED);
+  for (int i = 0; i < 16; i++)
+    admission_release(&tickets[i], ADMISSION_OVERLOADED, -1, -1);
+
+  AdmissionStats stats;
+  admission_stats(&stats);
+  assert(stats.decreases == 0);
+
+  printf("Disabled admission test passed\n");
+}
+
+int main() {
+  printf("Running admission control tests...\n");
+
+  test_concurrency_limit();
+  test_queue_bounds();
+  test_queued_admission();
+  test_cancelled_wait();
+  test_rate_limits();
+  test_disabled();
+
+  printf("All admission control tests passed!\n");
+  return 0;
+}
@@ -0,0 +1,171 @@
+#include "../../src/runtime/call_context.h"
+#include "../../src/runtime/retry_policy.h"
+#include "../../src/runtime/single_flight.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static FunctionConfig function;
+
+static void count_hook(void *arg) { (*(int *)arg)++; }
+
+// Test that deadlines only narrow and contexts restore
+static void test_enter_restore() {
+  VibeCallContext empty = vibe_call_context_current();
+  assert(empty.deadline_ms == 0 && empty.cancel == NULL);
+
+  VibeCancelToken *token = vibe_cancel_token_create();
+  assert(token != NULL);
+  VibeCallContext outer = vibe_call_context_enter(1000, token);
+  VibeCallContext current = vibe_call_context_current();
+  assert(current.cancel == token);
+  long long outer_deadline = current.deadline_ms;
+  assert(outer_deadline > retry_now_ms());
+
+  // A longer timeout keeps the earlier deadline, a shorter one narrows it
+  VibeCallContext inner = vibe_call_context_enter(60000, NULL);
+  assert(vibe_call_context_current().deadline_ms == outer_deadline);
+  assert(vibe_call_context_current().cancel == token);
+  vibe_call_context_restore(inner);
+  inner = vibe_call_context_enter(10, NULL);
+  assert(vibe_call_context_current().deadline_ms < outer_deadline);
+  vibe_call_context_restore(inner);
+  assert(vibe_call_context_current().deadline_ms == outer_deadline);
+
+  vibe_call_context_restore(outer);
+  current = vibe_call_context_current();
+  assert(current.deadline_ms == 0 && current.cancel == NULL);
+  assert(call_context_remaining_ms(0, 500) == 500);
+  assert(call_context_remaining_ms(retry_now_ms() + 100000, 500) == 500);
+  assert(call_context_remaining_ms(retry_now_ms() - 1, 500) <= 0);
+
+  vibe_cancel_token_free(token);
+  printf("Context enter/restore test passed\n");
+}
+
+// Test that cancelling runs hooks once and later hooks are refused
+static void test_cancel_hooks() {
+  VibeCancelToken *token = vibe_cancel_token_create();
+  int first = 0, second = 0, removed = 0;
+  CancelHook hooks[3];
+  assert(call_context_hook(token, &hooks[0], count_hook, &first));
+  assert(call_context_hook(token, &hooks[1], count_hook, &removed));
+  assert(call_context_hook(token, &hooks[2], count_hook, &second));
+  call_context_unhook(token, &hooks[1]);
+
+  VibeCallContext context = {0, token};
+  assert(call_context_status(context) == VIBE_SUCCESS);
+  assert(!vibe_cancel_token_is_cancelled(token));
+  vibe_cancel_token_cancel(token);
+  vibe_cancel_token_cancel(token);
+  assert(vibe_cancel_token_is_cancelled(token));
+  assert(first == 1 && second == 1 && removed == 0);
+  assert(call_context_status(context) == VIBE_ERROR_CANCELLED);
+
+  int late = 0;
+  CancelHook hook;
+  assert(!call_context_hook(token, &hook, count_hook, &late));
+  assert(late == 0);
+  assert(!call_context_sleep(token, 1000));
+
+  // A NULL token accepts hooks and never cancels
+  assert(call_context_hook(NULL, &hook, count_hook, &late));
+  call_context_unhook(NULL, &hook);
+  assert(call_context_sleep(NULL, 1));
+
+  VibeCallContext expired = {retry_now_ms() - 1, NULL};
+  assert(call_context_status(expired) == VIBE_ERROR_TIMEOUT);
+
+  call_context_unhook(token, &hooks[0]);
+  call_context_unhook(token, &hooks[2]);
+  vibe_cancel_token_free(token);
+  printf("Cancel hooks test passed\n");
+}
+
+static void *cancel_later(void *arg) {
+  retry_sleep_ms(50);
+  vibe_cancel_token_cancel((VibeCancelToken *)arg);
+  return NULL;
+}
+
+// Test that a cancellable sleep wakes when another thread cancels
+static void test_sleep_interrupted() {
+  VibeCancelToken *token = vibe_cancel_token_create();
+  assert(call_context_sleep(token, 20));
+
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, cancel_later, token) == 0);
+  int64_t start = retry_now_ms();
+  assert(!call_context_sleep(token, 10000));
+  assert(retry_now_ms() - start < 5000);
+  pthread_join(thread, NULL);
+
+  vibe_cancel_token_free(token);
+  printf("Interrupted sleep test passed\n");
+}
+
+// Test that followers give up on their own context and rejoin abandoned
+// flights
+static void test_single_flight() {
+  ResponseCacheKey key;
+  assert(response_cache_key_init(&key, "What is 2+2?", NULL, &function));
+
+  SingleFlightCall *leader, *follower;
+  assert(single_flight_join(&key, &leader) == 1);
+
+  // A follower with a short deadline stops waiting
+  assert(single_flight_join(&key, &follower) == 0);
+  VibeCallContext short_context = {retry_now_ms() + 30, NULL};
+  int abandoned = -1;
+  assert(single_flight_wait(follower, short_context, &abandoned) == NULL);
+  assert(abandoned == 0);
+
+  // A follower whose token is cancelled stops waiting
+  VibeCancelToken *token = vibe_cancel_token_create();
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, cancel_later, token) == 0);
+  assert(single_flight_join(&key, &follower) == 0);
+  VibeCallContext cancel_context = {0, token};
+  assert(single_flight_wait(follower, cancel_context, &abandoned) == NULL);
+  assert(abandoned == 0);
+  pthread_join(thread, NULL);
+  vibe_cancel_token_free(token);
+
+  // An abandoned flight tells the follower to join again
+  assert(single_flight_join(&key, &follower) == 0);
+  single_flight_abandon(leader);
+  VibeCallContext none = {0, NULL};
+  assert(single_flight_wait(follower, none, &abandoned) == NULL);
+  assert(abandoned == 1);
+
+  // The next flight completes normally
+  assert(single_flight_join(&key, &leader) == 1);
+  assert(single_flight_join(&key, &follower) == 0);
+  single_flight_complete(leader, "4");
+  char *response = single_flight_wait(follower, none, &abandoned);
+  assert(response && strcmp(response, "4") == 0 && abandoned == 0);
+  free(response);
+
+  response_cache_key_free(&key);
+  printf("Single-flight context test passed\n");
+}
+
+int main() {
+  printf("Running call context tests...\n");
+
+  function.endpoint = "https://api.openai.com/v1/chat/completions";
+  function.model = "gpt-3.5-turbo";
+  function.temperature = 0.7;
+  function.max_tokens = 150;
+
+  test_enter_restore();
+  test_cancel_hooks();
+  test_sleep_interrupted();
+  test_single_flight();
+
+  printf("All call context tests passed!\n");
+  return 0;
+}
@@ -0,0 +1,217 @@
+#include "../../src/runtime/cassette.h"
+#include "../../src/runtime/retry_policy.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CASSETTE_PATH "test_cassette.cassette"
+
+static FunctionConfig function;
+
+static CassetteConfig make_config(CassetteMode mode) {
+  CassetteConfig config = {mode, CASSETTE_PATH, LATENCY_NONE, 0, 0, 0, 0};
+  return config;
+}
+
+static void record(const char *prompt, const char *response) {
+  ResponseCacheKey key;
+  assert(response_cache_key_init(&key, prompt, NULL, &function));
+  cassette_record(&key, response, 42);
+  response_cache_key_free(&key);
+}
+
+// Replay a prompt within a context, NULL if it was never recorded or the
+// call ended first
+static char *replay_within(const char *prompt, VibeCallContext context,
+                           VibeError *error) {
+  ResponseCacheKey key;
+  assert(response_cache_key_init(&key, prompt, NULL, &function));
+  char *response = cassette_replay(&key, context, error);
+  response_cache_key_free(&key);
+  return response;
+}
+
+// Replay a prompt, NULL if it was never recorded
+static char *replay(const char *prompt, const char *meaning) {
+  ResponseCacheKey key;
+  assert(response_cache_key_init(&key, prompt, meaning, &function));
+  VibeCallContext unbounded = {0, NULL};
+  VibeError error;
+  char *response = cassette_replay(&key, unbounded, &error);
+  assert(response ? error == VIBE_SUCCESS : error == VIBE_ERROR_GENERAL);
+  response_cache_key_free(&key);
+  return response;
+}
+
+static void expect(const char *prompt, const char *expected) {
+  char *response = replay(prompt, NULL);
+  assert(response != NULL);
+  assert(strcmp(response, expected) == 0);
+  free(response);
+}
+
+// Test that recorded calls are replayed and unrecorded ones miss
+static void test_record_replay() {
+  CassetteConfig config = make_config(CASSETTE_RECORD);
+  assert(cassette_open(&config));
+  assert(cassette_mode() == CASSETTE_RECORD);
+  record("What is 2+2?", "4");
+  record("Describe the weather", "Sunny with \"quotes\"\nand lines");
+  record("What is 2+2?", "four"); // The first recording wins
+  record("empty", "");
+  cassette_close();
+  assert(cassette_mode() == CASSETTE_OFF);
+
+  config.mode = CASSETTE_REPLAY;
+  assert(cassette_open(&config));
+  expect("What is 2+2?", "4");
+  expect("Describe the weather", "Sunny with \"quotes\"\nand lines");
+  expect("empty", "");
+  assert(replay("What is 3+3?", NULL) == NULL);
+  assert(replay("What is 2+2?", "number") == NULL);
+
+  // Stop sequences and the instruction change what the model is asked
+  static const char *const stop[] = {"\n", NULL};
+  function.stop = stop;
+  assert(replay("What is 2+2?", NULL) == NULL);
+  function.stop = NULL;
+  function.instruction = "Reply with only a number.";
+  assert(replay("What is 2+2?", NULL) == NULL);
+  function.instruction = NULL;
+  expect("What is 2+2?", "4");
+  cassette_close();
+
+  printf("Record/replay test passed\n");
+}
+
+// Test that a cassette without an index is still replayed and can be
+// extended
+static void test_interrupted_recording() {
+  // Cut off the index and footer, as if the recording had crashed
+  FILE *file = fopen(CASSETTE_PATH, "rb");
+  assert(file);
+  uint64_t index_offset;
+  assert(fseek(file, -24, SEEK_END) == 0);
+  assert(fread(&index_offset, sizeof(index_offset), 1, file) == 1);
+  fclose(file);
+  assert(truncate(CASSETTE_PATH, (off_t)index_offset) == 0);
+
+  CassetteConfig config = make_config(CASSETTE_REPLAY);
+  assert(cassette_open(&config));
+  expect("Describe the weather", "Sunny with \"quotes\"\nand lines");
+  cassette_close();
+
+  config.mode = CASSETTE_RECORD;
+  assert(cassette_open(&config));
+  record("Say hello", "Hello!");
+  cassette_close();
+
+  config.mode = CASSETTE_REPLAY;
+  assert(cassette_open(&config));
+  expect("What is 2+2?", "4");
+  expect("Say hello", "Hello!");
+  cassette_close();
+
+  printf("Interrupted recording test passed\n");
+}
+
+// Test the simulated latency of replayed calls
+static void test_latency() {
+  CassetteConfig config = make_config(CASSETTE_REPLAY);
+  config.latency = LATENCY_RECORDED;
+  assert(cassette_open(&config));
+  int64_t start = retry_now_ms();
+  expect("What is 2+2?", "4");
+  assert(retry_now_ms() - start >= 42);
+  cassette_close();
+
+  config.latency = LATENCY_UNIFORM;
+  config.min_ms = 20;
+  config.max_ms = 30;
+  assert(cassette_open(&config));
+  start = retry_now_ms();
+  expect("Say hello", "Hello!");
+  int64_t elapsed = retry_now_ms() - start;
+  assert(elapsed >= 20 && elapsed < 1000);
+  cassette_close();
+
+  printf("Latency test passed\n");
+}
+
+// Test that the simulated latency ends with the call's deadline or token
+static void test_latency_bounded_by_context() {
+  CassetteConfig config = make_config(CASSETTE_REPLAY);
+  config.latency = LATENCY_FIXED;
+  config.median_ms = 5000;
+  assert(cassette_open(&config));
+
+  // The deadline cuts the delay short and the response is dropped
+  int64_t start = retry_now_ms();
+  VibeCallContext context = {start + 50, NULL};
+  VibeError error;
+  assert(replay_within("What is 2+2?", context, &error) == NULL);
+  assert(error == VIBE_ERROR_TIMEOUT);
+  int64_t elapsed = retry_now_ms() - start;
+  assert(elapsed >= 45 && elapsed < 1000);
+
+  // A call whose deadline has passed is not answered at all
+  context.deadline_ms = retry_now_ms() - 1;
+  assert(replay_within("What is 2+2?", context, &error) == NULL);
+  assert(error == VIBE_ERROR_TIMEOUT);
+
+  // Neither is a call whose token was cancelled
+  VibeCancelToken *token = vibe_cancel_token_create();
+  assert(token);
+  vibe_cancel_token_cancel(token);
+  VibeCallContext cancelled = {0, token};
+  start = retry_now_ms();
+  assert(replay_within("What is 2+2?", cancelled, &error) == NULL);
+  assert(error == VIBE_ERROR_CANCELLED);
+  assert(retry_now_ms() - start < 1000);
+  vibe_cancel_token_free(token);
+  cassette_close();
+
+  printf("Latency bounded by context test passed\n");
+}
+
+// Test that files that are not cassettes are left alone
+static void test_foreign_file() {
+  FILE *file = fopen(CASSETTE_PATH, "w");
+  assert(file);
+  fputs("{\"not\": \"a cassette\"}\n", file);
+  fclose(file);
+
+  CassetteConfig config = make_config(CASSETTE_RECORD);
+  assert(!cassette_open(&config));
+  config.mode = CASSETTE_REPLAY;
+  assert(!cassette_open(&config));
+  assert(cassette_mode() == CASSETTE_OFF);
+
+  config.path = "missing.cassette";
+  assert(!cassette_open(&config));
+
+  printf("Foreign file test passed\n");
+}
+
+int main() {
+  printf("Running cassette tests...\n");
+
+  function.endpoint = "https://api.openai.com/v1/chat/completions";
+  function.model = "gpt-3.5-turbo";
+  function.temperature = 0.7;
+  function.max_tokens = 150;
+  remove(CASSETTE_PATH);
+
+  test_record_replay();
+  test_interrupted_recording();
+  test_latency();
+  test_latency_bounded_by_context();
+  test_foreign_file();
+
+  remove(CASSETTE_PATH);
+  printf("All cassette tests passed!\n");
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include "../../include/runtime.h"
 #include "../../include/symbol_table.h"
 #include "../../src/utils/ast.h"
 #include "../../src/utils/file_utils.h"
@@ -11,6 +12,10 @@
 
 // External functions that we'll test
 extern int generate_code(ast_node_t *ast, const char *output_file);
+extern void codegen_set_config_file(const char *config_file);
+extern void codegen_set_resolver(char *(*resolver)(const VibePromptSite *,
+                                                   const char *,
+                                                   VibeGenerationParams *));
 extern ast_node_t *parse_string(const char *source);
 
 // Create directories if they don't exist
@@ -178,6 +183,323 @@ static void test_meaning_var() {
   test_codegen("meaning_var", source);
 }
 
+// Test that function overrides are compiled into prompt sites
+static void test_compiled_overrides() {
+  const char *config_path = "tests/unit/data/overrides.json";
+  const char *output_path = "tests/unit/data/overrides.output.c";
+  assert(ensure_test_directory());
+  FILE *config = fopen(config_path, "w");
+  assert(config);
+  fputs("{\"overrides\": {"
+        "\"getTemperature\": {\"model\": \"gpt-4o-mini\", "
+        "\"temperature\": 0.2, \"max_tokens\": 8},"
+        "\"describe\": {\"cache\": false},"
+        "\"isWarm\": {\"stop\": [\"END\"], "
+        "\"instruction\": \"Say yes or no.\"}}}",
+        config);
+  fclose(config);
+
+  ast_node_t *ast =
+      parse_string("type Temperature = Meaning<Int>(\"temperature\");\n"
+                   "fn getTemperature(city: String) -> Temperature {\n"
+                   "    prompt \"What is the temperature in {city}?\";\n"
+                   "}\n"
+                   "fn describe(city: String) -> String {\n"
+                   "    prompt \"Describe {city}\";\n"
+                   "}\n"
+                   "fn isWarm(city: String) -> Bool {\n"
+                   "    prompt \"Is it warm in {city}?\";\n"
+                   "}\n");
+  assert(ast);
+  codegen_set_config_file(config_path);
+  assert(generate_code(ast, output_path));
+  codegen_set_config_file(NULL);
+  ast_node_free(ast);
+
+  char *output = read_file(output_path);
+  assert(output);
+  assert(strstr(output, "static const VibeGenerationParams prompt_params = "
+                        "{.model = \"gpt-4o-mini\", .temperature = 0.2, "
+                        ".max_tokens = 8};"));
+  // The result type adds its own limits, which the runtime ranks below params
+  assert(strstr(output, "static const VibeGenerationParams prompt_limits = "
+                        "{.temperature = -1, .max_tokens = 16, "
+                        ".stop = prompt_limits_stop, .instruction = \"Reply "
+                        "with only the temperature, as an integer.\"};"));
+  assert(strstr(output, "{.function_name = \"getTemperature\", "
+                        ".meaning = \"temperature\", "
+                        ".params = &prompt_params, .decoder = VIBE_DECODE_INT, "
+                        ".limits = &prompt_limits};"));
+  // An override without generation parameters compiles to no descriptor, and
+  // text has no limits
+  assert(strstr(output, "{.function_name = \"describe\", "
+                        ".decoder = VIBE_DECODE_STRING};"));
+  // Stop sequences and the instruction can be overridden too
+  assert(strstr(output, "static const char *const prompt_params_stop[] = "
+                        "{\"END\", NULL};"));
+  assert(strstr(output, "{.temperature = -1, .max_tokens = 0, "
+                        ".stop = prompt_params_stop, "
+                        ".instruction = \"Say yes or no.\"};"));
+  assert(strstr(output, "{.temperature = -1, .max_tokens = 4, "
+                        ".stop = prompt_limits_stop, "
+                        ".instruction = \"Reply with only true or false.\"};"));
+  free(output);
+  printf("Compiled overrides test passed\n");
+}
+
+// Test that prompt templates are split into segments and slots
+static void test_precompiled_template() {
+  const char *output_path = "tests/unit/data/template.output.c";
+  assert(ensure_test_directory());
+  ast_node_t *ast = parse_string(
+      "fn compare(a: String, b: String) -> String {\n"
+      "    prompt \"Compare {a} with {b}.\\nPrefer {a} {not a name}\";\n"
+      "}\n");
+  assert(ast);
+  assert(generate_code(ast, output_path));
+  ast_node_free(ast);
+
+  char *output = read_file(output_path);
+  assert(output);
+  assert(strstr(output, "{\"Compare \", 8, 0},"));
+  assert(strstr(output, "{\" with \", 6, 1},"));
+  assert(strstr(output, "{\".\\012Prefer \", 9, 0},"));
+  assert(strstr(output, "{\" {not a name}\", 13, -1},"));
+  assert(strstr(output, "{prompt_segments, 4, 2, 36};"));
+  assert(strstr(output, "VibePromptArg prompt_args[2] = {"));
+  assert(strstr(output, "{a, a ? strlen(a) : 0},"));
+  assert(strstr(output, "vibe_execute_template(&prompt_site, "
+                        "&prompt_template, prompt_args);"));
+  assert(!strstr(output, "malloc"));
+  free(output);
+  printf("Precompiled template test passed\n");
+}
+
+// Test that prompt sites are routed by meaning first, then by type class
+static void test_model_routes() {
+  const char *config_path = "tests/unit/data/routes.json";
+  const char *output_path = "tests/unit/data/routes.output.c";
+  assert(ensure_test_directory());
+  FILE *config = fopen(config_path, "w");
+  assert(config);
+  fputs("{\"routes\": {"
+        "\"small\": {\"model\": \"gpt-4o-mini\", "
+        "\"types\": [\"number\", \"bool\"]},"
+        "\"weather\": {\"model\": \"gpt-4o\", "
+        "\"meanings\": [\"temperature\"]}}}",
+        config);
+  fclose(config);
+
+  ast_node_t *ast =
+      parse_string("type Temperature = Meaning<Int>(\"temperature\");\n"
+                   "fn getTemperature(city: String) -> Temperature {\n"
+                   "    prompt \"What is the temperature in {city}?\";\n"
+                   "}\n"
+                   "fn count(city: String) -> Int {\n"
+                   "    prompt \"How many people live in {city}?\";\n"
+                   "}\n"
+                   "fn describe(city: String) -> String {\n"
+                   "    prompt \"Describe {city}\";\n"
+                   "}\n");
+  assert(ast);
+  codegen_set_config_file(config_path);
+  assert(generate_code(ast, output_path));
+  codegen_set_config_file(NULL);
+  ast_node_free(ast);
+
+  char *output = read_file(output_path);
+  assert(output);
+  assert(strstr(output, ".decoder = VIBE_DECODE_INT, "
+                        ".limits = &prompt_limits, .route = \"weather\"};"));
+  assert(strstr(output, "{.function_name = \"count\", "
+                        ".decoder = VIBE_DECODE_INT, .limits = &prompt_limits, "
+                        ".route = \"small\"};"));
+  // Unrouted sites use the function's or the global model
+  assert(strstr(output, "{.function_name = \"describe\", "
+                        ".decoder = VIBE_DECODE_STRING};"));
+  free(output);
+  printf("Model routes test passed\n");
+}
+
+// Test that classes become structs decoded from a schema-constrained reply
+static void test_structured_output() {
+  const char *output_path = "tests/unit/data/structured.output.c";
+  assert(ensure_test_directory());
+  ast_node_t *ast = parse_string(
+      "type Celsius = Meaning<Int>(\"temperature in Celsius\");\n"
+      "class Forecast {\n"
+      "    place: Place;\n"
+      "    high: Celsius;\n"
+      "    windy: Bool;\n"
+      "}\n"
+      "class Place {\n"
+      "    city: String;\n"
+      "}\n"
+      "fn forecast(city: String) -> Forecast {\n"
+      "    prompt \"Forecast for {city}\";\n"
+      "}\n");
+  assert(ast);
+  assert(generate_code(ast, output_path));
+  ast_node_free(ast);
+
+  char *output = read_file(output_path);
+  assert(output);
+  // A class is emitted after the classes it holds
+  char *place = strstr(output, "typedef struct Place {");
+  char *forecast = strstr(output, "typedef struct Forecast {");
+  assert(place && forecast && place < forecast);
+  assert(strstr(output, "    Place place;\n    int high;\n    int windy;\n"));
+  assert(strstr(output, "{\"place\", VIBE_FIELD_OBJECT, "
+                        "offsetof(Forecast, place), &Place_shape},"));
+  assert(strstr(output, "static const VibeObjectShape Forecast_shape = "
+                        "{Forecast_fields, 3, sizeof(Forecast), "
+                        "offsetof(Forecast, vibe_response)};"));
+  // The schema is strict and carries meanings as descriptions
+  assert(strstr(output, "{\\\"type\\\":\\\"json_schema\\\",\\\"json_schema\\\":"
+                        "{\\\"name\\\":\\\"Forecast\\\",\\\"strict\\\":true"));
+  assert(strstr(output, "\\\"high\\\":{\\\"type\\\":\\\"integer\\\","
+                        "\\\"description\\\":\\\"temperature in Celsius\\\"}"));
+  assert(strstr(output, ".decoder = VIBE_DECODE_CUSTOM, "
+                        ".limits = &prompt_limits};"));
+  assert(strstr(output, "vibe_value_get_object(&prompt_result, "
+                        "&Forecast_shape, &prompt_object);"));
+  free(output);
+  printf("Structured output test passed\n");
+}
+
+// Test that a meaning with escapes reaches the site and its instruction as
+// the same text
+static void test_escaped_meaning() {
+  const char *output_path = "tests/unit/data/escaped_meaning.output.c";
+  assert(ensure_test_directory());
+  ast_node_t *ast = parse_string(
+      "type Reading = Meaning<Int>(\"degrees\\\\C\\nplease\");\n"
+      "fn reading() -> Reading {\n"
+      "    prompt \"Read the thermometer.\";\n"
+      "}\n");
+  assert(ast);
+  assert(generate_code(ast, output_path));
+  ast_node_free(ast);
+
+  char *output = read_file(output_path);
+  assert(output);
+  assert(strstr(output, ".meaning = \"degrees\\\\C\\012please\""));
+  assert(strstr(output, ".instruction = \"Reply with only the "
+                        "degrees\\\\C\\012please, as an integer.\""));
+  free(output);
+  printf("Escaped meaning test passed\n");
+}
+
+// Test that a long meaning reaches its instruction whole
+static void test_long_meaning() {
+  const char *output_path = "tests/unit/data/long_meaning.output.c";
+  assert(ensure_test_directory());
+  char meaning[700];
+  memset(meaning, 'x', sizeof(meaning) - 1);
+  meaning[sizeof(meaning) - 1] = '\0';
+  char source[1024];
+  snprintf(source, sizeof(source),
+           "type Reading = Meaning<Int>(\"%s\");\n"
+           "fn reading() -> Reading {\n"
+           "    prompt \"Read the thermometer.\";\n"
+           "}\n",
+           meaning);
+  ast_node_t *ast = parse_string(source);
+  assert(ast);
+  assert(generate_code(ast, output_path));
+  ast_node_free(ast);
+
+  char expected[800];
+  snprintf(expected, sizeof(expected),
+           ".instruction = \"Reply with only the %s, as an integer.\"",
+           meaning);
+  char *output = read_file(output_path);
+  assert(output);
+  assert(strstr(output, expected));
+  free(output);
+  printf("Long meaning test passed\n");
+}
+
+// Answer prompts about France; leave everything else to run time. Yes or
+// no questions get an answer that is neither.
+static char *fake_resolver(const VibePromptSite *site, const char *prompt,
+                           VibeGenerationParams *used) {
+  used->model = "fake-model";
+  if (site->decoder == VIBE_DECODE_BOOL)
+    return strdup("It depends on the pressure.");
+  assert(site->decoder == VIBE_DECODE_STRING);
+  if (strcmp(prompt, "Name a colour.") == 0)
+    return strdup("\"Red\"\n");
+  if (strstr(prompt, "France"))
+    return strdup("Paris");
+  return NULL;
+}
+
+// Test that constant prompts are answered at build time and recorded
+static void test_materialized_prompts() {
+  const char *output_path = "tests/unit/data/materialized.output.c";
+  const char *manifest_path = "tests/unit/data/materialized.output"
+                              ".materialized.json";
+  assert(ensure_test_directory());
+  remove(manifest_path);
+  ast_node_t *ast = parse_string(
+      "fn colour() -> String {\n"
+      "    prompt \"Name a colour.\";\n"
+      "}\n"
+      "fn capital(country: String) -> String {\n"
+      "    prompt \"What is the capital of {country}?\";\n"
+      "}\n"
+      "fn france() -> String {\n"
+      "    return capital(\"France\");\n"
+      "}\n"
+      "fn japan() -> String {\n"
+      "    return capital(\"Japan\");\n"
+      "}\n"
+      "fn boiling() -> Bool {\n"
+      "    prompt \"Does water boil at 90 degrees?\";\n"
+      "}\n");
+  assert(ast);
+  codegen_set_resolver(fake_resolver);
+  assert(generate_code(ast, output_path));
+  codegen_set_resolver(NULL);
+  ast_node_free(ast);
+
+  char *output = read_file(output_path);
+  assert(output);
+  // The generated code does not change with the build date
+  assert(strstr(output, "// Answered at build time\n"));
+  assert(strstr(output, "// Literal arguments answered at build time\n"));
+  // A prompt without variables needs no template at all
+  assert(strstr(output, "vibe_decode_site(&prompt_site, "
+                        "\"\\\"Red\\\"\\012\");"));
+  assert(strstr(output, "vibe_decode_site_stream(&prompt_site, "
+                        "\"\\\"Red\\\"\\012\", on_token, user_data);"));
+  assert(strstr(output, "{\"What is the capital of \", 23, 0},"));
+  // Literal arguments are matched before the request is sent
+  assert(strstr(output, "if (prompt_args[0].length == 6 && "
+                        "memcmp(prompt_args[0].text, \"France\", 6) == 0)"));
+  assert(strstr(output, "prompt_result = vibe_decode_site(&prompt_site, "
+                        "\"Paris\");"));
+  assert(!strstr(output, "\"Japan\", 5"));
+  assert(strstr(output, "    prompt_result = vibe_execute_template("
+                        "&prompt_site, &prompt_template, prompt_args);"));
+  // An answer that does not decode is not embedded
+  assert(!strstr(output, "pressure"));
+  assert(strstr(output, "VibeValue prompt_result = vibe_execute_template("
+                        "&prompt_site, &prompt_template, NULL);"));
+  free(output);
+
+  char *manifest = read_file(manifest_path);
+  assert(manifest);
+  assert(strstr(manifest, "\"prompt\":\t\"What is the capital of France?\""));
+  assert(strstr(manifest, "\"arguments\":\t[\"France\"]"));
+  assert(strstr(manifest, "\"model\":\t\"fake-model\""));
+  assert(!strstr(manifest, "Japan"));
+  assert(!strstr(manifest, "boil"));
+  free(manifest);
+  printf("Materialized prompts test passed\n");
+}
+
 // Main test runner - with simple timeout
 int main() {
   printf("Running code generator tests with timeout protection...\n");
@@ -208,6 +530,27 @@ int main() {
   printf("Running test_meaning_var\n");
   test_meaning_var();
 
+  printf("Running test_compiled_overrides\n");
+  test_compiled_overrides();
+
+  printf("Running test_precompiled_template\n");
+  test_precompiled_template();
+
+  printf("Running test_model_routes\n");
+  test_model_routes();
+
+  printf("Running test_structured_output\n");
+  test_structured_output();
+
+  printf("Running test_escaped_meaning\n");
+  test_escaped_meaning();
+
+  printf("Running test_long_meaning\n");
+  test_long_meaning();
+
+  printf("Running test_materialized_prompts\n");
+  test_materialized_prompts();
+
   printf("All code generator tests completed!\n");
   return 0;
 }
@@ -0,0 +1,127 @@
+#include "../../src/runtime/completion_parser.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Run the extractor on a private, writable copy of a document
+static int extract(const char *json, char **copy, CompletionFields *fields) {
+  *copy = strdup(json);
+  assert(*copy != NULL);
+  return completion_extract(*copy, strlen(*copy), fields);
+}
+
+// Test a complete chat.completion response
+static void test_full_response() {
+  const char *json =
+      "{\n"
+      "  \"id\": \"chatcmpl-1\",\n"
+      "  \"object\": \"chat.completion\",\n"
+      "  \"choices\": [\n"
+      "    {\n"
+      "      \"index\": 0,\n"
+      "      \"message\": {\"role\": \"assistant\",\n"
+      "                  \"content\": \"Sunny, 25\\u00b0C\\n\\\"warm\\\"\"},\n"
+      "      \"logprobs\": null,\n"
+      "      \"finish_reason\": \"stop\"\n"
+      "    },\n"
+      "    {\"index\": 1, \"message\": {\"content\": \"ignored\"}}\n"
+      "  ],\n"
+      "  \"usage\": {\"prompt_tokens\": 12, \"completion_tokens\": 7,\n"
+      "            \"total_tokens\": 19,\n"
+      "            \"completion_tokens_details\": {\"reasoning_tokens\": 0}}\n"
+      "}\n";
+
+  char *copy;
+  CompletionFields fields;
+  assert(extract(json, &copy, &fields));
+  assert(fields.content != NULL);
+  assert(strcmp(fields.content, "Sunny, 25\xc2\xb0" "C\n\"warm\"") == 0);
+  assert(fields.content_length == strlen(fields.content));
+  assert(strcmp(fields.finish_reason, "stop") == 0);
+  assert(fields.prompt_tokens == 12);
+  assert(fields.completion_tokens == 7);
+  assert(fields.total_tokens == 19);
+  free(copy);
+
+  printf("Full response test passed\n");
+}
+
+// Test stream chunks, which carry a delta instead of a message
+static void test_stream_chunks() {
+  char *copy;
+  CompletionFields fields;
+
+  assert(extract("{\"choices\":[{\"index\":0,\"delta\":{\"content\":\"Hel\"},"
+                 "\"finish_reason\":null}]}",
+                 &copy, &fields));
+  assert(strcmp(fields.content, "Hel") == 0);
+  assert(fields.finish_reason == NULL);
+  assert(fields.total_tokens == -1);
+  free(copy);
+
+  assert(extract("{\"choices\":[{\"index\":0,\"delta\":{},"
+                 "\"finish_reason\":\"length\"}]}",
+                 &copy, &fields));
+  assert(fields.content == NULL);
+  assert(strcmp(fields.finish_reason, "length") == 0);
+  free(copy);
+
+  printf("Stream chunk test passed\n");
+}
+
+// Test escapes: surrogate pairs, escaped backslashes before quotes and keys
+// that only look like the ones the extractor wants
+static void test_escapes() {
+  char *copy;
+  CompletionFields fields;
+
+  assert(extract("{\"note\":\"\\\\\",\"x\\\"choices\":[],"
+                 "\"choices\":[{\"message\":{\"content\":"
+                 "\"\\ud83d\\ude00 \\\\\\\" \\/ \\t\\ud800\"}}]}",
+                 &copy, &fields));
+  assert(strcmp(fields.content, "\xf0\x9f\x98\x80 \\\" / \t\xef\xbf\xbd") ==
+         0);
+  free(copy);
+
+  assert(extract("{\"choices\":[{\"message\":{\"content\":null}}]}", &copy,
+                 &fields));
+  assert(fields.content == NULL);
+  free(copy);
+
+  printf("Escape test passed\n");
+}
+
+// Test that malformed documents are rejected
+static void test_malformed() {
+  const char *documents[] = {
+      "",
+      "[]",
+      "{\"choices\":[{\"message\":{\"content\":\"unterminated}}]}",
+      "{\"choices\":[{\"message\":{\"content\":\"bad \\q escape\"}}]}",
+      "{\"choices\":[{\"message\":{\"content\":\"x\"}}]",
+      "{\"choices\" [] }",
+      "{\"choices\":[]} trailing",
+  };
+
+  for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+    char *copy;
+    CompletionFields fields;
+    assert(!extract(documents[i], &copy, &fields));
+    free(copy);
+  }
+
+  printf("Malformed document test passed\n");
+}
+
+int main() {
+  printf("Running completion parser tests...\n");
+
+  test_full_response();
+  test_stream_chunks();
+  test_escapes();
+  test_malformed();
+
+  printf("All completion parser tests passed!\n");
+  return 0;
+}
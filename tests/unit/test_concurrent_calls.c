@@ -0,0 +1,512 @@
+#include "../../include/runtime.h"
+#include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Identical calls made at once by the coalescing test
+#define CALLERS 8
+
+// Threads making calls from the first init on, and the most calls each makes
+#define WORKERS 8
+#define WORKER_CALLS 4
+
+// Threads that stay idle with a session across a runtime restart
+#define IDLERS 2
+
+// Most batch pool workers at once, and how long an idle one waits before it
+// exits in this test's configuration
+#define POOL_MAX_WORKERS 64
+#define POOL_IDLE_MS 1000
+
+// A chat completions server on a Unix-domain socket. Every answer is held
+// back for delay_ms so that calls made together overlap. A prompt
+// containing "Question <n>" is answered "Answer <n>"; one containing "fail"
+// gets a 400.
+static struct {
+  char path[108];
+  int fd;
+  pthread_t thread;
+  long delay_ms;
+  atomic_int requests;
+
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+  int connections; // Being answered
+} server = {.lock = PTHREAD_MUTEX_INITIALIZER,
+            .idle = PTHREAD_COND_INITIALIZER};
+
+static void sleep_ms(long ms) {
+  struct timespec delay = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&delay, NULL);
+}
+
+// Read a request's headers and body into buffer, NUL terminated
+static int read_request(int fd, char *buffer, size_t size) {
+  size_t length = 0;
+  char *body = NULL;
+  size_t content_length = 0;
+  while (length + 1 < size) {
+    ssize_t n = read(fd, buffer + length, size - 1 - length);
+    if (n <= 0)
+      return 0;
+    length += (size_t)n;
+    buffer[length] = '\0';
+    if (!body && (body = strstr(buffer, "\r\n\r\n"))) {
+      body += 4;
+      for (char *line = buffer; line < body; line = strstr(line, "\n") + 1) {
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+          content_length = strtoul(line + 15, NULL, 10);
+      }
+    }
+    if (body && length - (size_t)(body - buffer) >= content_length)
+      return 1;
+  }
+  return 0;
+}
+
+static void *answer_connection(void *arg) {
+  int fd = (int)(intptr_t)arg;
+  char request[8192];
+  if (read_request(fd, request, sizeof(request))) {
+    atomic_fetch_add(&server.requests, 1);
+    sleep_ms(server.delay_ms);
+
+    char body[256];
+    int status = 200;
+    const char *question = strstr(request, "Question ");
+    if (strstr(request, "fail")) {
+      status = 400;
+      snprintf(body, sizeof(body), "{\"error\":{\"message\":\"refused\"}}");
+    } else {
+      snprintf(body, sizeof(body),
+               "{\"choices\":[{\"message\":{\"role\":\"assistant\","
+               "\"content\":\"Answer %d\"},\"finish_reason\":\"stop\"}]}",
+               question ? atoi(question + 9) : 0);
+    }
+    char response[512];
+    int length = snprintf(response, sizeof(response),
+                          "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                          "Content-Length: %zu\r\nConnection: close\r\n\r\n%s",
+                          status, status == 200 ? "OK" : "Bad Request",
+                          strlen(body), body);
+    ssize_t written = write(fd, response, (size_t)length);
+    assert(written == length);
+    (void)written;
+  }
+  close(fd);
+
+  pthread_mutex_lock(&server.lock);
+  if (--server.connections == 0)
+    pthread_cond_broadcast(&server.idle);
+  pthread_mutex_unlock(&server.lock);
+  return NULL;
+}
+
+static void *serve(void *arg) {
+  (void)arg;
+  for (;;) {
+    int fd = accept(server.fd, NULL, NULL);
+    if (fd < 0)
+      return NULL; // Stopped
+
+    pthread_mutex_lock(&server.lock);
+    server.connections++;
+    pthread_mutex_unlock(&server.lock);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, answer_connection,
+                       (void *)(intptr_t)fd) == 0) {
+      pthread_detach(thread);
+    } else {
+      close(fd);
+      pthread_mutex_lock(&server.lock);
+      server.connections--;
+      pthread_mutex_unlock(&server.lock);
+    }
+  }
+}
+
+static void server_start(const char *path, long delay_ms) {
+  snprintf(server.path, sizeof(server.path), "%s", path);
+  server.delay_ms = delay_ms;
+  server.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  assert(server.fd >= 0);
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+  unlink(path);
+  assert(bind(server.fd, (struct sockaddr *)&address, sizeof(address)) == 0);
+  assert(listen(server.fd, 64) == 0);
+  assert(pthread_create(&server.thread, NULL, serve, NULL) == 0);
+}
+
+// Wait until every connection has been answered and its thread is done
+static void server_wait_idle(void) {
+  pthread_mutex_lock(&server.lock);
+  while (server.connections > 0)
+    pthread_cond_wait(&server.idle, &server.lock);
+  pthread_mutex_unlock(&server.lock);
+}
+
+static void server_stop(void) {
+  shutdown(server.fd, SHUT_RDWR);
+  close(server.fd);
+  pthread_join(server.thread, NULL);
+  server_wait_idle();
+  unlink(server.path);
+}
+
+// Threads in this process, batch pool workers included
+static int count_threads(void) {
+  server_wait_idle();
+  DIR *tasks = opendir("/proc/self/task");
+  assert(tasks);
+  int count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(tasks)))
+    count += entry->d_name[0] != '.';
+  closedir(tasks);
+  return count;
+}
+
+// Ask "Question <n>" and check that the answer is "Answer <n>"
+static int ask(int question) {
+  char prompt[32], expected[32];
+  snprintf(prompt, sizeof(prompt), "Question %d", question);
+  snprintf(expected, sizeof(expected), "Answer %d", question);
+  VibeValue result = vibe_execute_prompt(prompt, NULL);
+  if (result.type != VIBE_STRING)
+    return 0;
+  int answered = strcmp(result.data.string_val, expected) == 0;
+  free(result.data.string_val);
+  return answered;
+}
+
+// A thread that initializes the runtime, makes its calls and exits
+typedef struct {
+  pthread_barrier_t *start;
+  int id;
+  int calls;
+  int answered;
+} Worker;
+
+static void *work(void *arg) {
+  Worker *worker = (Worker *)arg;
+  pthread_barrier_wait(worker->start);
+  if (vibe_runtime_init() != VIBE_SUCCESS)
+    return NULL;
+  for (int i = 0; i < worker->calls; i++)
+    worker->answered += ask(worker->id * 100 + i);
+  return NULL;
+}
+
+// A thread that makes a call, stays idle while the runtime restarts and
+// then either calls again or exits
+typedef struct {
+  pthread_barrier_t *idle;
+  pthread_barrier_t *restarted;
+  int id;
+  int call_again;
+  int answered;
+} Idler;
+
+static void *idle(void *arg) {
+  Idler *idler = (Idler *)arg;
+  idler->answered += ask(900 + idler->id * 10);
+  pthread_barrier_wait(idler->idle);
+  pthread_barrier_wait(idler->restarted);
+  if (idler->call_again)
+    idler->answered += ask(900 + idler->id * 10 + 1);
+  return NULL;
+}
+
+// Test calls from threads that race to initialize the runtime and exit
+// while others are still calling, then a shutdown and re-init while
+// threads that made calls are still alive
+static void test_threads_and_restart() {
+  pthread_barrier_t start, idle_barrier, restarted;
+  pthread_barrier_init(&start, NULL, WORKERS);
+  pthread_barrier_init(&idle_barrier, NULL, IDLERS + 1);
+  pthread_barrier_init(&restarted, NULL, IDLERS + 1);
+  int requests = atomic_load(&server.requests);
+  long delay_ms = server.delay_ms;
+  server.delay_ms = 20;
+
+  // Worker i makes i % WORKER_CALLS + 1 calls, so some exit after one call
+  // while others keep calling
+  Worker workers[WORKERS];
+  pthread_t worker_threads[WORKERS];
+  int calls = 0;
+  for (int i = 0; i < WORKERS; i++) {
+    workers[i] = (Worker){.start = &start, .id = i,
+                          .calls = i % WORKER_CALLS + 1};
+    calls += workers[i].calls;
+    assert(pthread_create(&worker_threads[i], NULL, work, &workers[i]) == 0);
+  }
+  for (int i = 0; i < WORKERS; i++) {
+    pthread_join(worker_threads[i], NULL);
+    assert(workers[i].answered == workers[i].calls);
+  }
+
+  // Idler 0 calls again through its detached session once the runtime is
+  // back; idler 1 exits and frees its detached session
+  Idler idlers[IDLERS];
+  pthread_t idle_threads[IDLERS];
+  for (int i = 0; i < IDLERS; i++) {
+    idlers[i] = (Idler){.idle = &idle_barrier, .restarted = &restarted,
+                        .id = i, .call_again = i == 0};
+    calls += 1 + idlers[i].call_again;
+    assert(pthread_create(&idle_threads[i], NULL, idle, &idlers[i]) == 0);
+  }
+  pthread_barrier_wait(&idle_barrier);
+  vibe_runtime_shutdown();
+  assert(vibe_runtime_init() == VIBE_SUCCESS);
+  pthread_barrier_wait(&restarted);
+  for (int i = 0; i < IDLERS; i++) {
+    pthread_join(idle_threads[i], NULL);
+    assert(idlers[i].answered == 1 + idlers[i].call_again);
+  }
+
+  // A thread with no session before the restart gets a new one
+  assert(ask(999));
+  calls++;
+  assert(atomic_load(&server.requests) == requests + calls);
+
+  server.delay_ms = delay_ms;
+  pthread_barrier_destroy(&start);
+  pthread_barrier_destroy(&idle_barrier);
+  pthread_barrier_destroy(&restarted);
+  printf("Threads and restart test passed\n");
+}
+
+// One of several callers asking the same question at once
+typedef struct {
+  pthread_barrier_t *start;
+  const char *prompt;
+  VibeValue result;
+  VibeError error;
+} Caller;
+
+static void *call_prompt(void *arg) {
+  Caller *caller = (Caller *)arg;
+  pthread_barrier_wait(caller->start);
+  caller->result = vibe_execute_prompt(caller->prompt, NULL);
+  caller->error = vibe_last_error();
+  return NULL;
+}
+
+// Ask the same question from CALLERS threads at once
+static void call_together(const char *prompt, Caller *callers) {
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, CALLERS);
+  pthread_t threads[CALLERS];
+  for (int i = 0; i < CALLERS; i++) {
+    callers[i] = (Caller){.start = &start, .prompt = prompt};
+    assert(pthread_create(&threads[i], NULL, call_prompt, &callers[i]) == 0);
+  }
+  for (int i = 0; i < CALLERS; i++)
+    pthread_join(threads[i], NULL);
+  pthread_barrier_destroy(&start);
+}
+
+// Test that identical calls made at once send one request, that every
+// caller gets its own copy of the response and that a failure reaches all
+static void test_coalescing() {
+  Caller callers[CALLERS];
+  VibeCacheStats stats;
+
+  vibe_cache_clear();
+  int requests = atomic_load(&server.requests);
+  call_together("Question 7", callers);
+  assert(atomic_load(&server.requests) == requests + 1);
+  vibe_cache_stats(&stats);
+  assert(stats.coalesced == CALLERS - 1);
+  for (int i = 0; i < CALLERS; i++) {
+    assert(callers[i].error == VIBE_SUCCESS);
+    assert(callers[i].result.type == VIBE_STRING);
+    assert(strcmp(callers[i].result.data.string_val, "Answer 7") == 0);
+    for (int j = 0; j < i; j++)
+      assert(callers[i].result.data.string_val !=
+             callers[j].result.data.string_val);
+  }
+  for (int i = 0; i < CALLERS; i++)
+    free(callers[i].result.data.string_val);
+
+  vibe_cache_clear();
+  requests = atomic_load(&server.requests);
+  call_together("Question 8, then fail", callers);
+  assert(atomic_load(&server.requests) == requests + 1);
+  vibe_cache_stats(&stats);
+  assert(stats.coalesced == CALLERS - 1);
+  for (int i = 0; i < CALLERS; i++) {
+    assert(callers[i].result.type == VIBE_NULL);
+    assert(callers[i].error == VIBE_ERROR_LLM_CONNECTION_FAILED);
+  }
+
+  printf("Coalescing test passed\n");
+}
+
+// Run a batch asking "Question <first + i>" for every item and return the
+// number of items answered correctly
+static int run_batch(int first, size_t count, int max_concurrency) {
+  VibePromptRequest *requests = calloc(count, sizeof(VibePromptRequest));
+  char(*prompts)[32] = calloc(count, sizeof(*prompts));
+  VibeValue *results = calloc(count, sizeof(VibeValue));
+  VibeError *errors = calloc(count, sizeof(VibeError));
+  assert(requests && prompts && results && errors);
+  for (size_t i = 0; i < count; i++) {
+    snprintf(prompts[i], sizeof(prompts[i]), "Question %d", first + (int)i);
+    requests[i].prompt = prompts[i];
+  }
+
+  int answered = 0;
+  if (vibe_execute_prompts_batch(requests, count, max_concurrency, results,
+                                 errors) == VIBE_SUCCESS) {
+    for (size_t i = 0; i < count; i++) {
+      char expected[32];
+      snprintf(expected, sizeof(expected), "Answer %d", first + (int)i);
+      answered += errors[i] == VIBE_SUCCESS &&
+                  results[i].type == VIBE_STRING &&
+                  strcmp(results[i].data.string_val, expected) == 0;
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (results[i].type == VIBE_STRING)
+      free(results[i].data.string_val);
+  }
+  free(requests);
+  free(prompts);
+  free(results);
+  free(errors);
+  return answered;
+}
+
+// Test that a batch asking for more workers than the pool holds gets the
+// pool's limit, and that idle workers exit and are replaced by the next
+// batch
+static void test_batch_pool_limit() {
+  server.delay_ms = 20;
+  int threads = count_threads();
+
+  // The transport allows 100 connections, so only the pool limit applies
+  assert(run_batch(2000, 130, 200) == 130);
+  assert(count_threads() == threads + POOL_MAX_WORKERS);
+
+  // Once idle the workers exit, and the next batch starts only those it
+  // needs
+  int waited_ms = 0;
+  while (count_threads() > threads && waited_ms < 10 * POOL_IDLE_MS) {
+    sleep_ms(50);
+    waited_ms += 50;
+  }
+  assert(count_threads() == threads);
+  assert(waited_ms >= POOL_IDLE_MS / 2);
+  assert(run_batch(2200, 8, 4) == 8);
+  assert(count_threads() == threads + 3);
+
+  printf("Batch pool limit test passed\n");
+}
+
+typedef struct {
+  pthread_barrier_t *start;
+  int first;
+  int answered;
+} BatchCaller;
+
+static void *call_batch(void *arg) {
+  BatchCaller *caller = (BatchCaller *)arg;
+  pthread_barrier_wait(caller->start);
+  caller->answered = run_batch(caller->first, 40, 16);
+  return NULL;
+}
+
+// Test that batches posted from two threads at once share the pool and
+// each get their own answers
+static void test_overlapping_batches() {
+  server.delay_ms = 20;
+  int threads = count_threads();
+
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, 2);
+  BatchCaller callers[2] = {{&start, 3000, 0}, {&start, 3100, 0}};
+  pthread_t batch_threads[2];
+  for (int i = 0; i < 2; i++)
+    assert(pthread_create(&batch_threads[i], NULL, call_batch,
+                          &callers[i]) == 0);
+  for (int i = 0; i < 2; i++) {
+    pthread_join(batch_threads[i], NULL);
+    assert(callers[i].answered == 40);
+  }
+  pthread_barrier_destroy(&start);
+
+  // Both callers worked on their own batch, so the pool needed no more
+  // workers than the two batches asked for together
+  assert(count_threads() <= threads + 2 * 15);
+
+  printf("Overlapping batches test passed\n");
+}
+
+// Test that a batch after a shutdown starts a new pool
+static void test_batch_after_shutdown() {
+  server.delay_ms = 20;
+  assert(run_batch(4000, 16, 8) == 16);
+  int threads = count_threads();
+
+  // Shutdown joins the pool workers and the transfer engine
+  vibe_runtime_shutdown();
+  int stopped = count_threads();
+  assert(stopped <= threads - 8);
+
+  // The batch restarts the runtime, then the pool with its seven workers
+  assert(run_batch(4100, 16, 8) == 16);
+  assert(count_threads() == stopped + 1 + 7);
+
+  printf("Batch after shutdown test passed\n");
+}
+
+int main() {
+  printf("Running concurrent call tests...\n");
+
+  // The runtime reads vibeconfig.json from the working directory, so the
+  // test gets one of its own
+  char directory[] = "/tmp/vibelang_calls_XXXXXX";
+  assert(mkdtemp(directory));
+  assert(chdir(directory) == 0);
+  char socket_path[108];
+  snprintf(socket_path, sizeof(socket_path), "%s/server.sock", directory);
+  FILE *config = fopen("vibeconfig.json", "w");
+  assert(config);
+  fprintf(config,
+          "{\"global\": {\"api_key\": \"sk-test\", \"default_params\": "
+          "{\"model\": \"gpt-3.5-turbo\", \"endpoint\": \"unix:%s\"}, "
+          "\"transport\": {\"max_host_connections\": 100, "
+          "\"batch_idle_ms\": %d}}}\n",
+          socket_path, POOL_IDLE_MS);
+  fclose(config);
+  unsetenv("VIBELANG_DEV_MODE");
+  setenv("OPENAI_API_KEY", "sk-test", 1);
+
+  server_start(socket_path, 300);
+
+  test_threads_and_restart();
+  test_coalescing();
+  test_batch_pool_limit();
+  test_overlapping_batches();
+  test_batch_after_shutdown();
+
+  vibe_runtime_shutdown();
+  server_stop();
+  remove("vibeconfig.json");
+  assert(chdir("/") == 0);
+  rmdir(directory);
+  printf("All concurrent call tests passed!\n");
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include "../../src/runtime/hedging.h"
+#include <assert.h>
+#include <stdio.h>
+
+// Test that the trigger follows the configured percentile once enough
+// latencies have been seen
+static void test_delay() {
+  HedgeConfig config = {1, 90.0, 0, 0.0};
+  hedge_reset();
+
+  for (long i = 1; i <= 19; i++)
+    hedge_record_latency(i * 10);
+  assert(hedge_delay_ms(&config) == -1); // Too few samples
+
+  for (long i = 20; i <= 100; i++)
+    hedge_record_latency(i * 10);
+  assert(hedge_delay_ms(&config) == 900);
+
+  config.percentile = 50.0;
+  assert(hedge_delay_ms(&config) == 510);
+
+  config.min_delay_ms = 2000;
+  assert(hedge_delay_ms(&config) == 2000);
+
+  config.enabled = 0;
+  assert(hedge_delay_ms(&config) == -1);
+
+  printf("Hedge delay test passed\n");
+}
+
+// Test that duplicates are limited to the budgeted share of requests
+static void test_budget() {
+  HedgeConfig config = {1, 95.0, 0, 0.25};
+  hedge_reset();
+  for (int i = 0; i < 20; i++)
+    hedge_record_latency(100);
+
+  int granted = 0;
+  for (int i = 0; i < 100; i++) {
+    assert(hedge_delay_ms(&config) == 100);
+    granted += hedge_acquire();
+  }
+  assert(granted == 25);
+
+  HedgeStats stats;
+  hedge_stats(&stats);
+  assert(stats.hedges == 25);
+  assert(stats.denied == 75);
+
+  // Savings are capped, so a quiet period cannot fund a large burst
+  for (int i = 0; i < 1000; i++)
+    hedge_delay_ms(&config);
+  granted = 0;
+  for (int i = 0; i < 100; i++)
+    granted += hedge_acquire();
+  assert(granted == 10);
+
+  hedge_reset();
+  printf("Hedge budget test passed\n");
+}
+
+int main() {
+  printf("Running hedging tests...\n");
+
+  test_delay();
+  test_budget();
+
+  printf("All hedging tests passed!\n");
+  return 0;
+}
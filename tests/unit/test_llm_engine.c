@@ -0,0 +1,131 @@
+#include "../../src/runtime/llm_engine.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// A completion callback that blocks until the test lets it return
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int entered;
+  int released;
+} Gate;
+
+static Gate gate = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0,
+                    0};
+
+static void gated_done(LLMTransfer *transfer, void *user_data) {
+  (void)transfer;
+  (void)user_data;
+  pthread_mutex_lock(&gate.lock);
+  gate.entered = 1;
+  pthread_cond_broadcast(&gate.cond);
+  while (!gate.released)
+    pthread_cond_wait(&gate.cond, &gate.lock);
+  pthread_mutex_unlock(&gate.lock);
+}
+
+static size_t discard(char *data, size_t size, size_t count, void *user) {
+  (void)data;
+  (void)user;
+  return size * count;
+}
+
+// Test that cancelling a transfer while its completion callback runs, as a
+// hedge race or a cancel token may, leaves the engine idle
+static void test_cancel_while_completing(const char *url) {
+  CURL *easy = curl_easy_init();
+  assert(easy);
+  curl_easy_setopt(easy, CURLOPT_URL, url);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, discard);
+
+  LLMTransfer transfer;
+  llm_transfer_init(&transfer, easy);
+  transfer.on_done = gated_done;
+  assert(llm_engine_submit(&transfer));
+
+  pthread_mutex_lock(&gate.lock);
+  while (!gate.entered)
+    pthread_cond_wait(&gate.cond, &gate.lock);
+  pthread_mutex_unlock(&gate.lock);
+
+  // The callback is running with the engine unlocked
+  llm_engine_abort(&transfer);
+  pthread_mutex_lock(&gate.lock);
+  gate.released = 1;
+  pthread_cond_broadcast(&gate.cond);
+  pthread_mutex_unlock(&gate.lock);
+
+  llm_engine_cancel(&transfer);
+  assert(transfer.state == LLM_TRANSFER_DONE);
+  assert(transfer.result == CURLE_OK && !transfer.cancelled);
+  assert(llm_engine_idle());
+
+  llm_transfer_destroy(&transfer);
+  curl_easy_cleanup(easy);
+  printf("Cancel while completing test passed\n");
+}
+
+// Record the thread a completion callback runs on
+static void record_thread(LLMTransfer *transfer, void *user_data) {
+  (void)transfer;
+  *(pthread_t *)user_data = pthread_self();
+}
+
+// Test that aborting transfers, most of them still queued, runs their
+// completion callbacks on the engine thread rather than the caller's
+static void test_abort_queued(const char *url) {
+  enum { COUNT = 8 };
+  CURL *easy[COUNT];
+  LLMTransfer transfers[COUNT];
+  pthread_t threads[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    easy[i] = curl_easy_init();
+    assert(easy[i]);
+    curl_easy_setopt(easy[i], CURLOPT_URL, url);
+    curl_easy_setopt(easy[i], CURLOPT_WRITEFUNCTION, discard);
+    llm_transfer_init(&transfers[i], easy[i]);
+    transfers[i].on_done = record_thread;
+    transfers[i].user_data = &threads[i];
+    threads[i] = pthread_self();
+  }
+  for (int i = 0; i < COUNT; i++) {
+    assert(llm_engine_submit(&transfers[i]));
+    llm_engine_abort(&transfers[i]);
+  }
+
+  for (int i = 0; i < COUNT; i++) {
+    llm_engine_wait(&transfers[i]);
+    assert(transfers[i].state == LLM_TRANSFER_DONE);
+    assert(!pthread_equal(threads[i], pthread_self()));
+    llm_transfer_destroy(&transfers[i]);
+    curl_easy_cleanup(easy[i]);
+  }
+  assert(llm_engine_idle());
+  printf("Abort queued transfers test passed\n");
+}
+
+int main() {
+  printf("Running LLM engine tests...\n");
+
+  // A local file completes at once without any network
+  char path[] = "/tmp/test_llm_engine_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  char url[64];
+  snprintf(url, sizeof(url), "file://%s", path);
+
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  assert(llm_engine_start());
+  test_cancel_while_completing(url);
+  test_abort_queued(url);
+  llm_engine_stop();
+  curl_global_cleanup();
+  remove(path);
+
+  printf("All LLM engine tests passed!\n");
+  return 0;
+}
@@ -1,6 +1,8 @@
 #include "../../include/runtime.h"
 #include "../../include/vibelang.h"
+#include "../../src/runtime/llm_engine.h"
 #include "../../src/runtime/llm_interface.h"
+#include "../../src/runtime/sse_parser.h"
 #include "../../src/utils/log_utils.h"
 #include <assert.h>
 #include <errno.h>
@@ -43,6 +45,26 @@ static void create_test_config() {
                        "      \"model\": \"gpt-3.5-turbo\",\n"
                        "      \"temperature\": 0.7,\n"
                        "      \"max_tokens\": 150\n"
+                       "    },\n"
+                       "    \"retry\": {\"base_delay_ms\": 100}\n"
+                       "  },\n"
+                       "  \"overrides\": {\n"
+                       "    \"uncachedFunction\": {\n"
+                       "      \"cache\": false,\n"
+                       "      \"retry\": {\"max_attempts\": 5,\n"
+                       "                \"retryable_status\": [429]}\n"
+                       "    },\n"
+                       "    \"localFunction\": {\n"
+                       "      \"endpoint\": \"unix:/run/gateway.sock\"\n"
+                       "    },\n"
+                       "    \"gatewayFunction\": {\n"
+                       "      \"endpoint\": \"unix:/run/gateway.sock:/v2/chat\"\n"
+                       "    },\n"
+                       "    \"plainFunction\": {\n"
+                       "      \"endpoint\": \"http://127.0.0.1:8000/v1/chat\"\n"
+                       "    },\n"
+                       "    \"tinyFunction\": {\n"
+                       "      \"max_prompt_tokens\": 2\n"
                        "    }\n"
                        "  }\n"
                        "}\n");
@@ -103,6 +125,34 @@ static int test_format_prompt() {
   return 1;
 }
 
+// Test rendering a precompiled template, with a repeated slot
+static int test_render_prompt() {
+  current_test = "test_render_prompt";
+  printf("Testing render_prompt()...\n");
+
+  static const VibePromptSegment segments[] = {
+      {"Compare ", 8, 0}, {" with ", 6, 1}, {"; prefer ", 9, 0}, {".", 1, -1}};
+  static const VibePromptTemplate template = {segments, 4, 2, 24};
+  VibePromptArg args[2] = {{"tea leaves", 3}, {NULL, 0}};
+
+  char rendered[64];
+  size_t length = render_prompt(&template, args, NULL);
+  SAFE_ASSERT(length == 30);
+  SAFE_ASSERT(render_prompt(&template, args, rendered) == length);
+  SAFE_ASSERT(strcmp(rendered, "Compare tea with ; prefer tea.") == 0);
+
+  // Markers are replaced once, even if a value looks like a marker
+  char *var_names[2] = {"a", "b"};
+  char *var_values[2] = {"{b}", "x"};
+  char *formatted = format_prompt("{a}{b}{c}{", var_names, var_values, 2);
+  SAFE_ASSERT(formatted != NULL);
+  SAFE_ASSERT(strcmp(formatted, "{b}x{c}{") == 0);
+  free(formatted);
+
+  printf("render_prompt() test passed!\n");
+  return 1;
+}
+
 // Test the LLM connection initialization
 static int test_llm_connection() {
   current_test = "test_llm_connection";
@@ -156,7 +206,7 @@ static int test_send_prompt() {
   printf("  Sending prompt: '%s'\n", test_prompt);
 
   // Call with explicit NULL for meaning to verify it works
-  char *weather_response = send_llm_prompt(test_prompt, NULL);
+  char *weather_response = send_llm_prompt(test_prompt, NULL, NULL);
 
   printf("  Response received: %p\n", (void *)weather_response);
   SAFE_ASSERT(weather_response != NULL);
@@ -167,7 +217,7 @@ static int test_send_prompt() {
   // Test with a temperature-related prompt
   printf("  Sending temperature prompt...\n");
   char *temp_response = send_llm_prompt("What is the temperature in Paris?",
-                                        "temperature in Celsius");
+                                        "temperature in Celsius", NULL);
   SAFE_ASSERT(temp_response != NULL);
   printf("  Temperature response: %s\n", temp_response);
 
@@ -183,6 +233,79 @@ static int test_send_prompt() {
   return 1;
 }
 
+// Collects the body of a file:// transfer driven by the engine
+typedef struct {
+  char data[64];
+  size_t size;
+} EngineTestBuffer;
+
+static size_t engine_test_write(void *contents, size_t size, size_t nmemb,
+                                void *userp) {
+  EngineTestBuffer *buf = (EngineTestBuffer *)userp;
+  size_t len = size * nmemb;
+  if (buf->size + len >= sizeof(buf->data))
+    return 0;
+  memcpy(buf->data + buf->size, contents, len);
+  buf->size += len;
+  buf->data[buf->size] = '\0';
+  return len;
+}
+
+// Test that the transfer engine keeps several transfers in flight at once
+static int test_engine_concurrent() {
+  current_test = "test_engine_concurrent";
+  printf("Testing concurrent transfers through the engine...\n");
+
+  const char *path = "engine_test_payload.txt";
+  FILE *payload = fopen(path, "w");
+  SAFE_ASSERT(payload != NULL);
+  fputs("engine payload", payload);
+  fclose(payload);
+
+  char cwd[512];
+  SAFE_ASSERT(getcwd(cwd, sizeof(cwd)) != NULL);
+  char url[600];
+  snprintf(url, sizeof(url), "file://%s/%s", cwd, path);
+
+  SAFE_ASSERT(init_llm_connection() == 1);
+
+  enum { TRANSFER_COUNT = 8 };
+  CURL *handles[TRANSFER_COUNT];
+  LLMTransfer transfers[TRANSFER_COUNT];
+  EngineTestBuffer buffers[TRANSFER_COUNT];
+
+  // Submit everything before waiting on anything
+  for (int i = 0; i < TRANSFER_COUNT; i++) {
+    buffers[i].size = 0;
+    handles[i] = curl_easy_init();
+    SAFE_ASSERT(handles[i] != NULL);
+    curl_easy_setopt(handles[i], CURLOPT_URL, url);
+    curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, engine_test_write);
+    curl_easy_setopt(handles[i], CURLOPT_WRITEDATA, &buffers[i]);
+    llm_engine_configure_handle(handles[i], url);
+    llm_transfer_init(&transfers[i], handles[i]);
+    SAFE_ASSERT(llm_engine_submit(&transfers[i]) == 1);
+  }
+
+  int ok = 1;
+  for (int i = 0; i < TRANSFER_COUNT; i++) {
+    llm_engine_wait(&transfers[i]);
+    if (transfers[i].result != CURLE_OK ||
+        strcmp(buffers[i].data, "engine payload") != 0) {
+      ok = 0;
+    }
+    llm_transfer_destroy(&transfers[i]);
+    curl_easy_cleanup(handles[i]);
+  }
+
+  close_llm_connection();
+  remove(path);
+  SAFE_ASSERT(ok);
+
+  printf("Concurrent engine test passed!\n");
+  return 1;
+}
+
 // Test the VibeValue creation and access functions
 static int test_vibe_values() {
   current_test = "test_vibe_values";
@@ -255,6 +378,11 @@ static int test_execute_prompt() {
     free(result.data.string_val);
   }
 
+  // The meaning that always gave a number still does
+  result = vibe_execute_prompt("What is the temperature in Tokyo?",
+                               "temperature in Celsius");
+  SAFE_ASSERT(result.type == VIBE_NUMBER);
+
   printf("  Shutting down runtime...\n");
   vibe_runtime_shutdown();
 
@@ -262,6 +390,266 @@ static int test_execute_prompt() {
   return 1;
 }
 
+// Collects the events produced by the SSE parser
+typedef struct {
+  char events[4][32];
+  int count;
+} SSETestEvents;
+
+static int sse_test_event(char *data, size_t length, void *user_data) {
+  SSETestEvents *events = (SSETestEvents *)user_data;
+  if (events->count >= 4 || length >= sizeof(events->events[0]))
+    return 0;
+  memcpy(events->events[events->count], data, length + 1);
+  events->count++;
+  return strcmp(data, "[DONE]") != 0;
+}
+
+// Test that the SSE parser reassembles events split across arbitrary chunks
+static int test_sse_parser() {
+  current_test = "test_sse_parser";
+  printf("Testing SSE parser...\n");
+
+  const char *stream = ": keep-alive\r\n\r\n"
+                       "data: {\"a\":1}\r\n\r\n"
+                       "event: message\n"
+                       "data: line one\n"
+                       "data: line two\n\n"
+                       "data: [DONE]\n\n"
+                       "data: ignored\n\n";
+  size_t length = strlen(stream);
+
+  // Feed the stream whole, one byte at a time and in odd-sized chunks
+  size_t steps[] = {length, 1, 7};
+  for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+    size_t step = steps[s];
+    SSETestEvents events;
+    memset(&events, 0, sizeof(events));
+    SSEParser parser;
+    sse_parser_init(&parser, sse_test_event, &events);
+    for (size_t pos = 0; pos < length; pos += step) {
+      size_t chunk = length - pos < step ? length - pos : step;
+      if (!sse_parser_feed(&parser, stream + pos, chunk))
+        break;
+    }
+    sse_parser_free(&parser);
+
+    SAFE_ASSERT(events.count == 3);
+    SAFE_ASSERT(strcmp(events.events[0], "{\"a\":1}") == 0);
+    SAFE_ASSERT(strcmp(events.events[1], "line one\nline two") == 0);
+    SAFE_ASSERT(strcmp(events.events[2], "[DONE]") == 0);
+  }
+
+  printf("SSE parser test passed!\n");
+  return 1;
+}
+
+static void stream_test_token(const char *delta, size_t length,
+                              void *user_data) {
+  size_t *received = (size_t *)user_data;
+  if (strlen(delta) == length)
+    *received += length;
+}
+
+// Test streaming a prompt through the runtime
+static int test_execute_prompt_stream() {
+  current_test = "test_execute_prompt_stream";
+  printf("Testing vibe_execute_prompt_stream()...\n");
+
+  size_t received = 0;
+  VibeValue result = vibe_execute_prompt_stream(
+      "What is the weather like in Tokyo?", "weather description",
+      stream_test_token, &received);
+
+  SAFE_ASSERT(result.type == VIBE_STRING);
+  SAFE_ASSERT(result.data.string_val != NULL);
+  SAFE_ASSERT(strstr(result.data.string_val, "Sunny") != NULL);
+  SAFE_ASSERT(received == strlen(result.data.string_val));
+
+  free(result.data.string_val);
+  vibe_runtime_shutdown();
+
+  printf("vibe_execute_prompt_stream() test passed!\n");
+  return 1;
+}
+
+// Test that repeated prompts are served from the response cache
+static int test_response_cache() {
+  current_test = "test_response_cache";
+  printf("Testing the response cache...\n");
+
+  VibePromptSite cached = {.function_name = "cachedFunction",
+                           .meaning = "weather description"};
+  VibePromptSite uncached = {.function_name = "uncachedFunction",
+                             .meaning = "weather description"};
+  const char *prompt = "What is the weather like in Oslo?";
+  VibeCacheStats stats;
+
+  for (int i = 0; i < 3; i++) {
+    VibeValue result = vibe_execute_site(&cached, prompt);
+    SAFE_ASSERT(result.type == VIBE_STRING);
+    SAFE_ASSERT(strstr(result.data.string_val, "Sunny") != NULL);
+    free(result.data.string_val);
+  }
+  vibe_cache_stats(&stats);
+  SAFE_ASSERT(stats.misses == 1);
+  SAFE_ASSERT(stats.hits == 2);
+  SAFE_ASSERT(stats.entries == 1);
+
+  // A different meaning is a different request
+  VibePromptSite other = {.function_name = "cachedFunction",
+                          .meaning = "temperature in Celsius",
+                          .decoder = VIBE_DECODE_INT};
+  VibeValue result = vibe_execute_site(&other, prompt);
+  SAFE_ASSERT(result.type == VIBE_NUMBER);
+  vibe_cache_stats(&stats);
+  SAFE_ASSERT(stats.misses == 2);
+  SAFE_ASSERT(stats.entries == 2);
+
+  // Functions that opt out never touch the cache
+  for (int i = 0; i < 2; i++) {
+    result = vibe_execute_site(&uncached, prompt);
+    SAFE_ASSERT(result.type == VIBE_STRING);
+    free(result.data.string_val);
+  }
+  vibe_cache_stats(&stats);
+  SAFE_ASSERT(stats.hits == 2 && stats.misses == 2);
+
+  vibe_cache_clear();
+  vibe_cache_stats(&stats);
+  SAFE_ASSERT(stats.entries == 0 && stats.bytes == 0);
+
+  vibe_runtime_shutdown();
+  printf("Response cache test passed!\n");
+  return 1;
+}
+
+// Test that a batch reports per-item errors without failing the others
+static int test_execute_prompts_batch() {
+  current_test = "test_execute_prompts_batch";
+  printf("Testing vibe_execute_prompts_batch()...\n");
+
+  VibePromptRequest requests[] = {
+      {"What is the weather like in Rome?", "weather description", NULL,
+       VIBE_DECODE_STRING},
+      {NULL, NULL, NULL, VIBE_DECODE_STRING},
+      {"What is the temperature in Rome?", "temperature in Celsius", NULL,
+       VIBE_DECODE_INT},
+      {"Say hello", NULL, "uncachedFunction", VIBE_DECODE_STRING},
+  };
+  enum { COUNT = sizeof(requests) / sizeof(requests[0]) };
+  VibeValue results[COUNT];
+  VibeError errors[COUNT];
+
+  VibeError err =
+      vibe_execute_prompts_batch(requests, COUNT, 2, results, errors);
+  SAFE_ASSERT(err == VIBE_ERROR_RUNTIME);
+
+  SAFE_ASSERT(errors[0] == VIBE_SUCCESS);
+  SAFE_ASSERT(results[0].type == VIBE_STRING);
+  SAFE_ASSERT(strstr(results[0].data.string_val, "Sunny") != NULL);
+  SAFE_ASSERT(errors[1] != VIBE_SUCCESS);
+  SAFE_ASSERT(results[1].type == VIBE_NULL);
+  SAFE_ASSERT(errors[2] == VIBE_SUCCESS);
+  SAFE_ASSERT(results[2].type == VIBE_NUMBER);
+  SAFE_ASSERT(results[2].data.number_val == 25);
+  SAFE_ASSERT(errors[3] == VIBE_SUCCESS);
+  SAFE_ASSERT(results[3].type == VIBE_STRING);
+
+  free(results[0].data.string_val);
+  free(results[3].data.string_val);
+  vibe_runtime_shutdown();
+
+  printf("vibe_execute_prompts_batch() test passed!\n");
+  return 1;
+}
+
+// Test that retry settings are inherited from global and overridden per
+// function
+static int test_retry_config() {
+  current_test = "test_retry_config";
+  printf("Testing retry configuration...\n");
+
+  const FunctionConfig *defaults = get_function_config(NULL);
+  SAFE_ASSERT(defaults->retry.base_delay_ms == 100);
+  SAFE_ASSERT(defaults->retry.max_attempts == 3);
+  SAFE_ASSERT(defaults->retry.retryable_status_count == 6);
+
+  const FunctionConfig *function = get_function_config("uncachedFunction");
+  SAFE_ASSERT(function->retry.base_delay_ms == 100);
+  SAFE_ASSERT(function->retry.max_attempts == 5);
+  SAFE_ASSERT(function->retry.retryable_status_count == 1);
+  SAFE_ASSERT(function->retry.retryable_status[0] == 429);
+  free_config();
+
+  printf("Retry configuration test passed!\n");
+  return 1;
+}
+
+// Test that endpoints default to OpenAI and can be set per function, over
+// HTTP or a Unix-domain socket
+static int test_endpoint_config() {
+  current_test = "test_endpoint_config";
+  printf("Testing endpoint configuration...\n");
+
+  const FunctionConfig *defaults = get_function_config(NULL);
+  SAFE_ASSERT(strcmp(defaults->endpoint,
+                     "https://api.openai.com/v1/chat/completions") == 0);
+  SAFE_ASSERT(defaults->unix_socket == NULL);
+
+  const FunctionConfig *function = get_function_config("localFunction");
+  SAFE_ASSERT(strcmp(function->endpoint,
+                     "http://localhost/v1/chat/completions") == 0);
+  SAFE_ASSERT(strcmp(function->unix_socket, "/run/gateway.sock") == 0);
+
+  function = get_function_config("gatewayFunction");
+  SAFE_ASSERT(strcmp(function->endpoint, "http://localhost/v2/chat") == 0);
+  SAFE_ASSERT(strcmp(function->unix_socket, "/run/gateway.sock") == 0);
+
+  function = get_function_config("plainFunction");
+  SAFE_ASSERT(strcmp(function->endpoint, "http://127.0.0.1:8000/v1/chat") ==
+              0);
+  SAFE_ASSERT(function->unix_socket == NULL);
+
+  // Other overrides inherit the global endpoint
+  function = get_function_config("uncachedFunction");
+  SAFE_ASSERT(strcmp(function->endpoint, defaults->endpoint) == 0);
+  free_config();
+
+  printf("Endpoint configuration test passed!\n");
+  return 1;
+}
+
+// Test that a prompt over its token budget is reported apart from other
+// failures
+static int test_last_error() {
+  current_test = "test_last_error";
+  printf("Testing vibe_last_error()...\n");
+
+  SAFE_ASSERT(vibe_runtime_init() == VIBE_SUCCESS);
+
+  // The template alone is over the budget, so no argument can be shortened
+  // to fit it
+  static const VibePromptSegment segments[] = {
+      {"Describe the weather in ", 24, 0}, {" in great detail.", 17, -1}};
+  static const VibePromptTemplate template = {segments, 2, 1, 41};
+  VibePromptArg args[1] = {{"Tokyo", 5}};
+  VibePromptSite tiny = {.function_name = "tinyFunction"};
+  VibeValue result = vibe_execute_template(&tiny, &template, args);
+  SAFE_ASSERT(result.type == VIBE_NULL);
+  SAFE_ASSERT(vibe_last_error() == VIBE_ERROR_CONTEXT_LENGTH);
+
+  VibePromptSite roomy = {.function_name = NULL};
+  result = vibe_execute_template(&roomy, &template, args);
+  SAFE_ASSERT(result.type == VIBE_STRING);
+  SAFE_ASSERT(vibe_last_error() == VIBE_SUCCESS);
+  free(result.data.string_val);
+
+  vibe_runtime_shutdown();
+  printf("vibe_last_error() test passed!\n");
+  return 1;
+}
+
 typedef int (*test_func)(void);
 
 int main() {
@@ -288,10 +676,20 @@ int main() {
   create_test_config();
 
   // Define tests to run
-  test_func tests[] = {test_format_prompt, test_llm_connection,
-                       test_send_prompt, test_vibe_values, test_execute_prompt};
-  const char *test_names[] = {"format_prompt", "llm_connection", "send_prompt",
-                              "vibe_values", "execute_prompt"};
+  test_func tests[] = {test_format_prompt,     test_render_prompt,
+                       test_llm_connection,    test_send_prompt,
+                       test_engine_concurrent, test_sse_parser,
+                       test_vibe_values,       test_execute_prompt,
+                       test_execute_prompt_stream, test_response_cache,
+                       test_execute_prompts_batch, test_retry_config,
+                       test_endpoint_config, test_last_error};
+  const char *test_names[] = {"format_prompt",     "render_prompt",
+                              "llm_connection",    "send_prompt",
+                              "engine_concurrent", "sse_parser",
+                              "vibe_values",       "execute_prompt",
+                              "execute_prompt_stream", "response_cache",
+                              "execute_prompts_batch", "retry_config",
+                              "endpoint_config", "last_error"};
 
   // Run each test separately to isolate failures
   int pass_count = 0;
@@ -0,0 +1,157 @@
+#include "../../src/runtime/llm_session.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Capacity a buffer starts at, and the largest one a session keeps
+#define MIN_CAPACITY 4096
+#define MAX_RETAINED (1024 * 1024)
+
+// Test that capacity doubles and the contents stay NUL terminated
+static void test_buffer_growth() {
+  LLMBuffer buffer = {0};
+
+  assert(llm_buffer_reserve(&buffer, 0));
+  assert(buffer.capacity == MIN_CAPACITY);
+  assert(buffer.length == 0 && buffer.data[0] == '\0');
+
+  // Reserving what already fits, terminator included, keeps the storage
+  char *data = buffer.data;
+  assert(llm_buffer_reserve(&buffer, MIN_CAPACITY - 1));
+  assert(buffer.data == data && buffer.capacity == MIN_CAPACITY);
+
+  // Appending byte by byte only ever doubles the capacity
+  size_t capacity = buffer.capacity;
+  int doublings = 0;
+  for (size_t i = 0; i < 5 * MIN_CAPACITY; i++) {
+    assert(llm_buffer_append(&buffer, "x", 1));
+    if (buffer.capacity != capacity) {
+      assert(buffer.capacity == capacity * 2);
+      capacity = buffer.capacity;
+      doublings++;
+    }
+    assert(buffer.capacity > buffer.length);
+    assert(buffer.data[buffer.length] == '\0');
+  }
+  assert(doublings == 3);
+  assert(buffer.length == 5 * MIN_CAPACITY);
+  assert(strlen(buffer.data) == buffer.length);
+
+  // Reserving far ahead keeps the contents and the terminator
+  assert(llm_buffer_reserve(&buffer, 20 * MIN_CAPACITY));
+  assert(buffer.capacity == 32 * MIN_CAPACITY);
+  assert(strlen(buffer.data) == 5 * MIN_CAPACITY);
+  assert(buffer.data[0] == 'x' && buffer.data[buffer.length - 1] == 'x');
+
+  llm_buffer_free(&buffer);
+  assert(buffer.data == NULL && buffer.length == 0 && buffer.capacity == 0);
+  printf("Buffer growth test passed\n");
+}
+
+// Test that reset empties a buffer without releasing its storage
+static void test_buffer_reset() {
+  LLMBuffer buffer = {0};
+  assert(llm_buffer_append(&buffer, "hello", 5));
+  char *data = buffer.data;
+  size_t capacity = buffer.capacity;
+
+  llm_buffer_reset(&buffer);
+  assert(buffer.data == data && buffer.capacity == capacity);
+  assert(buffer.length == 0 && buffer.data[0] == '\0');
+
+  assert(llm_buffer_append(&buffer, "hi", 2));
+  assert(buffer.data == data && strcmp(buffer.data, "hi") == 0);
+
+  // Resetting a buffer that never had storage is fine too
+  llm_buffer_free(&buffer);
+  llm_buffer_reset(&buffer);
+  assert(buffer.data == NULL && buffer.length == 0);
+  printf("Buffer reset test passed\n");
+}
+
+static void *acquire_elsewhere(void *arg) {
+  LLMHandle *handle = llm_session_acquire();
+  assert(handle != NULL && handle != arg);
+  assert(handle->request.data == NULL && handle->response.data == NULL);
+  llm_session_release(handle);
+  return NULL;
+}
+
+// Test that a released handle comes back with its buffers to the same
+// thread, except for buffers that grew past the retained limit
+static void test_handle_reuse() {
+  LLMHandle *handle = llm_session_acquire();
+  assert(handle != NULL && handle->easy != NULL);
+  assert(llm_buffer_append(&handle->request, "{\"model\":\"m\"}", 13));
+  assert(llm_buffer_append(&handle->response, "{\"choices\":[]}", 14));
+  char *request = handle->request.data;
+  char *response = handle->response.data;
+  llm_session_release(handle);
+
+  // Another thread has a session of its own
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, acquire_elsewhere, handle) == 0);
+  pthread_join(thread, NULL);
+
+  LLMHandle *again = llm_session_acquire();
+  assert(again == handle);
+  assert(again->request.data == request && again->response.data == response);
+  assert(again->request.length == 0 && again->request.data[0] == '\0');
+  assert(again->response.length == 0 && again->response.data[0] == '\0');
+  assert(again->error_buffer[0] == '\0');
+
+  // An outlier response is dropped on release; the request is kept
+  assert(llm_buffer_reserve(&again->response, MAX_RETAINED));
+  assert(again->response.capacity > MAX_RETAINED);
+  llm_session_release(again);
+  again = llm_session_acquire();
+  assert(again == handle);
+  assert(again->request.data == request);
+  assert(again->response.data == NULL && again->response.capacity == 0);
+  llm_session_release(again);
+
+  printf("Handle reuse test passed\n");
+}
+
+// Test that key buffers are lent out a couple at a time and come back
+// with their storage
+static void test_key_buffers() {
+  LLMBuffer *first = llm_session_key_acquire();
+  LLMBuffer *second = llm_session_key_acquire();
+  assert(first != NULL && second != NULL && first != second);
+  assert(llm_session_key_acquire() == NULL);
+
+  assert(llm_buffer_append(first, "key", 3));
+  char *data = first->data;
+  llm_session_key_release(first);
+  LLMBuffer *again = llm_session_key_acquire();
+  assert(again == first && again->data == data);
+  assert(again->length == 0 && again->data[0] == '\0');
+
+  // A buffer not lent by the session is ignored
+  LLMBuffer other = {0};
+  llm_session_key_release(&other);
+
+  llm_session_key_release(again);
+  llm_session_key_release(second);
+  printf("Key buffers test passed\n");
+}
+
+int main() {
+  printf("Running LLM session tests...\n");
+
+  test_buffer_growth();
+  test_buffer_reset();
+
+  assert(curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK);
+  assert(llm_sessions_init());
+  test_handle_reuse();
+  test_key_buffers();
+  llm_sessions_cleanup();
+  curl_global_cleanup();
+
+  printf("All LLM session tests passed!\n");
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "../../src/runtime/request_serializer.h"
+#include <assert.h>
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Escape a string literal, embedded NULs included
+#define CHECK_ESCAPED(text, expected)                                          \
+  check_escaped(text, sizeof(text) - 1, expected)
+
+// Escape a string and check the result against the expected JSON text
+static void check_escaped(const char *text, size_t length,
+                          const char *expected) {
+  LLMBuffer buffer = {0};
+  assert(json_append_string(&buffer, text, length));
+  assert(buffer.length == strlen(expected));
+  assert(strcmp(buffer.data, expected) == 0);
+  llm_buffer_free(&buffer);
+}
+
+// Test escaping of the characters JSON requires, on both sides of the
+// 16-byte blocks the vectorized scan works in
+static void test_escaping() {
+  CHECK_ESCAPED("", "\"\"");
+  CHECK_ESCAPED("plain", "\"plain\"");
+  CHECK_ESCAPED("say \"hi\"\n", "\"say \\\"hi\\\"\\n\"");
+  CHECK_ESCAPED("C:\\path\t\r\b\f", "\"C:\\\\path\\t\\r\\b\\f\"");
+  CHECK_ESCAPED("\x01\x1f", "\"\\u0001\\u001f\"");
+  CHECK_ESCAPED("nul\0byte", "\"nul\\u0000byte\"");
+  CHECK_ESCAPED("0123456789abcdef\"0123456789abcde\n",
+                "\"0123456789abcdef\\\"0123456789abcde\\n\"");
+
+  // Non-ASCII bytes and DEL pass through untouched
+  CHECK_ESCAPED("Z\xc3\xbcrich \xe2\x82\xac\x7f",
+                "\"Z\xc3\xbcrich \xe2\x82\xac\x7f\"");
+
+  printf("Escaping test passed\n");
+}
+
+// Test that a large prompt full of special characters survives a round trip
+// through a JSON parser
+static void test_round_trip() {
+  size_t length = 100000;
+  char *prompt = malloc(length + 1);
+  assert(prompt != NULL);
+  for (size_t i = 0; i < length; i++) {
+    const char pattern[] = "Document \"text\"\n\twith \\ and \x02 bytes. ";
+    prompt[i] = pattern[i % (sizeof(pattern) - 1)];
+  }
+  prompt[length] = '\0';
+
+  FunctionConfig function = {0};
+  function.model = "gpt-4o-mini";
+  function.temperature = 0.2;
+  function.max_tokens = 512;
+
+  LLMBuffer buffer = {0};
+  assert(chat_request_serialize(&buffer, &function, prompt, 1));
+  assert(strlen(buffer.data) == buffer.length);
+
+  cJSON *root = cJSON_ParseWithLength(buffer.data, buffer.length);
+  assert(root != NULL);
+  assert(strcmp(cJSON_GetObjectItem(root, "model")->valuestring,
+                "gpt-4o-mini") == 0);
+  assert(cJSON_GetObjectItem(root, "temperature")->valuedouble == 0.2);
+  assert(cJSON_GetObjectItem(root, "max_tokens")->valueint == 512);
+  assert(cJSON_IsTrue(cJSON_GetObjectItem(root, "stream")));
+
+  cJSON *message =
+      cJSON_GetArrayItem(cJSON_GetObjectItem(root, "messages"), 0);
+  assert(strcmp(cJSON_GetObjectItem(message, "role")->valuestring, "user") ==
+         0);
+  assert(strcmp(cJSON_GetObjectItem(message, "content")->valuestring,
+                prompt) == 0);
+  cJSON_Delete(root);
+
+  // The buffer is reused for the next request
+  size_t capacity = buffer.capacity;
+  assert(chat_request_serialize(&buffer, &function, "short", 0));
+  assert(buffer.capacity == capacity);
+  assert(strstr(buffer.data, "\"stream\"") == NULL);
+
+  llm_buffer_free(&buffer);
+  free(prompt);
+
+  printf("Round trip test passed\n");
+}
+
+// Test that an instruction leads the messages and stop sequences are listed
+static void test_output_limits() {
+  static const char *const stop[] = {"\n", "END", NULL};
+  FunctionConfig function = {0};
+  function.model = "gpt-4o-mini";
+  function.max_tokens = 16;
+  function.stop = stop;
+  function.instruction = "Reply with only an integer.";
+
+  LLMBuffer buffer = {0};
+  assert(chat_request_serialize(&buffer, &function, "How many?", 0));
+  cJSON *root = cJSON_ParseWithLength(buffer.data, buffer.length);
+  assert(root != NULL);
+
+  cJSON *messages = cJSON_GetObjectItem(root, "messages");
+  assert(cJSON_GetArraySize(messages) == 2);
+  cJSON *system = cJSON_GetArrayItem(messages, 0);
+  assert(strcmp(cJSON_GetObjectItem(system, "role")->valuestring, "system") ==
+         0);
+  assert(strcmp(cJSON_GetObjectItem(system, "content")->valuestring,
+                function.instruction) == 0);
+  cJSON *user = cJSON_GetArrayItem(messages, 1);
+  assert(strcmp(cJSON_GetObjectItem(user, "content")->valuestring,
+                "How many?") == 0);
+
+  cJSON *stops = cJSON_GetObjectItem(root, "stop");
+  assert(cJSON_GetArraySize(stops) == 2);
+  assert(strcmp(cJSON_GetArrayItem(stops, 0)->valuestring, "\n") == 0);
+  assert(strcmp(cJSON_GetArrayItem(stops, 1)->valuestring, "END") == 0);
+  assert(cJSON_GetObjectItem(root, "max_tokens")->valueint == 16);
+  cJSON_Delete(root);
+
+  llm_buffer_free(&buffer);
+  printf("Output limits test passed\n");
+}
+
+int main() {
+  printf("Running request serializer tests...\n");
+
+  test_escaping();
+  test_round_trip();
+  test_output_limits();
+
+  printf("All request serializer tests passed!\n");
+  return 0;
+}
@@ -0,0 +1,229 @@
+#include "../../src/runtime/object_decoder.h"
+#include "../../src/utils/response_decoder.h"
+#include <assert.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Structs as the compiler generates them for two classes
+typedef struct Place {
+  char *city;
+  char *vibe_response;
+} Place;
+
+typedef struct Report {
+  Place place;
+  int high;
+  double rain;
+  int windy;
+  char *summary;
+  char *vibe_response;
+} Report;
+
+static const VibeField place_fields[] = {
+    {"city", VIBE_FIELD_STRING, offsetof(Place, city), NULL},
+};
+static const VibeObjectShape place_shape = {place_fields, 1, sizeof(Place),
+                                            offsetof(Place, vibe_response)};
+static const VibeField report_fields[] = {
+    {"place", VIBE_FIELD_OBJECT, offsetof(Report, place), &place_shape},
+    {"high", VIBE_FIELD_INT, offsetof(Report, high), NULL},
+    {"rain", VIBE_FIELD_FLOAT, offsetof(Report, rain), NULL},
+    {"windy", VIBE_FIELD_BOOL, offsetof(Report, windy), NULL},
+    {"summary", VIBE_FIELD_STRING, offsetof(Report, summary), NULL},
+};
+static const VibeObjectShape report_shape = {report_fields, 5, sizeof(Report),
+                                             offsetof(Report, vibe_response)};
+
+static int decode_int(const char *text, long long *value) {
+  return response_decode_int(text, strlen(text), value);
+}
+
+static int decode_float(const char *text, double *value) {
+  return response_decode_float(text, strlen(text), value);
+}
+
+static int decode_bool(const char *text, int *value) {
+  return response_decode_bool(text, strlen(text), value);
+}
+
+// Test integers in free text
+static void test_int() {
+  long long value;
+  assert(decode_int("25", &value) && value == 25);
+  assert(decode_int("It is 25\xc2\xb0" "C in Paris", &value) && value == 25);
+  assert(decode_int("-7", &value) && value == -7);
+  assert(decode_int("about \xe2\x88\x92" "3 degrees", &value) && value == -3);
+  assert(decode_int("well-known 12", &value) && value == 12);
+  assert(decode_int("The Q3 total is 1,234,567.", &value) && value == 1234567);
+  assert(decode_int("1,2,3", &value) && value == 1);
+  assert(decode_int("25.9", &value) && value == 25);
+  assert(decode_int("99999999999999999999999", &value) && value == LLONG_MAX);
+
+  // Only the given length is read
+  assert(response_decode_int("12345", 2, &value) && value == 12);
+  assert(!decode_int("no digits here", &value));
+  assert(!decode_int("", &value));
+  printf("Integer test passed\n");
+}
+
+// Test decimal numbers, which must not depend on the locale
+static void test_float() {
+  double value;
+  assert(decode_float("The answer is 3.25.", &value) && value == 3.25);
+  assert(decode_float("-0.5", &value) && value == -0.5);
+  assert(decode_float("1.5e3 meters", &value) && value == 1500.0);
+  assert(decode_float("2E-2", &value) && value == 0.02);
+  assert(decode_float("0.1", &value) && value == 0.1);
+  assert(decode_float("12,500.75", &value) && value == 12500.75);
+  assert(decode_float("3 eggs", &value) && value == 3.0);
+  assert(decode_float("3.14159265358979323846264", &value) &&
+         fabs(value - 3.14159265358979323846) < 1e-15);
+  assert(decode_float("1e400", &value) && isinf(value));
+  assert(!decode_float("none", &value));
+
+  // A locale with a decimal comma changes nothing
+  if (setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+    assert(decode_float("2.5", &value) && value == 2.5);
+    setlocale(LC_NUMERIC, "C");
+  }
+  printf("Float test passed\n");
+}
+
+// Test yes/no answers
+static void test_bool() {
+  int value;
+  assert(decode_bool("true", &value) && value == 1);
+  assert(decode_bool("FALSE", &value) && value == 0);
+  assert(decode_bool("Yes, it is.", &value) && value == 1);
+  assert(decode_bool("**No**", &value) && value == 0);
+  assert(decode_bool("The answer is yes", &value) && value == 1);
+  assert(decode_bool("0", &value) && value == 0);
+  assert(!decode_bool("maybe", &value));
+  assert(!decode_bool("Notably unsure", &value));
+  printf("Boolean test passed\n");
+}
+
+// Test that objects decode in place into a struct
+static void test_object() {
+  char text[] = "```json\n{\"extra\": [1, {\"x\": \"}\"}], \"place\": "
+                "{\"city\": \"Caf\\u00e9 \\\"A\\\"\"}, \"high\": \"25\", "
+                "\"rain\": 0.5e1, \"windy\": true, "
+                "\"summary\": \"a\\nb \\ud83d\\ude00\"}\n```";
+  Report report;
+  assert(object_decode(text, strlen(text), &report_shape, &report));
+  assert(strcmp(report.place.city, "Caf\xc3\xa9 \"A\"") == 0);
+  assert(report.high == 25);
+  assert(report.rain == 5.0);
+  assert(report.windy == 1);
+  assert(strcmp(report.summary, "a\nb \xf0\x9f\x98\x80") == 0);
+  // Strings point into the text
+  assert(report.summary > text && report.summary < text + sizeof(text));
+  assert(report.vibe_response == NULL);
+
+  // Missing and null properties stay zero
+  char sparse[] = "{\"summary\": null, \"high\": -3}";
+  assert(object_decode(sparse, strlen(sparse), &report_shape, &report));
+  assert(report.high == -3 && report.summary == NULL);
+  assert(report.place.city == NULL && report.rain == 0);
+
+  // Malformed input leaves the struct zeroed
+  char truncated[] = "{\"high\": 4, \"summary\": \"cut";
+  assert(!object_decode(truncated, strlen(truncated), &report_shape, &report));
+  assert(report.high == 0 && report.summary == NULL);
+  char none[] = "no object here";
+  assert(!object_decode(none, strlen(none), &report_shape, &report));
+  printf("Object test passed\n");
+}
+
+static VibeValue string_value(const char *text) {
+  VibeValue value;
+  value.type = VIBE_STRING;
+  value.data.string_val = strdup(text);
+  return value;
+}
+
+// Test that JSON responses become tapes that accessors can walk
+static void test_tape() {
+  VibeValue value = string_value(
+      "Here you go:\n```json\n"
+      "{\"city\": \"S\\u00e3o Paulo\", \"days\": [{\"high\": 31.5, "
+      "\"dry\": true}, {\"high\": \"28\", \"dry\": \"no\"}, {}],"
+      " \"note\": null, \"tags\": [], \"count\": -2e1}\n```");
+  assert(vibe_value_to_object(&value));
+  assert(value.type == VIBE_OBJECT);
+
+  VibeNode root = vibe_value_root(&value);
+  assert(vibe_node_type(root) == VIBE_NODE_OBJECT);
+  assert(vibe_node_count(root) == 5);
+  size_t length;
+  const char *city = vibe_node_string(vibe_node_get(root, "city"), &length);
+  assert(city && strcmp(city, "S\xc3\xa3o Paulo") == 0 && length == 10);
+  assert(vibe_node_number(vibe_node_get(root, "count")) == -20);
+  assert(vibe_node_type(vibe_node_get(root, "note")) == VIBE_NODE_NULL);
+  assert(vibe_node_count(vibe_node_get(root, "tags")) == 0);
+  assert(vibe_node_type(vibe_node_first(vibe_node_get(root, "tags"))) ==
+         VIBE_NODE_MISSING);
+  assert(vibe_node_type(vibe_node_get(root, "missing")) == VIBE_NODE_MISSING);
+  assert(vibe_node_string(vibe_node_get(root, "count"), NULL) == NULL);
+
+  // Members iterate in order, skipping over nested containers
+  const char *names[] = {"city", "days", "note", "tags", "count"};
+  int i = 0;
+  for (VibeNode m = vibe_node_first(root); vibe_node_type(m);
+       m = vibe_node_next(m))
+    assert(strcmp(vibe_node_key(m), names[i++]) == 0);
+  assert(i == 5);
+
+  // Typed reads accept numbers and answers sent as strings
+  VibeNode day = vibe_node_first(vibe_node_get(root, "days"));
+  assert(vibe_node_key(day) == NULL);
+  assert(vibe_node_number(vibe_node_get(day, "high")) == 31.5);
+  assert(vibe_node_bool(vibe_node_get(day, "dry")) == 1);
+  day = vibe_node_next(day);
+  assert(vibe_node_number(vibe_node_get(day, "high")) == 28);
+  assert(vibe_node_bool(vibe_node_get(day, "dry")) == 0);
+  day = vibe_node_next(day);
+  assert(vibe_node_type(day) == VIBE_NODE_OBJECT && !vibe_node_count(day));
+  assert(vibe_node_type(vibe_node_next(day)) == VIBE_NODE_MISSING);
+  free(value.data.object_val);
+
+  // An array at the root, deeper than any stack would like
+  char deep[4096];
+  memset(deep, '[', 2000);
+  memset(deep + 2000, ']', 2000);
+  deep[4000] = '\0';
+  value = string_value(deep);
+  assert(vibe_value_to_object(&value));
+  root = vibe_value_root(&value);
+  assert(vibe_node_type(root) == VIBE_NODE_ARRAY && vibe_node_count(root) == 1);
+  free(value.data.object_val);
+
+  // Malformed input leaves a null value
+  const char *malformed[] = {"{\"a\": 1", "{\"a\" 1}", "[1, 2}", "{\"a\": tru}",
+                             "[1,]", "{,}", "no json", "{\"a\": \"\\x\"}"};
+  for (size_t k = 0; k < sizeof(malformed) / sizeof(*malformed); k++) {
+    value = string_value(malformed[k]);
+    assert(!vibe_value_to_object(&value));
+    assert(value.type == VIBE_NULL);
+    assert(vibe_node_type(vibe_value_root(&value)) == VIBE_NODE_MISSING);
+  }
+  printf("Tape test passed\n");
+}
+
+int main() {
+  printf("Running response decoder tests...\n");
+
+  test_int();
+  test_float();
+  test_bool();
+  test_object();
+  test_tape();
+
+  printf("All response decoder tests passed!\n");
+  return 0;
+}
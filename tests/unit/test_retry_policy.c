@@ -0,0 +1,78 @@
+#include "../../src/runtime/retry_policy.h"
+#include <assert.h>
+#include <stdio.h>
+
+static RetryConfig make_policy(void) {
+  RetryConfig policy = {4, 100, 1000, 0.5, 1, 0, {429, 503}, 2};
+  return policy;
+}
+
+// Test which failures are retried
+static void test_retryable() {
+  RetryConfig policy = make_policy();
+  assert(retry_status_is_retryable(&policy, 429));
+  assert(retry_status_is_retryable(&policy, 503));
+  assert(!retry_status_is_retryable(&policy, 500));
+  assert(!retry_status_is_retryable(&policy, 401));
+
+  assert(retry_transport_is_retryable(CURLE_COULDNT_CONNECT));
+  assert(retry_transport_is_retryable(CURLE_OPERATION_TIMEDOUT));
+  assert(!retry_transport_is_retryable(CURLE_WRITE_ERROR));
+  assert(!retry_transport_is_retryable(CURLE_URL_MALFORMAT));
+
+  printf("Retryable failure test passed\n");
+}
+
+// Test exponential growth, the cap and the jitter range
+static void test_backoff() {
+  RetryConfig policy = make_policy();
+
+  // Without randomness the full delay doubles per attempt up to the cap
+  assert(retry_backoff_ms(&policy, 1, 0.0) == 100);
+  assert(retry_backoff_ms(&policy, 2, 0.0) == 200);
+  assert(retry_backoff_ms(&policy, 4, 0.0) == 800);
+  assert(retry_backoff_ms(&policy, 5, 0.0) == 1000);
+  assert(retry_backoff_ms(&policy, 60, 0.0) == 1000);
+
+  // Half jitter keeps at least half of the delay
+  assert(retry_backoff_ms(&policy, 2, 0.999) >= 100);
+  assert(retry_backoff_ms(&policy, 2, 0.5) == 150);
+
+  policy.jitter = 0.0;
+  assert(retry_backoff_ms(&policy, 3, 0.9) == 400);
+
+  for (int i = 0; i < 1000; i++) {
+    double random = retry_random();
+    assert(random >= 0.0 && random < 1.0);
+  }
+
+  printf("Backoff test passed\n");
+}
+
+// Test both Retry-After formats
+static void test_retry_after() {
+  assert(retry_parse_after("3", 0) == 3000);
+  assert(retry_parse_after(" 0 ", 0) == 0);
+  assert(retry_parse_after("soon", 0) == -1);
+  assert(retry_parse_after("12abc", 0) == -1);
+  assert(retry_parse_after(NULL, 0) == -1);
+
+  // 1445412480 is Wed, 21 Oct 2015 07:28:00 GMT
+  time_t date = 1445412480;
+  assert(retry_parse_after("Wed, 21 Oct 2015 07:28:00 GMT", date - 5) ==
+         5000);
+  assert(retry_parse_after("Wed, 21 Oct 2015 07:28:00 GMT", date + 5) == 0);
+
+  printf("Retry-After test passed\n");
+}
+
+int main() {
+  printf("Running retry policy tests...\n");
+
+  test_retryable();
+  test_backoff();
+  test_retry_after();
+
+  printf("All retry policy tests passed!\n");
+  return 0;
+}
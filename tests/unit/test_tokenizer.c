@@ -0,0 +1,120 @@
+#include "../../src/runtime/tokenizer.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VOCAB_PATH "test_tokenizer.tiktoken"
+
+static void write_token(FILE *file, const char *token, int rank) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const unsigned char *p = (const unsigned char *)token;
+  size_t n = strlen(token);
+  if (n == 0) // Rank files hold the NUL byte too
+    n = 1;
+  for (size_t i = 0; i < n; i += 3) {
+    unsigned v = p[i] << 16;
+    if (i + 1 < n)
+      v |= p[i + 1] << 8;
+    if (i + 2 < n)
+      v |= p[i + 2];
+    fputc(alphabet[v >> 18 & 63], file);
+    fputc(alphabet[v >> 12 & 63], file);
+    fputc(i + 1 < n ? alphabet[v >> 6 & 63] : '=', file);
+    fputc(i + 2 < n ? alphabet[v & 63] : '=', file);
+  }
+  fprintf(file, " %d\n", rank);
+}
+
+// Every byte, then a few merges
+static void write_vocab() {
+  FILE *file = fopen(VOCAB_PATH, "w");
+  assert(file != NULL);
+  for (int byte = 0; byte < 256; byte++) {
+    char token[2] = {(char)byte, '\0'};
+    write_token(file, token, byte);
+  }
+  const char *merges[] = {"he", "ll", "th", "the", " t", " the",
+                          "a b", "123", "1234", "n'", "'t", "\n\n"};
+  for (int i = 0; i < (int)(sizeof(merges) / sizeof(merges[0])); i++)
+    write_token(file, merges[i], 256 + i);
+  fclose(file);
+}
+
+static size_t count(const char *text) {
+  return tokenizer_count(text, strlen(text));
+}
+
+// Test the estimate used without a vocabulary
+static void test_estimate() {
+  assert(!tokenizer_loaded());
+  assert(count("") == 0);
+  assert(count("abcdefgh") == 2);
+  assert(count("abcdefghi") == 3);
+  assert(tokenizer_prefix("abcdefghijkl", 12, 2) == 8);
+  assert(!tokenizer_load("does_not_exist.tiktoken"));
+  printf("Estimate test passed\n");
+}
+
+// Test that pairs merge lowest rank first
+static void test_merges() {
+  assert(tokenizer_loaded());
+  assert(count("the") == 1);
+  assert(count(" the") == 1);
+  assert(count("the the the") == 3);
+  assert(count("hello") == 3); // he ll o
+  assert(count("xyz") == 3);
+  printf("Merge test passed\n");
+}
+
+// Test that merges never cross pre-tokenizer pieces
+static void test_pieces() {
+  assert(count("a b") == 3);    // a, " b"
+  assert(count("1234") == 2);   // 123, 4
+  assert(count("don't") == 4);  // d o n, 't
+  assert(count("a\n\nb") == 3); // a, \n\n, b
+  printf("Piece test passed\n");
+}
+
+// Test prefixes by token count
+static void test_prefix() {
+  const char *text = "the the the";
+  assert(tokenizer_prefix(text, strlen(text), 2) == 7);
+  assert(tokenizer_prefix(text, strlen(text), 0) == 0);
+  assert(tokenizer_prefix(text, strlen(text), 10) == strlen(text));
+  assert(tokenizer_prefix("hello", 5, 2) == 4);
+
+  // A cut inside a UTF-8 sequence backs off to its start
+  const char *accent = "x\xc3\xa9y";
+  assert(tokenizer_prefix(accent, strlen(accent), 2) == 1);
+  printf("Prefix test passed\n");
+}
+
+// Test that the longest arguments are cut first
+static void test_fit() {
+  VibePromptArg args[] = {{"the the the the", 15}, {"hello", 5}, {"the", 3}};
+  assert(tokenizer_fit(args, 3, 100) == 0);
+  assert(tokenizer_fit(args, 3, 6) == 2);
+  assert(args[0].length == 7); // "the the"
+  assert(args[1].length == 4); // "hell"
+  assert(args[2].length == 3);
+  printf("Fit test passed\n");
+}
+
+int main() {
+  printf("Running tokenizer tests...\n");
+
+  test_estimate();
+  write_vocab();
+  assert(tokenizer_load(VOCAB_PATH));
+  test_merges();
+  test_pieces();
+  test_prefix();
+  test_fit();
+  tokenizer_free();
+  assert(!tokenizer_loaded());
+  remove(VOCAB_PATH);
+
+  printf("All tokenizer tests passed!\n");
+  return 0;
+}